@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for the JIT loop optimizations: hoisted null and range checks, loop
+ * invariant code motion and vectorization.  Each loop is run often enough to be compiled,
+ * then fed the inputs that make the hoisted checks fail.
+ */
+public class Main {
+    /* Enough calls for the loops below to get hot */
+    static final int WARMUP = 1000;
+
+    static class Counter {
+        int step;
+    }
+
+    public static void main(String args[]) throws Exception {
+        twoCountersTest();
+        countDownTest();
+        derivedIndexTest();
+        nullArrayTest();
+        nullObjectTest();
+        invariantFieldTest();
+        invariantExitTest();
+        vectorTest();
+    }
+
+    static int[] iota(int n) {
+        int[] a = new int[n];
+        for (int i = 0; i < n; i++) {
+            a[i] = i;
+        }
+        return a;
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    /* Only the counter tested by the loop branch bounds the checks */
+    static void reverse(int[] src, int[] dst, int n) {
+        int j = src.length - 1;
+        for (int i = 0; i < n; i++) {
+            dst[i] = src[j];
+            j--;
+        }
+    }
+
+    static void twoCountersTest() {
+        int[] src = iota(100);
+        int[] dst = new int[100];
+        for (int i = 0; i < WARMUP; i++) {
+            reverse(src, dst, 100);
+        }
+        for (int i = 0; i < 100; i++) {
+            check(dst[i] == 99 - i, "reverse: dst[" + i + "] = " + dst[i]);
+        }
+
+        /* j runs off the start of src after 100 iterations */
+        int[] longDst = new int[101];
+        try {
+            reverse(src, longDst, 101);
+            check(false, "reverse: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+            check(longDst[99] == 0 && longDst[100] == 0,
+                  "reverse: stored past the exception");
+        }
+
+        /* i runs off the end of dst */
+        int[] shortDst = new int[50];
+        try {
+            reverse(src, shortDst, 100);
+            check(false, "reverse: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+            check(shortDst[49] == 50, "reverse: shortDst[49] = " + shortDst[49]);
+        }
+        System.out.println("twoCounters passes");
+    }
+
+    static int sumDown(int[] a, int n) {
+        int sum = 0;
+        for (int i = n - 1; i >= 0; i--) {
+            sum += a[i];
+        }
+        return sum;
+    }
+
+    static void countDownTest() {
+        int[] a = iota(101);
+        for (int i = 0; i < WARMUP; i++) {
+            check(sumDown(a, 101) == 5050, "sumDown");
+        }
+        try {
+            sumDown(a, 102);
+            check(false, "sumDown: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+        }
+        check(sumDown(a, 0) == 0, "sumDown: empty");
+        System.out.println("countDown passes");
+    }
+
+    static void smooth(int[] a, int[] b) {
+        int end = a.length - 1;
+        for (int i = 1; i < end; i++) {
+            b[i] = a[i - 1] + a[i] + a[i + 1];
+        }
+    }
+
+    static void derivedIndexTest() {
+        int[] a = iota(64);
+        int[] b = new int[64];
+        for (int i = 0; i < WARMUP; i++) {
+            smooth(a, b);
+        }
+        for (int i = 1; i < 63; i++) {
+            check(b[i] == 3 * i, "smooth: b[" + i + "] = " + b[i]);
+        }
+
+        int[] shortB = new int[32];
+        try {
+            smooth(a, shortB);
+            check(false, "smooth: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+            check(shortB[31] == 93, "smooth: shortB[31] = " + shortB[31]);
+        }
+        System.out.println("derivedIndex passes");
+    }
+
+    /* a[] is invariant but its index is not an induction variable */
+    static int gather(int[] a, int[] idx) {
+        int sum = 0;
+        for (int i = 0; i < idx.length; i++) {
+            sum += a[idx[i]];
+        }
+        return sum;
+    }
+
+    static void nullArrayTest() {
+        int[] a = iota(16);
+        int[] idx = new int[] { 3, 1, 4, 1, 5, 9, 2, 6 };
+        for (int i = 0; i < WARMUP; i++) {
+            check(gather(a, idx) == 31, "gather");
+        }
+        check(gather(null, new int[0]) == 0, "gather: empty");
+        try {
+            gather(null, idx);
+            check(false, "gather: no exception");
+        } catch (NullPointerException expected) {
+        }
+        try {
+            gather(a, new int[] { 0, 16 });
+            check(false, "gather: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+        }
+        System.out.println("nullArray passes");
+    }
+
+    /* c.step can be loaded once before the loop */
+    static int accumulate(Counter c, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += c.step;
+        }
+        return sum;
+    }
+
+    static void nullObjectTest() {
+        Counter c = new Counter();
+        c.step = 3;
+        for (int i = 0; i < WARMUP; i++) {
+            check(accumulate(c, 100) == 300, "accumulate");
+        }
+        check(accumulate(null, 0) == 0, "accumulate: empty");
+        try {
+            accumulate(null, 100);
+            check(false, "accumulate: no exception");
+        } catch (NullPointerException expected) {
+        }
+        System.out.println("nullObject passes");
+    }
+
+    /* c.step is stored in the loop and has to be reloaded */
+    static int bump(Counter c, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += c.step;
+            c.step = c.step + 1;
+        }
+        return sum;
+    }
+
+    static void invariantFieldTest() {
+        Counter c = new Counter();
+        for (int i = 0; i < WARMUP; i++) {
+            c.step = 1;
+            check(bump(c, 10) == 55, "bump");
+            check(c.step == 11, "bump: step = " + c.step);
+        }
+        System.out.println("invariantField passes");
+    }
+
+    /* "scaled" is invariant, but an exit before its def must not see it */
+    static int scaledAfterExit(int[] a, int k, int limit) {
+        int scaled = -1;
+        for (int i = 0; i < a.length; i++) {
+            if (a[i] > limit) {
+                break;
+            }
+            scaled = k * 3;
+        }
+        return scaled;
+    }
+
+    static int scaledBeforeExit(int[] a, int k, int limit) {
+        int scaled = -1;
+        for (int i = 0; i < a.length; i++) {
+            scaled = k * 3;
+            if (a[i] > limit) {
+                break;
+            }
+        }
+        return scaled;
+    }
+
+    /* "cur" is invariant, but read before it is written */
+    static int previous(int k, int n) {
+        int prev = -1;
+        int cur = -2;
+        for (int i = 0; i < n; i++) {
+            prev = cur;
+            cur = k + 1;
+        }
+        return prev;
+    }
+
+    static void invariantExitTest() {
+        int[] a = iota(10);
+        for (int i = 0; i < WARMUP; i++) {
+            check(scaledAfterExit(a, 5, 100) == 15, "scaledAfterExit");
+            check(scaledBeforeExit(a, 5, 100) == 15, "scaledBeforeExit");
+            check(previous(5, 10) == 6, "previous");
+        }
+        check(scaledAfterExit(a, 5, -1) == -1, "scaledAfterExit: early exit");
+        check(scaledBeforeExit(a, 5, -1) == 15,
+              "scaledBeforeExit: early exit");
+        check(previous(5, 1) == -2, "previous: one trip");
+        System.out.println("invariantExit passes");
+    }
+
+    static void addInts(int[] a, int[] b, int[] c, int n) {
+        for (int i = 0; i < n; i++) {
+            c[i] = a[i] + b[i];
+        }
+    }
+
+    /* Lanes can't run ahead of the scalar order when a and b are the same */
+    static void shiftUp(int[] a, int[] b, int n) {
+        for (int i = 0; i < n; i++) {
+            b[i + 1] = a[i];
+        }
+    }
+
+    static void xorBytes(byte[] a, byte[] b, int key, int n) {
+        for (int i = 0; i < n; i++) {
+            b[i] = (byte) (a[i] ^ key);
+        }
+    }
+
+    static void scaleFloats(float[] a, float k, int n) {
+        for (int i = 0; i < n; i++) {
+            a[i] = a[i] * k;
+        }
+    }
+
+    static int sumHalves(int[] a, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += a[i] >> 1;
+        }
+        return sum;
+    }
+
+    static void vectorTest() {
+        int[] a = iota(67);
+        int[] b = new int[67];
+        int[] c = new int[67];
+        byte[] bytes = new byte[67];
+        byte[] xored = new byte[67];
+        float[] floats = new float[67];
+        for (int i = 0; i < 67; i++) {
+            b[i] = -2 * i;
+            bytes[i] = (byte) (i * 5);
+        }
+        for (int i = 0; i < WARMUP; i++) {
+            addInts(a, b, c, 67);
+            shiftUp(a, c, 66);
+            xorBytes(bytes, xored, 0x5a, 67);
+            scaleFloats(floats, 0.5f, 67);
+            sumHalves(a, 67);
+        }
+
+        /* Every trip count, so each remainder is left to the scalar loop */
+        for (int n = 0; n <= 66; n++) {
+            int[] sum = new int[67];
+            addInts(a, b, sum, n);
+            for (int i = 0; i < 67; i++) {
+                check(sum[i] == (i < n ? -i : 0),
+                      "addInts(" + n + "): sum[" + i + "] = " + sum[i]);
+            }
+
+            int[] shifted = iota(67);
+            shiftUp(shifted, shifted, n);
+            for (int i = 0; i <= n; i++) {
+                check(shifted[i] == 0,
+                      "shiftUp(" + n + "): shifted[" + i + "] = " + shifted[i]);
+            }
+            check(n == 66 || shifted[n + 1] == n + 1, "shiftUp: stored past n");
+
+            xorBytes(bytes, xored, 0x5a, n);
+            for (int i = 0; i < n; i++) {
+                check(xored[i] == (byte) ((byte) (i * 5) ^ 0x5a),
+                      "xorBytes(" + n + "): xored[" + i + "] = " + xored[i]);
+            }
+
+            for (int i = 0; i < 67; i++) {
+                floats[i] = i;
+            }
+            scaleFloats(floats, 0.5f, n);
+            for (int i = 0; i < 67; i++) {
+                check(floats[i] == (i < n ? i * 0.5f : i),
+                      "scaleFloats(" + n + "): floats[" + i + "] = " + floats[i]);
+            }
+
+            int expected = 0;
+            for (int i = 0; i < n; i++) {
+                expected += i / 2;
+            }
+            check(sumHalves(a, n) == expected, "sumHalves(" + n + ")");
+        }
+        System.out.println("vector passes");
+    }
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for whole-method compilation.  Each method is called often enough
+ * to be compiled, then checked against inputs that take the paths the
+ * warm-up calls didn't.
+ */
+public class Main {
+    /* Enough calls for the methods below to get hot */
+    static final int WARMUP = 1000;
+
+    interface Shape {
+        int area();
+    }
+
+    static class Square implements Shape {
+        int side;
+        Square(int side) { this.side = side; }
+        public int area() { return side * side; }
+    }
+
+    static class Rect implements Shape {
+        int w, h;
+        Rect(int w, int h) { this.w = w; this.h = h; }
+        public int area() { return w * h; }
+    }
+
+    /* Only touched after lateResolve's method is compiled */
+    static class Late {
+        static int created;
+        int value;
+        Late(int value) { this.value = value; created++; }
+    }
+
+    public static void main(String args[]) {
+        loopsTest();
+        callsTest();
+        recursionTest();
+        exceptionsTest();
+        switchTest();
+        lateResolveTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    /* Nested loops, a loop exit and a long accumulator */
+    static long triangle(int n, int stop) {
+        long sum = 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j <= i; j++) {
+                if (i * j == stop) {
+                    return -sum;
+                }
+                sum += j;
+            }
+        }
+        return sum;
+    }
+
+    static void loopsTest() {
+        for (int i = 0; i < WARMUP; i++) {
+            check(triangle(10, -1) == 165, "triangle");
+        }
+        check(triangle(0, -1) == 0, "triangle: empty");
+        check(triangle(100, -1) == 166650, "triangle: 100");
+        check(triangle(10, 12) == -13, "triangle: early exit");
+        System.out.println("loops passes");
+    }
+
+    static int twice(int x) {
+        return x * 2;
+    }
+
+    /* Static and interface calls, with the result used after the return */
+    static int sumAreas(Shape[] shapes) {
+        int sum = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            sum += shapes[i].area();
+            sum = twice(sum) - sum;
+        }
+        return sum;
+    }
+
+    static void callsTest() {
+        Shape[] squares = new Shape[] { new Square(2), new Square(3) };
+        for (int i = 0; i < WARMUP; i++) {
+            check(sumAreas(squares) == 13, "sumAreas");
+        }
+        /* A receiver class the call site hasn't seen */
+        Shape[] mixed = new Shape[] { new Square(2), new Rect(2, 5) };
+        check(sumAreas(mixed) == 14, "sumAreas: mixed");
+        System.out.println("calls passes");
+    }
+
+    static int fib(int n) {
+        if (n < 2) {
+            return n;
+        }
+        return fib(n - 1) + fib(n - 2);
+    }
+
+    static void recursionTest() {
+        for (int i = 0; i < WARMUP; i++) {
+            check(fib(5) == 5, "fib");
+        }
+        check(fib(20) == 6765, "fib(20)");
+        System.out.println("recursion passes");
+    }
+
+    /* The handler isn't compiled - the interpreter has to find it */
+    static int safeDivide(int[] a, int d) {
+        int caught = 0;
+        for (int i = 0; i < a.length; i++) {
+            try {
+                a[i] = a[i] / d;
+            } catch (ArithmeticException expected) {
+                caught++;
+            }
+        }
+        return caught;
+    }
+
+    static int sumTo(int[] a, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += a[i];
+        }
+        return sum;
+    }
+
+    static void exceptionsTest() {
+        int[] a = new int[] { 8, 16 };
+        for (int i = 0; i < WARMUP; i++) {
+            a[0] = 8;
+            a[1] = 16;
+            check(safeDivide(a, 2) == 0, "safeDivide");
+            check(sumTo(a, 2) == 12, "sumTo");
+        }
+        check(safeDivide(a, 0) == 2, "safeDivide: by zero");
+        check(a[0] == 4 && a[1] == 8, "safeDivide: stored");
+        try {
+            sumTo(a, 3);
+            check(false, "sumTo: no exception");
+        } catch (ArrayIndexOutOfBoundsException expected) {
+        }
+        try {
+            sumTo(null, 1);
+            check(false, "sumTo: no exception");
+        } catch (NullPointerException expected) {
+        }
+        System.out.println("exceptions passes");
+    }
+
+    /* The switch leaves the method code through the interpreter */
+    static int classify(int[] a) {
+        int score = 0;
+        for (int i = 0; i < a.length; i++) {
+            switch (a[i]) {
+                case 0:  score += 1; break;
+                case 1:  score += 10; break;
+                case 7:  score += 100; break;
+                case 1000: score += 1000; break;
+                default: score -= 1; break;
+            }
+        }
+        return score;
+    }
+
+    static void switchTest() {
+        int[] a = new int[] { 0, 1, 7 };
+        for (int i = 0; i < WARMUP; i++) {
+            check(classify(a) == 111, "classify");
+        }
+        check(classify(new int[] { 1000, 5, 0 }) == 1000, "classify: more");
+        System.out.println("switch passes");
+    }
+
+    /* Late is neither loaded nor initialized until flag is set */
+    static int lateResolve(boolean flag, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += i;
+        }
+        if (flag) {
+            Late late = new Late(sum);
+            sum = late.value + Late.created;
+        }
+        return sum;
+    }
+
+    static void lateResolveTest() {
+        for (int i = 0; i < WARMUP; i++) {
+            check(lateResolve(false, 10) == 45, "lateResolve");
+        }
+        check(lateResolve(true, 10) == 46, "lateResolve: first");
+        check(lateResolve(true, 10) == 47, "lateResolve: second");
+        System.out.println("lateResolve passes");
+    }
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for the thin-lock fast paths in compiled code.  Each loop runs long
+ * enough to be compiled, and the lock is checked afterwards to be released
+ * exactly as many times as it was taken.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static int counter;
+
+    public static void main(String args[]) throws Exception {
+        simpleTest();
+        recursiveTest();
+        hashedTest();
+        inflatedTest();
+        contendedTest();
+        exceptionTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static int lockLoop(Object lock, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            synchronized (lock) {
+                sum += i;
+            }
+        }
+        return sum;
+    }
+
+    static int nestedLoop(Object lock, int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            synchronized (lock) {
+                synchronized (lock) {
+                    synchronized (lock) {
+                        sum += i;
+                    }
+                }
+            }
+        }
+        return sum;
+    }
+
+    static void simpleTest() {
+        Object lock = new Object();
+        check(lockLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "simple: sum");
+        check(!Thread.holdsLock(lock), "simple: still held");
+        System.out.println("simple passes");
+    }
+
+    static void recursiveTest() {
+        Object lock = new Object();
+        check(nestedLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "recursive: sum");
+        check(!Thread.holdsLock(lock), "recursive: still held");
+        /* Taken from compiled code while already held by the caller */
+        synchronized (lock) {
+            nestedLoop(lock, LOOPS);
+            check(Thread.holdsLock(lock), "recursive: released outer lock");
+        }
+        check(!Thread.holdsLock(lock), "recursive: outer still held");
+        System.out.println("recursive passes");
+    }
+
+    static void hashedTest() {
+        Object lock = new Object();
+        int hash = System.identityHashCode(lock);
+        check(lockLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "hashed: sum");
+        check(nestedLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "hashed: nested sum");
+        check(System.identityHashCode(lock) == hash, "hashed: hash changed");
+        check(!Thread.holdsLock(lock), "hashed: still held");
+        System.out.println("hashed passes");
+    }
+
+    static void inflatedTest() throws Exception {
+        Object lock = new Object();
+        /* wait() inflates the lock, so the compiled code must call out */
+        synchronized (lock) {
+            lock.wait(1);
+        }
+        check(lockLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "inflated: sum");
+        check(nestedLoop(lock, LOOPS) == LOOPS * (LOOPS - 1) / 2, "inflated: nested sum");
+        check(!Thread.holdsLock(lock), "inflated: still held");
+        System.out.println("inflated passes");
+    }
+
+    static void increment(Object lock, int n) {
+        for (int i = 0; i < n; i++) {
+            synchronized (lock) {
+                counter++;
+            }
+        }
+    }
+
+    static void contendedTest() throws Exception {
+        final Object lock = new Object();
+        counter = 0;
+        Thread[] threads = new Thread[4];
+        for (int t = 0; t < threads.length; t++) {
+            threads[t] = new Thread() {
+                public void run() {
+                    increment(lock, LOOPS);
+                }
+            };
+            threads[t].start();
+        }
+        increment(lock, LOOPS);
+        for (int t = 0; t < threads.length; t++) {
+            threads[t].join();
+        }
+        check(counter == (threads.length + 1) * LOOPS, "contended: lost updates");
+        System.out.println("contended passes");
+    }
+
+    static int divideLocked(Object lock, int[] a, int d) {
+        int caught = 0;
+        for (int i = 0; i < a.length; i++) {
+            try {
+                synchronized (lock) {
+                    a[i] /= d;
+                }
+            } catch (ArithmeticException expected) {
+                caught++;
+            }
+        }
+        return caught;
+    }
+
+    static void exceptionTest() {
+        Object lock = new Object();
+        int[] a = new int[LOOPS];
+        check(divideLocked(lock, a, 1) == 0, "exception: caught");
+        check(divideLocked(lock, a, 0) == LOOPS, "exception: not caught");
+        check(!Thread.holdsLock(lock), "exception: still held");
+        try {
+            lockLoop(null, 1);
+            check(false, "exception: no NullPointerException");
+        } catch (NullPointerException expected) {
+        }
+        System.out.println("exception passes");
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for new-instance and new-array allocated inline in compiled code.
+ * Each loop runs long enough to be compiled, and every object it makes is
+ * checked to be zeroed, of the right class and distinct from the others.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static class Small {
+        int a;
+        Object b;
+    }
+
+    static class Medium {
+        long a, b, c, d;
+        Object e, f;
+    }
+
+    /* Too big for the cache */
+    static class Large {
+        long f0, f1, f2, f3, f4, f5, f6, f7, f8, f9;
+        long g0, g1, g2, g3, g4, g5, g6, g7, g8, g9;
+        long h0, h1, h2, h3, h4, h5, h6, h7, h8, h9;
+        long i0, i1, i2, i3, i4, i5, i6, i7, i8, i9;
+    }
+
+    static class Finalizable {
+        static int finalized;
+        int value;
+        protected void finalize() {
+            finalized++;
+        }
+    }
+
+    public static void main(String args[]) {
+        objectsTest();
+        arraysTest();
+        mixedTest();
+        finalizableTest();
+        largeTest();
+        negativeTest();
+        gcTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static void objectsTest() {
+        Small last = null;
+        for (int i = 0; i < LOOPS; i++) {
+            Small s = new Small();
+            check(s.a == 0 && s.b == null, "objects: not zeroed");
+            check(s != last, "objects: handed out twice");
+            check(s.getClass() == Small.class, "objects: wrong class");
+            s.a = i;
+            s.b = last;
+            last = s;
+        }
+        check(last.a == LOOPS - 1 && ((Small) last.b).a == LOOPS - 2,
+              "objects: chain");
+        System.out.println("objects passes");
+    }
+
+    static void arraysTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            int n = i % 70;
+            byte[] b = new byte[n];
+            int[] a = new int[n];
+            long[] l = new long[n];
+            Object[] o = new Object[n];
+            check(b.length == n && a.length == n && l.length == n &&
+                  o.length == n, "arrays: length");
+            for (int j = 0; j < n; j++) {
+                check(b[j] == 0 && a[j] == 0 && l[j] == 0 && o[j] == null,
+                      "arrays: not zeroed");
+                b[j] = (byte) j;
+                a[j] = j;
+                l[j] = j;
+                o[j] = b;
+            }
+        }
+        System.out.println("arrays passes");
+    }
+
+    /* Two sizes taking turns, so the cache keeps missing for one of them */
+    static void mixedTest() {
+        Object[] keep = new Object[LOOPS];
+        for (int i = 0; i < LOOPS; i++) {
+            if ((i & 1) == 0) {
+                Small s = new Small();
+                s.a = i;
+                keep[i] = s;
+            } else {
+                Medium m = new Medium();
+                m.a = i;
+                keep[i] = m;
+            }
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            if ((i & 1) == 0) {
+                check(((Small) keep[i]).a == i, "mixed: small");
+            } else {
+                check(((Medium) keep[i]).a == i, "mixed: medium");
+            }
+        }
+        System.out.println("mixed passes");
+    }
+
+    static void finalizableTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            Finalizable f = new Finalizable();
+            check(f.value == 0, "finalizable: not zeroed");
+            f.value = i;
+        }
+        Runtime.getRuntime().gc();
+        System.runFinalization();
+        check(Finalizable.finalized > 0, "finalizable: never finalized");
+        System.out.println("finalizable passes");
+    }
+
+    static void largeTest() {
+        long sum = 0;
+        for (int i = 0; i < LOOPS; i++) {
+            Large l = new Large();
+            check(l.f0 == 0 && l.i9 == 0, "large: not zeroed");
+            l.i9 = i;
+            sum += l.i9;
+            char[] c = new char[200];
+            check(c.length == 200 && c[199] == 0, "large: array");
+        }
+        check(sum == (long) LOOPS * (LOOPS - 1) / 2, "large: sum");
+        System.out.println("large passes");
+    }
+
+    static int tryNegative(int n) {
+        int[] a = new int[n];
+        return a.length;
+    }
+
+    static void negativeTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(tryNegative(i & 15) == (i & 15), "negative: length");
+        }
+        try {
+            tryNegative(-1);
+            check(false, "negative: no exception");
+        } catch (NegativeArraySizeException expected) {
+        }
+        System.out.println("negative passes");
+    }
+
+    /* Objects from the cache have to survive GCs that happen while they're in use */
+    static void gcTest() {
+        Small[] keep = new Small[64];
+        for (int i = 0; i < LOOPS; i++) {
+            Small s = new Small();
+            s.a = i;
+            s.b = new int[] { i };
+            keep[i & 63] = s;
+            if ((i & 1023) == 0) {
+                Runtime.getRuntime().gc();
+            }
+        }
+        Runtime.getRuntime().gc();
+        for (int i = LOOPS - 64; i < LOOPS; i++) {
+            Small s = keep[i & 63];
+            check(s.a == i && ((int[]) s.b)[0] == i, "gc: lost an object");
+        }
+        System.out.println("gc passes");
+    }
+}
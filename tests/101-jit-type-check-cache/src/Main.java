@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for type check inline caches.  Each loop runs long enough to be
+ * compiled with the cache warmed by the classes it has seen, then gets
+ * classes that should miss or fail.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    interface Shape {
+        int sides();
+    }
+
+    interface Named {
+    }
+
+    static class Base {
+    }
+
+    static class A extends Base implements Shape {
+        public int sides() { return 3; }
+    }
+
+    static class B extends Base implements Shape, Named {
+        public int sides() { return 4; }
+    }
+
+    static class C extends Base implements Named {
+    }
+
+    static class D extends A {
+    }
+
+    public static void main(String args[]) {
+        monomorphicTest();
+        polymorphicTest();
+        megamorphicTest();
+        failingTest();
+        interfacesTest();
+        arraysTest();
+        nullsTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static int castToBase(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            Base b = (Base) objs[i];
+            if (b != null) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    static int countShapes(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            if (objs[i] instanceof Shape) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    static void monomorphicTest() {
+        Object[] objs = new Object[] { new A(), new A(), new A() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToBase(objs) == 3, "monomorphic: cast");
+            check(countShapes(objs) == 3, "monomorphic: instanceof");
+        }
+        System.out.println("monomorphic passes");
+    }
+
+    static void polymorphicTest() {
+        Object[] objs = new Object[] { new A(), new B(), new A(), new B() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToBase(objs) == 4, "polymorphic: cast");
+            check(countShapes(objs) == 4, "polymorphic: instanceof");
+        }
+        System.out.println("polymorphic passes");
+    }
+
+    /* More classes than the cache holds, so it keeps being replaced */
+    static void megamorphicTest() {
+        Object[] objs = new Object[] { new A(), new B(), new C(), new D() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToBase(objs) == 4, "megamorphic: cast");
+            check(countShapes(objs) == 3, "megamorphic: instanceof");
+        }
+        System.out.println("megamorphic passes");
+    }
+
+    /* A class that doesn't pass must not be let through by a warm cache */
+    static void failingTest() {
+        Object[] good = new Object[] { new A(), new B() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToBase(good) == 2, "failing: warm up");
+        }
+        try {
+            castToBase(new Object[] { new A(), "not a Base" });
+            check(false, "failing: no exception");
+        } catch (ClassCastException expected) {
+        }
+        check(countShapes(new Object[] { new C(), "x", new Object() }) == 0,
+              "failing: instanceof");
+        System.out.println("failing passes");
+    }
+
+    static int castToNamed(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            Named named = (Named) objs[i];
+            if (named != null) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    static void interfacesTest() {
+        Object[] objs = new Object[] { new B(), new C() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToNamed(objs) == 2, "interfaces: cast");
+        }
+        try {
+            castToNamed(new Object[] { new A() });
+            check(false, "interfaces: no exception");
+        } catch (ClassCastException expected) {
+        }
+        System.out.println("interfaces passes");
+    }
+
+    static int countBaseArrays(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            if (objs[i] instanceof Base[]) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    static void arraysTest() {
+        Object[] objs = new Object[] { new A[1], new B[2], new Base[3] };
+        for (int i = 0; i < LOOPS; i++) {
+            check(countBaseArrays(objs) == 3, "arrays: instanceof");
+        }
+        check(countBaseArrays(new Object[] { new int[1], new Object[1],
+                                             new Shape[1] }) == 0,
+              "arrays: non-matching");
+        System.out.println("arrays passes");
+    }
+
+    static void nullsTest() {
+        Object[] objs = new Object[] { new A(), null, new B() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(castToBase(objs) == 2, "nulls: cast");
+            check(countShapes(objs) == 2, "nulls: instanceof");
+        }
+        System.out.println("nulls passes");
+    }
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import java.io.Serializable;
+
+/**
+ * Tests for subtype checks through the superclass display.  The display
+ * holds eight levels, so L8 and below take the slow path.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static class L1 { int level() { return 1; } }
+    static class L2 extends L1 { int level() { return 2; } }
+    static class L3 extends L2 { int level() { return 3; } }
+    static class L4 extends L3 { int level() { return 4; } }
+    static class L5 extends L4 { int level() { return 5; } }
+    static class L6 extends L5 { int level() { return 6; } }
+    static class L7 extends L6 { int level() { return 7; } }
+    static class L8 extends L7 { int level() { return 8; } }
+    static class L9 extends L8 { int level() { return 9; } }
+    static class L10 extends L9 { int level() { return 10; } }
+
+    /* A branch off the chain, at the same depth as L4 */
+    static class M4 extends L3 { int level() { return -4; } }
+    /* And one below the display */
+    static class M10 extends L9 { int level() { return -10; } }
+
+    interface I0 {}
+    interface I1 {}
+    interface I2 {}
+    interface I3 {}
+    interface I4 {}
+    interface I5 {}
+    interface I6 {}
+    interface I7 {}
+    interface I8 extends I0, I1 {}
+    interface I9 {}
+
+    static class Wide implements I2, I3, I4, I5, I6, I7, I8 {}
+    static class Wider extends Wide implements I9 {}
+
+    public static void main(String args[]) {
+        shallowTest();
+        deepTest();
+        interfacesTest();
+        arraysTest();
+        mergeTest();
+        compiledTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static void shallowTest() {
+        Object o = new L4();
+        check(o instanceof L1, "L4 instanceof L1");
+        check(o instanceof L3, "L4 instanceof L3");
+        check(o instanceof L4, "L4 instanceof L4");
+        check(!(o instanceof L5), "L4 instanceof L5");
+        check(!(o instanceof M4), "L4 instanceof M4");
+        check(!(new M4() instanceof L4), "M4 instanceof L4");
+        check(new M4() instanceof L3, "M4 instanceof L3");
+        check(!(new L1() instanceof L2), "L1 instanceof L2");
+        check(L1.class.isAssignableFrom(L4.class), "L1 from L4");
+        check(!L4.class.isAssignableFrom(L1.class), "L4 from L1");
+        check(!Integer.TYPE.isAssignableFrom(Object.class), "int from Object");
+        check(!Object.class.isAssignableFrom(Integer.TYPE), "Object from int");
+        System.out.println("shallow passes");
+    }
+
+    static void deepTest() {
+        Object o = new L10();
+        check(o instanceof L7, "L10 instanceof L7");
+        check(o instanceof L8, "L10 instanceof L8");
+        check(o instanceof L9, "L10 instanceof L9");
+        check(o instanceof L10, "L10 instanceof L10");
+        check(!(o instanceof M10), "L10 instanceof M10");
+        check(!(new M10() instanceof L10), "M10 instanceof L10");
+        check(new M10() instanceof L9, "M10 instanceof L9");
+        check(!(new L8() instanceof L9), "L8 instanceof L9");
+        check(!(new L2() instanceof L9), "L2 instanceof L9");
+        try {
+            L10 l = (L10) (Object) new M10();
+            check(false, "M10 cast to L10");
+        } catch (ClassCastException expected) {
+        }
+        check(((L8) o).level() == 10, "L10 as L8");
+        System.out.println("deep passes");
+    }
+
+    static void interfacesTest() {
+        Object o = new Wider();
+        check(o instanceof I0, "Wider instanceof I0");
+        check(o instanceof I1, "Wider instanceof I1");
+        check(o instanceof I7, "Wider instanceof I7");
+        check(o instanceof I8, "Wider instanceof I8");
+        check(o instanceof I9, "Wider instanceof I9");
+        check(!(new Wide() instanceof I9), "Wide instanceof I9");
+        check(!(o instanceof Runnable), "Wider instanceof Runnable");
+        check(!(new L1() instanceof I0), "L1 instanceof I0");
+        check(I0.class.isAssignableFrom(Wide.class), "I0 from Wide");
+        check(!I9.class.isAssignableFrom(Wide.class), "I9 from Wide");
+        System.out.println("interfaces passes");
+    }
+
+    static void arraysTest() {
+        Object a = new L4[1][1];
+        check(a instanceof Object[], "L4[][] instanceof Object[]");
+        check(a instanceof L1[][], "L4[][] instanceof L1[][]");
+        check(!(a instanceof L5[][]), "L4[][] instanceof L5[][]");
+        check(a instanceof Cloneable, "L4[][] instanceof Cloneable");
+        check(a instanceof Serializable[], "L4[][] instanceof Serializable[]");
+        check(!(a instanceof Serializable[][]), "L4[][] instanceof Serializable[][]");
+        check(new L10[0] instanceof L8[], "L10[] instanceof L8[]");
+        check(!(new int[0] instanceof Object[]), "int[] instanceof Object[]");
+        check(new Wider[0] instanceof I0[], "Wider[] instanceof I0[]");
+        Object[] objs = new L2[1];
+        try {
+            objs[0] = new L1();
+            check(false, "stored L1 in L2[]");
+        } catch (ArrayStoreException expected) {
+        }
+        objs[0] = new L9();
+        System.out.println("arrays passes");
+    }
+
+    /* The verifier merges the two types into their common superclass */
+    static int merge(boolean which) {
+        L1 l;
+        if (which) {
+            l = new L10();
+        } else {
+            l = new M4();
+        }
+        return l.level();
+    }
+
+    static int mergeDeep(boolean which) {
+        L9 l = which ? (L9) new L10() : (L9) new M10();
+        return l.level();
+    }
+
+    static void mergeTest() {
+        check(merge(true) == 10, "merge L10");
+        check(merge(false) == -4, "merge M4");
+        check(mergeDeep(true) == 10, "merge deep L10");
+        check(mergeDeep(false) == -10, "merge deep M10");
+        System.out.println("merge passes");
+    }
+
+    static int countL4(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            if (objs[i] instanceof L4) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    static int castL9(Object[] objs) {
+        int n = 0;
+        for (int i = 0; i < objs.length; i++) {
+            n += ((L9) objs[i]).level();
+        }
+        return n;
+    }
+
+    static void compiledTest() {
+        Object[] shallow = new Object[] { new L4(), new L10(), new M4(), "x" };
+        Object[] deep = new Object[] { new L9(), new L10(), new M10() };
+        for (int i = 0; i < LOOPS; i++) {
+            check(countL4(shallow) == 2, "countL4");
+            check(castL9(deep) == 9, "castL9");
+        }
+        check(countL4(new Object[] { new L3(), new int[0], null }) == 0,
+            "countL4: misses");
+        try {
+            castL9(new Object[] { new L10(), new L8() });
+            check(false, "castL9: no exception");
+        } catch (ClassCastException expected) {
+        }
+        System.out.println("compiled passes");
+    }
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for value numbering.  Each method loads or computes the same thing
+ * more than once, with writes in between that the compiler must not miss,
+ * and runs often enough to be compiled.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static class Point {
+        int x;
+        int y;
+        long weight;
+        Point next;
+        Point(int x, int y) { this.x = x; this.y = y; }
+    }
+
+    static class Flag {
+        volatile int value;
+    }
+
+    static int counter;
+
+    public static void main(String args[]) {
+        fieldsTest();
+        aliasingTest();
+        arraysTest();
+        invokesTest();
+        volatilesTest();
+        arithmeticTest();
+        nullChecksTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    /* Every load after the first is redundant */
+    static long lengthSquared(Point p) {
+        long sum = p.x * p.x + p.y * p.y;
+        return sum * p.weight + p.weight;
+    }
+
+    static void fieldsTest() {
+        Point p = new Point(3, 4);
+        p.weight = 1L << 33;
+        for (int i = 0; i < LOOPS; i++) {
+            check(lengthSquared(p) == 25 * (1L << 33) + (1L << 33),
+                  "lengthSquared");
+        }
+        System.out.println("fields passes");
+    }
+
+    /* The store through q may or may not write p.x */
+    static int storeThrough(Point p, Point q, int v) {
+        int before = p.x;
+        q.x = v;
+        return before * 100 + p.x;
+    }
+
+    /* The stored value comes straight back from the load */
+    static int storeThenLoad(Point p, int v) {
+        p.y = v;
+        p.x = v + 1;
+        return p.y * 10 + p.x;
+    }
+
+    static void aliasingTest() {
+        Point a = new Point(1, 0);
+        Point b = new Point(2, 0);
+        for (int i = 0; i < LOOPS; i++) {
+            a.x = 1;
+            check(storeThrough(a, b, 7) == 101, "storeThrough: distinct");
+            check(storeThrough(a, a, 7) == 107, "storeThrough: same");
+            check(storeThenLoad(a, 3) == 34, "storeThenLoad");
+        }
+        System.out.println("aliasing passes");
+    }
+
+    static int elementTwice(int[] a, int[] b, int i) {
+        int first = a[i];
+        b[i] = first + 1;
+        return first * 100 + a[i];
+    }
+
+    static long wideElements(long[] a, int i) {
+        return a[i] * a[i] + a.length + a.length;
+    }
+
+    static void arraysTest() {
+        int[] a = new int[] { 5, 6 };
+        int[] b = new int[] { 0, 0 };
+        long[] w = new long[] { 1L << 20, 3 };
+        for (int i = 0; i < LOOPS; i++) {
+            a[1] = 6;
+            check(elementTwice(a, b, 1) == 606, "elementTwice: distinct");
+            check(elementTwice(a, a, 1) == 607, "elementTwice: same");
+            check(wideElements(w, 0) == (1L << 40) + 4, "wideElements");
+        }
+        System.out.println("arrays passes");
+    }
+
+    static void bump(Point p) {
+        p.x++;
+        counter++;
+    }
+
+    /* The callee writes both fields the caller loaded before the call */
+    static int aroundCall(Point p) {
+        int before = p.x + counter;
+        bump(p);
+        return before * 100 + p.x + counter;
+    }
+
+    static void invokesTest() {
+        Point p = new Point(0, 0);
+        for (int i = 0; i < LOOPS; i++) {
+            p.x = 1;
+            counter = 2;
+            check(aroundCall(p) == 305, "aroundCall");
+        }
+        System.out.println("invokes passes");
+    }
+
+    /* Another thread could change a volatile between the reads */
+    static int readTwice(Flag f, Point p) {
+        int x = p.x;
+        int v = f.value;
+        f.value = v + 1;
+        return x + p.x + v + f.value;
+    }
+
+    static void volatilesTest() {
+        Flag f = new Flag();
+        Point p = new Point(2, 0);
+        for (int i = 0; i < LOOPS; i++) {
+            f.value = 10;
+            check(readTwice(f, p) == 25, "readTwice");
+        }
+        System.out.println("volatiles passes");
+    }
+
+    /* Repeated expressions, including ones that may throw */
+    static int repeated(int a, int b) {
+        int x = (a + b) * (a - b);
+        int y = (b + a) * (a - b);
+        int q = a / b;
+        int r = a / b;
+        return x - y + q * 1000 + r;
+    }
+
+    static double repeatedDouble(double a, double b) {
+        return (a * b) + (a * b) - (b * a);
+    }
+
+    static void arithmeticTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(repeated(7, 3) == 2002, "repeated");
+            check(repeatedDouble(1.5, 4.0) == 6.0, "repeatedDouble");
+        }
+        try {
+            repeated(7, 0);
+            check(false, "repeated: no exception");
+        } catch (ArithmeticException expected) {
+        }
+        System.out.println("arithmetic passes");
+    }
+
+    /* Only the first access through each reference needs a check */
+    static int chain(Point p) {
+        int sum = p.x + p.y;
+        Point n = p.next;
+        sum += n.x;
+        return sum + n.y + p.x;
+    }
+
+    static void nullChecksTest() {
+        Point p = new Point(1, 2);
+        p.next = new Point(3, 4);
+        for (int i = 0; i < LOOPS; i++) {
+            check(chain(p) == 11, "chain");
+        }
+        try {
+            chain(null);
+            check(false, "chain: no exception for p");
+        } catch (NullPointerException expected) {
+        }
+        p.next = null;
+        try {
+            chain(p);
+            check(false, "chain: no exception for p.next");
+        } catch (NullPointerException expected) {
+        }
+        System.out.println("nullChecks passes");
+    }
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for inlining small methods.  Each helper is called often enough
+ * for its call sites to be compiled, and the results are checked against
+ * values worked out by hand.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static class Rect {
+        int w;
+        int h;
+        long scale = 1;
+        int count;
+        int total;
+        Rect(int w, int h) { this.w = w; this.h = h; }
+
+        int area() { return w * h; }
+        long scaledArea() { return (w * h) * scale + scale; }
+        void add(int d) { count++; total += d; }
+        private int halfPerimeter() { return w + h; }
+        int perimeter() { return halfPerimeter() * 2; }
+        int row(int i) {
+            if (i >= h || i < 0) {
+                return -1;
+            }
+            return i * w;
+        }
+    }
+
+    public static void main(String args[]) {
+        mathTest();
+        accessorsTest();
+        nestedTest();
+        argumentsTest();
+        exceptionsTest();
+        branchesTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static int mix(int h, int v) { return h * 31 + v; }
+    static int square(int x) { return x * x; }
+    static int wrap(int i, int n) { return i & (n - 1); }
+    static long scale(long v, int k) { return v * k + (v >> 3); }
+    static double lerp(double a, double b, double t) {
+        return a + (b - a) * t;
+    }
+
+    static void mathTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(mix(7, 3) == 220, "mix");
+            check(square(-9) == 81, "square");
+            check(wrap(i + 16, 16) == i % 16, "wrap");
+            check(scale(1L << 40, 3) == (3L << 40) + (1L << 37), "scale");
+            check(lerp(2.0, 4.0, 0.25) == 2.5, "lerp");
+        }
+        System.out.println("math passes");
+    }
+
+    static void accessorsTest() {
+        Rect r = new Rect(3, 5);
+        r.scale = 1L << 33;
+        for (int i = 0; i < LOOPS; i++) {
+            check(r.area() == 15, "area");
+            check(r.scaledArea() == 16 * (1L << 33), "scaledArea");
+            r.add(2);
+        }
+        check(r.count == LOOPS && r.total == 2 * LOOPS, "add");
+        System.out.println("accessors passes");
+    }
+
+    static int hash3(int a, int b, int c) { return mix(mix(mix(17, a), b), c); }
+
+    static void nestedTest() {
+        Rect r = new Rect(3, 5);
+        for (int i = 0; i < LOOPS; i++) {
+            check(hash3(1, 2, 3) == ((17 * 31 + 1) * 31 + 2) * 31 + 3,
+                  "hash3");
+            check(r.perimeter() == 16, "perimeter");
+        }
+        System.out.println("nested passes");
+    }
+
+    /* The helpers write their own arguments, the caller's copies must stay */
+    static int fold(int a, int b) {
+        a += b;
+        a ^= a >>> 16;
+        return a;
+    }
+
+    static int identity(int a) { return a; }
+
+    static void argumentsTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            int a = 0x10000;
+            int b = 1;
+            int f = fold(a, b);
+            check(a == 0x10000 && b == 1 && f == 0x10000, "fold");
+            /* The result goes to the argument's register */
+            a = fold(a, a);
+            check(a == 0x20002, "fold: same register");
+            int x = i;
+            x = identity(x + 1);
+            check(x == i + 1, "identity");
+        }
+        System.out.println("arguments passes");
+    }
+
+    static int ratio(int a, int b) { return a / b + 1; }
+    static int element(int[] a, int i) { return a[i] * 2 + 1; }
+
+    static void exceptionsTest() {
+        int[] a = new int[] { 1, 2, 3 };
+        Rect none = null;
+        int caught = 0;
+        for (int i = 0; i < LOOPS; i++) {
+            int before = i;
+            try {
+                before = ratio(i, i % 4);
+                check(i % 4 != 0, "ratio: no exception");
+            } catch (ArithmeticException expected) {
+                check(before == i, "ratio: result written");
+                caught++;
+            }
+            try {
+                before = element(a, i % 4);
+                check(i % 4 != 3, "element: no exception");
+                check(before == a[i % 4] * 2 + 1, "element");
+            } catch (ArrayIndexOutOfBoundsException expected) {
+                caught++;
+            }
+            if (i % 100 == 0) {
+                try {
+                    none.area();
+                    check(false, "area: no exception");
+                } catch (NullPointerException expected) {
+                    caught++;
+                }
+            }
+        }
+        check(caught == LOOPS / 4 * 2 + LOOPS / 100, "caught " + caught);
+        System.out.println("exceptions passes");
+    }
+
+    static int clamp(int x, int lo, int hi) {
+        if (x < lo) {
+            return lo;
+        }
+        if (x > hi) {
+            return hi;
+        }
+        return x;
+    }
+
+    static int max(int a, int b) { return a > b ? a : b; }
+
+    /* The arms join again before the return */
+    static int sign10(int x) {
+        int s = 0;
+        if (x > 0) {
+            s = 1;
+        } else if (x < 0) {
+            s = -1;
+        }
+        return s * 10 + 1;
+    }
+
+    static long shiftIf(boolean big, long v) {
+        if (big) {
+            return v << 8;
+        }
+        return v;
+    }
+
+    static void branchesTest() {
+        Rect r = new Rect(3, 5);
+        for (int i = 0; i < LOOPS; i++) {
+            int x = i % 7 - 3;
+            check(clamp(x, -1, 2) == (x < -1 ? -1 : x > 2 ? 2 : x), "clamp");
+            check(max(x, 1) == (x > 1 ? x : 1), "max");
+            int m = x;
+            m = max(m, 0);
+            check(m == (x > 0 ? x : 0), "max: same register");
+            check(sign10(x) == (x > 0 ? 11 : x < 0 ? -9 : 1), "sign10");
+            check(shiftIf((i & 1) == 0, 3L << 40) ==
+                  ((i & 1) == 0 ? 3L << 48 : 3L << 40), "shiftIf");
+            check(r.row(x) == (x >= 0 ? x * 3 : -1), "row");
+        }
+        System.out.println("branches passes");
+    }
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for escape analysis.  Each method makes an object per iteration of
+ * a loop that runs often enough to be compiled, and checks that the values
+ * read back from it, and the objects that outlive the loop, are right.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static class Point {
+        int x;
+        int y;
+        Point(int x, int y) { this.x = x; this.y = y; }
+        int dot(Point p) { return x * p.x + y * p.y; }
+    }
+
+    static class Small {
+        byte b;
+        char c;
+        short s;
+        boolean z;
+    }
+
+    static class Wide {
+        long value;
+        double scale;
+    }
+
+    static class Tracked {
+        static int finalized;
+        int value;
+        protected void finalize() { finalized++; }
+    }
+
+    static Point last;
+
+    public static void main(String args[]) {
+        temporariesTest();
+        exitsTest();
+        finalizableTest();
+        subWordTest();
+        escapingTest();
+        wideTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    /* The point never leaves the iteration that made it */
+    static int sumOfSquares(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            Point p = new Point(i, i + 1);
+            sum += p.dot(p);
+        }
+        return sum;
+    }
+
+    static void temporariesTest() {
+        int expected = 0;
+        for (int i = 0; i < 100; i++) {
+            expected += i * i + (i + 1) * (i + 1);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumOfSquares(100) == expected, "sumOfSquares");
+        }
+        System.out.println("temporaries passes");
+    }
+
+    /* The point made in the last iteration is the result */
+    static Point firstAbove(int limit) {
+        Point p = null;
+        for (int i = 0; i < 1000; i++) {
+            p = new Point(i, i * i);
+            if (p.y > limit) {
+                break;
+            }
+        }
+        return p;
+    }
+
+    static void exitsTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            Point p = firstAbove(i % 500);
+            int x = (int) Math.sqrt(i % 500) + 1;
+            check(p.x == x && p.y == x * x, "firstAbove");
+        }
+        Point p = firstAbove(1 << 30);
+        check(p.x == 999 && p.y == 999 * 999, "firstAbove: no break");
+        System.out.println("exits passes");
+    }
+
+    /* Every object made has to be finalized */
+    static int makeTracked(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            Tracked t = new Tracked();
+            t.value = i;
+            sum += t.value;
+        }
+        return sum;
+    }
+
+    static void finalizableTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(makeTracked(10) == 45, "makeTracked");
+        }
+        Runtime.getRuntime().gc();
+        System.runFinalization();
+        check(Tracked.finalized > 0, "makeTracked: no finalizers ran");
+        System.out.println("finalizable passes");
+    }
+
+    /* Stores to narrow fields truncate */
+    static int narrow(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            Small s = new Small();
+            s.b = (byte) (i * 37);
+            s.c = (char) (i * 4099);
+            s.s = (short) (i * 8191);
+            s.z = (i & 1) != 0;
+            sum += s.b + s.c + s.s + (s.z ? 1 : 0);
+        }
+        return sum;
+    }
+
+    static void subWordTest() {
+        int expected = 0;
+        for (int i = 0; i < 300; i++) {
+            expected += (byte) (i * 37) + (char) (i * 4099) +
+                        (short) (i * 8191) + (i & 1);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(narrow(300) == expected, "narrow");
+        }
+        System.out.println("subWord passes");
+    }
+
+    /* Every point is stored where it outlives the loop */
+    static int keepLast(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            Point p = new Point(i, -i);
+            last = p;
+            sum += p.x;
+        }
+        return sum;
+    }
+
+    static void escapingTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            last = null;
+            check(keepLast(10) == 45, "keepLast");
+            check(last != null && last.x == 9 && last.y == -9,
+                  "keepLast: last point");
+        }
+        System.out.println("escaping passes");
+    }
+
+    /* Long and double fields take a register pair each */
+    static double scaledSum(int n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++) {
+            Wide w = new Wide();
+            w.value = (long) i << 33;
+            w.scale = 0.5;
+            sum += (w.value >> 33) * w.scale;
+        }
+        return sum;
+    }
+
+    static void wideTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(scaledSum(100) == 2475.0, "scaledSum");
+        }
+        System.out.println("wide passes");
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for trace trees.  Each method is branchy straight-line code called
+ * often enough for the traces through it to be compiled, and for their
+ * side exits to get hot and grow into them.  The results are checked
+ * against the same computation done another way.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    public static void main(String args[]) {
+        bothSidesTest();
+        phaseChangeTest();
+        invokesTest();
+        longChainTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    /* Both sides of both branches are hot */
+    static int grade(int score) {
+        int bonus;
+        if (score >= 50) {
+            bonus = 10;
+        } else {
+            bonus = -5;
+        }
+        if ((score & 1) == 0) {
+            bonus *= 2;
+        } else {
+            bonus += 1;
+        }
+        return score + bonus;
+    }
+
+    static void bothSidesTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            int score = i % 100;
+            int bonus = score < 50 ? -5 : 10;
+            bonus = score % 2 == 1 ? bonus + 1 : bonus * 2;
+            check(grade(score) == score + bonus, "grade " + score);
+        }
+        System.out.println("bothSides passes");
+    }
+
+    /* The rare side only gets hot once the trace has been compiled */
+    static int adjust(int x, boolean rare) {
+        int y = x * 3;
+        if (rare) {
+            y = 7 - y;
+        }
+        return y + 1;
+    }
+
+    static void phaseChangeTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            check(adjust(i, false) == i * 3 + 1, "adjust common " + i);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(adjust(i, true) == 8 - i * 3, "adjust rare " + i);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            boolean rare = (i & 3) == 0;
+            check(adjust(i, rare) == (rare ? 8 - i * 3 : i * 3 + 1),
+                  "adjust mixed " + i);
+        }
+        System.out.println("phaseChange passes");
+    }
+
+    /* The sides of the first branch end in invokes */
+    static int twice(int x) {
+        return x * 2;
+    }
+
+    static int negate(int x) {
+        return -x;
+    }
+
+    static int route(int x) {
+        int y;
+        if (x > 0) {
+            y = twice(x);
+        } else {
+            y = negate(x);
+        }
+        if (y > 100) {
+            y -= 100;
+        }
+        return y;
+    }
+
+    static void invokesTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            int x = i % 200 - 100;
+            int y = Math.abs(x) * (x > 0 ? 2 : 1);
+            check(route(x) == (y > 100 ? y - 100 : y), "route " + x);
+        }
+        System.out.println("invokes passes");
+    }
+
+    /* More branches than fit in one trace, taken every which way */
+    static int bits(int mask) {
+        int sum = 0;
+        if ((mask & 0x001) != 0) sum += 1; else sum -= 1;
+        if ((mask & 0x002) != 0) sum += 2; else sum -= 1;
+        if ((mask & 0x004) != 0) sum += 3; else sum -= 1;
+        if ((mask & 0x008) != 0) sum += 4; else sum -= 1;
+        if ((mask & 0x010) != 0) sum += 5; else sum -= 1;
+        if ((mask & 0x020) != 0) sum += 6; else sum -= 1;
+        if ((mask & 0x040) != 0) sum += 7; else sum -= 1;
+        if ((mask & 0x080) != 0) sum += 8; else sum -= 1;
+        if ((mask & 0x100) != 0) sum += 9; else sum -= 1;
+        if ((mask & 0x200) != 0) sum += 10; else sum -= 1;
+        if ((mask & 0x400) != 0) sum += 11; else sum -= 1;
+        if ((mask & 0x800) != 0) sum += 12; else sum -= 1;
+        return sum;
+    }
+
+    static void longChainTest() {
+        for (int i = 0; i < LOOPS; i++) {
+            int mask = (int) ((i * 2654435761L) >>> 20) & 0xfff;
+            int expected = 0;
+            for (int k = 0; k < 12; k++) {
+                expected += (mask >> k & 1) != 0 ? k + 1 : -1;
+            }
+            check(bits(mask) == expected, "bits " + mask);
+        }
+        System.out.println("longChain passes");
+    }
+}
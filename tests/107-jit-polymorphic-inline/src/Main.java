@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tests for inlining at polymorphic call sites.  Each site sees several
+ * receiver classes that dispatch to different small methods, often enough
+ * for the site to be profiled and compiled with a guard per target.  The
+ * results are checked against values worked out by hand.
+ */
+public class Main {
+    static final int LOOPS = 10000;
+
+    static abstract class Shape {
+        int size;
+        int hits;
+        long weight;
+        abstract int get();
+        abstract long heavy();
+        abstract void set(int v);
+        abstract void touch();
+    }
+
+    static class A extends Shape {
+        int a;
+        int get() { return a; }
+        long heavy() { return weight; }
+        void set(int v) { a = v; }
+        void touch() { }
+    }
+
+    static class B extends Shape {
+        int b;
+        int get() { return b; }
+        long heavy() { return weight; }
+        void set(int v) { b = v; }
+        void touch() { }
+    }
+
+    static class C extends Shape {
+        int get() { return size; }
+        long heavy() { return weight; }
+        void set(int v) { size = v; }
+        void touch() { }
+    }
+
+    static class D extends Shape {
+        int get() { return hits; }
+        long heavy() { return weight; }
+        void set(int v) { hits = v; }
+        void touch() { hits++; }
+    }
+
+    /* Shares the target of A */
+    static class A2 extends A {
+    }
+
+    public static void main(String args[]) {
+        bimorphicTest();
+        tetramorphicTest();
+        settersTest();
+        emptyTest();
+        phaseChangeTest();
+        nullReceiverTest();
+    }
+
+    static void check(boolean ok, String what) {
+        if (!ok) {
+            throw new RuntimeException(what);
+        }
+    }
+
+    static Shape make(int kind, int v) {
+        Shape s;
+        switch (kind & 3) {
+            case 0: A a = new A(); a.a = v; s = a; break;
+            case 1: B b = new B(); b.b = v; s = b; break;
+            case 2: s = new C(); s.size = v; break;
+            default: s = new D(); s.hits = v; break;
+        }
+        s.weight = (long) v << 33;
+        return s;
+    }
+
+    static int sumGet(Shape[] shapes) {
+        int sum = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            sum += shapes[i].get();
+        }
+        return sum;
+    }
+
+    static void bimorphicTest() {
+        Shape[] shapes = new Shape[64];
+        int expected = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i & 1, i);
+            expected += i;
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet bimorphic " + i);
+        }
+
+        /* Two classes sharing one target, next to a second target */
+        for (int i = 0; i < shapes.length; i += 4) {
+            A2 a2 = new A2();
+            a2.a = i;
+            shapes[i] = a2;
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet shared " + i);
+        }
+        System.out.println("bimorphic passes");
+    }
+
+    static long sumHeavy(Shape[] shapes) {
+        long sum = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            sum += shapes[i].heavy();
+        }
+        return sum;
+    }
+
+    static void tetramorphicTest() {
+        Shape[] shapes = new Shape[64];
+        int expected = 0;
+        long expectedHeavy = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i, i);
+            expected += i;
+            expectedHeavy += (long) i << 33;
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet tetramorphic " + i);
+            check(sumHeavy(shapes) == expectedHeavy, "sumHeavy " + i);
+        }
+        System.out.println("tetramorphic passes");
+    }
+
+    static void setAll(Shape[] shapes, int v) {
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i].set(v + i);
+        }
+    }
+
+    static void settersTest() {
+        Shape[] shapes = new Shape[64];
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i, 0);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            setAll(shapes, i);
+            for (int j = 0; j < shapes.length; j++) {
+                check(shapes[j].get() == i + j, "set " + i + " " + j);
+            }
+        }
+        /* Each setter must have written its own field only */
+        A a = (A) shapes[0];
+        check(a.size == 0 && a.hits == 0, "setter wrote the wrong field");
+        System.out.println("setters passes");
+    }
+
+    static void touchAll(Shape[] shapes) {
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i].touch();
+        }
+    }
+
+    static void emptyTest() {
+        Shape[] shapes = new Shape[64];
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i, 0);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            touchAll(shapes);
+        }
+        for (int i = 0; i < shapes.length; i++) {
+            int expected = (i & 3) == 3 ? LOOPS : 0;
+            check(shapes[i].hits == expected, "touch " + i);
+        }
+        System.out.println("empty passes");
+    }
+
+    static void phaseChangeTest() {
+        Shape[] shapes = new Shape[64];
+        int expected = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i & 1, i);
+            expected += i;
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet before " + i);
+        }
+        /* Classes the compiled site has no guard for */
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i | 2, i);
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet after " + i);
+        }
+        System.out.println("phaseChange passes");
+    }
+
+    static void nullReceiverTest() {
+        Shape[] shapes = new Shape[64];
+        int expected = 0;
+        for (int i = 0; i < shapes.length; i++) {
+            shapes[i] = make(i, i);
+            expected += i;
+        }
+        for (int i = 0; i < LOOPS; i++) {
+            check(sumGet(shapes) == expected, "sumGet " + i);
+        }
+        shapes[37] = null;
+        try {
+            sumGet(shapes);
+            check(false, "no exception for a null receiver");
+        } catch (NullPointerException expectedException) {
+        }
+        System.out.println("nullReceiver passes");
+    }
+}
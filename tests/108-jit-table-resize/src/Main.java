@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import java.math.BigInteger;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.TreeMap;
+
+/**
+ * Tests growing the JitTable while translations are installed.  Each
+ * thread runs a spread of library code, which has far more trace heads
+ * than the initial table holds, and checks its results every seventh
+ * round against a run made before any of the threads started.
+ */
+public class Main {
+    static final int THREADS = 4;
+    static final int ROUNDS = 200;
+
+    public static void main(String args[]) throws Exception {
+        final long expected = work(0);
+        final String[] failures = new String[THREADS];
+        Thread[] threads = new Thread[THREADS];
+
+        for (int t = 0; t < THREADS; t++) {
+            final int id = t;
+            threads[t] = new Thread() {
+                public void run() {
+                    for (int round = 0; round < ROUNDS; round++) {
+                        long result = work(round % 7 == 0 ? 0 : round);
+                        if (round % 7 == 0 && result != expected) {
+                            failures[id] = "round " + round + ": " + result +
+                                           " != " + expected;
+                            return;
+                        }
+                    }
+                }
+            };
+            threads[t].start();
+        }
+        for (int t = 0; t < THREADS; t++) {
+            threads[t].join();
+            if (failures[t] != null) {
+                System.out.println("thread " + t + " " + failures[t]);
+            }
+        }
+        System.out.println("resize passes");
+    }
+
+    /* Deterministic for a given seed */
+    static long work(int seed) {
+        long sum = seed;
+
+        StringBuilder sb = new StringBuilder();
+        for (int i = 0; i < 50; i++) {
+            sb.append(i).append(',').append(Integer.toHexString(i * 31 + seed));
+            sb.append(Long.toString((long) i << 20, 7));
+        }
+        String s = sb.toString();
+        sum += s.hashCode();
+        sum += s.indexOf("1f") + s.lastIndexOf(',');
+        sum += s.toUpperCase().hashCode() ^ s.replace('1', 'x').hashCode();
+        sum += Arrays.hashCode(s.split(","));
+
+        HashMap<String, Integer> map = new HashMap<String, Integer>();
+        TreeMap<Integer, String> tree = new TreeMap<Integer, String>();
+        ArrayList<Double> list = new ArrayList<Double>();
+        for (int i = 0; i < 100; i++) {
+            map.put("k" + (i % 37), i);
+            tree.put((i * 7919 + seed) % 101, "v" + i);
+            list.add(Math.sqrt(i + seed) * Math.sin(i));
+        }
+        for (String key : map.keySet()) {
+            sum += map.get(key) * key.length();
+        }
+        sum += tree.firstKey() + tree.lastKey() + tree.headMap(50).size();
+        Double[] doubles = list.toArray(new Double[0]);
+        Arrays.sort(doubles);
+        sum += (long) (doubles[doubles.length / 2] * 1000);
+
+        BigInteger big = BigInteger.valueOf(seed + 3);
+        for (int i = 0; i < 10; i++) {
+            big = big.multiply(big).add(BigInteger.valueOf(i)).mod(
+                BigInteger.valueOf(1000000007L));
+        }
+        sum += big.longValue();
+
+        sum += String.format("%08x %5.2f %s", seed, seed / 3.0, "z").hashCode();
+        sum += Double.toString(seed * 1.25).hashCode();
+        sum += Long.parseLong("123456789") + Integer.parseInt("-42", 10);
+        return sum;
+    }
+}
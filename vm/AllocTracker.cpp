@@ -123,6 +123,10 @@ bool dvmEnableAllocTracker()
     }
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
+
+    /* allocations from the compiled code's caches wouldn't be recorded */
+    if (result)
+        dvmEmptyAllocCaches();
     return result;
 }
 
@@ -218,6 +218,14 @@ ifeq ($(WITH_JIT),true)
 	compiler/SSATransformation.cpp \
 	compiler/Loop.cpp \
 	compiler/Ralloc.cpp \
+	compiler/PerfMap.cpp \
+	compiler/WarmStart.cpp \
+	compiler/TraceTree.cpp \
+	compiler/CallSiteProfile.cpp \
+	compiler/TypeCheckSites.cpp \
+	compiler/Vectorize.cpp \
+	compiler/ValueNumbering.cpp \
+	compiler/EscapeAnalysis.cpp \
 	interp/Jit.cpp
 endif
 
@@ -39,6 +39,10 @@
 struct GcHeap;
 struct BreakpointSet;
 struct InlineSub;
+struct WarmStartClass;
+struct PerfMapEntry;
+struct JitCallSiteProfile;
+struct JitTypeCheckSite;
 
 /*
  * One of these for each -ea/-da/-esa/-dsa on the command line.
@@ -489,6 +493,23 @@ struct DvmGlobals {
      */
     int  sumThreadSuspendCount;
 
+    /*
+     * Time-to-safepoint statistics.  Updated by dvmSuspendAllThreads while
+     * it holds the thread suspend lock; readers may see slightly stale
+     * values.
+     */
+    SafepointStats safepointStats;
+
+    /*
+     * Pool of recycled Thread structs, linked through Thread.next.  Guarded
+     * by threadPoolLock, which is a leaf: never grab another lock while
+     * holding it.
+     */
+    pthread_mutex_t threadPoolLock;
+    Thread*     threadPool;
+    int         threadPoolCount;
+    ThreadPoolStats threadPoolStats;
+
     /*
      * MUTEX ORDERING: when locking multiple mutexes, always grab them in
      * this order to avoid deadlock:
@@ -500,10 +521,14 @@ struct DvmGlobals {
 
 
     /*
-     * Thread ID bitmap.  We want threads to have small integer IDs so
-     * we can use them in "thin locks".
+     * Thread ID allocation.  We want threads to have small integer IDs so
+     * we can use them in "thin locks".  Released IDs go on a lock-free
+     * stack linked through threadIdNext; fresh ones come from
+     * threadIdHighWater.  See assignThreadId().
      */
-    BitVector*  threadIdMap;
+    volatile int32_t threadIdFreeHead;
+    u2*         threadIdNext;
+    volatile int32_t threadIdHighWater;
 
     /*
      * Manage exit conditions.  The VM exits when all non-daemon threads
@@ -780,8 +805,12 @@ struct DvmJitGlobals {
      */
     pthread_mutex_t tableLock;
 
-    /* The JIT hash table.  Note that for access speed, copies of this pointer
-     * are stored in each thread. */
+    /* The current generation of the JIT hash table.  Lookups that don't hold
+     * tableLock must load this once and only use that generation. */
+    struct JitTable * volatile pJitTable;
+
+    /* The entries of pJitTable, for the compiler thread and code that holds
+     * tableLock.  Only changed by a resize, under tableLock. */
     struct JitEntry *pJitEntryTable;
 
     /* Array of compilation trigger threshold counters */
@@ -802,6 +831,9 @@ struct DvmJitGlobals {
     /* How many entries in the JitEntryTable are in use */
     unsigned int jitTableEntriesUsed;
 
+    /* Times the JitTable has been grown */
+    int jitTableResizes;
+
     /* Bytes allocated for the code cache */
     unsigned int codeCacheSize;
 
@@ -813,20 +845,60 @@ struct DvmJitGlobals {
     bool               blockingMode;
     bool               methodTraceSupport;
     bool               genSuspendPoll;
-    Thread*            compilerThread;
-    pthread_t          compilerHandle;
+    /* -Xjitmode:method - compile whole methods instead of hot traces */
+    bool               methodTraces;
+    /* One handle per compiler thread; only the first is started up front */
+    pthread_t          compilerHandles[JIT_MAX_COMPILER_THREADS];
+    int                numCompilerThreads;
+    int                compilerThreadsStarted;
     pthread_mutex_t    compilerLock;
+    /*
+     * Serializes the parts of code generation that can't run concurrently:
+     * assembly into the code cache, and all of the x86 lowering.  Taken
+     * before compilerLock.
+     */
+    pthread_mutex_t    compilerCodegenLock;
     pthread_mutex_t    compilerICPatchLock;
     pthread_cond_t     compilerQueueActivity;
     pthread_cond_t     compilerQueueEmpty;
     volatile int       compilerQueueLength;
     int                compilerHighWater;
-    int                compilerWorkEnqueueIndex;
-    int                compilerWorkDequeueIndex;
+    unsigned int       compilerWorkSequence;
     int                compilerICPatchIndex;
 
+    /*
+     * Receiver classes seen at virtual/interface call sites, hashed by the
+     * Dalvik PC of the invoke.  Guarded by compilerICPatchLock.
+     */
+    JitCallSiteProfile* pCallSiteProfile;
+    int                callSitesProfiled;
+    int                callSitesPolymorphic;
+    int                callSitesMegamorphic;
+
+    /*
+     * Inline caches for check-cast/instance-of sites, hashed by the Dalvik
+     * PC of the bytecode.  Entries are claimed by compiler threads holding
+     * compilerCodegenLock.
+     */
+    JitTypeCheckSite*  pTypeCheckSites;
+    int                typeCheckSitesUsed;
+
+    /*
+     * Side exits of installed traces, hashed by the Dalvik PC they leave
+     * to, that a hot request may grow into their trace (see
+     * compiler/TraceTree.cpp).  Guarded by compilerLock.
+     */
+    HashTable*         traceTreeExits;
+    int                traceTreesGrown;
+    int                traceTreeExitsDropped;
+
+    /* Scheduling priority (1-10) for the compiler threads; 0 to inherit */
+    int                compilerThreadPriority;
+
     /* JIT internal stats */
     int                compilerMaxQueued;
+    int                compilerWorkBumped;
+    int                compilerWorkEvicted;
     int                translationChains;
 
     /* Compiled code cache */
@@ -839,9 +911,10 @@ struct DvmJitGlobals {
      * guarantee whether GC has happened before the code address has been
      * installed to the JIT table. Because of that, this field can only
      * been cleared/overwritten by the compiler thread if it is in the
-     * THREAD_RUNNING state or in a safe point.
+     * THREAD_RUNNING state or in a safe point.  Each compiler thread has
+     * its own slot.
      */
-    void *inflightBaseAddr;
+    void *inflightBaseAddr[JIT_MAX_COMPILER_THREADS];
 
     /* Translation cache version (protected by compilerLock */
     int cacheVersion;
@@ -849,12 +922,57 @@ struct DvmJitGlobals {
     /* Bytes used by the code templates */
     unsigned int templateSize;
 
-    /* Bytes already used in the code cache */
+    /*
+     * Allocation point in the code cache.  New translations go between
+     * codeCacheByteUsed and codeCacheByteLimit, the end of the current
+     * segment (see JIT_CODE_CACHE_SEGMENTS).
+     */
     unsigned int codeCacheByteUsed;
+    unsigned int codeCacheByteLimit;
+
+    /* End of the furthest segment ever used; everything below may be live */
+    unsigned int codeCacheHighMark;
+
+    /* Code cache segment layout and fill levels */
+    unsigned int codeCacheSegmentSize;
+    int codeCacheCurrentSegment;
+    unsigned int codeCacheSegmentUsed[JIT_CODE_CACHE_SEGMENTS];
+
+    /* Segment eviction stats */
+    int numCodeCacheEvictions;
+    int numTranslationsEvicted;
 
     /* Number of installed compilations in the cache */
     unsigned int numCompilations;
 
+    /*
+     * Warm start profile named by -Xjitwarmstart (see compiler/WarmStart.cpp).
+     * warmStartLock guards the pending table and the ready list; the saved
+     * trace table is only touched by the compiler thread.
+     */
+    char*              warmStartFile;
+    pthread_mutex_t    warmStartLock;
+    u1*                warmStartImage;
+    HashTable*         warmStartPending;
+    WarmStartClass*    warmStartReady;
+    HashTable*         warmStartTraces;
+    bool               warmStartDirty;
+    u4                 warmStartLastSave;
+    int                numWarmStartLoaded;
+    int                numWarmStartQueued;
+    int                numWarmStartDropped;
+
+    /* Linux perf symbol output (see compiler/PerfMap.cpp) */
+    bool               perfMap;
+    bool               jitDump;
+    FILE*              perfMapFile;
+    PerfMapEntry*      perfMapEntries;
+    int                perfMapCount;
+    int                perfMapCapacity;
+    int                jitDumpFd;
+    void*              jitDumpMarker;
+    u8                 jitDumpCodeIndex;
+
     /* Flag to indicate that the code cache is full */
     bool codeCacheFull;
 
@@ -953,6 +1071,9 @@ struct DvmJitGlobals {
     int                invokeMonoSetterInlined;
     int                invokePolyGetterInlined;
     int                invokePolySetterInlined;
+    int                invokePolyTargetsInlined;
+    int                invokeMonoBodyInlined;
+    int                invokeNestedInlined;
     int                returnOp;
     int                icPatchInit;
     int                icPatchLockFree;
@@ -961,6 +1082,17 @@ struct DvmJitGlobals {
     int                icPatchDropped;
     int                codeCachePatches;
     int                numCompilerThreadBlockGC;
+    int                loopRegsPromoted;
+    int                loopRegsDropped;
+    int                loopRegRefsPromoted;
+    int                loopInvariantsHoisted;
+    int                loopsVectorized;
+    int                gvnLoadsEliminated;
+    int                gvnExprsEliminated;
+    int                gvnNullChecksEliminated;
+    int                allocsEliminated;
+    int                allocsMaterialized;
+    int                loopsWithAllocsEliminated;
     u8                 jitTime;
     u8                 compilerThreadBlockGCStart;
     u8                 compilerThreadBlockGCTime;
@@ -973,7 +1105,10 @@ struct DvmJitGlobals {
 
     /* Place arrays at the end to ease the display in gdb sessions */
 
-    /* Work order queue for compilations */
+    /*
+     * Work order queue for compilations.  This is a binary heap ordered by
+     * CompilerWorkOrder.priority, so the hottest request is at index 0.
+     */
     CompilerWorkOrder compilerWorkQueue[COMPILER_WORK_QUEUE_SIZE];
 
     /* Work order queue for predicted chain patching */
@@ -58,6 +58,16 @@ void IndirectRefTable::destroy()
     alloc_entries_ = max_entries_ = -1;
 }
 
+/*
+ * Empties the table without releasing its storage.
+ */
+void IndirectRefTable::reset()
+{
+    assert(table_ != NULL);
+    memset(table_, 0xd1, alloc_entries_ * sizeof(IndirectRefSlot));
+    segmentState.all = IRT_FIRST_SEGMENT;
+}
+
 IndirectRef IndirectRefTable::add(u4 cookie, Object* obj)
 {
     IRTSegmentState prevState;
@@ -317,6 +317,19 @@ public:
      */
     void destroy();
 
+    /*
+     * Discard all entries but keep the allocated storage, so the table
+     * can be handed to a new owner without another init().
+     */
+    void reset();
+
+    /*
+     * Returns "true" if init() has been called and destroy() hasn't.
+     */
+    bool isInitialized() const {
+        return table_ != NULL;
+    }
+
     /*
      * Dump the contents of a reference table to the log file.
      *
@@ -138,16 +138,24 @@ static void usage(const char* progName)
     dvmFprintf(stderr, "  -Xincludeselectedmethod\n");
     dvmFprintf(stderr, "  -Xjitthreshold:decimalvalue\n");
     dvmFprintf(stderr, "  -Xjitblocking\n");
+    dvmFprintf(stderr, "  -Xjitthreadpriority:<1-10>\n");
+    dvmFprintf(stderr, "  -Xjitthreads:<1-%d> "
+                       "(parallel frontend only; one thread on x86)\n",
+               JIT_MAX_COMPILER_THREADS);
     dvmFprintf(stderr, "  -Xjitmethod:signature[,signature]* "
                        "(eg Ljava/lang/String\\;replace)\n");
     dvmFprintf(stderr, "  -Xjitclass:classname[,classname]*\n");
     dvmFprintf(stderr, "  -Xjitoffset:offset[,offset]\n");
     dvmFprintf(stderr, "  -Xjitconfig:filename\n");
+    dvmFprintf(stderr, "  -Xjitwarmstart:filename\n");
+    dvmFprintf(stderr, "  -Xjitperfmap\n");
+    dvmFprintf(stderr, "  -Xjitdump\n");
     dvmFprintf(stderr, "  -Xjitcheckcg\n");
     dvmFprintf(stderr, "  -Xjitverbose\n");
     dvmFprintf(stderr, "  -Xjitprofile\n");
     dvmFprintf(stderr, "  -Xjitdisableopt\n");
     dvmFprintf(stderr, "  -Xjitsuspendpoll\n");
+    dvmFprintf(stderr, "  -Xjitmode:{trace,method}\n");
 #endif
     dvmFprintf(stderr, "\n");
     dvmFprintf(stderr, "Configured with:"
@@ -1118,10 +1126,32 @@ static int processOptions(int argc, const char* const argv[],
             processXjitoffset(argv[i] + strlen("-Xjitoffset:"));
         } else if (strncmp(argv[i], "-Xjitconfig:", 12) == 0) {
             processXjitconfig(argv[i] + strlen("-Xjitconfig:"));
+        } else if (strncmp(argv[i], "-Xjitwarmstart:", 15) == 0) {
+            gDvmJit.warmStartFile = strdup(argv[i] + strlen("-Xjitwarmstart:"));
+        } else if (strcmp(argv[i], "-Xjitperfmap") == 0) {
+            gDvmJit.perfMap = true;
+        } else if (strcmp(argv[i], "-Xjitdump") == 0) {
+            gDvmJit.jitDump = true;
         } else if (strncmp(argv[i], "-Xjitblocking", 13) == 0) {
           gDvmJit.blockingMode = true;
         } else if (strncmp(argv[i], "-Xjitthreshold:", 15) == 0) {
           gDvmJit.threshold = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "-Xjitthreadpriority:", 20) == 0) {
+          int priority = atoi(argv[i] + 20);
+          if (priority < THREAD_MIN_PRIORITY ||
+              priority > THREAD_MAX_PRIORITY) {
+              dvmFprintf(stderr, "Invalid -Xjitthreadpriority '%s'\n",
+                         argv[i]);
+              return -1;
+          }
+          gDvmJit.compilerThreadPriority = priority;
+        } else if (strncmp(argv[i], "-Xjitthreads:", 13) == 0) {
+          int threads = atoi(argv[i] + 13);
+          if (threads < 1 || threads > JIT_MAX_COMPILER_THREADS) {
+              dvmFprintf(stderr, "Invalid -Xjitthreads '%s'\n", argv[i]);
+              return -1;
+          }
+          gDvmJit.numCompilerThreads = threads;
         } else if (strncmp(argv[i], "-Xincludeselectedop", 19) == 0) {
           gDvmJit.includeSelectedOp = true;
         } else if (strncmp(argv[i], "-Xincludeselectedmethod", 23) == 0) {
@@ -1146,6 +1176,20 @@ static int processOptions(int argc, const char* const argv[],
           }
         } else if (strncmp(argv[i], "-Xjitsuspendpoll", 16) == 0) {
           gDvmJit.genSuspendPoll = true;
+        } else if (strncmp(argv[i], "-Xjitmode:", 10) == 0) {
+          if (strcmp(argv[i] + 10, "method") == 0) {
+#if defined(ARCH_IA32)
+              gDvmJit.methodTraces = true;
+#else
+              ALOGW("-Xjitmode:method is only supported on x86, "
+                    "compiling traces");
+#endif
+          } else if (strcmp(argv[i] + 10, "trace") == 0) {
+              gDvmJit.methodTraces = false;
+          } else {
+              dvmFprintf(stderr, "Invalid -Xjitmode '%s'\n", argv[i]);
+              return -1;
+          }
 #endif
 
         } else if (strncmp(argv[i], "-Xstacktracefile:", 17) == 0) {
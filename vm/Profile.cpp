@@ -26,12 +26,15 @@
 #include <sys/time.h>
 #include <time.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sched.h>
 #include <errno.h>
 #include <fcntl.h>
 
 #include <cutils/open_memstream.h>
 
+#include <vector>
+
 #ifdef HAVE_ANDROID_OS
 # define UPDATE_MAGIC_PAGE      1
 #endif
@@ -78,6 +81,30 @@
 
 #define FILL_PATTERN        0xeeeeeeee
 
+/*
+ * Each thread appends records to its own chunk of the trace buffer, so the
+ * shared "curOffset" only moves once per chunk rather than once per record.
+ * A chunk starts with this header; the records that follow are in file
+ * format.  The chunks are merged back into a single stream when tracing
+ * stops, so none of this appears in the output.
+ */
+#define TRACE_CHUNK_SIZE    8192
+
+struct TraceChunkHeader {
+    u2      kind;           /* see below; written last */
+    u2      length;         /* bytes of record data in this chunk */
+    int     nextOffset;     /* offset of the thread's next chunk, or 0 */
+};
+
+/*
+ * TraceChunkHeader.kind.  A chunk that has been claimed but whose header
+ * hasn't been written yet still holds the fill pattern, which is neither.
+ */
+enum {
+    kTraceChunkFirst = 0x4346,      /* starts a thread's list of chunks */
+    kTraceChunkNext  = 0x434e,      /* follows another chunk in a list */
+};
+
 
 /*
  * Returns true if the thread CPU clock should be used.
@@ -170,6 +197,14 @@ static inline void storeLongLE(u1* buf, u8 val)
     *buf++ = (u1) (val >> 56);
 }
 
+/*
+ * Read little-endian data.
+ */
+static inline u4 loadIntLE(const u1* buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
+}
+
 /*
  * Boot-time init.
  */
@@ -181,6 +216,11 @@ bool dvmProfilingStartup()
     memset(&gDvm.methodTrace, 0, sizeof(gDvm.methodTrace));
     dvmInitMutex(&gDvm.methodTrace.startStopLock);
     pthread_cond_init(&gDvm.methodTrace.threadExitCond, NULL);
+    dvmInitMutex(&gDvm.methodTrace.samplingLock);
+    pthread_cond_init(&gDvm.methodTrace.samplingCond, NULL);
+    dvmInitMutex(&gDvm.methodTrace.streamLock);
+    pthread_cond_init(&gDvm.methodTrace.streamCond, NULL);
+    pthread_cond_init(&gDvm.methodTrace.chunkFreeCond, NULL);
 
     assert(!dvmCheckException(dvmThreadSelf()));
 
@@ -267,7 +307,12 @@ static void updateActiveProfilers(ExecutionSubModes newMode, bool enable)
 
 
 /*
- * Reset the "cpuClockBase" field in all threads.
+ * Reset the "cpuClockBase" field in all threads.  We also forget the
+ * last stack sample, so the sampling profiler starts from an empty stack.
+ *
+ * Trace chunks left over from a previous run are left alone; only the
+ * owning thread changes "methodTraceChunk", and it notices the new
+ * "traceGeneration" the next time it adds a record.
  */
 static void resetCpuClockBase()
 {
@@ -277,6 +322,189 @@ static void resetCpuClockBase()
     for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
         thread->cpuClockBaseSet = false;
         thread->cpuClockBase = 0;
+        thread->sampleStackDepth = 0;
+    }
+    dvmUnlockThreadList();
+}
+
+/*
+ * Returns the thread's current chunk, or NULL if it doesn't have one in
+ * this trace.
+ */
+static TraceChunkHeader* currentTraceChunk(const Thread* thread)
+{
+    if (thread->methodTraceGeneration != gDvm.methodTrace.traceGeneration)
+        return NULL;
+    return (TraceChunkHeader*) thread->methodTraceChunk;
+}
+
+/*
+ * Record the final length of a thread's current chunk, and set its limit
+ * to what's been used so that the next record goes looking for a new
+ * chunk, which fails once tracing is disabled.
+ *
+ * The chunk stays attached: the owner may still be part way through
+ * dvmMethodTraceAdd, and must keep writing into memory that's ours.
+ */
+static void sealTraceChunk(Thread* thread)
+{
+    TraceChunkHeader* hdr = (TraceChunkHeader*) thread->methodTraceChunk;
+
+    hdr->length = thread->methodTraceChunkUsed;
+    thread->methodTraceChunkSize = thread->methodTraceChunkUsed;
+}
+
+/*
+ * Seal each thread's current chunk, so the trace buffer can be merged.
+ */
+static void flushThreadTraceChunks()
+{
+    Thread* thread;
+
+    dvmLockThreadList(NULL);
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        if (currentTraceChunk(thread) != NULL)
+            sealTraceChunk(thread);
+    }
+    dvmUnlockThreadList();
+}
+
+/*
+ * Safe point callback used by the sampling profiler.  This runs on the
+ * sampled thread itself, so its interpreted stack can't change under us.
+ *
+ * We compare the stack against the one captured by the previous sample
+ * and emit exit records for the frames that went away and enter records
+ * for the new ones.  The result is an ordinary dmtrace event stream, so
+ * dmtracedump and traceview can build the call tree as usual.
+ *
+ * Returning "false" disarms the callback until the next sample.
+ */
+static bool sampleThreadStack(Thread* self, void* arg)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    const void* fp = self->interpSave.curFrame;
+
+    UNUSED_PARAMETER(arg);
+
+    if (!state->traceEnabled || !state->samplingEnabled || fp == NULL)
+        return false;
+
+    int depth = dvmComputeExactFrameDepth(fp);
+    if (depth > self->sampleStackCapacity) {
+        int newCapacity = MAX(depth * 2, 32);
+        const Method** prevStack = (const Method**)
+            realloc(self->sampleStack, newCapacity * sizeof(Method*));
+        const Method** scratch = (const Method**)
+            realloc(self->sampleScratch, newCapacity * sizeof(Method*));
+        if (prevStack != NULL)
+            self->sampleStack = prevStack;
+        if (scratch != NULL)
+            self->sampleScratch = scratch;
+        if (prevStack == NULL || scratch == NULL) {
+            ALOGW("threadid=%d: unable to grow sample stack to %d",
+                self->threadId, newCapacity);
+            return false;
+        }
+        self->sampleStackCapacity = newCapacity;
+    }
+
+    /* both arrays are innermost-first; match them up from the outside in */
+    const Method** curStack = self->sampleScratch;
+    const Method** prevStack = self->sampleStack;
+    int prevDepth = self->sampleStackDepth;
+    dvmFillStackTraceArray(fp, curStack, depth);
+
+    int common = 0;
+    while (common < depth && common < prevDepth &&
+           curStack[depth - 1 - common] == prevStack[prevDepth - 1 - common])
+    {
+        common++;
+    }
+
+    for (int i = 0; i < prevDepth - common; i++)
+        dvmMethodTraceAdd(self, prevStack[i], METHOD_TRACE_EXIT);
+    for (int i = depth - common - 1; i >= 0; i--)
+        dvmMethodTraceAdd(self, curStack[i], METHOD_TRACE_ENTER);
+
+    self->sampleStack = curStack;
+    self->sampleScratch = prevStack;
+    self->sampleStackDepth = depth;
+    return false;
+}
+
+/*
+ * Sampling profiler thread.  Every interval, ask each running thread to
+ * take a stack sample at its next safe point.  Threads that are waiting
+ * or in native code aren't executing bytecode, so they're left alone.
+ */
+static void* samplingThreadStart(void* arg)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    Thread* self = dvmThreadSelf();
+    s8 msec = state->samplingIntervalUs / 1000;
+    s4 nsec = (state->samplingIntervalUs % 1000) * 1000;
+
+    UNUSED_PARAMETER(arg);
+
+    /*
+     * This thread never touches managed objects, so stay in VMWAIT for
+     * the whole loop: a GC doesn't have to wait for the interval to run
+     * out, and we can't be suspended while holding samplingLock.
+     */
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+
+    dvmLockMutex(&state->samplingLock);
+    while (!state->haltSampler) {
+        dvmRelativeCondWait(&state->samplingCond, &state->samplingLock,
+            msec, nsec);
+        if (state->haltSampler)
+            break;
+
+        /* don't hold samplingLock while we wait for the thread list */
+        dvmUnlockMutex(&state->samplingLock);
+        dvmLockThreadList(self);
+        for (Thread* thread = gDvm.threadList; thread != NULL;
+             thread = thread->next)
+        {
+            if (thread == self || thread->status != THREAD_RUNNING)
+                continue;
+
+            /* leave other safe point users alone */
+            dvmTryArmSafePointCallback(thread, sampleThreadStack, NULL);
+        }
+        dvmUnlockThreadList();
+        dvmLockMutex(&state->samplingLock);
+    }
+    dvmUnlockMutex(&state->samplingLock);
+
+    dvmChangeStatus(self, oldStatus);
+    return NULL;
+}
+
+/*
+ * Shut down the sampling thread and disarm any samples that haven't
+ * been taken yet.
+ */
+static void stopSamplingThread()
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+
+    dvmLockMutex(&state->samplingLock);
+    state->haltSampler = true;
+    pthread_cond_signal(&state->samplingCond);
+    dvmUnlockMutex(&state->samplingLock);
+    pthread_join(state->samplingThreadHandle, NULL);
+
+    dvmChangeStatus(self, oldStatus);
+
+    dvmLockThreadList(self);
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        dvmDisarmSafePointCallback(thread, sampleThreadStack);
     }
     dvmUnlockThreadList();
 }
@@ -348,6 +576,261 @@ static void dumpMethodList(FILE* fp)
     dvmHashTableUnlock(gDvm.loadedClasses);
 }
 
+/*
+ * Set the "inProfile" flag on every method that appears in the records
+ * between "ptr" and "end".
+ */
+static void markTouchedRecords(const u1* ptr, const u1* end)
+{
+    size_t recordSize = gDvm.methodTrace.recordSize;
+
+    while (ptr < end) {
+        Method* method = (Method*) METHOD_ID(loadIntLE(ptr + 2));
+        method->inProfile = true;
+        ptr += recordSize;
+    }
+}
+
+/*
+ * Streaming trace writer thread.  Takes full chunks off the queue in the
+ * order they were filled, which keeps each thread's records in order, and
+ * appends them to the trace file.
+ *
+ * Unlike the buffered merge, this doesn't interleave the threads by
+ * timestamp: a chunk holds a run of one thread's records, so the file is
+ * ordered per thread but not overall.  Tools that rebuild each thread's
+ * call stack separately, as dmtracedump and traceview do, don't mind.
+ */
+static void* streamWriterThreadStart(void* arg)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    int fd = fileno(state->traceFile);
+
+    UNUSED_PARAMETER(arg);
+
+    dvmLockMutex(&state->streamLock);
+    while (true) {
+        while (state->numFullChunks == 0 && !state->haltStreamWriter)
+            dvmWaitCond(&state->streamCond, &state->streamLock);
+        if (state->numFullChunks == 0)
+            break;
+
+        int offset = state->fullChunks[state->fullHead];
+        state->fullHead = (state->fullHead + 1) % state->numChunks;
+        state->numFullChunks--;
+        dvmUnlockMutex(&state->streamLock);
+
+        /*
+         * The methods have to be marked now, since the records won't be
+         * around when we write the key.  After a write error we keep
+         * draining the queue so tracing threads don't stall.
+         */
+        const TraceChunkHeader* hdr =
+            (const TraceChunkHeader*) (state->buf + offset);
+        const u1* data = (const u1*) (hdr + 1);
+        markTouchedRecords(data, data + hdr->length);
+        if (state->streamError == 0) {
+            int err = sysWriteFully(fd, data, hdr->length, "Trace data");
+            if (err != 0)
+                state->streamError = err;
+            else
+                state->streamedBytes += hdr->length;
+        }
+
+        dvmLockMutex(&state->streamLock);
+        state->freeChunks[state->numFreeChunks++] = offset;
+        pthread_cond_broadcast(&state->chunkFreeCond);
+    }
+    dvmUnlockMutex(&state->streamLock);
+
+    return NULL;
+}
+
+/*
+ * Divide the trace buffer into chunks, write the file header, and start
+ * the writer thread.
+ *
+ * On failure, we throw an exception and return "false".
+ */
+static bool startStreamWriter()
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    int fd = fileno(state->traceFile);
+
+    state->numChunks = (state->bufferSize - TRACE_HEADER_LEN) / TRACE_CHUNK_SIZE;
+    state->freeChunks = (int*) malloc(state->numChunks * sizeof(int));
+    state->fullChunks = (int*) malloc(state->numChunks * sizeof(int));
+    if (state->freeChunks == NULL || state->fullChunks == NULL) {
+        dvmThrowInternalError("chunk list alloc failed");
+        goto fail;
+    }
+    for (int i = 0; i < state->numChunks; i++) {
+        state->freeChunks[i] =
+            TRACE_HEADER_LEN + (state->numChunks - 1 - i) * TRACE_CHUNK_SIZE;
+    }
+    state->numFreeChunks = state->numChunks;
+    state->fullHead = 0;
+    state->numFullChunks = 0;
+    state->haltStreamWriter = false;
+    state->streamedBytes = 0;
+    state->streamStart = lseek(fd, 0, SEEK_CUR);
+    state->streamError = 0;
+    state->droppedRecords = 0;
+
+    {
+        int err = sysWriteFully(fd, state->buf, TRACE_HEADER_LEN,
+            "Trace header");
+        if (err != 0) {
+            dvmThrowExceptionFmt(gDvm.exRuntimeException,
+                "Trace data write failed: %s", strerror(err));
+            goto fail;
+        }
+    }
+
+    if (!dvmCreateInternalThread(&state->streamThreadHandle,
+            "Trace Writer", streamWriterThreadStart, NULL))
+    {
+        dvmThrowInternalError("failed to start trace writer thread");
+        goto fail;
+    }
+    return true;
+
+fail:
+    free(state->freeChunks);
+    state->freeChunks = NULL;
+    free(state->fullChunks);
+    state->fullChunks = NULL;
+    return false;
+}
+
+/*
+ * Seal a thread's chunk and queue it for writing.  Empty chunks go straight
+ * back on the free list.  Caller must hold streamLock.
+ */
+static void queueTraceChunk(Thread* thread)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    TraceChunkHeader* hdr = (TraceChunkHeader*) thread->methodTraceChunk;
+    int offset = thread->methodTraceChunk - state->buf;
+
+    sealTraceChunk(thread);
+    if (hdr->length == 0) {
+        state->freeChunks[state->numFreeChunks++] = offset;
+    } else {
+        int tail = (state->fullHead + state->numFullChunks) % state->numChunks;
+        state->fullChunks[tail] = offset;
+        state->numFullChunks++;
+        pthread_cond_signal(&state->streamCond);
+    }
+}
+
+/*
+ * Stop the writer thread once everything that was traced has been
+ * written.
+ */
+static void stopStreamWriter()
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    Thread* self = dvmThreadSelf();
+
+    dvmLockThreadList(self);
+    dvmLockMutex(&state->streamLock);
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        if (currentTraceChunk(thread) != NULL)
+            queueTraceChunk(thread);
+    }
+    state->haltStreamWriter = true;
+    pthread_cond_signal(&state->streamCond);
+    dvmUnlockMutex(&state->streamLock);
+    dvmUnlockThreadList();
+
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    pthread_join(state->streamThreadHandle, NULL);
+    dvmChangeStatus(self, oldStatus);
+
+    free(state->freeChunks);
+    state->freeChunks = NULL;
+    free(state->fullChunks);
+    state->fullChunks = NULL;
+}
+
+/*
+ * The key has to come first in a .trace file, but when streaming we don't
+ * know what goes in it until the data has been written.  Slide the data,
+ * which starts at "dataStart" (where the file offset was when tracing
+ * started; a caller-supplied fd needn't be at 0), down to make room, and
+ * write the key in front of it.
+ *
+ * Returns 0 on success, or an errno value on failure.
+ */
+static int insertTraceKey(int fd, const char* key, size_t keyLen,
+    off_t dataStart, off_t dataLen)
+{
+    const size_t kBlockSize = 64 * 1024;
+    u1* block = (u1*) malloc(kBlockSize);
+    if (block == NULL)
+        return ENOMEM;
+
+    int err = 0;
+    off_t remaining = dataLen;
+    while (remaining > 0) {
+        size_t len = MIN((off_t) kBlockSize, remaining);
+        off_t from = dataStart + remaining - len;
+        if (pread(fd, block, len, from) != (ssize_t) len ||
+            pwrite(fd, block, len, from + keyLen) != (ssize_t) len)
+        {
+            err = (errno != 0) ? errno : EIO;
+            break;
+        }
+        remaining -= len;
+    }
+    if (err == 0 && pwrite(fd, key, keyLen, dataStart) != (ssize_t) keyLen)
+        err = (errno != 0) ? errno : EIO;
+
+    free(block);
+    return err;
+}
+
+/*
+ * Open the file for a streamed trace.  insertTraceKey reads the data back,
+ * so the file has to be a regular file open for reading as well as
+ * writing.  A caller-supplied fd is usually write-only, so it is reopened
+ * through /proc, at the same offset; the caller still owns "traceFd".
+ *
+ * Returns the new fd, or -1 with errno set.
+ */
+static int openStreamFd(const char* traceFileName, int traceFd)
+{
+    if (traceFd < 0)
+        return open(traceFileName, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+    struct stat sb;
+    if (fstat(traceFd, &sb) != 0)
+        return -1;
+    if (!S_ISREG(sb.st_mode)) {
+        errno = ESPIPE;
+        return -1;
+    }
+    off_t offset = lseek(traceFd, 0, SEEK_CUR);
+    if (offset < 0)
+        return -1;
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", traceFd);
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        return -1;
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
 /*
  * Start method tracing.  Method tracing is global to the VM (i.e. we
  * trace all threads).
@@ -359,11 +842,22 @@ static void dumpMethodList(FILE* fp)
  * On failure, we throw an exception and return.
  */
 void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
-    int flags, bool directToDdms)
+    int flags, bool directToDdms, bool samplingEnabled, int intervalUs)
 {
     MethodTraceState* state = &gDvm.methodTrace;
+    bool streaming = (flags & TRACE_STREAMING) != 0;
 
     assert(bufferSize > 0);
+    assert(!samplingEnabled || intervalUs > 0);
+
+    if (streaming && directToDdms) {
+        ALOGW("TRACE streaming isn't supported for DDMS; buffering instead");
+        streaming = false;
+    }
+    if (streaming) {
+        /* need enough chunks to keep tracing while the writer catches up */
+        bufferSize = MAX(bufferSize, TRACE_HEADER_LEN + 16 * TRACE_CHUNK_SIZE);
+    }
 
     dvmLockMutex(&state->startStopLock);
     while (state->traceEnabled != 0) {
@@ -372,7 +866,8 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
         dvmMethodTraceStop();
         dvmLockMutex(&state->startStopLock);
     }
-    ALOGI("TRACE STARTED: '%s' %dKB", traceFileName, bufferSize / 1024);
+    ALOGI("TRACE STARTED: '%s' %dKB%s%s", traceFileName, bufferSize / 1024,
+        samplingEnabled ? " (sampling)" : "", streaming ? " (streaming)" : "");
 
     /*
      * Allocate storage and open files.
@@ -385,21 +880,40 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
         dvmThrowInternalError("buffer alloc failed");
         goto fail;
     }
-    if (!directToDdms) {
-        if (traceFd < 0) {
-            state->traceFile = fopen(traceFileName, "w");
-        } else {
-            state->traceFile = fdopen(traceFd, "w");
-        }
-        if (state->traceFile == NULL) {
+    if (!directToDdms && streaming) {
+        int fd = openStreamFd(traceFileName, traceFd);
+        if (fd < 0) {
             int err = errno;
-            ALOGE("Unable to open trace file '%s': %s",
+            ALOGE("Unable to open trace file '%s' for streaming: %s",
                 traceFileName, strerror(err));
             dvmThrowExceptionFmt(gDvm.exRuntimeException,
-                "Unable to open trace file '%s': %s",
+                "Streaming trace output needs a regular file that can be "
+                "opened for reading and writing; '%s': %s",
                 traceFileName, strerror(err));
             goto fail;
         }
+        if (traceFd >= 0) {
+            close(traceFd);
+            traceFd = -1;
+        }
+        state->traceFile = fdopen(fd, "w+");
+        if (state->traceFile == NULL)
+            close(fd);
+    } else if (!directToDdms) {
+        if (traceFd < 0) {
+            state->traceFile = fopen(traceFileName, "w");
+        } else {
+            state->traceFile = fdopen(traceFd, "w");
+        }
+    }
+    if (!directToDdms && state->traceFile == NULL) {
+        int err = errno;
+        ALOGE("Unable to open trace file '%s': %s",
+            traceFileName, strerror(err));
+        dvmThrowExceptionFmt(gDvm.exRuntimeException,
+            "Unable to open trace file '%s': %s",
+            traceFileName, strerror(err));
+        goto fail;
     }
     traceFd = -1;
     memset(state->buf, (char)FILL_PATTERN, bufferSize);
@@ -407,6 +921,10 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     state->directToDdms = directToDdms;
     state->bufferSize = bufferSize;
     state->overflow = false;
+    state->samplingEnabled = samplingEnabled;
+    state->samplingIntervalUs = intervalUs;
+    state->haltSampler = false;
+    state->streaming = streaming;
 
     /*
      * Enable alloc counts if we've been requested to do so.
@@ -440,6 +958,10 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
         storeShortLE(state->buf + 16, state->recordSize);
     }
     state->curOffset = TRACE_HEADER_LEN;
+    state->traceGeneration++;
+
+    if (streaming && !startStreamWriter())
+        goto fail;
 
     /*
      * Set the "enabled" flag.  Once we do this, threads will wait to be
@@ -448,11 +970,26 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     android_atomic_release_store(true, &state->traceEnabled);
 
     /*
-     * ENHANCEMENT: To trace just a single thread, modify the
-     * following to take a Thread* argument, and set the appropriate
-     * interpBreak flags only on the target thread.
+     * In sampling mode the interpreter and JIT run undisturbed, so we
+     * don't count as an active profiler.
      */
-    updateActiveProfilers(kSubModeMethodTrace, true);
+    if (samplingEnabled) {
+        if (!dvmCreateInternalThread(&state->samplingThreadHandle,
+                "Sampling Profiler", samplingThreadStart, NULL))
+        {
+            android_atomic_release_store(false, &state->traceEnabled);
+            dvmBroadcastCond(&state->threadExitCond);
+            dvmThrowInternalError("failed to start sampling thread");
+            goto fail;
+        }
+    } else {
+        /*
+         * ENHANCEMENT: To trace just a single thread, modify the
+         * following to take a Thread* argument, and set the appropriate
+         * interpBreak flags only on the target thread.
+         */
+        updateActiveProfilers(kSubModeMethodTrace, true);
+    }
 
     dvmUnlockMutex(&state->startStopLock);
     return;
@@ -477,20 +1014,209 @@ fail:
  */
 static void markTouchedMethods(int endOffset)
 {
-    u1* ptr = gDvm.methodTrace.buf + TRACE_HEADER_LEN;
-    u1* end = gDvm.methodTrace.buf + endOffset;
-    size_t recordSize = gDvm.methodTrace.recordSize;
-    unsigned int methodVal;
-    Method* method;
+    markTouchedRecords(gDvm.methodTrace.buf + TRACE_HEADER_LEN,
+        gDvm.methodTrace.buf + endOffset);
+}
 
-    while (ptr < end) {
-        methodVal = ptr[2] | (ptr[3] << 8) | (ptr[4] << 16)
-                    | (ptr[5] << 24);
-        method = (Method*) METHOD_ID(methodVal);
+/*
+ * Position in one thread's sequence of chunks, used while merging.
+ */
+struct TraceCursor {
+    const u1*   ptr;            /* next record, or NULL when done */
+    const u1*   end;            /* end of the current chunk's records */
+    int         nextOffset;     /* offset of the following chunk, or 0 */
+    int         endOffset;      /* end of the data in the trace buffer */
+};
 
-        method->inProfile = true;
-        ptr += recordSize;
+/*
+ * Returns the header of the chunk at "offset" if it's a published chunk
+ * of the given kind that fits in the first "endOffset" bytes of the trace
+ * buffer, or NULL if it isn't.
+ *
+ * A thread may have claimed a chunk without having written its header, or
+ * may have been stopped part way through updating it, so we don't trust
+ * anything we find here.  Chunks are handed out in increasing order, so
+ * insisting that "nextOffset" moves forward also keeps us out of loops.
+ */
+static const TraceChunkHeader* getTraceChunk(int offset, int endOffset,
+    u2 kind)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    if (offset < TRACE_HEADER_LEN || offset >= endOffset ||
+        (offset - TRACE_HEADER_LEN) % TRACE_CHUNK_SIZE != 0)
+    {
+        return NULL;
+    }
+
+    const TraceChunkHeader* hdr =
+        (const TraceChunkHeader*) (state->buf + offset);
+    int capacity = MIN(offset + TRACE_CHUNK_SIZE, endOffset) - offset -
+        (int) sizeof(TraceChunkHeader);
+    if (hdr->kind != kind || hdr->length > capacity ||
+        hdr->length % state->recordSize != 0 ||
+        (hdr->nextOffset != 0 && hdr->nextOffset <= offset))
+    {
+        return NULL;
+    }
+    return hdr;
+}
+
+/*
+ * Point the cursor at the first record of the chunk at "offset", which
+ * must be of the given kind, skipping over empty chunks.  The cursor is
+ * done if the list ends or runs into a chunk that isn't valid.
+ */
+static void setTraceCursor(TraceCursor* cursor, int offset, u2 kind)
+{
+    while (offset != 0) {
+        const TraceChunkHeader* hdr =
+            getTraceChunk(offset, cursor->endOffset, kind);
+        if (hdr == NULL)
+            break;
+        if (hdr->length != 0) {
+            cursor->ptr = (const u1*) (hdr + 1);
+            cursor->end = cursor->ptr + hdr->length;
+            cursor->nextOffset = hdr->nextOffset;
+            return;
+        }
+        offset = hdr->nextOffset;
+        kind = kTraceChunkNext;
+    }
+    cursor->ptr = NULL;
+}
+
+static void advanceTraceCursor(TraceCursor* cursor, size_t recordSize)
+{
+    cursor->ptr += recordSize;
+    if (cursor->ptr >= cursor->end)
+        setTraceCursor(cursor, cursor->nextOffset, kTraceChunkNext);
+}
+
+/*
+ * Entry in the heap of cursors used while merging.  Ties on the time go
+ * to the cursor found first, so without wall-clock times each thread's
+ * records are emitted in one run.
+ */
+struct TraceHeapEntry {
+    u4          when;           /* time of the cursor's next record */
+    size_t      index;          /* cursor's position in the cursor list */
+};
+
+static inline u4 getTraceCursorTime(const TraceCursor* cursor,
+    size_t recordSize, bool haveWallClock)
+{
+    return haveWallClock ? loadIntLE(cursor->ptr + recordSize - 4) : 0;
+}
+
+static inline bool traceHeapLess(const TraceHeapEntry* a,
+    const TraceHeapEntry* b)
+{
+    return a->when < b->when || (a->when == b->when && a->index < b->index);
+}
+
+/*
+ * Move the entry at "pos" down the "count"-entry heap until neither of
+ * its children comes before it.
+ */
+static void siftDownTraceHeap(TraceHeapEntry* heap, size_t count, size_t pos)
+{
+    TraceHeapEntry entry = heap[pos];
+    while (true) {
+        size_t child = pos * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && traceHeapLess(&heap[child + 1], &heap[child]))
+            child++;
+        if (!traceHeapLess(&heap[child], &entry))
+            break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = entry;
+}
+
+/*
+ * Merge the per-thread chunks in the trace buffer, which hold data up to
+ * "endOffset", into a newly-allocated buffer in file format (header
+ * included).  The length of the result is stored in "*pLength".
+ *
+ * Each list of chunks starts with one marked kTraceChunkFirst; we don't
+ * go by thread ID, since IDs are reused when threads come and go.  Only
+ * the records we can reach by following the lists are counted and copied.
+ *
+ * Each thread's records stay in the order they were written.  If we're
+ * recording wall-clock time we interleave the threads by timestamp;
+ * otherwise the times aren't comparable and we just emit them one thread
+ * after another.
+ */
+static u1* mergeTraceChunks(int endOffset, int* pLength)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    size_t recordSize = state->recordSize;
+    bool haveWallClock = useWallClock();
+    std::vector<TraceCursor> cursors;
+    int length = TRACE_HEADER_LEN;
+
+    for (int offset = TRACE_HEADER_LEN; offset < endOffset;
+         offset += TRACE_CHUNK_SIZE)
+    {
+        TraceCursor cursor;
+        cursor.endOffset = endOffset;
+        setTraceCursor(&cursor, offset, kTraceChunkFirst);
+        if (cursor.ptr == NULL)
+            continue;
+        cursors.push_back(cursor);
+
+        /* walk a copy to count what the merge below will copy */
+        while (cursor.ptr != NULL) {
+            length += cursor.end - cursor.ptr;
+            cursor.ptr = cursor.end;
+            advanceTraceCursor(&cursor, 0);
+        }
+    }
+
+    u1* merged = (u1*) malloc(length);
+    if (merged == NULL) {
+        /* not expected */
+        ALOGE("Unable to allocate %d bytes for merged trace", length);
+        dvmAbort();
+    }
+    memcpy(merged, state->buf, TRACE_HEADER_LEN);
+
+    /* min-heap of the live cursors, keyed on their next record's time */
+    std::vector<TraceHeapEntry> heap;
+    for (size_t i = 0; i < cursors.size(); i++) {
+        TraceHeapEntry entry;
+        entry.when = getTraceCursorTime(&cursors[i], recordSize,
+            haveWallClock);
+        entry.index = i;
+        heap.push_back(entry);
+    }
+    for (size_t i = heap.size() / 2; i > 0; i--)
+        siftDownTraceHeap(&heap[0], heap.size(), i - 1);
+
+    u1* outPtr = merged + TRACE_HEADER_LEN;
+    while (!heap.empty()) {
+        TraceCursor* best = &cursors[heap[0].index];
+        memcpy(outPtr, best->ptr, recordSize);
+        outPtr += recordSize;
+        advanceTraceCursor(best, recordSize);
+
+        if (best->ptr == NULL) {
+            heap[0] = heap.back();
+            heap.pop_back();
+        } else {
+            heap[0].when = getTraceCursorTime(best, recordSize,
+                haveWallClock);
+        }
+        if (!heap.empty())
+            siftDownTraceHeap(&heap[0], heap.size(), 0);
     }
+    assert(outPtr == merged + length);
+
+    *pLength = length;
+    return merged;
 }
 
 /*
@@ -564,6 +1290,8 @@ void dvmMethodTraceStop()
         ALOGD("TRACE stop requested, but not running");
         dvmUnlockMutex(&state->startStopLock);
         return;
+    } else if (state->samplingEnabled) {
+        stopSamplingThread();
     } else {
         updateActiveProfilers(kSubModeMethodTrace, false);
     }
@@ -586,42 +1314,51 @@ void dvmMethodTraceStop()
     if ((state->flags & TRACE_ALLOC_COUNTS) != 0)
         dvmStopAllocCounting();
 
+    size_t recordSize = state->recordSize;
+    int finalCurOffset;
+    s8 numRecords;
+    if (state->streaming) {
+        /*
+         * The writer has been appending the data to the file as we went.
+         * Hand it what's left and wait for it to finish.
+         */
+        stopStreamWriter();
+        finalCurOffset = TRACE_HEADER_LEN;
+        numRecords = state->streamedBytes / recordSize;
+    } else {
+        /*
+         * Every thread's records are in its own chunks.  Seal them, then
+         * merge them into a single stream in file format.  This replaces
+         * state->buf.
+         */
+        flushThreadTraceChunks();
+        u1* mergedBuf = mergeTraceChunks(state->curOffset, &finalCurOffset);
+        free(state->buf);
+        state->buf = mergedBuf;
+        numRecords = (finalCurOffset - TRACE_HEADER_LEN) / recordSize;
+    }
+
     /*
-     * It's possible under some circumstances for a thread to have advanced
-     * the data pointer but not written the method value.  It's possible
-     * (though less likely) for the data pointer to be advanced, or partial
-     * data written, while we're doing work here.
-     *
-     * To avoid seeing partially-written data, we grab state->curOffset here,
-     * and use our local copy from here on.  We then scan through what's
-     * already written.  If we see the fill pattern in what should be the
-     * method pointer, we cut things off early.  (If we don't, we'll fail
-     * when we dereference the pointer.)
-     *
-     * There's a theoretical possibility of interrupting another thread
-     * after it has partially written the method pointer, in which case
-     * we'll likely crash when we dereference it.  The possibility of
-     * this actually happening should be at or near zero.  Fixing it
-     * completely could be done by writing the thread number last and
-     * using a sentinel value to indicate a partially-written record,
-     * but that requires memory barriers.
+     * It's possible under some circumstances for a thread to have been
+     * interrupted while writing a record, though with per-thread chunks
+     * the odds of seeing that at this point are at or near zero.  If we
+     * see the fill pattern in what should be the method pointer, we cut
+     * things off early.  (If we don't, we'll fail when we dereference the
+     * pointer.)
      */
-    int finalCurOffset = state->curOffset;
-
-    size_t recordSize = state->recordSize;
     if (finalCurOffset > TRACE_HEADER_LEN) {
         u4 fillVal = METHOD_ID(FILL_PATTERN);
         u1* scanPtr = state->buf + TRACE_HEADER_LEN;
 
         while (scanPtr < state->buf + finalCurOffset) {
-            u4 methodVal = scanPtr[2] | (scanPtr[3] << 8) | (scanPtr[4] << 16)
-                        | (scanPtr[5] << 24);
+            u4 methodVal = loadIntLE(scanPtr + 2);
             if (METHOD_ID(methodVal) == fillVal) {
                 u1* scanBase = state->buf + TRACE_HEADER_LEN;
                 ALOGW("Found unfilled record at %d (of %d)",
                     (scanPtr - scanBase) / recordSize,
                     (finalCurOffset - TRACE_HEADER_LEN) / recordSize);
                 finalCurOffset = scanPtr - state->buf;
+                numRecords = (finalCurOffset - TRACE_HEADER_LEN) / recordSize;
                 break;
             }
 
@@ -629,9 +1366,12 @@ void dvmMethodTraceStop()
         }
     }
 
-    ALOGI("TRACE STOPPED%s: writing %d records",
-        state->overflow ? " (NOTE: overflowed buffer)" : "",
-        (finalCurOffset - TRACE_HEADER_LEN) / recordSize);
+    ALOGI("TRACE STOPPED%s: writing %lld records",
+        state->overflow ? " (NOTE: overflowed buffer)" : "", numRecords);
+    if (state->streaming && state->droppedRecords != 0) {
+        ALOGW("TRACE dropped %d records while the writer caught up",
+            state->droppedRecords);
+    }
     if (gDvm.debuggerActive) {
         ALOGW("WARNING: a debugger is active; method-tracing results "
              "will be skewed");
@@ -642,12 +1382,19 @@ void dvmMethodTraceStop()
      */
     u4 clockNsec = getClockOverhead();
 
+    /* when streaming this is a no-op; the writer marked them as it went */
     markTouchedMethods(finalCurOffset);
 
+    /*
+     * When streaming, the data is already in the file, so we build the
+     * key in memory and slot it in ahead of the data afterward.
+     */
     char* memStreamPtr;
     size_t memStreamSize;
-    if (state->directToDdms) {
-        assert(state->traceFile == NULL);
+    FILE* streamFile = NULL;
+    if (state->directToDdms || state->streaming) {
+        assert(state->directToDdms == (state->traceFile == NULL));
+        streamFile = state->traceFile;
         state->traceFile = open_memstream(&memStreamPtr, &memStreamSize);
         if (state->traceFile == NULL) {
             /* not expected */
@@ -671,8 +1418,7 @@ void dvmMethodTraceStop()
         fprintf(state->traceFile, "clock=wall\n");
     }
     fprintf(state->traceFile, "elapsed-time-usec=%llu\n", elapsed);
-    fprintf(state->traceFile, "num-method-calls=%d\n",
-        (finalCurOffset - TRACE_HEADER_LEN) / state->recordSize);
+    fprintf(state->traceFile, "num-method-calls=%lld\n", numRecords);
     fprintf(state->traceFile, "clock-call-overhead-nsec=%d\n", clockNsec);
     fprintf(state->traceFile, "vm=dalvik\n");
     if ((state->flags & TRACE_ALLOC_COUNTS) != 0) {
@@ -702,6 +1448,20 @@ void dvmMethodTraceStop()
         iov[1].iov_base = state->buf;
         iov[1].iov_len = finalCurOffset;
         dvmDbgDdmSendChunkV(CHUNK_TYPE("MPSE"), iov, 2);
+    } else if (state->streaming) {
+        fflush(state->traceFile);
+
+        int err = state->streamError;
+        if (err == 0) {
+            err = insertTraceKey(fileno(streamFile), memStreamPtr,
+                memStreamSize, state->streamStart,
+                TRACE_HEADER_LEN + state->streamedBytes);
+        }
+        if (err != 0) {
+            ALOGE("trace streaming failed: %s", strerror(err));
+            dvmThrowExceptionFmt(gDvm.exRuntimeException,
+                "Trace data write failed: %s", strerror(err));
+        }
     } else {
         /* append the profiling data */
         if (fwrite(state->buf, finalCurOffset, 1, state->traceFile) != 1) {
@@ -718,6 +1478,10 @@ void dvmMethodTraceStop()
     state->buf = NULL;
     fclose(state->traceFile);
     state->traceFile = NULL;
+    if (streamFile != NULL) {
+        free(memStreamPtr);
+        fclose(streamFile);
+    }
 
     /* wake any threads that were waiting for profiling to complete */
     dvmBroadcastCond(&state->threadExitCond);
@@ -725,16 +1489,127 @@ void dvmMethodTraceStop()
 }
 
 /*
- * We just did something with a method.  Emit a record.
+ * Streaming version of allocTraceChunk.  Hand our chunk to the writer and
+ * take a free one.  If the writer can't keep up we wait a little while for
+ * it, then give up and count the record as dropped.  Once we've dropped
+ * anything we stop waiting, so a stalled writer can't stall the app too.
+ */
+static bool allocStreamingTraceChunk(Thread* self)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    if (!state->traceEnabled)
+        return false;
+
+    dvmLockMutex(&state->streamLock);
+    if (self->methodTraceChunk != NULL) {
+        queueTraceChunk(self);
+        self->methodTraceChunk = NULL;
+    }
+    if (state->numFreeChunks == 0 && !state->overflow) {
+        /*
+         * Don't hold up a GC while we wait.  Drop the lock to change
+         * status, so we never block on a suspension while holding it.
+         */
+        dvmUnlockMutex(&state->streamLock);
+        ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        dvmLockMutex(&state->streamLock);
+        if (state->numFreeChunks == 0) {
+            dvmRelativeCondWait(&state->chunkFreeCond, &state->streamLock,
+                100, 0);
+        }
+        dvmUnlockMutex(&state->streamLock);
+        dvmChangeStatus(self, oldStatus);
+        dvmLockMutex(&state->streamLock);
+    }
+    if (state->numFreeChunks == 0) {
+        dvmUnlockMutex(&state->streamLock);
+        state->overflow = true;
+        android_atomic_inc(&state->droppedRecords);
+        return false;
+    }
+    int offset = state->freeChunks[--state->numFreeChunks];
+    dvmUnlockMutex(&state->streamLock);
+
+    TraceChunkHeader* hdr = (TraceChunkHeader*) (state->buf + offset);
+    hdr->kind = kTraceChunkFirst;
+    hdr->length = 0;
+    hdr->nextOffset = 0;
+
+    int avail = TRACE_CHUNK_SIZE - sizeof(TraceChunkHeader);
+    self->methodTraceChunk = state->buf + offset;
+    self->methodTraceChunkUsed = 0;
+    self->methodTraceChunkSize = avail - avail % state->recordSize;
+    return true;
+}
+
+/*
+ * Give the thread a fresh chunk of the trace buffer, sealing its current
+ * one.  Returns "false" if the buffer is full.
  *
  * Multiple threads may be banging on this all at once.  We use atomic ops
  * rather than mutexes for speed.
  */
+static bool allocTraceChunk(Thread* self)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    int minSize = sizeof(TraceChunkHeader) + state->recordSize;
+    int oldOffset, newOffset;
+
+    /* tracing is being stopped; the buffer is about to go away */
+    if (!state->traceEnabled)
+        return false;
+
+    if (state->streaming)
+        return allocStreamingTraceChunk(self);
+
+    /*
+     * Advance "curOffset" atomically.  The last chunk may be short.
+     */
+    do {
+        oldOffset = state->curOffset;
+        newOffset = MIN(oldOffset + TRACE_CHUNK_SIZE, state->bufferSize);
+        if (newOffset - oldOffset < minSize) {
+            state->overflow = true;
+            return false;
+        }
+    } while (android_atomic_release_cas(oldOffset, newOffset,
+            &state->curOffset) != 0);
+
+    /*
+     * Write the new header, then publish it by setting its kind, and only
+     * then link it to the previous chunk, so that the merge never follows
+     * a link to a header that isn't there yet.
+     */
+    TraceChunkHeader* hdr = (TraceChunkHeader*) (state->buf + oldOffset);
+    hdr->length = 0;
+    hdr->nextOffset = 0;
+    ANDROID_MEMBAR_STORE();
+    hdr->kind = (self->methodTraceChunk != NULL) ?
+        kTraceChunkNext : kTraceChunkFirst;
+
+    if (self->methodTraceChunk != NULL) {
+        TraceChunkHeader* prevHdr = (TraceChunkHeader*) self->methodTraceChunk;
+        prevHdr->length = self->methodTraceChunkUsed;
+        ANDROID_MEMBAR_STORE();
+        prevHdr->nextOffset = oldOffset;
+    }
+
+    int avail = newOffset - oldOffset - sizeof(TraceChunkHeader);
+    self->methodTraceChunk = state->buf + oldOffset;
+    self->methodTraceChunkUsed = 0;
+    self->methodTraceChunkSize = avail - avail % state->recordSize;
+    return true;
+}
+
+/*
+ * We just did something with a method.  Emit a record into the thread's
+ * chunk of the trace buffer.
+ */
 void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
 {
     MethodTraceState* state = &gDvm.methodTrace;
     u4 methodVal;
-    int oldOffset, newOffset;
     u1* ptr;
 
     assert(method != NULL);
@@ -754,27 +1629,29 @@ void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
     }
 #endif
 
-    /*
-     * Advance "curOffset" atomically.
-     */
-    do {
-        oldOffset = state->curOffset;
-        newOffset = oldOffset + state->recordSize;
-        if (newOffset > state->bufferSize) {
-            state->overflow = true;
+    if (self->methodTraceGeneration != state->traceGeneration) {
+        /* our chunk, if any, was in the buffer of an earlier trace */
+        self->methodTraceChunk = NULL;
+        self->methodTraceGeneration = state->traceGeneration;
+    }
+
+    if (self->methodTraceChunk == NULL ||
+        self->methodTraceChunkUsed + (int) state->recordSize >
+            self->methodTraceChunkSize)
+    {
+        if (!allocTraceChunk(self))
             return;
-        }
-    } while (android_atomic_release_cas(oldOffset, newOffset,
-            &state->curOffset) != 0);
+    }
 
     //assert(METHOD_ACTION((u4) method) == 0);
 
     methodVal = METHOD_COMBINE((u4) method, action);
 
     /*
-     * Write data into "oldOffset".
+     * Write data at the end of our chunk.
      */
-    ptr = state->buf + oldOffset;
+    ptr = self->methodTraceChunk + sizeof(TraceChunkHeader) +
+        self->methodTraceChunkUsed;
     *ptr++ = (u1) self->threadId;
     *ptr++ = (u1) (self->threadId >> 8);
     *ptr++ = (u1) methodVal;
@@ -799,6 +1676,8 @@ void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
         *ptr++ = (u1) (wallClockDiff >> 16);
         *ptr++ = (u1) (wallClockDiff >> 24);
     }
+
+    self->methodTraceChunkUsed += state->recordSize;
 }
 
 
@@ -991,11 +1870,13 @@ void dvmStopInstructionCounting()
 
 /*
  * Start alloc counting.  Note this doesn't affect the "active profilers"
- * count, since the interpreter loop is not involved.
+ * count, since the interpreter loop is not involved.  Compiled code has
+ * to stop allocating from its caches, though, or we'd miss its objects.
  */
 void dvmStartAllocCounting()
 {
     gDvm.allocProf.enabled = true;
+    dvmEmptyAllocCaches();
 }
 
 /*
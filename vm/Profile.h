@@ -32,8 +32,9 @@ bool dvmProfilingStartup(void);
 void dvmProfilingShutdown(void);
 
 /*
- * Method trace state.  This is currently global.  In theory we could make
- * most of this per-thread.
+ * Method trace state.  This is global, but each thread appends records to
+ * its own chunk of "buf" (see Thread.methodTraceChunk), so "curOffset"
+ * only advances when a thread needs a new chunk.
  */
 struct MethodTraceState {
     /* active state */
@@ -47,11 +48,42 @@ struct MethodTraceState {
     int     traceEnabled;
     u1*     buf;
     volatile int curOffset;
+    int     traceGeneration;    // bumped by each start; see Thread
     u8      startWhen;
     int     overflow;
 
     int     traceVersion;
     size_t  recordSize;
+
+    /* sampling profiler state; only used when samplingEnabled is set */
+    bool    samplingEnabled;
+    int     samplingIntervalUs;
+    pthread_t samplingThreadHandle;
+    pthread_mutex_t samplingLock;
+    pthread_cond_t  samplingCond;
+    bool    haltSampler;
+
+    /*
+     * Streaming state; only used when "streaming" is set.  The buffer is
+     * treated as a pool of chunks that a writer thread drains to the file
+     * while tracing continues.
+     */
+    bool    streaming;
+    pthread_t streamThreadHandle;
+    pthread_mutex_t streamLock;
+    pthread_cond_t  streamCond;         // writer waits for full chunks
+    pthread_cond_t  chunkFreeCond;      // tracers wait for free chunks
+    int*    freeChunks;                 // stack of free chunk offsets
+    int     numFreeChunks;
+    int*    fullChunks;                 // FIFO of chunks to write
+    int     fullHead;
+    int     numFullChunks;
+    int     numChunks;
+    bool    haltStreamWriter;
+    s8      streamedBytes;              // record data written so far
+    off_t   streamStart;                // file offset of the trace header
+    int     streamError;                // errno from a failed write, or 0
+    volatile int droppedRecords;
 };
 
 /*
@@ -81,9 +113,13 @@ struct AllocProfState {
 
 /*
  * Start/stop method tracing.
+ *
+ * If "samplingEnabled" is set, methods are not instrumented; instead every
+ * running thread records its stack each "intervalUs" microseconds and the
+ * differences between successive samples are written as enter/exit records.
  */
 void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
-        int flags, bool directToDdms);
+        int flags, bool directToDdms, bool samplingEnabled, int intervalUs);
 bool dvmIsMethodTraceActive(void);
 void dvmMethodTraceStop(void);
 
@@ -105,6 +141,7 @@ void dvmStopInstructionCounting();
  */
 enum {
     TRACE_ALLOC_COUNTS      = 0x01,
+    TRACE_STREAMING         = 0x02,     // write to a regular file while tracing
 };
 
 /*
@@ -121,6 +121,8 @@ static void logThreadStacks(FILE* fp)
     printProcessName(&target);
     dvmPrintDebugMessage(&target, "\n");
     dvmDumpAllThreadsEx(&target, true);
+    dvmDumpSafepointStats(&target);
+    dvmDumpThreadPoolStats(&target);
     fprintf(fp, "----- end %d -----\n", pid);
 }
 
@@ -152,6 +154,8 @@ static void handleSigQuit()
         DebugOutputTarget target;
         dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
         dvmDumpAllThreadsEx(&target, true);
+        dvmDumpSafepointStats(&target);
+        dvmDumpThreadPoolStats(&target);
     } else {
         /* write to memory buffer */
         FILE* memfp = open_memstream(&traceBuf, &traceLen);
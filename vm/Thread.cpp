@@ -235,6 +235,7 @@ static bool prepareThread(Thread* thread);
 static void setThreadSelf(Thread* thread);
 static void unlinkThread(Thread* thread);
 static void freeThread(Thread* thread);
+static void destroyThread(Thread* thread);
 static void assignThreadId(Thread* thread);
 static bool createFakeEntryFrame(Thread* thread);
 static bool createFakeRunFrame(Thread* thread);
@@ -269,6 +270,7 @@ bool dvmThreadStartup()
     pthread_cond_init(&gDvm.vmExitCond, NULL);
     dvmInitMutex(&gDvm._threadSuspendLock);
     dvmInitMutex(&gDvm.threadSuspendCountLock);
+    dvmInitMutex(&gDvm.threadPoolLock);
     pthread_cond_init(&gDvm.threadSuspendCountCond, NULL);
 
     /*
@@ -280,7 +282,11 @@ bool dvmThreadStartup()
      */
     gDvm.threadSleepMon = dvmCreateMonitor(NULL);
 
-    gDvm.threadIdMap = dvmAllocBitVector(kMaxThreadId, false);
+    gDvm.threadIdFreeHead = 0;
+    gDvm.threadIdHighWater = 0;
+    gDvm.threadIdNext = (u2*) calloc(kMaxThreadId + 1, sizeof(u2));
+    if (gDvm.threadIdNext == NULL)
+        return false;
 
     thread = allocThread(gDvm.mainThreadStackSize);
     if (thread == NULL)
@@ -319,7 +325,17 @@ void dvmThreadShutdown()
         gDvm.threadList = NULL;
     }
 
-    dvmFreeBitVector(gDvm.threadIdMap);
+    free(gDvm.threadIdNext);
+    gDvm.threadIdNext = NULL;
+
+    /* drain the Thread pool; nobody can be allocating threads now */
+    while (gDvm.threadPool != NULL) {
+        Thread* pooled = gDvm.threadPool;
+        gDvm.threadPool = pooled->next;
+        pooled->next = NULL;
+        destroyThread(pooled);
+    }
+    gDvm.threadPoolCount = 0;
 
     dvmFreeMonitorList();
 
@@ -424,6 +440,7 @@ static const char* getSuspendCauseStr(SuspendCause why)
     case SUSPEND_FOR_DEBUG:         return "debug";
     case SUSPEND_FOR_DEBUG_EVENT:   return "debug-event";
     case SUSPEND_FOR_STACK_DUMP:    return "stack-dump";
+    case SUSPEND_FOR_DEX_OPT:       return "dex-opt";
     case SUSPEND_FOR_VERIFY:        return "verify";
     case SUSPEND_FOR_HPROF:         return "hprof";
 #if defined(WITH_JIT)
@@ -797,19 +814,91 @@ bool dvmPrepMainThread()
 }
 
 
+/*
+ * Take a Thread with a matching interpreter stack size out of the pool.
+ * Everything but the interpreter stack and the JNI local reference table
+ * storage is zeroed, as if it had just come from calloc().
+ *
+ * Returns NULL if there's nothing suitable.
+ */
+static Thread* takePooledThread(int interpStackSize)
+{
+    Thread* thread;
+
+    dvmLockMutex(&gDvm.threadPoolLock);
+    Thread** link = &gDvm.threadPool;
+    while (*link != NULL && (*link)->interpStackSize != interpStackSize)
+        link = &(*link)->next;
+    thread = *link;
+    if (thread != NULL) {
+        *link = thread->next;
+        gDvm.threadPoolCount--;
+    }
+    dvmUnlockMutex(&gDvm.threadPoolLock);
+
+    if (thread == NULL)
+        return NULL;
+
+    u1* interpStackStart = thread->interpStackStart;
+    IndirectRefTable jniLocalRefTable = thread->jniLocalRefTable;
+    memset((void*) thread, 0, sizeof(Thread));
+    thread->interpStackStart = interpStackStart;
+    thread->interpStackSize = interpStackSize;
+    thread->jniLocalRefTable = jniLocalRefTable;
+
+    return thread;
+}
+
+/*
+ * Allocate and initialize the interpreted code stack.  We essentially
+ * "lose" the alloc pointer, which points at the bottom of the stack,
+ * but we can get it back later because we know how big the stack is.
+ *
+ * The stack must be aligned on a 4-byte boundary.
+ *
+ * Returns NULL on failure.
+ */
+static u1* allocInterpStack(int interpStackSize)
+{
+    u1* stackBottom;
+
+#ifdef MALLOC_INTERP_STACK
+    stackBottom = (u1*) malloc(interpStackSize);
+    if (stackBottom == NULL)
+        return NULL;
+    memset(stackBottom, 0xc5, interpStackSize);     // stop valgrind complaints
+#else
+    stackBottom = (u1*) mmap(NULL, interpStackSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (stackBottom == MAP_FAILED)
+        return NULL;
+#endif
+
+    return stackBottom;
+}
+
 /*
  * Alloc and initialize a Thread struct.
  *
  * Does not create any objects, just stuff on the system (malloc) heap.
+ * Recycles a pooled Thread and interpreter stack when one is available.
  */
 static Thread* allocThread(int interpStackSize)
 {
     Thread* thread;
     u1* stackBottom;
+    u8 startWhen = dvmGetRelativeTimeNsec();
+    bool pooled;
 
-    thread = (Thread*) calloc(1, sizeof(Thread));
-    if (thread == NULL)
-        return NULL;
+    assert(interpStackSize >= kMinStackSize && interpStackSize <=kMaxStackSize);
+
+    thread = takePooledThread(interpStackSize);
+    pooled = (thread != NULL);
+    if (!pooled) {
+        thread = (Thread*) calloc(1, sizeof(Thread));
+        if (thread == NULL)
+            return NULL;
+    }
 
     /* Check sizes and alignment */
     assert((((uintptr_t)&thread->interpBreak.all) & 0x7) == 0);
@@ -821,38 +910,20 @@ static Thread* allocThread(int interpStackSize)
         return NULL;
 #endif
 
-    assert(interpStackSize >= kMinStackSize && interpStackSize <=kMaxStackSize);
-
     thread->status = THREAD_INITIALIZING;
 
-    /*
-     * Allocate and initialize the interpreted code stack.  We essentially
-     * "lose" the alloc pointer, which points at the bottom of the stack,
-     * but we can get it back later because we know how big the stack is.
-     *
-     * The stack must be aligned on a 4-byte boundary.
-     */
-#ifdef MALLOC_INTERP_STACK
-    stackBottom = (u1*) malloc(interpStackSize);
-    if (stackBottom == NULL) {
-#if defined(WITH_SELF_VERIFICATION)
-        dvmSelfVerificationShadowSpaceFree(thread);
-#endif
-        free(thread);
-        return NULL;
-    }
-    memset(stackBottom, 0xc5, interpStackSize);     // stop valgrind complaints
-#else
-    stackBottom = (u1*) mmap(NULL, interpStackSize, PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (stackBottom == MAP_FAILED) {
+    if (pooled) {
+        stackBottom = thread->interpStackStart - interpStackSize;
+    } else {
+        stackBottom = allocInterpStack(interpStackSize);
+        if (stackBottom == NULL) {
 #if defined(WITH_SELF_VERIFICATION)
-        dvmSelfVerificationShadowSpaceFree(thread);
+            dvmSelfVerificationShadowSpaceFree(thread);
 #endif
-        free(thread);
-        return NULL;
+            free(thread);
+            return NULL;
+        }
     }
-#endif
 
     assert(((u4)stackBottom & 0x03) == 0); // looks like our malloc ensures this
     thread->interpStackSize = interpStackSize;
@@ -871,6 +942,18 @@ static Thread* allocThread(int interpStackSize)
     /* One-time setup for interpreter/JIT state */
     dvmInitInterpreterState(thread);
 
+    u8 elapsed = dvmGetRelativeTimeNsec() - startWhen;
+    ThreadPoolStats* stats = &gDvm.threadPoolStats;
+    dvmLockMutex(&gDvm.threadPoolLock);
+    if (pooled) {
+        stats->hits++;
+        stats->hitNsec += elapsed;
+    } else {
+        stats->misses++;
+        stats->missNsec += elapsed;
+    }
+    dvmUnlockMutex(&gDvm.threadPoolLock);
+
     return thread;
 }
 
@@ -892,10 +975,8 @@ pid_t dvmGetSysThreadId()
  * Finish initialization of a Thread struct.
  *
  * This must be called while executing in the new thread, but before the
- * thread is added to the thread list.
- *
- * NOTE: The threadListLock must be held by the caller (needed for
- * assignThreadId()).
+ * thread is added to the thread list.  Thread ID assignment is lock-free,
+ * so the caller doesn't need to hold the threadListLock.
  */
 static bool prepareThread(Thread* thread)
 {
@@ -921,12 +1002,14 @@ static bool prepareThread(Thread* thread)
     pthread_cond_init(&thread->invokeReq.cv, NULL);
 
     /*
-     * Initialize our reference tracking tables.
+     * Initialize our reference tracking tables.  A recycled Thread keeps
+     * its (already emptied) JNI local reference table.
      *
      * Most threads won't use jniMonitorRefTable, so we clear out the
      * structure but don't call the init function (which allocs storage).
      */
-    if (!thread->jniLocalRefTable.init(kJniLocalRefMin,
+    if (!thread->jniLocalRefTable.isInitialized() &&
+        !thread->jniLocalRefTable.init(kJniLocalRefMin,
             kJniLocalRefMax, kIndirectKindLocal)) {
         return false;
     }
@@ -966,7 +1049,75 @@ static void unlinkThread(Thread* thread)
 }
 
 /*
- * Free a Thread struct, and all the stuff allocated within.
+ * Release the per-thread storage that doesn't survive a trip through the
+ * Thread pool.
+ */
+static void clearThreadTables(Thread* thread)
+{
+    dvmClearReferenceTable(&thread->internalLocalRefTable);
+    if (&thread->jniMonitorRefTable.table != NULL)
+        dvmClearReferenceTable(&thread->jniMonitorRefTable);
+
+    free(thread->sampleStack);
+    free(thread->sampleScratch);
+    thread->sampleStack = thread->sampleScratch = NULL;
+
+#if defined(WITH_SELF_VERIFICATION)
+    if (thread->shadowSpace != NULL) {
+        dvmSelfVerificationShadowSpaceFree(thread);
+        thread->shadowSpace = NULL;
+    }
+#endif
+}
+
+/*
+ * Try to park a dead Thread in the pool.  Its interpreter stack is kept
+ * mapped, but everything below the top page is handed back to the kernel
+ * so an idle pool costs very little memory.
+ *
+ * Returns "false" if the pool is full, in which case the caller should
+ * free the Thread.
+ */
+static bool releaseToPool(Thread* thread)
+{
+    if (thread->interpStackStart == NULL)
+        return false;
+
+    dvmLockMutex(&gDvm.threadPoolLock);
+    if (gDvm.threadPoolCount >= kThreadPoolMax) {
+        gDvm.threadPoolStats.discarded++;
+        dvmUnlockMutex(&gDvm.threadPoolLock);
+        return false;
+    }
+    gDvm.threadPoolCount++;
+    gDvm.threadPoolStats.released++;
+    dvmUnlockMutex(&gDvm.threadPoolLock);
+
+    clearThreadTables(thread);
+    if (thread->jniLocalRefTable.isInitialized())
+        thread->jniLocalRefTable.reset();
+
+#ifndef MALLOC_INTERP_STACK
+    u1* interpStackBottom = thread->interpStackStart - thread->interpStackSize;
+    u1* keepFrom = (u1*) ALIGN_DOWN_TO_PAGE_SIZE(
+        thread->interpStackStart - SYSTEM_PAGE_SIZE);
+    if (keepFrom > interpStackBottom &&
+        madvise(interpStackBottom, keepFrom - interpStackBottom,
+            MADV_DONTNEED) != 0)
+    {
+        ALOGW("madvise(thread stack) failed: %s", strerror(errno));
+    }
+#endif
+
+    dvmLockMutex(&gDvm.threadPoolLock);
+    thread->next = gDvm.threadPool;
+    gDvm.threadPool = thread;
+    dvmUnlockMutex(&gDvm.threadPoolLock);
+    return true;
+}
+
+/*
+ * Free a Thread struct, or recycle it if there's room in the pool.
  */
 static void freeThread(Thread* thread)
 {
@@ -976,6 +1127,15 @@ static void freeThread(Thread* thread)
     /* thread->threadId is zero at this point */
     LOGVV("threadid=%d: freeing", thread->threadId);
 
+    if (!releaseToPool(thread))
+        destroyThread(thread);
+}
+
+/*
+ * Free a Thread struct, and all the stuff allocated within.
+ */
+static void destroyThread(Thread* thread)
+{
     if (thread->interpStackStart != NULL) {
         u1* interpStackBottom;
 
@@ -990,13 +1150,7 @@ static void freeThread(Thread* thread)
     }
 
     thread->jniLocalRefTable.destroy();
-    dvmClearReferenceTable(&thread->internalLocalRefTable);
-    if (&thread->jniMonitorRefTable.table != NULL)
-        dvmClearReferenceTable(&thread->jniMonitorRefTable);
-
-#if defined(WITH_SELF_VERIFICATION)
-    dvmSelfVerificationShadowSpaceFree(thread);
-#endif
+    clearThreadTables(thread);
     free(thread);
 }
 
@@ -1098,28 +1252,56 @@ static void threadExitCheck(void* arg)
 static void assignThreadId(Thread* thread)
 {
     /*
-     * Find a small unique integer.  threadIdMap is a vector of
-     * kMaxThreadId bits;  dvmAllocBit() returns the index of a
-     * bit, meaning that it will always be < kMaxThreadId.
+     * Find a small unique integer, without taking a lock.  Released IDs
+     * are kept on a stack whose head word packs the top ID (low 16 bits,
+     * zero if empty) with a tag (high 16 bits).  Every push changes the
+     * tag, so a pop that raced with a pop-and-push of the same ID fails
+     * its CAS instead of corrupting the stack.  Reusing recently freed
+     * IDs first keeps the numbers small.
      */
-    int num = dvmAllocBit(gDvm.threadIdMap);
-    if (num < 0) {
-        ALOGE("Ran out of thread IDs");
-        dvmAbort();     // TODO: make this a non-fatal error result
+    int32_t oldHead, newHead;
+    u4 id;
+
+    do {
+        oldHead = gDvm.threadIdFreeHead;
+        id = oldHead & 0xffff;
+        if (id == 0)
+            break;
+        newHead = (oldHead & 0xffff0000) | gDvm.threadIdNext[id];
+    } while (android_atomic_acquire_cas(oldHead, newHead,
+            &gDvm.threadIdFreeHead) != 0);
+
+    if (id == 0) {
+        /* nothing to reuse; take a fresh one */
+        id = android_atomic_inc(&gDvm.threadIdHighWater) + 1;
+        if (id > kMaxThreadId) {
+            ALOGE("Ran out of thread IDs");
+            dvmAbort();     // TODO: make this a non-fatal error result
+        }
     }
 
-    thread->threadId = num + 1;
+    thread->threadId = id;
 
     assert(thread->threadId != 0);
 }
 
 /*
- * Give back the thread ID.
+ * Give back the thread ID.  The thread must no longer be on the thread
+ * list, but we don't need to hold the thread list lock.
  */
 static void releaseThreadId(Thread* thread)
 {
-    assert(thread->threadId > 0);
-    dvmClearBit(gDvm.threadIdMap, thread->threadId - 1);
+    u4 id = thread->threadId;
+    int32_t oldHead, newHead;
+
+    assert(id > 0 && id <= kMaxThreadId);
+    do {
+        oldHead = gDvm.threadIdFreeHead;
+        gDvm.threadIdNext[id] = oldHead & 0xffff;
+        newHead = (int32_t) ((((u4) oldHead + 0x10000) & 0xffff0000) | id);
+    } while (android_atomic_release_cas(oldHead, newHead,
+            &gDvm.threadIdFreeHead) != 0);
+
     thread->threadId = 0;
 }
 
@@ -1785,12 +1967,11 @@ bool dvmAttachCurrentThread(const JavaVMAttachArgs* pArgs, bool isDaemon)
 
     /*
      * Finish our thread prep.  We need to do this before adding ourselves
-     * to the thread list or invoking any interpreted code.  prepareThread()
-     * requires that we hold the thread list lock.
+     * to the thread list or invoking any interpreted code.  Nothing here
+     * needs the thread list lock, so attaching threads don't contend on
+     * it until they link themselves in below.
      */
-    dvmLockThreadList(self);
     ok = prepareThread(self);
-    dvmUnlockThreadList();
     if (!ok)
         goto fail;
 
@@ -2111,25 +2292,32 @@ void dvmDetachCurrentThread()
      */
     MethodTraceState* traceState = &gDvm.methodTrace;
 
-    dvmLockMutex(&traceState->startStopLock);
-    if (traceState->traceEnabled) {
-        ALOGI("threadid=%d: waiting for method trace to finish",
-            self->threadId);
-        while (traceState->traceEnabled) {
-            dvmWaitCond(&traceState->threadExitCond,
-                        &traceState->startStopLock);
+    /*
+     * Tracing can start right after we check whether or not we hold the
+     * lock, so there's no point in taking it when tracing is off.
+     */
+    if (android_atomic_acquire_load(&traceState->traceEnabled)) {
+        dvmLockMutex(&traceState->startStopLock);
+        if (traceState->traceEnabled) {
+            ALOGI("threadid=%d: waiting for method trace to finish",
+                self->threadId);
+            while (traceState->traceEnabled) {
+                dvmWaitCond(&traceState->threadExitCond,
+                            &traceState->startStopLock);
+            }
         }
+        dvmUnlockMutex(&traceState->startStopLock);
     }
-    dvmUnlockMutex(&traceState->startStopLock);
-
-    dvmLockThreadList(self);
 
     /*
-     * Lose the JNI context.
+     * Lose the JNI context.  Nobody else looks at our JNIEnv, so this
+     * doesn't need the thread list lock.
      */
     dvmDestroyJNIEnv(self->jniEnv);
     self->jniEnv = NULL;
 
+    dvmLockThreadList(self);
+
     self->status = THREAD_ZOMBIE;
 
     /*
@@ -2160,9 +2348,11 @@ void dvmDetachCurrentThread()
     }
 
     ALOGV("threadid=%d: bye!", self->threadId);
-    releaseThreadId(self);
     dvmUnlockThreadList();
 
+    /* we're off the list, so nobody can find us by ID any more */
+    releaseThreadId(self);
+
     setThreadSelf(NULL);
 
     freeThread(self);
@@ -2517,6 +2707,194 @@ static void waitForThreadSuspend(Thread* self, Thread* thread)
     }
 }
 
+/*
+ * Map a latency in usec to a time-to-safepoint histogram bucket.
+ */
+static int safepointBucket(u8 usec)
+{
+    int bucket = 0;
+    while (usec != 0 && bucket < kSafepointHistogramBuckets - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Work out how long a now-stopped thread took to reach a safe point after
+ * a suspend-all began at "suspendStart".  A thread that was already in
+ * native code or waiting when we started was at a safe point all along.
+ */
+static u8 timeToSafepoint(const Thread* thread, u8 suspendStart)
+{
+    if (thread->safepointWhen >= suspendStart)
+        return thread->safepointWhen - suspendStart;
+    return 0;
+}
+
+/*
+ * Fill out "pStraggler" with where a stopped thread is.  Break frames
+ * don't tell us anything, so we report the first real method.
+ */
+static void getSafepointLocation(const Thread* thread,
+    SafepointStraggler* pStraggler)
+{
+    const u4* fp = thread->interpSave.curFrame;
+
+    while (fp != NULL && dvmIsBreakFrame(fp))
+        fp = (const u4*) SAVEAREA_FROM_FP(fp)->prevFrame;
+
+    pStraggler->method = NULL;
+    pStraggler->pcOffset = -1;
+    if (fp != NULL) {
+        const StackSaveArea* saveArea = SAVEAREA_FROM_FP(fp);
+        const Method* method = saveArea->method;
+        pStraggler->method = method;
+        if (!dvmIsNativeMethod(method) && saveArea->xtra.currentPc != NULL)
+            pStraggler->pcOffset = saveArea->xtra.currentPc - method->insns;
+    }
+}
+
+/*
+ * Update the time-to-safepoint statistics at the end of a suspend-all.
+ * "straggler" is the thread that took longest to stop, if any.
+ *
+ * Caller must hold the thread suspend lock and the thread list lock.
+ */
+static void recordSuspendAll(SuspendCause why, u8 totalUsec,
+    Thread* straggler, u8 stragglerUsec)
+{
+    SafepointStats* stats = &gDvm.safepointStats;
+
+    assert(why > SUSPEND_NOT && why < kNumSuspendCauses);
+    stats->suspendCount[why]++;
+    stats->suspendTotalUsec[why] += totalUsec;
+    if (totalUsec > stats->suspendMaxUsec[why])
+        stats->suspendMaxUsec[why] = totalUsec;
+    stats->suspendHistogram[why][safepointBucket(totalUsec)]++;
+
+    if (straggler == NULL)
+        return;
+
+    SafepointStraggler* last = &stats->lastStraggler;
+    last->usec = stragglerUsec;
+    last->why = why;
+    last->threadId = straggler->threadId;
+    getSafepointLocation(straggler, last);
+
+    /* keep the worst list sorted, slowest first */
+    int i = kSafepointWorstStragglers - 1;
+    if (stragglerUsec <= stats->worst[i].usec)
+        return;
+    while (i > 0 && stats->worst[i - 1].usec < stragglerUsec) {
+        stats->worst[i] = stats->worst[i - 1];
+        i--;
+    }
+    stats->worst[i] = *last;
+
+    if (stragglerUsec >= 100 * 1000) {
+        ALOGD("threadid=%d: slow suspend (%s): threadid=%d took %llu msec",
+            dvmThreadSelf()->threadId, getSuspendCauseStr(why),
+            straggler->threadId, stragglerUsec / 1000);
+    }
+}
+
+/*
+ * Clear the time-to-safepoint statistics.
+ */
+void dvmResetSafepointStats()
+{
+    memset(&gDvm.safepointStats, 0, sizeof(gDvm.safepointStats));
+}
+
+/*
+ * Print one histogram, skipping empty buckets.
+ */
+static void dumpSafepointHistogram(const DebugOutputTarget* target,
+    const char* label, const u4* histogram)
+{
+    char buf[512];
+    int len = 0;
+
+    for (int i = 0; i < kSafepointHistogramBuckets; i++) {
+        if (histogram[i] == 0)
+            continue;
+        len += snprintf(buf + len, sizeof(buf) - len, " %s%u:%u",
+            (i == 0) ? "<" : "", (i == 0) ? 1 : 1u << (i - 1), histogram[i]);
+        if (len >= (int) sizeof(buf))
+            break;
+    }
+    buf[MIN(len, (int) sizeof(buf) - 1)] = '\0';
+    dvmPrintDebugMessage(target, "  %s (usec):%s\n", label, buf);
+}
+
+/*
+ * Print the time-to-safepoint statistics, including the threads that have
+ * been slowest to stop.  Used for the SIGQUIT dump.
+ */
+void dvmDumpSafepointStats(const DebugOutputTarget* target)
+{
+    const SafepointStats* stats = &gDvm.safepointStats;
+
+    dvmPrintDebugMessage(target, "DALVIK SAFEPOINTS:\n");
+    for (int why = SUSPEND_NOT + 1; why < kNumSuspendCauses; why++) {
+        u4 count = stats->suspendCount[why];
+        if (count == 0)
+            continue;
+        dvmPrintDebugMessage(target,
+            "  suspend-all (%s): count=%u avg=%lluus max=%lluus\n",
+            getSuspendCauseStr((SuspendCause) why), count,
+            stats->suspendTotalUsec[why] / count, stats->suspendMaxUsec[why]);
+    }
+    dumpSafepointHistogram(target, "per-thread time to safepoint",
+        stats->threadHistogram);
+
+    dvmPrintDebugMessage(target, "  slowest threads to reach a safepoint:\n");
+    for (int i = 0; i < kSafepointWorstStragglers; i++) {
+        const SafepointStraggler* worst = &stats->worst[i];
+        if (worst->usec == 0)
+            break;
+        if (worst->method != NULL) {
+            char* desc = dexProtoCopyMethodDescriptor(&worst->method->prototype);
+            dvmPrintDebugMessage(target,
+                "    threadid=%u %lluus (%s) at %s.%s%s pc=%d\n",
+                worst->threadId, worst->usec, getSuspendCauseStr(worst->why),
+                worst->method->clazz->descriptor, worst->method->name, desc,
+                worst->pcOffset);
+            free(desc);
+        } else {
+            dvmPrintDebugMessage(target, "    threadid=%u %lluus (%s)\n",
+                worst->threadId, worst->usec, getSuspendCauseStr(worst->why));
+        }
+    }
+    dvmPrintDebugMessage(target, "\n");
+}
+
+/*
+ * Print the Thread pool counters.  The average allocThread() time for
+ * hits and misses shows what recycling is saving us.
+ */
+void dvmDumpThreadPoolStats(const DebugOutputTarget* target)
+{
+    ThreadPoolStats stats;
+    int pooled;
+
+    dvmLockMutex(&gDvm.threadPoolLock);
+    stats = gDvm.threadPoolStats;
+    pooled = gDvm.threadPoolCount;
+    dvmUnlockMutex(&gDvm.threadPoolLock);
+
+    dvmPrintDebugMessage(target,
+        "DALVIK THREAD POOL: pooled=%d/%d hits=%u misses=%u"
+        " released=%u discarded=%u\n",
+        pooled, kThreadPoolMax, stats.hits, stats.misses,
+        stats.released, stats.discarded);
+    dvmPrintDebugMessage(target,
+        "  avg thread alloc: hit=%lluns miss=%lluns\n",
+        (stats.hits != 0) ? stats.hitNsec / stats.hits : 0,
+        (stats.misses != 0) ? stats.missNsec / stats.misses : 0);
+}
+
 /*
  * Suspend all threads except the current one.  This is used by the GC,
  * the debugger, and by any thread that hits a "suspend all threads"
@@ -2566,10 +2944,15 @@ void dvmSuspendAllThreads(SuspendCause why)
     //assert(self->suspendCount == 0);
 
     /*
-     * Increment everybody's suspend count (except our own).
+     * Increment everybody's suspend count (except our own).  Threads that
+     * notice the new count after this point note when they stopped.
      */
     dvmLockThreadList(self);
 
+    u8 suspendStart = dvmGetRelativeTimeUsec();
+    Thread* straggler = NULL;
+    u8 stragglerUsec = 0;
+
     lockThreadSuspendCount();
     for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
         if (thread == self)
@@ -2613,11 +2996,21 @@ void dvmSuspendAllThreads(SuspendCause why)
         /* wait for the other thread to see the pending suspend */
         waitForThreadSuspend(self, thread);
 
+        u8 ttsp = timeToSafepoint(thread, suspendStart);
+        gDvm.safepointStats.threadHistogram[safepointBucket(ttsp)]++;
+        if (straggler == NULL || ttsp > stragglerUsec) {
+            straggler = thread;
+            stragglerUsec = ttsp;
+        }
+
         LOG_THREAD("threadid=%d:   threadid=%d status=%d sc=%d dc=%d",
             self->threadId, thread->threadId, thread->status,
             thread->suspendCount, thread->dbgSuspendCount);
     }
 
+    recordSuspendAll(why, dvmGetRelativeTimeUsec() - suspendStart,
+        straggler, stragglerUsec);
+
     dvmUnlockThreadList();
     unlockThreadSuspend();
 
@@ -2860,6 +3253,7 @@ static bool fullSuspendCheck(Thread* self)
     if (needSuspend) {
         LOG_THREAD("threadid=%d: self-suspending", self->threadId);
         ThreadStatus oldStatus = self->status;      /* should be RUNNING */
+        self->safepointWhen = dvmGetRelativeTimeUsec();
         self->status = THREAD_SUSPENDED;
 
         while (self->suspendCount != 0) {
@@ -2983,6 +3377,8 @@ ThreadStatus dvmChangeStatus(Thread* self, ThreadStatus newStatus)
          * will be observed before the state change.
          */
         assert(newStatus != THREAD_SUSPENDED);
+        if (oldStatus == THREAD_RUNNING && self->suspendCount != 0)
+            self->safepointWhen = dvmGetRelativeTimeUsec();
         volatile void* raw = reinterpret_cast<volatile void*>(&self->status);
         volatile int32_t* addr = reinterpret_cast<volatile int32_t*>(raw);
         android_atomic_release_store(newStatus, addr);
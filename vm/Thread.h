@@ -97,6 +97,26 @@ union InterpBreak {
     } ctl;
 };
 
+#if defined(WITH_JIT)
+/*
+ * Per-thread cache of preallocated, zeroed heap chunks of a single size.
+ * Compiled new-instance and new-array pop a chunk by bumping "top" instead
+ * of calling into the allocator; dvmMalloc() refills it when called with
+ * ALLOC_FILL_CACHE.  Cached chunks are GC roots that look like plain
+ * java.lang.Object instances until they are handed out.
+ */
+#define kAllocCacheEntries  16
+#define kAllocCacheMaxSize  256     /* largest chunk we cache, in bytes */
+
+struct AllocCache {
+    size_t      size;           /* chunk size; 0 when the cache is off */
+    Object**    top;            /* next chunk to hand out */
+    Object**    end;            /* one past the last chunk */
+    int         misses;         /* refills refused since the last one */
+    Object*     objects[kAllocCacheEntries];
+};
+#endif
+
 /*
  * Our per-thread data.
  *
@@ -287,9 +307,26 @@ struct Thread {
     bool        cpuClockBaseSet;
     u8          cpuClockBase;
 
+    /* this thread's chunk of the method trace buffer (see Profile.cpp) */
+    u1*         methodTraceChunk;
+    int         methodTraceChunkUsed;
+    int         methodTraceChunkSize;
+    int         methodTraceGeneration;  /* trace the chunk belongs to */
+
+    /* previous stack sample, innermost first (used by sampling profiler) */
+    const Method** sampleStack;
+    const Method** sampleScratch;
+    int         sampleStackDepth;
+    int         sampleStackCapacity;
+
     /* memory allocation profiling state */
     AllocProfState allocProf;
 
+#if defined(WITH_JIT)
+    /* chunks handed out inline by compiled code */
+    AllocCache  allocCache;
+#endif
+
 #ifdef WITH_JNI_STACK_CHECK
     u4          stackCrc;
 #endif
@@ -299,6 +336,9 @@ struct Thread {
     const u2*   currentPc2;
 #endif
 
+    /* when we last stopped for a pending suspend (dvmGetRelativeTimeUsec) */
+    u8          safepointWhen;
+
     /* Safepoint callback state */
     pthread_mutex_t   callbackMutex;
     SafePointCallback callback;
@@ -365,6 +405,11 @@ enum SuspendCause {
     SUSPEND_FOR_REFRESH,     // Reload data cached in interpState
 #endif
 };
+#if defined(WITH_JIT)
+# define kNumSuspendCauses  (SUSPEND_FOR_REFRESH + 1)
+#else
+# define kNumSuspendCauses  (SUSPEND_FOR_HPROF + 1)
+#endif
 void dvmSuspendThread(Thread* thread);
 void dvmSuspendSelf(bool jdwpActivity);
 void dvmResumeThread(Thread* thread);
@@ -372,6 +417,68 @@ void dvmSuspendAllThreads(SuspendCause why);
 void dvmResumeAllThreads(SuspendCause why);
 void dvmUndoDebuggerSuspensions(void);
 
+/*
+ * Time-to-safepoint statistics, gathered by dvmSuspendAllThreads.
+ *
+ * Histogram bucket N counts latencies in [2^(N-1), 2^N) usec.  Bucket 0
+ * holds latencies under 1 usec, and the last bucket everything too long
+ * for the others.
+ */
+#define kSafepointHistogramBuckets  24
+#define kSafepointWorstStragglers   8
+
+struct SafepointStraggler {
+    u8              usec;           /* time it took the thread to stop */
+    SuspendCause    why;
+    u4              threadId;
+    const Method*   method;         /* where it stopped, or NULL */
+    int             pcOffset;       /* code units into method, or -1 */
+};
+
+struct SafepointStats {
+    /* suspend-all latency, by cause */
+    u4      suspendCount[kNumSuspendCauses];
+    u8      suspendTotalUsec[kNumSuspendCauses];
+    u8      suspendMaxUsec[kNumSuspendCauses];
+    u4      suspendHistogram[kNumSuspendCauses][kSafepointHistogramBuckets];
+
+    /* time for each individual thread to stop */
+    u4      threadHistogram[kSafepointHistogramBuckets];
+
+    /* last thread to stop in the most recent suspend-all */
+    SafepointStraggler lastStraggler;
+
+    /* slowest threads seen so far, worst first */
+    SafepointStraggler worst[kSafepointWorstStragglers];
+};
+
+/*
+ * Reset or dump the time-to-safepoint statistics.
+ */
+void dvmResetSafepointStats(void);
+void dvmDumpSafepointStats(const DebugOutputTarget* target);
+
+/*
+ * Recycled Thread structs.  Detached threads park their Thread and its
+ * interpreter stack here, up to kThreadPoolMax of them, so the next
+ * thread with the same stack size can skip the mmap and table setup.
+ */
+#define kThreadPoolMax  8
+
+struct ThreadPoolStats {
+    u4      hits;           /* allocThread served from the pool */
+    u4      misses;         /* allocThread had to build from scratch */
+    u8      hitNsec;        /* total allocThread time on hits */
+    u8      missNsec;       /* ...and on misses */
+    u4      released;       /* Threads parked in the pool */
+    u4      discarded;      /* Threads freed because the pool was full */
+};
+
+/*
+ * Dump the Thread pool counters.
+ */
+void dvmDumpThreadPoolStats(const DebugOutputTarget* target);
+
 /*
  * Check suspend state.  Grab threadListLock before calling.
  */
@@ -26,6 +26,7 @@ enum {
     ALLOC_DEFAULT = 0x00,
     ALLOC_DONT_TRACK = 0x01,  /* don't add to internal tracking list */
     ALLOC_NON_MOVING = 0x02,
+    ALLOC_FILL_CACHE = 0x04,  /* refill the caller's allocation cache */
 };
 
 /*
@@ -53,6 +54,12 @@ bool dvmGcPreZygoteFork(void);
  */
 void* dvmMalloc(size_t size, int flags);
 
+/*
+ * Drop the contents of every thread's allocation cache and stop it from
+ * being refilled while allocation profiling or tracking is enabled.
+ */
+void dvmEmptyAllocCaches(void);
+
 /*
  * Allocate a new object.
  *
@@ -317,6 +317,66 @@ static void throwOOME()
     }
 }
 
+#if defined(WITH_JIT)
+/*
+ * Refill the caller's allocation cache with chunks of "size" bytes.  The
+ * cache is left alone while it still holds chunks of another size, unless
+ * it has been missing for a while.  Chunks are allocated without trying to
+ * GC; the cache simply ends up shorter if the heap is nearly full.
+ *
+ * The heap lock must be held.
+ */
+static void fillAllocCache(Thread* self, size_t size)
+{
+    AllocCache* cache = &self->allocCache;
+
+    if (size > kAllocCacheMaxSize ||
+        gDvm.allocProf.enabled || gDvm.allocRecords != NULL) {
+        return;
+    }
+    if (cache->top < cache->end && cache->size != size &&
+        ++cache->misses < kAllocCacheEntries) {
+        return;
+    }
+
+    /* Any chunks still in the cache become garbage once we drop them */
+    int count = 0;
+    while (count < kAllocCacheEntries) {
+        Object* obj = (Object*) dvmHeapSourceAlloc(size);
+        if (obj == NULL) {
+            break;
+        }
+        DVM_OBJECT_INIT(obj, gDvm.classJavaLangObject);
+        cache->objects[count++] = obj;
+    }
+    cache->size = size;
+    cache->top = cache->objects;
+    cache->end = cache->objects + count;
+    cache->misses = 0;
+}
+#endif
+
+/*
+ * Drop the contents of every thread's allocation cache.  Called after
+ * allocation profiling or tracking is switched on; dvmMalloc() won't
+ * refill the caches until both are off again.
+ */
+void dvmEmptyAllocCaches()
+{
+#if defined(WITH_JIT)
+    dvmLockHeap();
+    dvmLockThreadList(dvmThreadSelf());
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next) {
+        AllocCache* cache = &thread->allocCache;
+        cache->size = 0;
+        cache->top = cache->end;
+    }
+    dvmUnlockThreadList();
+    dvmUnlockHeap();
+#endif
+}
+
 /*
  * Allocate storage on the GC heap.  We guarantee 8-byte alignment.
  *
@@ -336,6 +396,9 @@ static void throwOOME()
  * be part of the root set immediately) or we can't (because this allocation
  * is for a brand new thread).
  *
+ * ALLOC_FILL_CACHE is set by compiled code that missed in its allocation
+ * cache; we take the opportunity to refill it while we hold the heap lock.
+ *
  * Returns NULL and throws an exception on failure.
  *
  * TODO: don't do a GC if the debugger thinks all threads are suspended
@@ -361,6 +424,14 @@ void* dvmMalloc(size_t size, int flags)
                 self->allocProf.allocSize += size;
             }
         }
+#if defined(WITH_JIT)
+        if ((flags & ALLOC_FILL_CACHE) != 0) {
+            Thread* self = dvmThreadSelf();
+            if (self != NULL) {
+                fillAllocCache(self, size);
+            }
+        }
+#endif
     } else {
         /* The allocation failed.
          */
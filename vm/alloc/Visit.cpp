@@ -174,6 +174,11 @@ static void visitThread(RootVisitor *visitor, Thread *thread, void *arg)
         visitReferenceTable(visitor, &thread->jniMonitorRefTable, threadId, ROOT_JNI_MONITOR, arg);
     }
     visitThreadStack(visitor, thread, arg);
+#if defined(WITH_JIT)
+    for (Object** obj = thread->allocCache.top; obj < thread->allocCache.end; obj++) {
+        (*visitor)(obj, threadId, ROOT_VM_INTERNAL, arg);
+    }
+#endif
 }
 
 /*
@@ -2285,65 +2285,41 @@ static RegType adjustForRightShift(RegisterLine* registerLine, int reg,
  */
 
 /*
- * Compute the "class depth" of a class.  This is the distance from the
- * class to the top of the tree, chasing superclass links.  java.lang.Object
- * has a class depth of 0.
- */
-static int getClassDepth(ClassObject* clazz)
-{
-    int depth = 0;
-
-    while (clazz->super != NULL) {
-        clazz = clazz->super;
-        depth++;
-    }
-    return depth;
-}
-
-/*
- * Given two classes, walk up the superclass tree to find a common
- * ancestor.  (Called from findCommonSuperclass().)
+ * Given two classes, find their deepest common ancestor.  (Called from
+ * findCommonSuperclass().)
  *
- * TODO: consider caching the class depth in the class object so we don't
- * have to search for it here.
+ * Every class agrees with its superclass on the ancestors above it, so the
+ * classes share the ancestor at depth d for every d up to some deepest
+ * one, and none past it.  Binary search for that depth, reading ancestors
+ * from the superclass displays.
  */
 static ClassObject* digForSuperclass(ClassObject* c1, ClassObject* c2)
 {
-    int depth1, depth2;
-
-    depth1 = getClassDepth(c1);
-    depth2 = getClassDepth(c2);
+    int depth1 = c1->classDepth;
+    int depth2 = c2->classDepth;
 
     if (gDebugVerbose) {
         LOGVV("COMMON: %s(%d) + %s(%d)",
             c1->descriptor, depth1, c2->descriptor, depth2);
     }
 
-    /* pull the deepest one up */
-    if (depth1 > depth2) {
-        while (depth1 > depth2) {
-            c1 = c1->super;
-            depth1--;
-        }
-    } else {
-        while (depth2 > depth1) {
-            c2 = c2->super;
-            depth2--;
-        }
-    }
-
-    /* walk up in lock-step */
-    while (c1 != c2) {
-        c1 = c1->super;
-        c2 = c2->super;
-
-        assert(c1 != NULL && c2 != NULL);
+    /* depth 0 is java.lang.Object, which everything shares */
+    assert(dvmGetClassAtDepth(c1, 0) == dvmGetClassAtDepth(c2, 0));
+    int lo = 0;
+    int hi = (depth1 < depth2) ? depth1 : depth2;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (dvmGetClassAtDepth(c1, mid) == dvmGetClassAtDepth(c2, mid))
+            lo = mid;
+        else
+            hi = mid - 1;
     }
 
+    ClassObject* common = dvmGetClassAtDepth(c1, lo);
     if (gDebugVerbose) {
-        LOGVV("      : --> %s", c1->descriptor);
+        LOGVV("      : --> %s", common->descriptor);
     }
-    return c1;
+    return common;
 }
 
 /*
@@ -2433,9 +2409,8 @@ static ClassObject* findCommonArraySuperclass(ClassObject* c1, ClassObject* c2)
  * Find the first common superclass of the two classes.  We're not
  * interested in common interfaces.
  *
- * The easiest way to do this for concrete classes is to compute the "class
- * depth" of each, move up toward the root of the deepest one until they're
- * at the same depth, then walk both up to the root until they match.
+ * For concrete classes, the superclass displays give the ancestors of each
+ * at every depth, and we look for the deepest depth where they match.
  *
  * If both classes are arrays, we need to merge based on array depth and
  * element type.
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Receiver class profile for invoke-virtual and invoke-interface sites.
+ *
+ * A trace only records the class seen while it was being selected, so the
+ * inliner can't tell a monomorphic site from one that happened to be
+ * monomorphic once.  Every inline cache miss that reaches
+ * dvmJitToPatchPredictedChain is recorded here against the Dalvik PC of
+ * the invoke, which outlives any one translation of it.  Misses are
+ * sampled by the rechain counter, so the counts are only relative.
+ *
+ * The table is open addressed on the Dalvik PC and never shrinks; once it
+ * is full new sites are simply not profiled.
+ */
+
+#include "Dalvik.h"
+#include "interp/Jit.h"
+
+/* Find the entry for "dPC", claiming a free one if "add" is set */
+static JitCallSiteProfile* findCallSite(const u2* dPC, bool add)
+{
+    JitCallSiteProfile* table = gDvmJit.pCallSiteProfile;
+    u4 idx = dvmJitHashMask(dPC, JIT_CALL_SITE_PROFILE_SIZE - 1);
+
+    for (int probes = 0; probes < JIT_CALL_SITE_PROFILE_SIZE; probes++) {
+        JitCallSiteProfile* site = &table[idx];
+        if (site->dPC == dPC)
+            return site;
+        if (site->dPC == NULL) {
+            if (!add)
+                return NULL;
+            site->dPC = dPC;
+            gDvmJit.callSitesProfiled++;
+            return site;
+        }
+        idx = (idx + 1) & (JIT_CALL_SITE_PROFILE_SIZE - 1);
+    }
+    return NULL;
+}
+
+/*
+ * An inline cache at "dPC" missed on "clazz", which dispatches to
+ * "method".  Called on mutator threads.
+ */
+void dvmCompilerRecordCallSite(const u2* dPC, const ClassObject* clazz,
+                               const Method* method)
+{
+    if (gDvmJit.pCallSiteProfile == NULL || dPC == NULL)
+        return;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+
+    JitCallSiteProfile* site = findCallSite(dPC, true);
+    if (site != NULL && !site->megamorphic) {
+        int i;
+        for (i = 0; i < JIT_POLY_IC_SIZE; i++) {
+            if (site->clazz[i] == clazz || site->clazz[i] == NULL)
+                break;
+        }
+        if (i == JIT_POLY_IC_SIZE) {
+            site->megamorphic = true;
+            gDvmJit.callSitesMegamorphic++;
+        } else {
+            if (site->clazz[i] == NULL) {
+                site->clazz[i] = clazz;
+                site->method[i] = method;
+                if (i == 1)
+                    gDvmJit.callSitesPolymorphic++;
+            }
+            site->count[i]++;
+        }
+    }
+
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+}
+
+/*
+ * Copy out what is known about the site at "dPC".  Returns false if it
+ * has never missed.
+ */
+bool dvmCompilerGetCallSiteProfile(const u2* dPC, JitCallSiteProfile* profile)
+{
+    bool found = false;
+
+    if (gDvmJit.pCallSiteProfile == NULL)
+        return false;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    JitCallSiteProfile* site = findCallSite(dPC, false);
+    if (site != NULL) {
+        *profile = *site;
+        found = true;
+    }
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+
+    return found;
+}
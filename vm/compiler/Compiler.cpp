@@ -19,6 +19,7 @@
 #include <cutils/ashmem.h>
 
 #include "Dalvik.h"
+#include "os/os.h"
 #include "interp/Jit.h"
 #include "CompilerInternals.h"
 #ifdef ARCH_IA32
@@ -34,18 +35,86 @@ static inline bool workQueueLength(void)
     return gDvmJit.compilerQueueLength;
 }
 
+/*
+ * Returns true if work order "a" should be compiled before "b".  Equal
+ * priorities are served in the order they were requested.
+ */
+static inline bool workOrderBefore(const CompilerWorkOrder* a,
+                                   const CompilerWorkOrder* b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    return (int) (a->sequence - b->sequence) < 0;
+}
+
+/* Move the work order at "index" towards the root of the heap */
+static void workSiftUp(int index)
+{
+    CompilerWorkOrder* queue = gDvmJit.compilerWorkQueue;
+    CompilerWorkOrder work = queue[index];
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!workOrderBefore(&work, &queue[parent]))
+            break;
+        queue[index] = queue[parent];
+        index = parent;
+    }
+    queue[index] = work;
+}
+
+/* Move the work order at "index" towards the leaves of the heap */
+static void workSiftDown(int index)
+{
+    CompilerWorkOrder* queue = gDvmJit.compilerWorkQueue;
+    int length = gDvmJit.compilerQueueLength;
+    CompilerWorkOrder work = queue[index];
+
+    while (true) {
+        int child = 2 * index + 1;
+        if (child >= length)
+            break;
+        if (child + 1 < length && workOrderBefore(&queue[child + 1],
+                                                  &queue[child])) {
+            child++;
+        }
+        if (!workOrderBefore(&queue[child], &work))
+            break;
+        queue[index] = queue[child];
+        index = child;
+    }
+    queue[index] = work;
+}
+
+/* Remove the work order at "index", keeping the heap ordered */
+static void workRemove(int index)
+{
+    int last = --gDvmJit.compilerQueueLength;
+
+    if (index != last) {
+        gDvmJit.compilerWorkQueue[index] = gDvmJit.compilerWorkQueue[last];
+        workSiftDown(index);
+        workSiftUp(index);
+    }
+    gDvmJit.compilerWorkQueue[last].kind = kWorkOrderInvalid;
+}
+
+/* Find the queued work order for "pc", or return -1.  Caller holds lock. */
+static int workFind(const u2* pc)
+{
+    for (int i = 0; i < gDvmJit.compilerQueueLength; i++) {
+        if (gDvmJit.compilerWorkQueue[i].pc == pc)
+            return i;
+    }
+    return -1;
+}
+
+/* Take the highest priority work order off the queue */
 static CompilerWorkOrder workDequeue(void)
 {
-    assert(gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex].kind
-           != kWorkOrderInvalid);
-    CompilerWorkOrder work =
-        gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex];
-    gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkDequeueIndex++].kind =
-        kWorkOrderInvalid;
-    if (gDvmJit.compilerWorkDequeueIndex == COMPILER_WORK_QUEUE_SIZE) {
-        gDvmJit.compilerWorkDequeueIndex = 0;
-    }
-    gDvmJit.compilerQueueLength--;
+    assert(gDvmJit.compilerWorkQueue[0].kind != kWorkOrderInvalid);
+    CompilerWorkOrder work = gDvmJit.compilerWorkQueue[0];
+    workRemove(0);
     if (gDvmJit.compilerQueueLength == 0) {
         dvmSignalCond(&gDvmJit.compilerQueueEmpty);
     }
@@ -95,51 +164,67 @@ void dvmCompilerForceWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
 {
     int cc;
-    int i;
-    int numWork;
+    int priority;
     bool result = true;
 
+    /* Control and debugging requests go ahead of the profile-driven ones */
+    priority = (kind == kWorkOrderTrace || kind == kWorkOrderMethod) ?
+        COMPILER_PRIORITY_NORMAL : COMPILER_PRIORITY_CONTROL;
+
     dvmLockMutex(&gDvmJit.compilerLock);
 
     /*
-     * Return if queue or code cache is full.
+     * Return if code cache is full.
      */
-    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE ||
-        gDvmJit.codeCacheFull == true) {
+    if (gDvmJit.codeCacheFull == true) {
         dvmUnlockMutex(&gDvmJit.compilerLock);
         return false;
     }
 
-    for (numWork = gDvmJit.compilerQueueLength,
-           i = gDvmJit.compilerWorkDequeueIndex;
-         numWork > 0;
-         numWork--) {
-        /* Already enqueued */
-        if (gDvmJit.compilerWorkQueue[i++].pc == pc) {
+    /* Already enqueued */
+    if (pc != NULL && workFind(pc) >= 0) {
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        return true;
+    }
+
+    /*
+     * If the queue is full, make room by dropping the coldest order,
+     * provided the new one outranks it.  The coldest order is a leaf.
+     */
+    if (gDvmJit.compilerQueueLength == COMPILER_WORK_QUEUE_SIZE) {
+        CompilerWorkOrder* queue = gDvmJit.compilerWorkQueue;
+        int coldest = COMPILER_WORK_QUEUE_SIZE / 2;
+        for (int i = coldest + 1; i < COMPILER_WORK_QUEUE_SIZE; i++) {
+            if (workOrderBefore(&queue[coldest], &queue[i]))
+                coldest = i;
+        }
+        if (queue[coldest].priority >= priority) {
             dvmUnlockMutex(&gDvmJit.compilerLock);
-            return true;
+            return false;
         }
-        /* Wrap around */
-        if (i == COMPILER_WORK_QUEUE_SIZE)
-            i = 0;
+        free(queue[coldest].info);
+        workRemove(coldest);
+        gDvmJit.compilerWorkEvicted++;
     }
 
     CompilerWorkOrder *newOrder =
-        &gDvmJit.compilerWorkQueue[gDvmJit.compilerWorkEnqueueIndex];
+        &gDvmJit.compilerWorkQueue[gDvmJit.compilerQueueLength];
     newOrder->pc = pc;
     newOrder->kind = kind;
     newOrder->info = info;
+    newOrder->priority = priority;
+    newOrder->sequence = gDvmJit.compilerWorkSequence++;
     newOrder->result.methodCompilationAborted = NULL;
     newOrder->result.codeAddress = NULL;
+    newOrder->result.codeSize = 0;
     newOrder->result.discardResult =
         (kind == kWorkOrderTraceDebug) ? true : false;
     newOrder->result.cacheVersion = gDvmJit.cacheVersion;
     newOrder->result.requestingThread = dvmThreadSelf();
+    newOrder->result.replaceTranslation = false;
+    newOrder->result.canGrow = false;
 
-    gDvmJit.compilerWorkEnqueueIndex++;
-    if (gDvmJit.compilerWorkEnqueueIndex == COMPILER_WORK_QUEUE_SIZE)
-        gDvmJit.compilerWorkEnqueueIndex = 0;
-    gDvmJit.compilerQueueLength++;
+    workSiftUp(gDvmJit.compilerQueueLength++);
     cc = pthread_cond_signal(&gDvmJit.compilerQueueActivity);
     assert(cc == 0);
 #ifdef NDEBUG
@@ -150,6 +235,28 @@ bool dvmCompilerWorkEnqueue(const u2 *pc, WorkOrderKind kind, void* info)
     return result;
 }
 
+/*
+ * Note that the interpreter has reached the threshold again for a trace
+ * head whose compilation is still waiting in the queue, and move it up.
+ * This is called from the interpreter, so don't wait for the lock; a
+ * missed bump only costs a little ordering accuracy.
+ */
+void dvmCompilerBumpWorkOrder(const u2 *pc)
+{
+    if (dvmTryLockMutex(&gDvmJit.compilerLock) != 0)
+        return;
+
+    int index = workFind(pc);
+    if (index >= 0 &&
+        gDvmJit.compilerWorkQueue[index].priority < COMPILER_PRIORITY_CONTROL) {
+        gDvmJit.compilerWorkQueue[index].priority++;
+        workSiftUp(index);
+        gDvmJit.compilerWorkBumped++;
+    }
+
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
 /* Block until the queue length is 0, or there is a pending suspend request */
 void dvmCompilerDrainQueue(void)
 {
@@ -169,6 +276,89 @@ void dvmCompilerDrainQueue(void)
     dvmUnlockMutex(&gDvmJit.compilerLock);
 }
 
+/* Offset of the start of code cache segment "segment" */
+static inline unsigned int codeSegmentStart(int segment)
+{
+    return gDvmJit.templateSize + segment * gDvmJit.codeCacheSegmentSize;
+}
+
+/*
+ * Start allocating translations from the beginning of "segment".  Caller
+ * must hold compilerLock.
+ */
+static void switchCodeSegment(int segment)
+{
+    int current = gDvmJit.codeCacheCurrentSegment;
+
+    gDvmJit.codeCacheSegmentUsed[current] =
+        gDvmJit.codeCacheByteUsed - codeSegmentStart(current);
+    gDvmJit.codeCacheCurrentSegment = segment;
+    gDvmJit.codeCacheSegmentUsed[segment] = 0;
+    gDvmJit.codeCacheByteUsed = codeSegmentStart(segment);
+    gDvmJit.codeCacheByteLimit = codeSegmentStart(segment + 1);
+    if (gDvmJit.codeCacheByteLimit > gDvmJit.codeCacheHighMark)
+        gDvmJit.codeCacheHighMark = gDvmJit.codeCacheByteLimit;
+}
+
+/*
+ * Carve the space after the templates into segments and start filling the
+ * first one.
+ */
+static void initCodeCacheSegments(void)
+{
+    unsigned int size = (gDvmJit.codeCacheSize - gDvmJit.templateSize) /
+                        JIT_CODE_CACHE_SEGMENTS;
+
+    /* Keep each segment start as aligned as the first one */
+    gDvmJit.codeCacheSegmentSize = size & ~0xf;
+    gDvmJit.codeCacheCurrentSegment = 0;
+    memset(gDvmJit.codeCacheSegmentUsed, 0,
+           sizeof(gDvmJit.codeCacheSegmentUsed));
+    gDvmJit.codeCacheByteUsed = gDvmJit.templateSize;
+    gDvmJit.codeCacheByteLimit = codeSegmentStart(1);
+    gDvmJit.codeCacheHighMark = gDvmJit.codeCacheByteLimit;
+}
+
+/*
+ * Bytes of the code cache taken up by live translations (not counting the
+ * templates).
+ */
+unsigned int dvmCompilerCodeCacheLiveBytes(void)
+{
+    unsigned int live = 0;
+
+    for (int i = 0; i < JIT_CODE_CACHE_SEGMENTS; i++) {
+        if (i == gDvmJit.codeCacheCurrentSegment) {
+            live += gDvmJit.codeCacheByteUsed - codeSegmentStart(i);
+        } else {
+            live += gDvmJit.codeCacheSegmentUsed[i];
+        }
+    }
+    return live;
+}
+
+/*
+ * A translation didn't fit in the current segment.  If the next segment
+ * has never been used, switch to it right away; there is nothing in it
+ * to evict, so we don't need to wait for a safe point.  Returns true if
+ * the code cache has room again.
+ */
+bool dvmCompilerUseFreshCodeSegment(void)
+{
+    bool switched = false;
+
+    dvmLockMutex(&gDvmJit.compilerLock);
+    int next = gDvmJit.codeCacheCurrentSegment + 1;
+    if (gDvmJit.codeCacheFull && next < JIT_CODE_CACHE_SEGMENTS &&
+        codeSegmentStart(next) >= gDvmJit.codeCacheHighMark) {
+        switchCodeSegment(next);
+        gDvmJit.codeCacheFull = false;
+        switched = true;
+    }
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+    return switched;
+}
+
 bool dvmCompilerSetupCodeCache(void)
 {
     int fd;
@@ -224,6 +414,7 @@ bool dvmCompilerSetupCodeCache(void)
         ALOGE("Failed to remove the write permission for the code cache");
         dvmAbort();
     }
+    initCodeCacheSegments();
 #else
     gDvmJit.codeCacheByteUsed = 0;
     stream = (char*)gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
@@ -233,6 +424,7 @@ bool dvmCompilerSetupCodeCache(void)
     gDvmJit.templateSize = (stream - streamStart);
     gDvmJit.codeCacheByteUsed = (stream - streamStart);
     ALOGV("stream = %p after initJIT", stream);
+    initCodeCacheSegments();
 #endif
 
     return true;
@@ -326,28 +518,31 @@ static void resetCodeCache(void)
     /* Reset the JitEntry table contents to the initial unpopulated state */
     dvmJitResetTable();
 
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    dvmCompilerPerfMapRemove((char *) gDvmJit.codeCache + gDvmJit.templateSize,
+                             (char *) gDvmJit.codeCache +
+                             gDvmJit.codeCacheHighMark);
+
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
     /*
      * Wipe out the code cache content to force immediate crashes if
      * stale JIT'ed code is invoked.
      */
     dvmCompilerCacheClear((char *) gDvmJit.codeCache + gDvmJit.templateSize,
-                          gDvmJit.codeCacheByteUsed - gDvmJit.templateSize);
+                          gDvmJit.codeCacheHighMark - gDvmJit.templateSize);
 
     dvmCompilerCacheFlush((intptr_t) gDvmJit.codeCache,
                           (intptr_t) gDvmJit.codeCache +
-                          gDvmJit.codeCacheByteUsed, 0);
+                          gDvmJit.codeCacheHighMark, 0);
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
-    /* Reset the current mark of used bytes to the end of template code */
-    gDvmJit.codeCacheByteUsed = gDvmJit.templateSize;
+    /* Start filling from the first segment, right after the templates */
+    initCodeCacheSegments();
     gDvmJit.numCompilations = 0;
 
     /* Reset the work queue */
     memset(gDvmJit.compilerWorkQueue, 0,
            sizeof(CompilerWorkOrder) * COMPILER_WORK_QUEUE_SIZE);
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
     gDvmJit.compilerQueueLength = 0;
 
     /* Reset the IC patch work queue */
@@ -359,7 +554,7 @@ static void resetCodeCache(void)
      * Reset the inflight compilation address (can only be done in safe points
      * or by the compiler thread when its thread state is RUNNING).
      */
-    gDvmJit.inflightBaseAddr = NULL;
+    memset(gDvmJit.inflightBaseAddr, 0, sizeof(gDvmJit.inflightBaseAddr));
 
     /* All clear now */
     gDvmJit.codeCacheFull = false;
@@ -372,16 +567,142 @@ static void resetCodeCache(void)
          gDvmJit.numCodeCacheResetDelayed);
 }
 
+/*
+ * Make room in a full code cache by evicting the segment after the current
+ * one, which holds the oldest translations.  Their JitTable entries lose
+ * their code address and are flagged so the interpreter may request them
+ * again; the hot ones come back quickly and land in the freed segment.
+ * Every chain is broken first, so nothing can branch into the freed space.
+ *
+ * Returns false if we need a full reset instead.  Must be called with all
+ * threads suspended.
+ */
+static bool evictCodeCacheSegment(void)
+{
+    Thread* thread;
+    u8 startTime = dvmGetRelativeTimeUsec();
+    int inJit = 0;
+    int evicted = 0;
+    unsigned int i;
+
+    /* Only possible once every segment has been filled */
+    if (gDvmJit.codeCacheHighMark < codeSegmentStart(JIT_CODE_CACHE_SEGMENTS))
+        return false;
+
+    /*
+     * A JitTable that couldn't be grown also raises codeCacheFull.
+     * Evicted entries stay in the table, so only a reset will help.
+     */
+    if (gDvmJit.jitTableEntriesUsed >
+        (gDvmJit.jitTableSize - gDvmJit.jitTableSize/4))
+        return false;
+
+    /*
+     * Whole-method translations are not unchained by dvmJitUnchainAll, so
+     * they could keep branching into the evicted segment.  The compiler
+     * thread may be resizing the table, so hold tableLock to walk it.
+     */
+    bool hasMethodEntry = false;
+    dvmLockMutex(&gDvmJit.tableLock);
+    for (i = 0; i < gDvmJit.jitTableSize; i++) {
+        if (gDvmJit.pJitEntryTable[i].u.info.isMethodEntry &&
+            gDvmJit.pJitEntryTable[i].codeAddress != NULL) {
+            hasMethodEntry = true;
+            break;
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+    if (hasMethodEntry)
+        return false;
+
+    /* Same rules as resetCodeCache: clear return addresses, wait for JIT'd code */
+    dvmLockThreadList(NULL);
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        crawlDalvikStack(thread, false);
+        if (thread->inJitCodeCache) {
+            inJit++;
+        }
+    }
+    dvmUnlockThreadList();
+
+    if (inJit) {
+        ALOGD("JIT code cache eviction delayed (%d/%d)",
+             gDvmJit.numCodeCacheEvictions,
+             ++gDvmJit.numCodeCacheResetDelayed);
+        return true;
+    }
+
+    dvmJitUnchainAll();
+
+    dvmLockMutex(&gDvmJit.compilerLock);
+
+    /*
+     * A compilation in flight may be writing into the old segment, so make
+     * it throw its work away.  Orders still queued haven't started, and
+     * can go into the new one.
+     */
+    gDvmJit.cacheVersion++;
+    for (i = 0; i < (unsigned int) gDvmJit.compilerQueueLength; i++) {
+        gDvmJit.compilerWorkQueue[i].result.cacheVersion =
+            gDvmJit.cacheVersion;
+    }
+
+    int victim = (gDvmJit.codeCacheCurrentSegment + 1) %
+                 JIT_CODE_CACHE_SEGMENTS;
+    char* lo = (char *) gDvmJit.codeCache + codeSegmentStart(victim);
+    char* hi = (char *) gDvmJit.codeCache + codeSegmentStart(victim + 1);
+
+    dvmLockMutex(&gDvmJit.tableLock);
+    for (i = 0; i < gDvmJit.jitTableSize; i++) {
+        JitEntry* entry = &gDvmJit.pJitEntryTable[i];
+        char* codeAddress = (char *) entry->codeAddress;
+        if (codeAddress >= lo && codeAddress < hi) {
+            entry->codeAddress = NULL;
+            entry->u.info.profileOffset = 0;
+            entry->u.info.retranslate = true;
+            evicted++;
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+
+    /* Queued inline cache patches may point into the evicted code */
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    gDvmJit.compilerICPatchIndex = 0;
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+
+    dvmCompilerPerfMapRemove(lo, hi);
+
+    UNPROTECT_CODE_CACHE(lo, hi - lo);
+    dvmCompilerCacheClear(lo, hi - lo);
+    dvmCompilerCacheFlush((intptr_t) lo, (intptr_t) hi, 0);
+    PROTECT_CODE_CACHE(lo, hi - lo);
+
+    switchCodeSegment(victim);
+    gDvmJit.numCompilations -= evicted;
+    gDvmJit.numTranslationsEvicted += evicted;
+    memset(gDvmJit.inflightBaseAddr, 0, sizeof(gDvmJit.inflightBaseAddr));
+    gDvmJit.codeCacheFull = false;
+
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+
+    ALOGD("JIT code cache segment %d evicted in %lld ms (%d translations, %d)",
+         victim, (dvmGetRelativeTimeUsec() - startTime) / 1000, evicted,
+         ++gDvmJit.numCodeCacheEvictions);
+    return true;
+}
+
 /*
  * Perform actions that are only safe when all threads are suspended. Currently
  * we do:
- * 1) Check if the code cache is full. If so reset it and restart populating it
- *    from scratch.
- * 2) Patch predicted chaining cells by consuming recorded work orders.
+ * 1) Free the JitTables replaced by online resizing.
+ * 2) Check if the code cache is full. If so evict its oldest segment, or
+ *    reset it and restart populating it from scratch.
+ * 3) Patch predicted chaining cells by consuming recorded work orders.
  */
 void dvmCompilerPerformSafePointChecks(void)
 {
-    if (gDvmJit.codeCacheFull) {
+    dvmJitFreeRetiredTables();
+    if (gDvmJit.codeCacheFull && !evictCodeCacheSegment()) {
         resetCodeCache();
     }
     dvmCompilerPatchInlineCache();
@@ -389,10 +710,9 @@ void dvmCompilerPerformSafePointChecks(void)
 
 static bool compilerThreadStartup(void)
 {
-    JitEntry *pJitTable = NULL;
+    JitTable *pJitTable = NULL;
     unsigned char *pJitProfTable = NULL;
     JitTraceProfCounters *pJitTraceProfCounters = NULL;
-    unsigned int i;
 
     if (!dvmCompilerArchInit())
         goto fail;
@@ -407,12 +727,12 @@ static bool compilerThreadStartup(void)
     }
 
     /* Allocate the initial arena block */
-    if (dvmCompilerHeapInit() == false) {
+    if (dvmCompilerHeapInit(0) == false) {
         goto fail;
     }
 
-    /* Cache the thread pointer */
-    gDvmJit.compilerThread = dvmThreadSelf();
+    /* Tell perf where the templates and translations are */
+    dvmCompilerPerfMapOpen();
 
     dvmLockMutex(&gDvmJit.compilerLock);
 
@@ -433,8 +753,7 @@ static bool compilerThreadStartup(void)
 
     dvmInitMutex(&gDvmJit.tableLock);
     dvmLockMutex(&gDvmJit.tableLock);
-    pJitTable = (JitEntry*)
-                calloc(gDvmJit.jitTableSize, sizeof(*pJitTable));
+    pJitTable = dvmJitAllocTable(gDvmJit.jitTableSize);
     if (!pJitTable) {
         ALOGE("jit table allocation failed");
         dvmUnlockMutex(&gDvmJit.tableLock);
@@ -451,29 +770,45 @@ static bool compilerThreadStartup(void)
     pJitProfTable = (unsigned char *)malloc(JIT_PROF_SIZE);
     if (!pJitProfTable) {
         ALOGE("jit prof table allocation failed");
+        free(pJitTable->entries);
         free(pJitTable);
         dvmUnlockMutex(&gDvmJit.tableLock);
         goto fail;
     }
     memset(pJitProfTable, gDvmJit.threshold, JIT_PROF_SIZE);
-    for (i=0; i < gDvmJit.jitTableSize; i++) {
-       pJitTable[i].u.info.chain = gDvmJit.jitTableSize;
-    }
-    /* Is chain field wide enough for termination pattern? */
-    assert(pJitTable[0].u.info.chain == gDvmJit.jitTableSize);
 
     /* Allocate the trace profiling structure */
     pJitTraceProfCounters = (JitTraceProfCounters*)
                              calloc(1, sizeof(*pJitTraceProfCounters));
     if (!pJitTraceProfCounters) {
         ALOGE("jit trace prof counters allocation failed");
+        free(pJitTable->entries);
         free(pJitTable);
         free(pJitProfTable);
         dvmUnlockMutex(&gDvmJit.tableLock);
         goto fail;
     }
 
-    gDvmJit.pJitEntryTable = pJitTable;
+    /*
+     * Like the profile table, the call site profile is never freed since
+     * mutator threads may still be patching inline caches at shutdown.
+     * Without it the inliner just sticks to the class seen by the trace.
+     */
+    gDvmJit.pCallSiteProfile = (JitCallSiteProfile*)
+        calloc(JIT_CALL_SITE_PROFILE_SIZE, sizeof(JitCallSiteProfile));
+    if (!gDvmJit.pCallSiteProfile) {
+        ALOGW("jit call site profile allocation failed");
+    }
+
+    /* Same for the type check sites, which compiled code writes into */
+    gDvmJit.pTypeCheckSites = (JitTypeCheckSite*)
+        calloc(JIT_TYPE_CHECK_SITES, sizeof(JitTypeCheckSite));
+    if (!gDvmJit.pTypeCheckSites) {
+        ALOGW("jit type check site allocation failed");
+    }
+
+    gDvmJit.pJitTable = pJitTable;
+    gDvmJit.pJitEntryTable = pJitTable->entries;
     gDvmJit.jitTableMask = gDvmJit.jitTableSize - 1;
     gDvmJit.jitTableEntriesUsed = 0;
     gDvmJit.compilerHighWater =
@@ -598,58 +933,13 @@ fail:
 
 }
 
-static void *compilerThreadStart(void *arg)
+/*
+ * Compile work orders until the compiler is shut down.  Every compiler
+ * thread runs this loop; "threadIndex" is 0 for the one that did the
+ * startup.
+ */
+static void runCompilerLoop(int threadIndex)
 {
-    dvmChangeStatus(NULL, THREAD_VMWAIT);
-
-    /*
-     * If we're not running stand-alone, wait a little before
-     * recieving translation requests on the assumption that process start
-     * up code isn't worth compiling.  We'll resume when the framework
-     * signals us that the first screen draw has happened, or the timer
-     * below expires (to catch daemons).
-     *
-     * There is a theoretical race between the callback to
-     * VMRuntime.startJitCompiation and when the compiler thread reaches this
-     * point. In case the callback happens earlier, in order not to permanently
-     * hold the system_server (which is not using the timed wait) in
-     * interpreter-only mode we bypass the delay here.
-     */
-    if (gDvmJit.runningInAndroidFramework &&
-        !gDvmJit.alreadyEnabledViaFramework) {
-        /*
-         * If the current VM instance is the system server (detected by having
-         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
-         * conditional variable to determine whether to start the JIT or not.
-         * If the system server detects that the whole system is booted in
-         * safe mode, the conditional variable will never be signaled and the
-         * system server will remain in the interpreter-only mode. All
-         * subsequent apps will be started with the --enable-safemode flag
-         * explicitly appended.
-         */
-        if (gDvm.systemServerPid == 0) {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
-                              &gDvmJit.compilerLock);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-            ALOGD("JIT started for system_server");
-        } else {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            /*
-             * TUNING: experiment with the delay & perhaps make it
-             * target-specific
-             */
-            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
-                                 &gDvmJit.compilerLock, 3000, 0);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-        }
-        if (gDvmJit.haltCompilerThread) {
-             return NULL;
-        }
-    }
-
-    compilerThreadStartup();
-
     dvmLockMutex(&gDvmJit.compilerLock);
     /*
      * Since the compiler thread will not touch any objects on the heap once
@@ -659,13 +949,32 @@ static void *compilerThreadStart(void *arg)
     while (!gDvmJit.haltCompilerThread) {
         if (workQueueLength() == 0) {
             int cc;
+            int waitMsec = 0;
+
+            /*
+             * Feed saved traces in while there's nothing else to do.  The
+             * first thread does this for all of them.
+             */
+            if (threadIndex == 0 && gDvmJit.warmStartFile != NULL) {
+                dvmUnlockMutex(&gDvmJit.compilerLock);
+                bool queued = dvmCompilerWarmStartIdle(&waitMsec);
+                dvmLockMutex(&gDvmJit.compilerLock);
+                if (queued || workQueueLength() != 0)
+                    continue;
+            }
             cc = pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
             assert(cc == 0);
 #ifdef NDEBUG
             (void)cc; // prevent bug on -Werror
 #endif
-            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
-                              &gDvmJit.compilerLock);
+            if (waitMsec != 0) {
+                /* Wake up to write the warm start profile */
+                dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
+                                    &gDvmJit.compilerLock, waitMsec, 0);
+            } else {
+                pthread_cond_wait(&gDvmJit.compilerQueueActivity,
+                                  &gDvmJit.compilerLock);
+            }
             continue;
         } else {
             do {
@@ -705,10 +1014,17 @@ static void *compilerThreadStart(void *arg)
                 if (gDvmJit.haltCompilerThread) {
                     ALOGD("Compiler shutdown in progress - discarding request");
                 } else if (!gDvmJit.codeCacheFull) {
+                    /* A hot side exit recompiles the trace it leaves */
+                    dvmLockMutex(&gDvmJit.compilerLock);
+                    const u2* exitPC = dvmCompilerGrowTraceTree(&work);
+                    dvmUnlockMutex(&gDvmJit.compilerLock);
                     jmp_buf jmpBuf;
                     work.bailPtr = &jmpBuf;
                     bool aborted = setjmp(jmpBuf);
-                    if (!aborted) {
+                    if (aborted) {
+                        /* The bail may have come from inside the backend */
+                        dvmCompilerAbandonCodegen();
+                    } else {
                         bool codeCompiled = dvmCompilerDoWork(&work);
                         /*
                          * Make sure we are still operating with the
@@ -725,8 +1041,62 @@ static void *compilerThreadStart(void *arg)
                                               work.result.instructionSet,
                                               false, /* not method entry */
                                               work.result.profileCodeSize);
+                            /*
+                             * Translations chained to the root of a grown
+                             * tree (including the root itself, if it
+                             * branches back to its head) would keep running
+                             * the old code.  Unchain them only now that the
+                             * entry points at the tree, so that a chain
+                             * made in between can't be left behind.
+                             */
+                            if (work.result.replaceTranslation)
+                                dvmJitUnchainAll();
+                            if (work.kind == kWorkOrderTrace) {
+                                dvmCompilerWarmStartRecord(
+                                    (JitTraceDescription*) work.info);
+                            }
+                            if (work.kind == kWorkOrderTrace &&
+                                work.result.canGrow) {
+                                dvmCompilerTraceTreeRecord(work.pc,
+                                    (JitTraceDescription*) work.info,
+                                    work.result.codeAddress);
+                            }
+                            if (work.kind == kWorkOrderTrace ||
+                                work.kind == kWorkOrderMethod) {
+                                dvmCompilerPerfMapAdd(
+                                    (JitTraceDescription*) work.info,
+                                    &work.result);
+                            }
                         }
                         dvmUnlockMutex(&gDvmJit.compilerLock);
+
+                        /*
+                         * Out of room in the current segment.  Let this
+                         * trace be requested again, and move on to the
+                         * next segment if it's free.
+                         */
+                        if (gDvmJit.codeCacheFull) {
+                            if (work.kind == kWorkOrderTrace ||
+                                work.kind == kWorkOrderMethod)
+                                dvmJitMarkForRetranslation(work.pc);
+                            dvmCompilerUseFreshCodeSegment();
+                        }
+                    }
+                    /*
+                     * A method the backend gave up on (nothing was installed
+                     * for it) is left to ordinary traces from now on.
+                     */
+                    if (work.kind == kWorkOrderMethod &&
+                        !gDvmJit.codeCacheFull) {
+                        dvmJitMethodTraceFailed(work.pc);
+                    }
+                    /*
+                     * The request at the side exit went into the tree, so
+                     * let the exit ask again if it is ever reached from
+                     * elsewhere.
+                     */
+                    if (exitPC != NULL) {
+                        dvmJitMarkForRetranslation(exitPC);
                     }
                     dvmCompilerArenaReset();
                 }
@@ -740,6 +1110,120 @@ static void *compilerThreadStart(void *arg)
     }
     pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
     dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
+/* Entry point for the compiler threads started after the first one */
+static void *helperThreadStart(void *arg)
+{
+    int threadIndex = (int) (intptr_t) arg;
+
+    if (gDvmJit.compilerThreadPriority != 0) {
+        os_changeThreadPriority(dvmThreadSelf(),
+                                gDvmJit.compilerThreadPriority);
+    }
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+    if (dvmCompilerHeapInit(threadIndex)) {
+        runCompilerLoop(threadIndex);
+    }
+
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+
+    if (gDvm.verboseShutdown)
+        ALOGD("Compiler thread %d shutting down", threadIndex + 1);
+    return NULL;
+}
+
+/*
+ * Start the rest of the compiler threads, now that the first one has set up
+ * the code cache and JitTable they share.  They take work orders from the
+ * same queue; see runCompilerLoop.
+ */
+static void startHelperThreads(void)
+{
+    /* Thread creation may have to wait for a GC */
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+    for (int i = 1; i < gDvmJit.numCompilerThreads; i++) {
+        char name[16];
+
+        if (gDvmJit.haltCompilerThread)
+            break;
+        snprintf(name, sizeof(name), "Compiler %d", i + 1);
+        if (!dvmCreateInternalThread(&gDvmJit.compilerHandles[i], name,
+                                     helperThreadStart, (void *) (intptr_t) i)) {
+            ALOGW("Unable to start compiler thread %d", i + 1);
+            break;
+        }
+        gDvmJit.compilerThreadsStarted = i + 1;
+    }
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+}
+
+static void *compilerThreadStart(void *arg)
+{
+    if (gDvmJit.compilerThreadPriority != 0) {
+        os_changeThreadPriority(dvmThreadSelf(),
+                                gDvmJit.compilerThreadPriority);
+    }
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+    bool warmStart = dvmCompilerWarmStartLoad();
+
+    /*
+     * If we're not running stand-alone, wait a little before
+     * recieving translation requests on the assumption that process start
+     * up code isn't worth compiling.  We'll resume when the framework
+     * signals us that the first screen draw has happened, or the timer
+     * below expires (to catch daemons).
+     *
+     * There is a theoretical race between the callback to
+     * VMRuntime.startJitCompiation and when the compiler thread reaches this
+     * point. In case the callback happens earlier, in order not to permanently
+     * hold the system_server (which is not using the timed wait) in
+     * interpreter-only mode we bypass the delay here.
+     *
+     * The timed delay is skipped as well if there is a warm start profile,
+     * since it already tells us what is worth compiling.
+     */
+    if (gDvmJit.runningInAndroidFramework &&
+        !gDvmJit.alreadyEnabledViaFramework) {
+        /*
+         * If the current VM instance is the system server (detected by having
+         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
+         * conditional variable to determine whether to start the JIT or not.
+         * If the system server detects that the whole system is booted in
+         * safe mode, the conditional variable will never be signaled and the
+         * system server will remain in the interpreter-only mode. All
+         * subsequent apps will be started with the --enable-safemode flag
+         * explicitly appended.
+         */
+        if (gDvm.systemServerPid == 0) {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
+                              &gDvmJit.compilerLock);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+            ALOGD("JIT started for system_server");
+        } else if (!warmStart) {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            /*
+             * TUNING: experiment with the delay & perhaps make it
+             * target-specific
+             */
+            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
+                                 &gDvmJit.compilerLock, 3000, 0);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+        }
+        if (gDvmJit.haltCompilerThread) {
+             return NULL;
+        }
+    }
+
+    if (compilerThreadStartup())
+        startHelperThreads();
+
+    runCompilerLoop(0);
 
     /*
      * As part of detaching the thread we need to call into Java code to update
@@ -757,24 +1241,45 @@ bool dvmCompilerStartup(void)
 {
 
     dvmInitMutex(&gDvmJit.compilerLock);
+    dvmInitMutex(&gDvmJit.compilerCodegenLock);
     dvmInitMutex(&gDvmJit.compilerICPatchLock);
     dvmInitMutex(&gDvmJit.codeCacheProtectionLock);
+    dvmInitMutex(&gDvmJit.warmStartLock);
     dvmLockMutex(&gDvmJit.compilerLock);
     pthread_cond_init(&gDvmJit.compilerQueueActivity, NULL);
     pthread_cond_init(&gDvmJit.compilerQueueEmpty, NULL);
 
     /* Reset the work queue */
-    gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
+    gDvmJit.compilerWorkSequence = 0;
     gDvmJit.compilerQueueLength = 0;
     dvmUnlockMutex(&gDvmJit.compilerLock);
 
+    if (gDvmJit.numCompilerThreads == 0)
+        gDvmJit.numCompilerThreads = 1;
+#ifdef ARCH_IA32
+    /*
+     * All of the x86 lowering runs under compilerCodegenLock, so extra
+     * threads would mostly wait on it.  Stay with one until the lowering
+     * keeps its state per thread.
+     */
+    if (gDvmJit.numCompilerThreads > 1) {
+        ALOGW("-Xjitthreads:%d ignored, x86 uses one compiler thread",
+              gDvmJit.numCompilerThreads);
+        gDvmJit.numCompilerThreads = 1;
+    }
+#endif
+
     /*
      * Defer rest of initialization until we're sure JIT'ng makes sense. Launch
      * the compiler thread, which will do the real initialization if and
-     * when it is signalled to do so.
+     * when it is signalled to do so, and then start any others.
      */
-    return dvmCreateInternalThread(&gDvmJit.compilerHandle, "Compiler",
-                                   compilerThreadStart, NULL);
+    if (!dvmCreateInternalThread(&gDvmJit.compilerHandles[0], "Compiler",
+                                 compilerThreadStart, NULL)) {
+        return false;
+    }
+    gDvmJit.compilerThreadsStarted = 1;
+    return true;
 }
 
 void dvmCompilerShutdown(void)
@@ -793,20 +1298,31 @@ void dvmCompilerShutdown(void)
           sleep(5);
     }
 
-    if (gDvmJit.compilerHandle) {
+    if (gDvmJit.compilerThreadsStarted) {
 
         gDvmJit.haltCompilerThread = true;
 
         dvmLockMutex(&gDvmJit.compilerLock);
-        pthread_cond_signal(&gDvmJit.compilerQueueActivity);
+        pthread_cond_broadcast(&gDvmJit.compilerQueueActivity);
         dvmUnlockMutex(&gDvmJit.compilerLock);
 
-        if (pthread_join(gDvmJit.compilerHandle, &threadReturn) != 0)
-            ALOGW("Compiler thread join failed");
-        else if (gDvm.verboseShutdown)
-            ALOGD("Compiler thread has shut down");
+        /*
+         * The first thread starts the others before it enters its loop, so
+         * once it's gone the count of started threads is final.
+         */
+        for (int i = 0; i < gDvmJit.compilerThreadsStarted; i++) {
+            if (pthread_join(gDvmJit.compilerHandles[i], &threadReturn) != 0)
+                ALOGW("Compiler thread %d join failed", i + 1);
+            else if (gDvm.verboseShutdown)
+                ALOGD("Compiler thread %d has shut down", i + 1);
+        }
     }
 
+    /* The compiler threads are gone, so the saved traces are ours now */
+    dvmCompilerWarmStartSave();
+
+    dvmCompilerPerfMapClose();
+
     /* Break loops within the translation cache */
     dvmJitUnchainAll();
 
@@ -29,6 +29,41 @@
 #define COMPILER_IC_PATCH_QUEUE_SIZE    64
 #define COMPILER_PC_OFFSET_SIZE         100
 
+/*
+ * Upper bound for -Xjitthreads.  The threads share one work queue and run
+ * trace building and optimization in parallel; assembly, and all of the
+ * x86 lowering, is serialized under compilerCodegenLock.
+ */
+#define JIT_MAX_COMPILER_THREADS        4
+
+/*
+ * The code cache past the templates is split into this many segments,
+ * which are filled in order.  Once all of them have been used, a full
+ * cache evicts the oldest segment instead of resetting everything.
+ */
+#define JIT_CODE_CACHE_SEGMENTS         4
+
+/* Most trace descriptions kept for the -Xjitwarmstart profile */
+#define JIT_WARM_START_MAX_TRACES       4096
+
+/* Most side exits remembered for growing trace trees */
+#define JIT_TRACE_TREE_MAX_EXITS        1024
+
+/*
+ * Receiver classes remembered per invoke-virtual/interface site, both in
+ * the call site profile and in the polymorphic inline cache on IA32.
+ */
+#define JIT_POLY_IC_SIZE                4
+
+/* Call sites tracked by the call site profile (must be power of 2) */
+#define JIT_CALL_SITE_PROFILE_SIZE      1024
+
+/* Classes remembered per check-cast/instance-of site on IA32 */
+#define JIT_TYPE_CHECK_IC_SIZE          2
+
+/* Check-cast/instance-of sites given an inline cache (must be power of 2) */
+#define JIT_TYPE_CHECK_SITES            1024
+
 /* Architectural-independent parameters for predicted chains */
 #define PREDICTED_CHAIN_CLAZZ_INIT       0
 #define PREDICTED_CHAIN_METHOD_INIT      0
@@ -84,10 +119,13 @@ typedef struct JitTranslationInfo {
     void *codeAddress;
     JitInstructionSetType instructionSet;
     int profileCodeSize;
+    int codeSize;               // Bytes from codeAddress to the end
     bool discardResult;         // Used for debugging divergence and IC patching
     bool methodCompilationAborted;  // Cannot compile the whole method
     Thread *requestingThread;   // For debugging purpose
     int cacheVersion;           // Used to identify stale trace requests
+    bool replaceTranslation;    // Supersedes the installed code (trace tree)
+    bool canGrow;               // Side exits may extend it (trace tree)
 } JitTranslationInfo;
 
 typedef enum WorkOrderKind {
@@ -98,12 +136,23 @@ typedef enum WorkOrderKind {
     kWorkOrderProfileMode = 4,  // Change profiling mode
 } WorkOrderKind;
 
+/*
+ * Work order priorities.  Trace requests start out at the normal priority
+ * and gain a point each time the interpreter hits the same trace head
+ * again while the request is still queued.  Control and debug orders
+ * always go first.
+ */
+#define COMPILER_PRIORITY_NORMAL        1
+#define COMPILER_PRIORITY_CONTROL       0x7fffffff
+
 typedef struct CompilerWorkOrder {
     const u2* pc;
     WorkOrderKind kind;
     void* info;
     JitTranslationInfo result;
     jmp_buf *bailPtr;
+    int priority;               // Higher is compiled sooner
+    unsigned int sequence;      // Enqueue order, breaks priority ties
 } CompilerWorkOrder;
 
 /* Chain cell for predicted method invocation */
@@ -117,8 +166,24 @@ typedef struct PredictedChainingCell {
     const ClassObject *clazz;   /* key for prediction */
     const Method *method;       /* to lookup native PC from dalvik PC */
     const ClassObject *stagedClazz;   /* possible next key for prediction */
+    const u2 *siteDalvikPC;     /* the invoke, for the call site profile */
 } PredictedChainingCell;
 
+/* Receiver classes seen at an invoke-virtual/interface site */
+typedef struct JitCallSiteProfile {
+    const u2 *dPC;              /* the invoke; NULL if the entry is free */
+    bool megamorphic;           /* more than JIT_POLY_IC_SIZE classes seen */
+    const ClassObject *clazz[JIT_POLY_IC_SIZE];
+    const Method *method[JIT_POLY_IC_SIZE];  /* callee for each class */
+    u4 count[JIT_POLY_IC_SIZE];              /* sampled misses per class */
+} JitCallSiteProfile;
+
+/* Classes that passed a check-cast/instance-of site, most recent first */
+typedef struct JitTypeCheckSite {
+    const u2 *dPC;              /* the type check; NULL if the entry is free */
+    const ClassObject *clazz[JIT_TYPE_CHECK_IC_SIZE];
+} JitTypeCheckSite;
+
 /* Work order for inline cache patching */
 typedef struct ICPatchWorkOrder {
     PredictedChainingCell *cellAddr;    /* Address to be patched */
@@ -197,6 +262,7 @@ bool dvmCompilerStartup(void);
 void dvmCompilerShutdown(void);
 void dvmCompilerForceWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
 bool dvmCompilerWorkEnqueue(const u2* pc, WorkOrderKind kind, void* info);
+void dvmCompilerBumpWorkOrder(const u2* pc);
 void *dvmCheckCodeCache(void *method);
 CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
                                                   bool isCallee);
@@ -205,14 +271,23 @@ bool dvmCompilerCanIncludeThisInstruction(const Method *method,
 bool dvmCompileMethod(const Method *method, JitTranslationInfo *info);
 bool dvmCompileTrace(JitTraceDescription *trace, int numMaxInsts,
                      JitTranslationInfo *info, jmp_buf *bailPtr, int optHints);
+#if defined(ARCH_IA32)
+bool dvmCompileMethodTrace(JitTraceDescription *desc,
+                           JitTranslationInfo *info, jmp_buf *bailPtr);
+#endif
 void dvmCompilerDumpStats(void);
 void dvmCompilerDrainQueue(void);
+bool dvmCompilerUseFreshCodeSegment(void);
+unsigned int dvmCompilerCodeCacheLiveBytes(void);
 void dvmJitUnchainAll(void);
 void dvmJitScanAllClassPointers(void (*callback)(void *ptr));
 void dvmCompilerSortAndPrintTraceProfiles(void);
 void dvmCompilerPerformSafePointChecks(void);
 void dvmCompilerInlineMIR(struct CompilationUnit *cUnit,
                           JitTranslationInfo *info);
+bool dvmCompilerInlineLoopInvokes(struct CompilationUnit *cUnit);
+bool dvmCompilerIsDeadDalvikReg(const Method *method, u4 reg,
+                                unsigned int offset);
 void dvmInitializeSSAConversion(struct CompilationUnit *cUnit);
 int dvmConvertSSARegToDalvik(const struct CompilationUnit *cUnit, int ssaReg);
 bool dvmCompilerLoopOpt(struct CompilationUnit *cUnit);
@@ -226,6 +301,8 @@ bool dvmCompilerDoConstantPropagation(struct CompilationUnit *cUnit,
                                       struct BasicBlock *bb);
 bool dvmCompilerFindInductionVariables(struct CompilationUnit *cUnit,
                                        struct BasicBlock *bb);
+void dvmCompilerValueNumbering(struct CompilationUnit *cUnit);
+void dvmCompilerEscapeAnalysis(struct CompilationUnit *cUnit);
 /* Clear the visited flag for each BB */
 bool dvmCompilerClearVisitedFlag(struct CompilationUnit *cUnit,
                                  struct BasicBlock *bb);
@@ -242,6 +319,28 @@ void dvmCompilerDataFlowAnalysisDispatcher(struct CompilationUnit *cUnit,
 void dvmCompilerMethodSSATransformation(struct CompilationUnit *cUnit);
 bool dvmCompilerBuildLoop(struct CompilationUnit *cUnit);
 void dvmCompilerUpdateGlobalState(void);
+bool dvmCompilerWarmStartLoad(void);
+void dvmCompilerWarmStartClassReady(ClassObject* clazz);
+bool dvmCompilerWarmStartIdle(int* pWaitMsec);
+void dvmCompilerWarmStartRecord(const JitTraceDescription* desc);
+void dvmCompilerWarmStartSave(void);
+const u2* dvmCompilerGrowTraceTree(CompilerWorkOrder* work);
+void dvmCompilerTraceTreeRecord(const u2* rootPC,
+                                const JitTraceDescription* desc,
+                                void* rootCode);
+void dvmCompilerPerfMapOpen(void);
+void dvmCompilerPerfMapClose(void);
+void dvmCompilerPerfMapAdd(const JitTraceDescription* desc,
+                           const JitTranslationInfo* info);
+void dvmCompilerPerfMapRemove(const void* lo, const void* hi);
+void dvmCompilerRecordCallSite(const u2* dPC, const ClassObject* clazz,
+                               const Method* method);
+bool dvmCompilerGetCallSiteProfile(const u2* dPC,
+                                   JitCallSiteProfile* profile);
+JitTypeCheckSite* dvmCompilerGetTypeCheckSite(const u2* dPC);
+extern "C" int dvmJitInstanceofAndCache(const ClassObject* instance,
+                                        const ClassObject* clazz,
+                                        JitTypeCheckSite* site);
 JitTraceDescription *dvmCopyTraceDescriptor(const u2 *pc,
                                             const struct JitEntry *desc);
 extern "C" void *dvmCompilerGetInterpretTemplate();
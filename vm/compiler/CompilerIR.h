@@ -93,6 +93,8 @@ enum ExtendedMIROpcode {
     kMirOpLowerBound,
     kMirOpPunt,
     kMirOpCheckInlinePrediction,        // Gen checks for predicted inlining
+    kMirOpNullCheck,                    // Hoisted null check of vA
+    kMirOpVectorLoop,                   // Vector prologue of the loop body
     kMirOpLast,
 };
 
@@ -107,6 +109,7 @@ typedef enum {
     kMIRInlinedPred,                    // Invoke is inlined via prediction
     kMIRCallee,                         // Instruction is inlined from callee
     kMIRInvokeMethodJIT,                // Callee is JIT'ed as a whole method
+    kMIRValueReused,                    // Load rewritten as a move of its value
 } MIROptimizationFlagPositons;
 
 #define MIR_IGNORE_NULL_CHECK           (1 << kMIRIgnoreNullCheck)
@@ -117,12 +120,18 @@ typedef enum {
 #define MIR_INLINED_PRED                (1 << kMIRInlinedPred)
 #define MIR_CALLEE                      (1 << kMIRCallee)
 #define MIR_INVOKE_METHOD_JIT           (1 << kMIRInvokeMethodJIT)
+#define MIR_VALUE_REUSED                (1 << kMIRValueReused)
 
 typedef struct CallsiteInfo {
     const char *classDescriptor;
     Object *classLoader;
     const Method *method;
     LIR *misPredBranchOver;
+    /* Other profiled receiver classes that dispatch to the same method */
+    struct CallsiteInfo *polyNext;
+    /* Guards of the other targets inlined at the same call site, in order */
+    struct CallsiteInfo *prevTarget;
+    struct CallsiteInfo *nextTarget;
 } CallsiteInfo;
 
 typedef struct MIR {
@@ -139,9 +148,84 @@ typedef struct MIR {
         const Method *calleeMethod;
         // Used by the inlined invoke to find the class and method pointers
         CallsiteInfo *callsiteInfo;
+        // Used by kMirOpVectorLoop to describe the vectorized body
+        struct VectorLoopInfo *vectorLoopInfo;
     } meta;
 } MIR;
 
+/*
+ * A Dalvik register kept in a physical register over part of a loop body.
+ * Positions are MIR sequence numbers along the body; position 0 is the
+ * loop entry block.
+ */
+typedef struct PromotedInterval {
+    int vReg;
+    int slot;                   // index into the target's promotion regs
+    int start;                  // defining MIR, 0 if live into the body
+    int end;                    // last MIR that needs it
+    int weight;                 // references, boosted for invariants/IVs
+} PromotedInterval;
+
+/*
+ * A loop body rewritten as operations on vector registers, each holding
+ * one value per lane.  See Vectorize.cpp.
+ */
+#define VECTOR_MAX_REGS             7
+#define VECTOR_MAX_OPS              24
+#define VECTOR_MAX_ALIAS_CHECKS     4
+
+typedef enum VectorRegKind {
+    kVectorTemp,                // defined by an op in the body
+    kVectorInvariant,           // vReg broadcast to every lane
+    kVectorConstant,            // value broadcast to every lane
+    kVectorSum,                 // partial sums of vReg, folded back on exit
+} VectorRegKind;
+
+typedef struct VectorReg {
+    VectorRegKind kind;
+    int vReg;
+    int value;
+} VectorReg;
+
+typedef enum VectorOpKind {
+    kVectorLoad,                // dst = vReg[i + imm], lane by lane
+    kVectorStore,               // vReg[i + imm] = src1, lane by lane
+    kVectorAdd,
+    kVectorSub,
+    kVectorAnd,
+    kVectorOr,
+    kVectorXor,
+    kVectorShl,                 // dst = src1 << imm
+    kVectorShr,
+    kVectorUshr,
+    kVectorAddFloat,
+    kVectorSubFloat,
+    kVectorMulFloat,
+    kVectorDivFloat,
+} VectorOpKind;
+
+typedef struct VectorOp {
+    VectorOpKind kind;
+    int dst;
+    int src1;
+    int src2;
+    int vReg;                   // array of a load or store
+    int imm;                    // index offset or shift count
+} VectorOp;
+
+typedef struct VectorLoopInfo {
+    int elemSize;               // 1, 2 or 4 bytes per lane
+    int ivReg;                  // loop counter, stepping by one
+    int endReg;                 // exit test compares the counter to this
+    bool endInclusive;          // exit test is OP_IF_GT rather than OP_IF_GE
+    int numRegs;
+    VectorReg regs[VECTOR_MAX_REGS];
+    int numOps;
+    VectorOp ops[VECTOR_MAX_OPS];
+    int numAliasChecks;         // pairs of arrays that must not be the same
+    int aliasChecks[VECTOR_MAX_ALIAS_CHECKS][2];
+} VectorLoopInfo;
+
 struct BasicBlockDataFlow;
 
 /* For successorBlockList */
@@ -253,6 +337,11 @@ typedef struct CompilationUnit {
     RegLocation *regLocation;
     int sequenceNumber;
 
+    /* Loop register promotion, see dvmCompilerLoopRegAlloc */
+    PromotedInterval *promotedIntervals;
+    int numPromotedIntervals;
+    int loopBodyLength;                 // seqNum of the last MIR in the body
+
     /*
      * Set to the Dalvik PC of the switch instruction if it has more than
      * MAX_CHAINED_SWITCH_CASES cases.
@@ -294,6 +383,8 @@ void dvmCompilerPrependMIR(BasicBlock *bb, MIR *mir);
 
 void dvmCompilerInsertMIRAfter(BasicBlock *bb, MIR *currentMIR, MIR *newMIR);
 
+void dvmCompilerRemoveMIR(BasicBlock *bb, MIR *mir);
+
 void dvmCompilerAppendLIR(CompilationUnit *cUnit, LIR *lir);
 
 void dvmCompilerInsertLIRBefore(LIR *currentLIR, LIR *newLIR);
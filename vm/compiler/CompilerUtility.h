@@ -22,8 +22,14 @@
 /* Each arena page has some overhead, so take a few bytes off 8k */
 #define ARENA_DEFAULT_SIZE 8100
 
-/* Allocate the initial memory block for arena-based allocation */
-bool dvmCompilerHeapInit(void);
+/*
+ * Allocate the initial memory block for arena-based allocation on the
+ * calling compiler thread
+ */
+bool dvmCompilerHeapInit(int threadIndex);
+
+/* Slot of the calling compiler thread, from 0 to numCompilerThreads - 1 */
+int dvmCompilerThreadIndex(void);
 
 typedef struct ArenaMemBlock {
     size_t blockSize;
@@ -36,6 +42,11 @@ void *dvmCompilerNew(size_t size, bool zero);
 
 void dvmCompilerArenaReset(void);
 
+/* Serialize code generation that uses state shared by compiler threads */
+void dvmCompilerLockCodegen(void);
+void dvmCompilerUnlockCodegen(void);
+void dvmCompilerAbandonCodegen(void);
+
 typedef struct GrowableList {
     size_t numAllocated;
     size_t numUsed;
@@ -17,6 +17,7 @@
 #include "Dalvik.h"
 #include "Dataflow.h"
 #include "Loop.h"
+#include "codegen/Optimizer.h"
 #include "libdex/DexOpcodes.h"
 
 /*
@@ -1743,4 +1744,8 @@ void dvmCompilerNonLoopAnalysis(CompilationUnit *cUnit)
     dvmCompilerDataFlowAnalysisDispatcher(cUnit, dvmCompilerDoSSAConversion,
                                           kAllNodes,
                                           false /* isIterative */);
+
+    if (!(gDvmJit.disableOpt & (1 << kValueNumbering))) {
+        dvmCompilerValueNumbering(cUnit);
+    }
 }
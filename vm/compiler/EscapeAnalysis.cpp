@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Escape analysis and scalar replacement of allocations in loop bodies.
+ *
+ * An object made by a new-instance in the loop body that is only ever the
+ * object of non-volatile field gets and puts - in the body itself or in the
+ * callees the inliner expanded there, the constructor in particular - is
+ * never seen by anything but the iteration that made it.  Its fields can
+ * live in the registers the stored values are already in instead.  Walking
+ * the body in order, the last store to each field is remembered; a load
+ * becomes a move from the register the stored value is still in, or a zero
+ * constant if nothing was stored, stores are deleted and the new-instance
+ * itself becomes a null constant in its register.
+ *
+ * Wherever the loop is left the interpreter picks up the Dalvik registers,
+ * and the one the object was allocated into holds null instead.  That is
+ * fine where the register is dead.  Where it isn't and the exit is a branch
+ * out of the loop, the object is materialized on the way out: a new block
+ * on the exit edge allocates it again and stores the current field values
+ * into it before going on to the chaining cell.  Only primitive fields are
+ * rebuilt, since a reference that only lives in a register is not a root
+ * the register maps know about.  For the same reason a stored reference may
+ * only be loaded back before the next point the GC can run at.  Exceptions
+ * and the back branch can't take a detour, so the register has to be dead
+ * there.
+ *
+ * Classes with finalizers or reference semantics are never replaced, since
+ * allocating those has effects of its own.
+ *
+ * The x86 backend re-reads the bytecode at mir->offset for most opcodes and
+ * doesn't inline bodies, so the pass is not used there.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+#include "Dataflow.h"
+#include "Loop.h"
+
+#ifndef ARCH_IA32
+
+/* Fields tracked per allocation */
+#define MAX_REPLACED_FIELDS     8
+/* Exits an allocation may be materialized at */
+#define MAX_MATERIALIZED_EXITS  4
+
+typedef struct ReplacedField {
+    int offset;                 // byte offset in the object
+    MIR *store;                 // last store seen so far, or NULL
+    bool gcSinceStore;          // the GC may have run since the store
+} ReplacedField;
+
+typedef struct EscapeState {
+    CompilationUnit *cUnit;
+    BasicBlock *firstBB;
+    int *regSSA;                // SSA name each Dalvik reg holds
+    MIR *alloc;                 // the new-instance being replaced
+    MIR *origAlloc;             // its original form, for materialization
+    int def;                    // SSA name of the new object
+    int reg;                    // Dalvik reg it was allocated into
+    ReplacedField fields[MAX_REPLACED_FIELDS];
+    int numFields;
+    int numMaterialized;
+} EscapeState;
+
+static int dalvikReg(const CompilationUnit *cUnit, int ssaName)
+{
+    return DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaName));
+}
+
+static bool isInstFieldGet(Opcode opcode)
+{
+    return (opcode >= OP_IGET && opcode <= OP_IGET_SHORT) ||
+           (opcode >= OP_IGET_QUICK && opcode <= OP_IGET_OBJECT_QUICK);
+}
+
+static bool isInstFieldPut(Opcode opcode)
+{
+    return (opcode >= OP_IPUT && opcode <= OP_IPUT_SHORT) ||
+           (opcode >= OP_IPUT_QUICK && opcode <= OP_IPUT_OBJECT_QUICK);
+}
+
+/* Index of the object among the uses of a field get or put, or -1 */
+static int objectUseIndex(const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+
+    if (isInstFieldGet(opcode))
+        return 0;
+    if (isInstFieldPut(opcode))
+        return mir->ssaRep->numUses - 1;
+    return -1;
+}
+
+/* Byte offset of the field a get or put accesses, or -1 if not known */
+static int fieldOffset(const CompilationUnit *cUnit, const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+
+    if (opcode >= OP_IGET_QUICK && opcode <= OP_IPUT_OBJECT_QUICK)
+        return mir->dalvikInsn.vC;
+
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) ?
+                           mir->meta.calleeMethod : cUnit->method;
+    const InstField *field = (const InstField *)
+        method->clazz->pDvmDex->pResFields[mir->dalvikInsn.vC];
+    if (field == NULL || dvmIsVolatileField(field))
+        return -1;
+    return field->byteOffset;
+}
+
+/* Can the loop be left through an exception at this MIR? */
+static bool mayThrow(const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int flags = dexGetFlagsFromOpcode(opcode);
+
+    if ((mir->OptimizationFlags & MIR_INLINED) || !(flags & kInstrCanThrow))
+        return false;
+
+    int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+    if ((dfAttributes & DF_HAS_NR_CHECKS) && opcode != OP_APUT_OBJECT) {
+        return (mir->OptimizationFlags &
+                (MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK)) !=
+               (MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK);
+    }
+    if (isInstFieldGet(opcode) || isInstFieldPut(opcode))
+        return !(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK);
+    return true;
+}
+
+/* Can the GC run while this MIR executes? */
+static bool mayCollect(const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+
+    if (mir->OptimizationFlags & MIR_INLINED)
+        return false;
+    switch (opcode) {
+        case OP_NEW_INSTANCE:
+        case OP_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY_RANGE:
+        case OP_MONITOR_ENTER:
+            return true;
+        default:
+            return (dexGetFlagsFromOpcode(opcode) & kInstrInvoke) != 0;
+    }
+}
+
+/* Allocating anything else may have effects besides making an object */
+static bool isReplaceableClass(const ClassObject *clazz)
+{
+    return clazz != NULL && dvmIsClassInitialized(clazz) &&
+           !(clazz->accessFlags & (ACC_INTERFACE | ACC_ABSTRACT)) &&
+           !IS_CLASS_FLAG_SET(clazz, CLASS_ISFINALIZABLE) &&
+           !IS_CLASS_FLAG_SET(clazz, CLASS_ISREFERENCE);
+}
+
+static bool isUsedInLoop(const EscapeState *state, int ssaName)
+{
+    BasicBlock *bb;
+    MIR *mir;
+
+    for (bb = state->firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(state->firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir != NULL; mir = mir->next) {
+            SSARepresentation *ssaRep = mir->ssaRep;
+            for (int i = 0; ssaRep != NULL && i < ssaRep->numUses; i++) {
+                if (ssaRep->uses[i] == ssaName)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Does the new object stay within the iteration?  It may only be the
+ * object of field accesses, be passed to inlined invokes, whose callee
+ * MIRs use it on their own, and flow into phis nothing reads.
+ */
+static bool isLocalObject(const EscapeState *state)
+{
+    BasicBlock *bb;
+    MIR *mir;
+
+    for (bb = state->firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(state->firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir != NULL; mir = mir->next) {
+            SSARepresentation *ssaRep = mir->ssaRep;
+            for (int i = 0; ssaRep != NULL && i < ssaRep->numUses; i++) {
+                if (ssaRep->uses[i] != state->def)
+                    continue;
+                if ((int) mir->dalvikInsn.opcode == (int) kMirOpPhi) {
+                    if (isUsedInLoop(state, ssaRep->defs[0]))
+                        return false;
+                } else if (!(mir->OptimizationFlags & MIR_INLINED) &&
+                           objectUseIndex(mir) != i) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Can the loop be left for "offset" with null in place of the object?
+ * The interpreter resumes there, so the register must not be read again.
+ */
+static bool isDeadAt(const EscapeState *state, unsigned int offset)
+{
+    return dvmCompilerIsDeadDalvikReg(state->cUnit->method, state->reg,
+                                      offset);
+}
+
+static bool holdsObject(const EscapeState *state)
+{
+    return state->regSSA[state->reg] == state->def;
+}
+
+/* Is the value "store" wrote still in the registers it was stored from? */
+static bool isStoredValueHeld(const EscapeState *state, const MIR *store)
+{
+    SSARepresentation *ssaRep = store->ssaRep;
+
+    for (int i = 0; i < ssaRep->numUses - 1; i++) {
+        int ssaName = ssaRep->uses[i];
+        if (state->regSSA[dalvikReg(state->cUnit, ssaName)] != ssaName)
+            return false;
+    }
+    return true;
+}
+
+static ReplacedField *findField(EscapeState *state, int offset)
+{
+    for (int i = 0; i < state->numFields; i++) {
+        if (state->fields[i].offset == offset)
+            return &state->fields[i];
+    }
+    if (state->numFields == MAX_REPLACED_FIELDS)
+        return NULL;
+
+    ReplacedField *field = &state->fields[state->numFields++];
+    field->offset = offset;
+    field->store = NULL;
+    field->gcSinceStore = false;
+    return field;
+}
+
+/* Turn a load into a move from the register holding the stored value */
+static void rewriteLoadAsMove(MIR *mir, const MIR *store)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int numWords = ssaRep->numDefs;
+
+    ssaRep->numUses = numWords;
+    ssaRep->uses = (int *) dvmCompilerNew(sizeof(int) * numWords, false);
+    ssaRep->fpUse = (bool *) dvmCompilerNew(sizeof(bool) * numWords, false);
+    for (int i = 0; i < numWords; i++) {
+        ssaRep->uses[i] = store->ssaRep->uses[i];
+        ssaRep->fpUse[i] = ssaRep->fpDef[i];
+    }
+
+    /*
+     * The verifier only lets values of the field's type be stored, so the
+     * sub-word loads would give back exactly what went in.
+     */
+    mir->dalvikInsn.opcode =
+        numWords == 2 ? OP_MOVE_WIDE :
+        (opcode == OP_IGET_OBJECT || opcode == OP_IGET_OBJECT_QUICK) ?
+            OP_MOVE_OBJECT : OP_MOVE;
+    mir->dalvikInsn.vB = store->dalvikInsn.vA;
+    mir->dalvikInsn.vC = 0;
+    mir->OptimizationFlags |= MIR_VALUE_REUSED;
+}
+
+/* A field nothing was stored to still holds zero, false or null */
+static void rewriteLoadAsZero(MIR *mir)
+{
+    mir->dalvikInsn.opcode =
+        mir->ssaRep->numDefs == 2 ? OP_CONST_WIDE_16 : OP_CONST_4;
+    mir->dalvikInsn.vB = 0;
+    mir->dalvikInsn.vC = 0;
+    mir->ssaRep->numUses = 0;
+    mir->OptimizationFlags |= MIR_VALUE_REUSED;
+}
+
+static bool replaceAccess(EscapeState *state, BasicBlock *bb, MIR *mir,
+                          bool rewrite)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int offset = fieldOffset(state->cUnit, mir);
+    ReplacedField *field = offset < 0 ? NULL : findField(state, offset);
+
+    if (field == NULL)
+        return false;
+
+    if (isInstFieldPut(opcode)) {
+        field->store = mir;
+        field->gcSinceStore = false;
+        if (rewrite)
+            dvmCompilerRemoveMIR(bb, mir);
+        return true;
+    }
+
+    MIR *store = field->store;
+    if (store == NULL) {
+        if (rewrite)
+            rewriteLoadAsZero(mir);
+        return true;
+    }
+    if (store->ssaRep->numUses - 1 != mir->ssaRep->numDefs ||
+        !isStoredValueHeld(state, store)) {
+        return false;
+    }
+    if ((opcode == OP_IGET_OBJECT || opcode == OP_IGET_OBJECT_QUICK) &&
+        field->gcSinceStore) {
+        return false;
+    }
+    if (rewrite)
+        rewriteLoadAsMove(mir, store);
+    return true;
+}
+
+/* Put a new block on the edge from "bb" to the chaining cell "exit" */
+static BasicBlock *splitExitEdge(CompilationUnit *cUnit, BasicBlock *bb,
+                                 BasicBlock *exit)
+{
+    /* Another allocation has been materialized on this edge already */
+    if (exit->blockType == kDalvikByteCode)
+        return exit;
+
+    BasicBlock *newBB = dvmCompilerNewBB(kDalvikByteCode, cUnit->numBlocks++);
+    dvmInsertGrowableList(&cUnit->blockList, (intptr_t) newBB);
+    newBB->startOffset = exit->startOffset;
+    newBB->fallThrough = exit;
+    newBB->needFallThroughBranch = true;
+    dvmCompilerSetBit(newBB->predecessors, bb->id);
+    dvmCompilerClearBit(exit->predecessors, bb->id);
+    dvmCompilerSetBit(exit->predecessors, newBB->id);
+    if (bb->taken == exit) {
+        bb->taken = newBB;
+    } else {
+        bb->fallThrough = newBB;
+    }
+    return newBB;
+}
+
+static MIR *copyMIR(const MIR *mir)
+{
+    MIR *newMIR = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+
+    *newMIR = *mir;
+    newMIR->prev = newMIR->next = NULL;
+    newMIR->seqNum = 0;
+    return newMIR;
+}
+
+/*
+ * Rebuild the object on the way from "bb" to "exit" from the values its
+ * fields hold at the end of "bb".
+ */
+static bool materializeAt(EscapeState *state, BasicBlock *bb,
+                          BasicBlock *exit, bool rewrite)
+{
+    int i;
+
+    if (state->numMaterialized == MAX_MATERIALIZED_EXITS)
+        return false;
+    for (i = 0; i < state->numFields; i++) {
+        MIR *store = state->fields[i].store;
+        if (store == NULL)
+            continue;
+        Opcode opcode = store->dalvikInsn.opcode;
+        if (opcode == OP_IPUT_OBJECT || opcode == OP_IPUT_OBJECT_QUICK ||
+            !isStoredValueHeld(state, store)) {
+            return false;
+        }
+    }
+    state->numMaterialized++;
+    if (!rewrite)
+        return true;
+
+    BasicBlock *exitBB = splitExitEdge(state->cUnit, bb, exit);
+
+    /* An allocation failure is reported where the interpreter resumes */
+    MIR *newMIR = copyMIR(state->origAlloc);
+    newMIR->offset = exitBB->startOffset;
+    dvmCompilerAppendMIR(exitBB, newMIR);
+
+    for (i = 0; i < state->numFields; i++) {
+        if (state->fields[i].store == NULL)
+            continue;
+        newMIR = copyMIR(state->fields[i].store);
+        newMIR->OptimizationFlags |= MIR_IGNORE_NULL_CHECK;
+        dvmCompilerAppendMIR(exitBB, newMIR);
+    }
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.allocsMaterialized++;
+#endif
+    return true;
+}
+
+/* Check the branches out of the loop at the end of "bb" */
+static bool visitExits(EscapeState *state, BasicBlock *bb, bool rewrite)
+{
+    BasicBlock *next = dvmCompilerNextLoopBlock(state->firstBB, bb);
+    BasicBlock *succ[2] = {bb->taken, bb->fallThrough};
+
+    if (!holdsObject(state))
+        return true;
+    for (int i = 0; i < 2; i++) {
+        BasicBlock *exit = succ[i];
+        if (exit == NULL || exit == next || exit == state->firstBB ||
+            isDeadAt(state, exit->startOffset)) {
+            continue;
+        }
+        if (!materializeAt(state, bb, exit, rewrite))
+            return false;
+    }
+    return true;
+}
+
+/* Check or replace one MIR after the allocation */
+static bool visitMIR(EscapeState *state, BasicBlock *bb, MIR *mir,
+                     bool rewrite)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    bool holds = holdsObject(state);
+
+    if ((int) mir->dalvikInsn.opcode >= (int) kMirOpFirst)
+        return (int) mir->dalvikInsn.opcode == (int) kMirOpPhi || !holds;
+
+    int objIdx = objectUseIndex(mir);
+    if (objIdx >= 0 && ssaRep->uses[objIdx] == state->def)
+        return replaceAccess(state, bb, mir, rewrite);
+
+    if (mayCollect(mir)) {
+        for (int i = 0; i < state->numFields; i++)
+            state->fields[i].gcSinceStore = true;
+    }
+    if (holds && mayThrow(mir) && !isDeadAt(state, mir->offset))
+        return false;
+
+    /* An inlined move-result renames what is in the register in place */
+    if (holds && (mir->OptimizationFlags & MIR_INLINED)) {
+        for (int i = 0; i < ssaRep->numDefs; i++) {
+            if (dalvikReg(state->cUnit, ssaRep->defs[i]) == state->reg)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void defineRegs(EscapeState *state, const MIR *mir)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+
+    for (int i = 0; ssaRep != NULL && i < ssaRep->numDefs; i++) {
+        state->regSSA[dalvikReg(state->cUnit, ssaRep->defs[i])] =
+            ssaRep->defs[i];
+    }
+}
+
+/*
+ * If the register still holds the object around the back branch, the
+ * ways out of the next iteration before it allocates see it as well.
+ */
+static bool checkExitsBefore(const EscapeState *state)
+{
+    BasicBlock *bb;
+    MIR *mir;
+
+    /* Suspend requests leave at the loop head */
+    if (!isDeadAt(state, state->firstBB->startOffset))
+        return false;
+
+    for (bb = state->firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(state->firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir != NULL; mir = mir->next) {
+            if (mir == state->alloc)
+                return true;
+            if ((int) mir->dalvikInsn.opcode >= (int) kMirOpFirst) {
+                if ((int) mir->dalvikInsn.opcode != (int) kMirOpPhi)
+                    return false;
+            } else if (mayThrow(mir) && !isDeadAt(state, mir->offset)) {
+                return false;
+            }
+        }
+        BasicBlock *next = dvmCompilerNextLoopBlock(state->firstBB, bb);
+        BasicBlock *succ[2] = {bb->taken, bb->fallThrough};
+        for (int i = 0; i < 2; i++) {
+            if (succ[i] != NULL && succ[i] != next &&
+                succ[i] != state->firstBB &&
+                !isDeadAt(state, succ[i]->startOffset)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Walk the loop body and replace the allocation, or with "rewrite" unset
+ * just find out whether it can be.  Both walks take the same decisions.
+ */
+static bool replaceAllocation(EscapeState *state, bool rewrite)
+{
+    CompilationUnit *cUnit = state->cUnit;
+    BasicBlock *bb;
+    MIR *mir;
+    MIR *nextMIR;
+    bool seen = false;
+
+    for (int i = 0; i < cUnit->numDalvikRegisters; i++)
+        state->regSSA[i] = i;
+    state->numFields = 0;
+    state->numMaterialized = 0;
+
+    for (bb = state->firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(state->firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir != NULL; mir = nextMIR) {
+            nextMIR = mir->next;
+            if (mir == state->alloc) {
+                seen = true;
+                if (rewrite) {
+                    mir->dalvikInsn.opcode = OP_CONST_4;
+                    mir->dalvikInsn.vB = 0;
+                }
+            } else if (seen && !visitMIR(state, bb, mir, rewrite)) {
+                return false;
+            }
+            /* Deleted stores define nothing */
+            defineRegs(state, mir);
+        }
+        if (seen && !visitExits(state, bb, rewrite))
+            return false;
+    }
+    return !holdsObject(state) || checkExitsBefore(state);
+}
+
+static bool tryReplaceAllocation(EscapeState *state, MIR *mir)
+{
+    CompilationUnit *cUnit = state->cUnit;
+    const ClassObject *clazz = (const ClassObject *)
+        cUnit->method->clazz->pDvmDex->pResClasses[mir->dalvikInsn.vB];
+
+    if ((mir->OptimizationFlags & MIR_CALLEE) || !isReplaceableClass(clazz))
+        return false;
+
+    state->alloc = mir;
+    state->def = mir->ssaRep->defs[0];
+    state->reg = mir->dalvikInsn.vA;
+    if (!isLocalObject(state) || !replaceAllocation(state, false))
+        return false;
+
+    state->origAlloc = copyMIR(mir);
+    replaceAllocation(state, true);
+    return true;
+}
+
+/* Main entry point of escape analysis, run on the SSA form of a loop */
+void dvmCompilerEscapeAnalysis(CompilationUnit *cUnit)
+{
+    EscapeState *state =
+        (EscapeState *) dvmCompilerNew(sizeof(EscapeState), true);
+    BasicBlock *bb;
+    MIR *mir;
+    int numReplaced = 0;
+
+    state->cUnit = cUnit;
+    state->firstBB = cUnit->entryBlock->fallThrough;
+    state->regSSA = (int *)
+        dvmCompilerNew(sizeof(int) * cUnit->numDalvikRegisters, false);
+
+    for (bb = state->firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(state->firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir != NULL; mir = mir->next) {
+            if (mir->dalvikInsn.opcode == OP_NEW_INSTANCE &&
+                tryReplaceAllocation(state, mir)) {
+                numReplaced++;
+            }
+        }
+    }
+
+    if (numReplaced && cUnit->printMe) {
+        ALOGD("LOOP %s@%#x: %d allocations eliminated",
+              cUnit->method->name, cUnit->entryBlock->startOffset,
+              numReplaced);
+    }
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.allocsEliminated += numReplaced;
+    if (numReplaced)
+        gDvmJit.loopsWithAllocsEliminated++;
+#endif
+}
+
+#endif
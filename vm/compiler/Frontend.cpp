@@ -283,6 +283,9 @@ CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
 
     /* For lookup only */
     dummyMethodEntry.method = method;
+
+    /* Compiler threads may look up the same method at the same time */
+    dvmHashTableLock(gDvmJit.methodStatsTable);
     realMethodEntry = (CompilerMethodStats *)
         dvmHashTableLookup(gDvmJit.methodStatsTable,
                            hashValue,
@@ -301,6 +304,7 @@ CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
                            (HashCompareFunc) compareMethod,
                            true);
     }
+    dvmHashTableUnlock(gDvmJit.methodStatsTable);
 
     /* This method is invoked as a callee and has been analyzed - just return */
     if ((isCallee == true) && (realMethodEntry->attributes & METHOD_IS_CALLEE))
@@ -1355,6 +1359,44 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
     return false;
 }
 
+#ifndef ARCH_IA32
+/*
+ * A loop body can't make calls, but a static or direct call may stay in it
+ * if dvmCompilerInlineLoopInvokes can expand the callee in place later on.
+ * Record the callee for it.
+ */
+static bool isLoopInlineCandidate(CompilationUnit *cUnit, MIR *insn)
+{
+    const Method *callee;
+
+    if (gDvmJit.methodTraceSupport ||
+        (gDvmJit.disableOpt & (1 << kMethodInlining)) ||
+        SINGLE_STEP_OP(insn->dalvikInsn.opcode)) {
+        return false;
+    }
+
+    switch (insn->dalvikInsn.opcode) {
+        case OP_INVOKE_STATIC:
+        case OP_INVOKE_STATIC_RANGE:
+        case OP_INVOKE_DIRECT:
+        case OP_INVOKE_DIRECT_RANGE:
+            callee = cUnit->method->clazz->pDvmDex->
+                pResMethods[insn->dalvikInsn.vB];
+            break;
+        default:
+            return false;
+    }
+    if (callee == NULL || dvmIsNativeMethod(callee))
+        return false;
+
+    insn->meta.callsiteInfo =
+        (CallsiteInfo *) dvmCompilerNew(sizeof(CallsiteInfo), true);
+    insn->meta.callsiteInfo->method = callee;
+    cUnit->hasInvoke = true;
+    return true;
+}
+#endif
+
 /* Extending the trace by crawling the code from curBlock */
 static bool exhaustTrace(CompilationUnit *cUnit, BasicBlock *curBlock)
 {
@@ -1397,6 +1439,23 @@ static bool exhaustTrace(CompilationUnit *cUnit, BasicBlock *curBlock)
         codePtr += width;
         int flags = dexGetFlagsFromOpcode(insn->dalvikInsn.opcode);
 
+#ifndef ARCH_IA32
+        /* The callee returns to the next block, which is still parsed */
+        if ((flags & kInstrInvoke) && isLoopInlineCandidate(cUnit, insn)) {
+            BasicBlock *returnBlock = findBlock(cUnit, curOffset + width,
+                                                /* split */
+                                                true,
+                                                /* create */
+                                                true,
+                                                /* immedPredBlockP */
+                                                &curBlock);
+            curBlock->fallThrough = returnBlock;
+            dvmCompilerSetBit(returnBlock->predecessors, curBlock->id);
+            exhaustTrace(cUnit, returnBlock);
+            break;
+        }
+#endif
+
         /* Stop extending the trace after seeing these instructions */
         if (flags & (kInstrCanReturn | kInstrCanSwitch | kInstrInvoke)) {
             curBlock->fallThrough = cUnit->exitBlock;
@@ -1647,15 +1706,19 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
     const u2 *startCodePtr = codePtr;
     BasicBlock *curBB, *entryCodeBB;
     int numBlocks = 0;
-    static int compilationId;
+    static volatile int32_t compilationId;
     CompilationUnit cUnit;
     GrowableList *blockList;
 #if defined(WITH_JIT_TUNING)
     CompilerMethodStats *methodStats;
 #endif
 
-    /* If we've already compiled this trace, just return success */
-    if (dvmJitGetTraceAddr(startCodePtr) && !info->discardResult) {
+    /*
+     * If we've already compiled this trace, just return success.  A grown
+     * trace tree is meant to replace what is there.
+     */
+    if (dvmJitGetTraceAddr(startCodePtr) && !info->discardResult &&
+        !info->replaceTranslation) {
         /*
          * Make sure the codeAddress is NULL so that it won't clobber the
          * existing entry.
@@ -1669,7 +1732,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
         return false;
     }
 
-    compilationId++;
+    android_atomic_inc(&compilationId);
     memset(&cUnit, 0, sizeof(CompilationUnit));
 
 #if defined(WITH_JIT_TUNING)
@@ -2031,7 +2094,8 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
                 } else {
                     newBB = dvmCompilerNewBB(kChainingCellInvokePredicted,
                                              numBlocks++);
-                    newBB->startOffset = 0;
+                    /* The invoke, to tie inline cache misses to the site */
+                    newBB->startOffset = curOffset;
                 }
             /* For unconditional branches, request a hot chaining cell */
             } else {
@@ -2173,5 +2237,347 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
     methodStats->nativeSize += cUnit.totalSize;
 #endif
 
+    /* The whole description made it in, so its side exits can grow it */
+    info->canGrow = numMaxInsts == JIT_MAX_TRACE_LEN;
+
     return info->codeAddress != NULL;
 }
+
+#if defined(ARCH_IA32)
+/*
+ * Whole-method traces take in code the interpreter may never have run, so
+ * on top of dvmCompilerCanIncludeThisInstruction make sure everything the
+ * x86 lowering reads out of the resolved tables is there.
+ */
+static bool canIncludeInMethodTrace(const Method *method,
+                                    const DecodedInstruction *insn)
+{
+    DvmDex *pDvmDex = method->clazz->pDvmDex;
+
+    switch (insn->opcode) {
+        case OP_NEW_INSTANCE: {
+            ClassObject *classPtr = pDvmDex->pResClasses[insn->vB];
+            if (classPtr == NULL || !dvmIsClassInitialized(classPtr)) {
+                return false;
+            }
+            return true;
+        }
+        case OP_INSTANCE_OF:
+        case OP_NEW_ARRAY:
+            return pDvmDex->pResClasses[insn->vC] != NULL;
+        case OP_FILLED_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY_RANGE:
+            return pDvmDex->pResClasses[insn->vB] != NULL;
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+        case OP_IPUT:
+        case OP_IPUT_WIDE:
+        case OP_IPUT_OBJECT:
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+        case OP_IGET_VOLATILE:
+        case OP_IGET_WIDE_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IPUT_VOLATILE:
+        case OP_IPUT_WIDE_VOLATILE:
+        case OP_IPUT_OBJECT_VOLATILE:
+            return pDvmDex->pResFields[insn->vC] != NULL;
+        case OP_SGET_VOLATILE:
+        case OP_SGET_WIDE_VOLATILE:
+        case OP_SGET_OBJECT_VOLATILE:
+        case OP_SPUT_VOLATILE:
+        case OP_SPUT_WIDE_VOLATILE:
+        case OP_SPUT_OBJECT_VOLATILE:
+            return pDvmDex->pResFields[insn->vB] != NULL;
+        case OP_INVOKE_VIRTUAL:
+        case OP_INVOKE_VIRTUAL_RANGE:
+            return pDvmDex->pResMethods[insn->vB] != NULL;
+        case OP_INVOKE_SUPER:
+        case OP_INVOKE_SUPER_RANGE:
+            /* The base method has to be there to look up the callee */
+            if (pDvmDex->pResMethods[insn->vB] == NULL) {
+                return false;
+            }
+            break;
+        default:
+            break;
+    }
+    return dvmCompilerCanIncludeThisInstruction(method, insn);
+}
+
+/*
+ * Parse the method code starting at curBlock's offset into curBlock, up to
+ * the end of the basic block.  Successor blocks are created empty, to be
+ * parsed in turn.  Code the trace doesn't take in - unresolved instructions
+ * and switches - is left through a hot chaining cell, so the interpreter
+ * builds an ordinary trace there.
+ */
+static void crawlMethodTraceBlock(CompilationUnit *cUnit, BasicBlock *curBlock)
+{
+    const Method *method = cUnit->method;
+    unsigned int curOffset = curBlock->startOffset;
+    const u2 *codePtr = method->insns + curOffset;
+    int numInsts = 0;
+
+    while (true) {
+        MIR *insn = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+        insn->offset = curOffset;
+        int width = parseInsn(codePtr, &insn->dalvikInsn, cUnit->printMe);
+        insn->width = width;
+        int flags = width ? dexGetFlagsFromOpcode(insn->dalvikInsn.opcode) : 0;
+
+        if (width == 0 || (flags & kInstrCanSwitch) ||
+            numInsts == JIT_MAX_TRACE_LEN ||
+            !canIncludeInMethodTrace(method, &insn->dalvikInsn)) {
+            if (curBlock->firstMIRInsn == NULL) {
+                curBlock->blockType = kChainingCellHot;
+            } else {
+                BasicBlock *exitBlock = findBlock(cUnit, curOffset,
+                                                  /* split */
+                                                  false,
+                                                  /* create */
+                                                  true,
+                                                  /* immedPredBlockP */
+                                                  NULL);
+                curBlock->fallThrough = exitBlock;
+                curBlock->needFallThroughBranch = true;
+                dvmCompilerSetBit(exitBlock->predecessors, curBlock->id);
+            }
+            return;
+        }
+
+        dvmCompilerAppendMIR(curBlock, insn);
+        cUnit->numInsts++;
+        numInsts++;
+        codePtr += width;
+
+        if (flags & kInstrInvoke) {
+            unsigned int target = curOffset;
+            bool isInvoke = false;
+            const Method *callee = NULL;
+            BasicBlock *calleeBlock = NULL;
+
+            /* No profile to inline from */
+            insn->meta.callsiteInfo =
+                (CallsiteInfo *) dvmCompilerNew(sizeof(CallsiteInfo), true);
+            cUnit->hasInvoke = true;
+
+            findBlockBoundary(method, insn, curOffset, &target, &isInvoke,
+                              &callee);
+            if (callee == NULL) {
+                calleeBlock = dvmCompilerNewBB(kChainingCellInvokePredicted,
+                                               cUnit->numBlocks++);
+                calleeBlock->startOffset = curOffset;
+            } else if (!dvmIsNativeMethod(callee)) {
+                calleeBlock = dvmCompilerNewBB(kChainingCellInvokeSingleton,
+                                               cUnit->numBlocks++);
+                calleeBlock->containingMethod = callee;
+            }
+            if (calleeBlock != NULL) {
+                dvmInsertGrowableList(&cUnit->blockList,
+                                      (intptr_t) calleeBlock);
+                curBlock->taken = calleeBlock;
+                dvmCompilerSetBit(calleeBlock->predecessors, curBlock->id);
+            }
+
+            /* The callee returns straight to the code after the invoke */
+            BasicBlock *returnBlock = findBlock(cUnit, curOffset + width,
+                                                /* split */
+                                                true,
+                                                /* create */
+                                                true,
+                                                /* immedPredBlockP */
+                                                &curBlock);
+            returnBlock->isFallThroughFromInvoke = true;
+            curBlock->fallThrough = returnBlock;
+            dvmCompilerSetBit(returnBlock->predecessors, curBlock->id);
+            return;
+        }
+        if (flags & kInstrCanBranch) {
+            processCanBranch(cUnit, curBlock, insn, curOffset, width, flags,
+                             codePtr, NULL);
+            return;
+        }
+        /* Returns and throws - exceptions are dispatched by the interpreter */
+        if ((flags & kInstrCanContinue) == 0) {
+            return;
+        }
+
+        curOffset += width;
+        BasicBlock *nextBlock = findBlock(cUnit, curOffset,
+                                          /* split */
+                                          false,
+                                          /* create */
+                                          false,
+                                          /* immedPredBlockP */
+                                          NULL);
+        if (nextBlock) {
+            curBlock->fallThrough = nextBlock;
+            curBlock->needFallThroughBranch = true;
+            dvmCompilerSetBit(nextBlock->predecessors, curBlock->id);
+            return;
+        }
+    }
+}
+
+/*
+ * Compile all the code of a method reachable from its entry without
+ * throwing as one trace, for -Xjitmode:method.  The translation is installed
+ * at the method's first instruction, where invokes and chaining enter it.
+ * Branches within the method stay in the translation; back edges go through
+ * backward branch chaining cells that the codegen chains to the loop heads
+ * up front, so a thread looping in the method can still be unchained to
+ * reach a safe point.  Returns false if the method can't be taken in, which
+ * leaves it to ordinary traces.
+ */
+bool dvmCompileMethodTrace(JitTraceDescription *desc,
+                           JitTranslationInfo *info, jmp_buf *bailPtr)
+{
+    const Method *method = desc->method;
+    CompilationUnit cUnit;
+    GrowableList *blockList;
+    unsigned int i;
+
+    /* If we've already compiled this method, just return success */
+    if (dvmJitGetTraceAddr(method->insns) && !info->discardResult) {
+        info->codeAddress = NULL;
+        return true;
+    }
+
+    /* If the work order is stale, discard it */
+    if (info->cacheVersion != gDvmJit.cacheVersion) {
+        return false;
+    }
+
+    /* The debugging filters only know about traces */
+    if (gDvmJit.methodTable || gDvmJit.classTable ||
+        gDvmJit.num_entries_pcTable >= 2) {
+        return false;
+    }
+
+    if (dvmGetMethodInsnsSize(method) > JIT_MAX_METHOD_TRACE_SIZE) {
+        return false;
+    }
+
+    memset(&cUnit, 0, sizeof(CompilationUnit));
+    cUnit.bailPtr = bailPtr;
+    cUnit.printMe = gDvmJit.printMe;
+    cUnit.method = method;
+    cUnit.traceDesc = desc;
+    cUnit.jitMode = kJitMethod;
+
+    dvmInitGrowableList(&cUnit.pcReconstructionList, 8);
+    blockList = &cUnit.blockList;
+    dvmInitGrowableList(blockList, 8);
+
+    BasicBlock *entryBlock = dvmCompilerNewBB(kEntryBlock, cUnit.numBlocks++);
+    dvmInsertGrowableList(blockList, (intptr_t) entryBlock);
+    cUnit.entryBlock = entryBlock;
+
+    BasicBlock *entryCodeBB = dvmCompilerNewBB(kDalvikByteCode,
+                                               cUnit.numBlocks++);
+    dvmInsertGrowableList(blockList, (intptr_t) entryCodeBB);
+    entryBlock->fallThrough = entryCodeBB;
+    dvmCompilerSetBit(entryCodeBB->predecessors, entryBlock->id);
+
+    if (cUnit.printMe) {
+        ALOGD("--------\nCompiler: Building method trace for %s%s",
+             method->clazz->descriptor, method->name);
+    }
+
+    /* Parse each block as it is discovered - the list grows as we go */
+    for (i = 0; i < blockList->numUsed; i++) {
+        BasicBlock *bb = (BasicBlock *) blockList->elemList[i];
+        if (bb->blockType != kDalvikByteCode || bb->firstMIRInsn != NULL) {
+            continue;
+        }
+        crawlMethodTraceBlock(&cUnit, bb);
+        if (blockList->numUsed > JIT_MAX_METHOD_TRACE_BLOCKS) {
+            return false;
+        }
+    }
+
+    /* Nothing of the method could be taken in */
+    if (entryCodeBB->blockType != kDalvikByteCode) {
+        return false;
+    }
+
+    /*
+     * Edges back to the same or an earlier offset close the loops.  Send
+     * them through backward branch chaining cells, which gives the thread a
+     * way out for suspension and leaves the code blocks acyclic.
+     */
+    unsigned int numCodeBlocks = blockList->numUsed;
+    for (i = 0; i < numCodeBlocks; i++) {
+        BasicBlock *bb = (BasicBlock *) blockList->elemList[i];
+        BasicBlock *target = bb->taken;
+        if (bb->blockType != kDalvikByteCode || bb->lastMIRInsn == NULL ||
+            target == NULL || target->blockType != kDalvikByteCode ||
+            target->startOffset > bb->lastMIRInsn->offset) {
+            continue;
+        }
+        BasicBlock *backChain =
+            dvmCompilerNewBB(kChainingCellBackwardBranch, cUnit.numBlocks++);
+        dvmInsertGrowableList(blockList, (intptr_t) backChain);
+        backChain->startOffset = target->startOffset;
+        dvmCompilerClearBit(target->predecessors, bb->id);
+        dvmCompilerSetBit(backChain->predecessors, bb->id);
+        bb->taken = backChain;
+    }
+
+    /* Now create a special block to host PC reconstruction code */
+    BasicBlock *bb = dvmCompilerNewBB(kPCReconstruction, cUnit.numBlocks++);
+    dvmInsertGrowableList(blockList, (intptr_t) bb);
+
+    /* And one final block that publishes the PC and raise the exception */
+    bb = dvmCompilerNewBB(kExceptionHandling, cUnit.numBlocks++);
+    dvmInsertGrowableList(blockList, (intptr_t) bb);
+    cUnit.puntBlock = bb;
+
+    if (cUnit.printMe) {
+        ALOGD("METHODTRACEINFO: 0x%08x %s%s %d of %d, %d blocks",
+             (intptr_t) method->insns, method->clazz->descriptor,
+             method->name, cUnit.numInsts, dvmGetMethodInsnsSize(method),
+             cUnit.numBlocks);
+    }
+
+    cUnit.instructionSet = dvmCompilerInstructionSet();
+    cUnit.numDalvikRegisters = method->registersSize;
+
+    /* Preparation for SSA conversion */
+    dvmInitializeSSAConversion(&cUnit);
+
+    dvmCompilerNonLoopAnalysis(&cUnit);
+
+    if (cUnit.printMe) {
+        dvmCompilerDumpCompilationUnit(&cUnit);
+    }
+
+    /* Convert MIR to LIR, etc. */
+    dvmCompilerMIR2LIR(&cUnit, info);
+
+    /* Convert LIR into machine code. Loop for recoverable retries */
+    do {
+        dvmCompilerAssembleLIR(&cUnit, info);
+        cUnit.assemblerRetries++;
+    } while (cUnit.assemblerStatus == kRetryAll);
+
+    if (cUnit.printMe) {
+        dvmCompilerCodegenDump(&cUnit);
+    }
+
+    if (cUnit.hasClassLiterals && info->codeAddress) {
+        dvmJitInstallClassObjectPointers(&cUnit, (char *) info->codeAddress);
+    }
+    dvmCompilerArenaReset();
+
+    return info->codeAddress != NULL;
+}
+#endif
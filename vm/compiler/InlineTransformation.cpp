@@ -17,6 +17,7 @@
 #include "Dalvik.h"
 #include "Dataflow.h"
 #include "libdex/DexOpcodes.h"
+#include "libdex/DexCatch.h"
 
 /* Convert the reg id from the callee to the original id passed by the caller */
 static inline u4 convertRegId(const DecodedInstruction *invoke,
@@ -34,16 +35,14 @@ static inline u4 convertRegId(const DecodedInstruction *invoke,
     }
 }
 
-static bool inlineGetter(CompilationUnit *cUnit,
-                         const Method *calleeMethod,
-                         MIR *invokeMIR,
-                         BasicBlock *invokeBB,
-                         bool isPredicted,
-                         bool isRange)
+/*
+ * Build the MIR that runs a getter callee in the caller's registers, with
+ * the result going straight to the move-result target.  Returns NULL if the
+ * getter can't be inlined there.
+ */
+static MIR *buildGetterMIR(const Method *calleeMethod, MIR *invokeMIR,
+                           MIR *moveResultMIR, bool isRange)
 {
-    BasicBlock *moveResultBB = invokeBB->fallThrough;
-    MIR *moveResultMIR = moveResultBB->firstMIRInsn;
-    MIR *newGetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     DecodedInstruction getterInsn;
 
     /*
@@ -56,7 +55,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
     dexDecodeInstruction(calleeMethod->insns, &getterInsn);
 
     if (!dvmCompilerCanIncludeThisInstruction(calleeMethod, &getterInsn))
-        return false;
+        return NULL;
 
     /*
      * Some getters (especially invoked through interface) are not followed
@@ -66,7 +65,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
         (moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT &&
          moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT_OBJECT &&
          moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT_WIDE)) {
-        return false;
+        return NULL;
     }
 
     int dfFlags = dvmCompilerDataFlowAttributes[getterInsn.opcode];
@@ -90,6 +89,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
     getterInsn.vA = moveResultMIR->dalvikInsn.vA;
 
     /* Now setup the Dalvik instruction with converted src/dst registers */
+    MIR *newGetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     newGetterMIR->dalvikInsn = getterInsn;
 
     newGetterMIR->width = dexGetWidthFromOpcode(getterInsn.opcode);
@@ -104,44 +104,13 @@ static bool inlineGetter(CompilationUnit *cUnit,
 
     newGetterMIR->meta.calleeMethod = calleeMethod;
 
-    dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newGetterMIR);
-
-    if (isPredicted) {
-        MIR *invokeMIRSlow = (MIR *)dvmCompilerNew(sizeof(MIR), true);
-        *invokeMIRSlow = *invokeMIR;
-        invokeMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
-
-        /* Use vC to denote the first argument (ie this) */
-        if (!isRange) {
-            invokeMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
-        }
-
-        moveResultMIR->OptimizationFlags |= MIR_INLINED_PRED;
-
-        dvmCompilerInsertMIRAfter(invokeBB, newGetterMIR, invokeMIRSlow);
-        invokeMIRSlow->OptimizationFlags |= MIR_INLINED_PRED;
-#if defined(WITH_JIT_TUNING)
-        gDvmJit.invokePolyGetterInlined++;
-#endif
-    } else {
-        invokeMIR->OptimizationFlags |= MIR_INLINED;
-        moveResultMIR->OptimizationFlags |= MIR_INLINED;
-#if defined(WITH_JIT_TUNING)
-        gDvmJit.invokeMonoGetterInlined++;
-#endif
-    }
-
-    return true;
+    return newGetterMIR;
 }
 
-static bool inlineSetter(CompilationUnit *cUnit,
-                         const Method *calleeMethod,
-                         MIR *invokeMIR,
-                         BasicBlock *invokeBB,
-                         bool isPredicted,
-                         bool isRange)
+/* Like buildGetterMIR, for a setter callee */
+static MIR *buildSetterMIR(const Method *calleeMethod, MIR *invokeMIR,
+                           bool isRange)
 {
-    MIR *newSetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     DecodedInstruction setterInsn;
 
     /*
@@ -154,7 +123,7 @@ static bool inlineSetter(CompilationUnit *cUnit,
     dexDecodeInstruction(calleeMethod->insns, &setterInsn);
 
     if (!dvmCompilerCanIncludeThisInstruction(calleeMethod, &setterInsn))
-        return false;
+        return NULL;
 
     int dfFlags = dvmCompilerDataFlowAttributes[setterInsn.opcode];
 
@@ -176,6 +145,7 @@ static bool inlineSetter(CompilationUnit *cUnit,
     }
 
     /* Now setup the Dalvik instruction with converted src/dst registers */
+    MIR *newSetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     newSetterMIR->dalvikInsn = setterInsn;
 
     newSetterMIR->width = dexGetWidthFromOpcode(setterInsn.opcode);
@@ -190,6 +160,66 @@ static bool inlineSetter(CompilationUnit *cUnit,
 
     newSetterMIR->meta.calleeMethod = calleeMethod;
 
+    return newSetterMIR;
+}
+
+static bool inlineGetter(CompilationUnit *cUnit,
+                         const Method *calleeMethod,
+                         MIR *invokeMIR,
+                         BasicBlock *invokeBB,
+                         bool isPredicted,
+                         bool isRange)
+{
+    BasicBlock *moveResultBB = invokeBB->fallThrough;
+    MIR *moveResultMIR = moveResultBB->firstMIRInsn;
+    MIR *newGetterMIR = buildGetterMIR(calleeMethod, invokeMIR, moveResultMIR,
+                                       isRange);
+
+    if (newGetterMIR == NULL)
+        return false;
+
+    dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newGetterMIR);
+
+    if (isPredicted) {
+        MIR *invokeMIRSlow = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+        *invokeMIRSlow = *invokeMIR;
+        invokeMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
+
+        /* Use vC to denote the first argument (ie this) */
+        if (!isRange) {
+            invokeMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
+        }
+
+        moveResultMIR->OptimizationFlags |= MIR_INLINED_PRED;
+
+        dvmCompilerInsertMIRAfter(invokeBB, newGetterMIR, invokeMIRSlow);
+        invokeMIRSlow->OptimizationFlags |= MIR_INLINED_PRED;
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokePolyGetterInlined++;
+#endif
+    } else {
+        invokeMIR->OptimizationFlags |= MIR_INLINED;
+        moveResultMIR->OptimizationFlags |= MIR_INLINED;
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokeMonoGetterInlined++;
+#endif
+    }
+
+    return true;
+}
+
+static bool inlineSetter(CompilationUnit *cUnit,
+                         const Method *calleeMethod,
+                         MIR *invokeMIR,
+                         BasicBlock *invokeBB,
+                         bool isPredicted,
+                         bool isRange)
+{
+    MIR *newSetterMIR = buildSetterMIR(calleeMethod, invokeMIR, isRange);
+
+    if (newSetterMIR == NULL)
+        return false;
+
     dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newSetterMIR);
 
     if (isPredicted) {
@@ -222,6 +252,1141 @@ static bool inlineSetter(CompilationUnit *cUnit,
     return true;
 }
 
+#ifndef ARCH_IA32
+/*
+ * General inlining of small callees.
+ *
+ * The trace has no frame for the callee, so the body is rewritten to run in
+ * the caller's registers: arguments are read straight out of the caller
+ * registers they were passed in, and callee locals are allocated to the
+ * move-result target and, if that is not enough, to caller registers that
+ * are dead where the caller resumes.  Every callee write defines a new
+ * value, so writes to in-registers never reach the caller, and moves are
+ * folded away.  Static and direct calls the callee makes are expanded the
+ * same way, up to a depth budget.
+ *
+ * As with getters, an exception punts to the interpreter and re-executes
+ * the whole invoke.  That is only safe before anything visible to the
+ * caller has changed, so only the first body instruction may throw, and a
+ * receiver that would have been null-checked by the invoke must be
+ * dereferenced by it.
+ *
+ * Forward branches of the callee split the trace's block.  Paths don't
+ * join again: the code after a join is inlined into each path that reaches
+ * it, so every path ends in a return of its own, and a value that would
+ * need a phi is written to the move-result register by each return
+ * instead.  The body stays a tree laid out in order, in which a value is
+ * live from its definition to its last use in that order, as the
+ * allocation of callee locals assumes.  Calls the callee makes, and bodies
+ * inlined into a loop, must still be straight-line, and no path may end in
+ * a throw.
+ *
+ * None of this is done for x86.  Its lowering and register analysis read
+ * the operands and the exported PC from the bytecode at mir->offset rather
+ * than from dalvikInsn, so a renamed body would be lowered as the invoke it
+ * replaced.  Only the first code unit can be rewritten there, as
+ * fetchMIRInst does for MIR_VALUE_REUSED.
+ */
+
+/* Code units of an inlined body, nested callees included */
+#define MAX_INLINED_BODY_SIZE   30
+/* The callee plus two levels of calls it makes */
+#define MAX_INLINE_DEPTH        3
+/* Receivers waiting to be null-checked by the first body instruction */
+#define MAX_PENDING_CHECKS      4
+/* Paths through a body with branches, each ending in its own return */
+#define MAX_INLINED_PATHS       4
+/* Dead caller registers borrowed for callee locals */
+#define MAX_BORROWED_REGS       4
+/* Instructions looked at to prove a caller register dead */
+#define DEAD_REG_SEARCH_LIMIT   64
+
+typedef struct InlinedValue {
+    int reg;                    // caller register once allocated
+    int def;                    // defining body instruction, -1 for args
+    int lastUse;                // last body instruction reading it
+    bool isArg;
+    bool wide;
+    bool nonNull;               // dereferenced by an earlier instruction
+    bool isResult;              // returned by some path of the body
+} InlinedValue;
+
+typedef struct InlinedInsn {
+    DecodedInstruction insn;    // register fields hold value ids
+    const Method *method;       // resolves the constant pool indices
+} InlinedInsn;
+
+/* Value ids held by the registers of one inlined method */
+typedef struct InlineFrame {
+    int *values;                // -1 if undefined
+    bool *highHalf;             // holds the high word of a wide value
+} InlineFrame;
+
+typedef struct InlineResult {
+    int numWords;
+    int values[2];
+    bool highHalf[2];
+} InlineResult;
+
+/*
+ * A run of body instructions, ending either in a conditional branch, its
+ * last instruction, to two later blocks, or in a return of "result".
+ */
+typedef struct InlinedBlock {
+    int firstInsn;
+    int endInsn;
+    int fallThrough;            // block index, -1 if the block returns
+    int taken;
+    InlineResult result;
+} InlinedBlock;
+
+typedef struct BodyInliner {
+    InlinedValue *values;
+    int numValues;
+    InlinedInsn insns[MAX_INLINED_BODY_SIZE];
+    int numInsns;
+    int codeUnits;
+    int numNestedCalls;
+    int pendingChecks[MAX_PENDING_CHECKS];
+    int numPendingChecks;
+    int newObjectId;            // receiver fresh from a new-instance, or -1
+    ClassObject *newObjectClass;
+    bool allowBranches;         // the trace's blocks may be split
+    InlinedBlock blocks[2 * MAX_INLINED_PATHS - 1];
+    int numBlocks;
+    int layout[2 * MAX_INLINED_PATHS - 1];  // blocks in the order they start
+    int numLaidOut;
+    int curBlock;               // block instructions are being added to
+    int resultWords;            // words every path returns, -1 until known
+} BodyInliner;
+
+static int newValue(BodyInliner *inliner, bool isArg, int reg, bool wide)
+{
+    InlinedValue *value = &inliner->values[inliner->numValues];
+
+    value->reg = reg;
+    value->def = isArg ? -1 : inliner->numInsns;
+    value->lastUse = value->def;
+    value->isArg = isArg;
+    value->wide = wide;
+    value->nonNull = false;
+    value->isResult = false;
+    return inliner->numValues++;
+}
+
+static void initFrame(InlineFrame *frame, const Method *method)
+{
+    frame->values = (int *)
+        dvmCompilerNew(sizeof(int) * method->registersSize, false);
+    frame->highHalf = (bool *)
+        dvmCompilerNew(sizeof(bool) * method->registersSize, true);
+    for (int i = 0; i < method->registersSize; i++) {
+        frame->values[i] = -1;
+    }
+}
+
+/* A path of a branch starts out with the registers held at the branch */
+static void copyFrame(InlineFrame *to, const InlineFrame *from,
+                      const Method *method)
+{
+    initFrame(to, method);
+    memcpy(to->values, from->values, sizeof(int) * method->registersSize);
+    memcpy(to->highHalf, from->highHalf,
+           sizeof(bool) * method->registersSize);
+}
+
+/*
+ * Return the value held in a callee register, or -1 if it isn't what the
+ * instruction expects.  A wide argument is two narrow values passed in
+ * consecutive caller registers.
+ */
+static int readReg(const BodyInliner *inliner, const InlineFrame *frame,
+                   u4 reg, bool wide)
+{
+    int id = frame->values[reg];
+
+    if (id < 0 || frame->highHalf[reg])
+        return -1;
+
+    const InlinedValue *value = &inliner->values[id];
+    if (!wide)
+        return value->wide ? -1 : id;
+    if (value->wide) {
+        return (frame->values[reg + 1] == id && frame->highHalf[reg + 1]) ?
+               id : -1;
+    }
+
+    int highId = frame->values[reg + 1];
+    if (!value->isArg || highId < 0 || frame->highHalf[reg + 1])
+        return -1;
+    const InlinedValue *high = &inliner->values[highId];
+    return (high->isArg && high->reg == value->reg + 1) ? id : -1;
+}
+
+/* Like readReg, and record the read by the instruction being added */
+static int useReg(BodyInliner *inliner, const InlineFrame *frame, u4 reg,
+                  bool wide)
+{
+    int id = readReg(inliner, frame, reg, wide);
+
+    if (id >= 0) {
+        inliner->values[id].lastUse = inliner->numInsns;
+        if (wide && !inliner->values[id].wide) {
+            inliner->values[frame->values[reg + 1]].lastUse =
+                inliner->numInsns;
+        }
+    }
+    return id;
+}
+
+static void writeReg(InlineFrame *frame, u4 reg, int id, bool wide)
+{
+    frame->values[reg] = id;
+    frame->highHalf[reg] = false;
+    if (wide) {
+        frame->values[reg + 1] = id;
+        frame->highHalf[reg + 1] = true;
+    }
+}
+
+/* Copy register contents word by word; the ranges may overlap */
+static void copyWords(InlineFrame *to, u4 toReg, const InlineFrame *from,
+                      u4 fromReg, int numWords)
+{
+    int values[2];
+    bool highHalf[2];
+
+    for (int i = 0; i < numWords; i++) {
+        values[i] = from->values[fromReg + i];
+        highHalf[i] = from->highHalf[fromReg + i];
+    }
+    for (int i = 0; i < numWords; i++) {
+        to->values[toReg + i] = values[i];
+        to->highHalf[toReg + i] = highHalf[i];
+    }
+}
+
+/*
+ * A receiver that the invoke would have null-checked must either be known
+ * to be non-null already, or be dereferenced by the first body instruction.
+ */
+static bool requireNonNull(BodyInliner *inliner, int id)
+{
+    if (inliner->values[id].nonNull)
+        return true;
+    if (inliner->numInsns > 0 ||
+        inliner->numPendingChecks == MAX_PENDING_CHECKS) {
+        return false;
+    }
+    inliner->pendingChecks[inliner->numPendingChecks++] = id;
+    return true;
+}
+
+static bool isFieldAccess(Opcode opcode)
+{
+    return (opcode >= OP_IGET && opcode <= OP_IPUT_SHORT) ||
+           (opcode >= OP_IGET_QUICK && opcode <= OP_IPUT_OBJECT_QUICK);
+}
+
+static bool canInlineInsn(const Method *method, const DecodedInstruction *insn)
+{
+    Opcode opcode = insn->opcode;
+
+    if ((opcode >= OP_CONST_4 && opcode <= OP_CONST_WIDE_HIGH16) ||
+        opcode == OP_ARRAY_LENGTH ||
+        (opcode >= OP_CMPL_FLOAT && opcode <= OP_CMP_LONG) ||
+        (opcode >= OP_AGET && opcode <= OP_APUT_SHORT) ||
+        (opcode >= OP_NEG_INT && opcode <= OP_USHR_INT_LIT8) ||
+        (opcode >= OP_IGET_QUICK && opcode <= OP_IPUT_OBJECT_QUICK)) {
+        return true;
+    }
+
+    if (opcode >= OP_IGET && opcode <= OP_IPUT_SHORT) {
+        Field *field = (Field *)
+            method->clazz->pDvmDex->pResFields[insn->vC];
+        return field != NULL && !dvmIsVolatileField(field);
+    }
+
+    /* A resolved static field can't throw if its class is initialized */
+    if (opcode >= OP_SGET && opcode <= OP_SPUT_SHORT) {
+        Field *field = (Field *)
+            method->clazz->pDvmDex->pResFields[insn->vB];
+        return field != NULL && !dvmIsVolatileField(field) &&
+               dvmIsClassInitialized(field->clazz);
+    }
+    return false;
+}
+
+/* Can the instruction, with value ids in its register fields, throw? */
+static bool mayThrow(const BodyInliner *inliner,
+                     const DecodedInstruction *insn)
+{
+    Opcode opcode = insn->opcode;
+
+    if (isFieldAccess(opcode) || opcode == OP_ARRAY_LENGTH)
+        return !inliner->values[insn->vB].nonNull;
+
+    switch (opcode) {
+        case OP_DIV_INT:
+        case OP_REM_INT:
+        case OP_DIV_LONG:
+        case OP_REM_LONG:
+            return true;
+        case OP_DIV_INT_LIT16:
+        case OP_REM_INT_LIT16:
+        case OP_DIV_INT_LIT8:
+        case OP_REM_INT_LIT8:
+            return insn->vC == 0;
+        default:
+            return opcode >= OP_AGET && opcode <= OP_APUT_SHORT;
+    }
+}
+
+/*
+ * Count the instruction just filled in.  The receivers waiting for a null
+ * check must have been dereferenced by the first one.
+ */
+static bool commitInsn(BodyInliner *inliner)
+{
+    if (inliner->numInsns++ > 0)
+        return true;
+    for (int i = 0; i < inliner->numPendingChecks; i++) {
+        if (!inliner->values[inliner->pendingChecks[i]].nonNull)
+            return false;
+    }
+    return true;
+}
+
+/* Rename an ordinary body instruction and append it to the body */
+static bool addInsn(BodyInliner *inliner, const Method *method,
+                    InlineFrame *frame, DecodedInstruction *insn)
+{
+    if (!canInlineInsn(method, insn))
+        return false;
+
+    /* A two-address op may get a destination apart from its first source */
+    if (insn->opcode >= OP_ADD_INT_2ADDR &&
+        insn->opcode <= OP_REM_DOUBLE_2ADDR) {
+        insn->opcode = (Opcode)
+            (insn->opcode - OP_ADD_INT_2ADDR + OP_ADD_INT);
+        insn->vC = insn->vB;
+        insn->vB = insn->vA;
+    }
+
+    int dfAttributes = dvmCompilerDataFlowAttributes[insn->opcode];
+    InlinedInsn *inlined = &inliner->insns[inliner->numInsns];
+    DecodedInstruction *renamed = &inlined->insn;
+    int id;
+
+    *renamed = *insn;
+    inlined->method = method;
+
+    if (dfAttributes & (DF_UA | DF_UA_WIDE)) {
+        id = useReg(inliner, frame, insn->vA, dfAttributes & DF_UA_WIDE);
+        if (id < 0) return false;
+        renamed->vA = id;
+    }
+    if (dfAttributes & (DF_UB | DF_UB_WIDE)) {
+        id = useReg(inliner, frame, insn->vB, dfAttributes & DF_UB_WIDE);
+        if (id < 0) return false;
+        renamed->vB = id;
+    }
+    if (dfAttributes & (DF_UC | DF_UC_WIDE)) {
+        id = useReg(inliner, frame, insn->vC, dfAttributes & DF_UC_WIDE);
+        if (id < 0) return false;
+        renamed->vC = id;
+    }
+
+    if (mayThrow(inliner, renamed) && inliner->numInsns > 0)
+        return false;
+
+    /* Past this instruction its object reference is known to be non-null */
+    if (isFieldAccess(renamed->opcode) || renamed->opcode == OP_ARRAY_LENGTH ||
+        (renamed->opcode >= OP_AGET && renamed->opcode <= OP_APUT_SHORT)) {
+        inliner->values[renamed->vB].nonNull = true;
+    }
+
+    if (dfAttributes & (DF_DA | DF_DA_WIDE)) {
+        bool wide = (dfAttributes & DF_DA_WIDE) != 0;
+        id = newValue(inliner, false, -1, wide);
+        writeReg(frame, insn->vA, id, wide);
+        renamed->vA = id;
+    }
+
+    return commitInsn(inliner);
+}
+
+/* Rename a conditional branch of the body and append it */
+static bool addBranch(BodyInliner *inliner, const Method *method,
+                      InlineFrame *frame, const DecodedInstruction *insn)
+{
+    InlinedInsn *inlined = &inliner->insns[inliner->numInsns];
+    int id;
+
+    inlined->insn = *insn;
+    inlined->method = method;
+
+    id = useReg(inliner, frame, insn->vA, false);
+    if (id < 0) return false;
+    inlined->insn.vA = id;
+    if (dvmCompilerDataFlowAttributes[insn->opcode] & DF_UB) {
+        id = useReg(inliner, frame, insn->vB, false);
+        if (id < 0) return false;
+        inlined->insn.vB = id;
+    }
+    return commitInsn(inliner);
+}
+
+static bool canInlineCallee(const Method *callee)
+{
+    if (callee == NULL || dvmIsNativeMethod(callee) ||
+        dvmIsAbstractMethod(callee) || dvmIsSynchronizedMethod(callee)) {
+        return false;
+    }
+    /* Running the body must not skip the class initializer */
+    return !dvmIsStaticMethod(callee) || dvmIsClassInitialized(callee->clazz);
+}
+
+static int branchOffset(const DecodedInstruction *insn)
+{
+    switch (dexGetFormatFromOpcode(insn->opcode)) {
+        case kFmt10t:
+        case kFmt20t:
+        case kFmt30t:
+            return (int) insn->vA;
+        case kFmt21t:
+            return (int) insn->vB;
+        default:
+            return (int) insn->vC;
+    }
+}
+
+/* Add instructions to the reserved block "index" from now on */
+static void startBlock(BodyInliner *inliner, int index)
+{
+    InlinedBlock *block = &inliner->blocks[index];
+
+    block->firstInsn = inliner->numInsns;
+    block->endInsn = -1;
+    block->fallThrough = -1;
+    block->taken = -1;
+    inliner->curBlock = index;
+    inliner->layout[inliner->numLaidOut++] = index;
+}
+
+/* A path of the outermost callee returns "result" */
+static bool endPath(BodyInliner *inliner, const InlineResult *result)
+{
+    InlinedBlock *block = &inliner->blocks[inliner->curBlock];
+
+    if (inliner->resultWords >= 0 && inliner->resultWords != result->numWords)
+        return false;
+    inliner->resultWords = result->numWords;
+    block->endInsn = inliner->numInsns;
+    block->result = *result;
+    return true;
+}
+
+static bool inlineBody(BodyInliner *inliner, const Method *method,
+                       InlineFrame *frame, const u2 *codePtr, int depth,
+                       InlineResult *result);
+
+/*
+ * End the current block with the branch just added, and inline both paths
+ * out of it.  A receiver dereferenced on the fall-through path is not known
+ * to be non-null on the taken one.
+ */
+static bool inlineBranch(BodyInliner *inliner, const Method *method,
+                         const InlineFrame *frame, const u2 *fallThroughPtr,
+                         const u2 *takenPtr)
+{
+    InlinedBlock *block = &inliner->blocks[inliner->curBlock];
+    int numValues = inliner->numValues;
+    bool *nonNull = (bool *) dvmCompilerNew(sizeof(bool) * numValues, false);
+    InlineFrame pathFrame;
+
+    for (int i = 0; i < numValues; i++)
+        nonNull[i] = inliner->values[i].nonNull;
+    block->endInsn = inliner->numInsns;
+    /* Reserve both, so that the fall-through path can't use up the room */
+    block->fallThrough = inliner->numBlocks++;
+    block->taken = inliner->numBlocks++;
+
+    startBlock(inliner, block->fallThrough);
+    copyFrame(&pathFrame, frame, method);
+    if (!inlineBody(inliner, method, &pathFrame, fallThroughPtr, 1, NULL))
+        return false;
+
+    for (int i = 0; i < numValues; i++)
+        inliner->values[i].nonNull = nonNull[i];
+    startBlock(inliner, block->taken);
+    copyFrame(&pathFrame, frame, method);
+    return inlineBody(inliner, method, &pathFrame, takenPtr, 1, NULL);
+}
+
+/*
+ * Append the body of "method", from "codePtr" on, with its registers held
+ * in "frame".  A nested callee leaves its returned value in "result"; the
+ * outermost one, at depth 1, records what each of its paths returns.
+ */
+static bool inlineBody(BodyInliner *inliner, const Method *method,
+                       InlineFrame *frame, const u2 *codePtr, int depth,
+                       InlineResult *result)
+{
+    const DexCode *dexCode = dvmGetMethodCode(method);
+    const u2 *codeEnd = dexCode->insns + dexCode->insnsSize;
+    InlineResult callResult;
+
+    memset(&callResult, 0, sizeof(callResult));
+    callResult.numWords = -1;
+
+    while (codePtr < codeEnd) {
+        DecodedInstruction insn;
+        InlineResult lastCallResult = callResult;
+        const u2 *insnPtr = codePtr;
+        int width = dexGetWidthFromInstruction(codePtr);
+
+        memset(&insn, 0, sizeof(insn));
+        dexDecodeInstruction(codePtr, &insn);
+        codePtr += width;
+        callResult.numWords = -1;
+
+        inliner->codeUnits += width;
+        if (inliner->codeUnits > MAX_INLINED_BODY_SIZE ||
+            SINGLE_STEP_OP(insn.opcode)) {
+            return false;
+        }
+
+        switch (insn.opcode) {
+            case OP_MOVE:
+            case OP_MOVE_FROM16:
+            case OP_MOVE_16:
+            case OP_MOVE_OBJECT:
+            case OP_MOVE_OBJECT_FROM16:
+            case OP_MOVE_OBJECT_16:
+                if (readReg(inliner, frame, insn.vB, false) < 0)
+                    return false;
+                copyWords(frame, insn.vA, frame, insn.vB, 1);
+                break;
+            case OP_MOVE_WIDE:
+            case OP_MOVE_WIDE_FROM16:
+            case OP_MOVE_WIDE_16:
+                if (readReg(inliner, frame, insn.vB, true) < 0)
+                    return false;
+                copyWords(frame, insn.vA, frame, insn.vB, 2);
+                break;
+            case OP_MOVE_RESULT:
+            case OP_MOVE_RESULT_OBJECT:
+            case OP_MOVE_RESULT_WIDE: {
+                int numWords = insn.opcode == OP_MOVE_RESULT_WIDE ? 2 : 1;
+                if (lastCallResult.numWords != numWords)
+                    return false;
+                for (int i = 0; i < numWords; i++) {
+                    frame->values[insn.vA + i] = lastCallResult.values[i];
+                    frame->highHalf[insn.vA + i] = lastCallResult.highHalf[i];
+                }
+                break;
+            }
+            case OP_RETURN_VOID:
+            case OP_RETURN:
+            case OP_RETURN_OBJECT:
+            case OP_RETURN_WIDE: {
+                int numWords = insn.opcode == OP_RETURN_VOID ? 0 :
+                               insn.opcode == OP_RETURN_WIDE ? 2 : 1;
+                InlineResult returned;
+                if (numWords > 0 &&
+                    readReg(inliner, frame, insn.vA, numWords == 2) < 0) {
+                    return false;
+                }
+                returned.numWords = numWords;
+                for (int i = 0; i < numWords; i++) {
+                    returned.values[i] = frame->values[insn.vA + i];
+                    returned.highHalf[i] = frame->highHalf[insn.vA + i];
+                }
+                if (depth == 1)
+                    return endPath(inliner, &returned);
+                *result = returned;
+                return codePtr == codeEnd;
+            }
+            /* The code after a forward goto is inlined in its place */
+            case OP_GOTO:
+            case OP_GOTO_16:
+            case OP_GOTO_32:
+                if (depth > 1 || branchOffset(&insn) <= 0 ||
+                    insnPtr + branchOffset(&insn) >= codeEnd) {
+                    return false;
+                }
+                codePtr = insnPtr + branchOffset(&insn);
+                break;
+            case OP_IF_EQ:
+            case OP_IF_NE:
+            case OP_IF_LT:
+            case OP_IF_GE:
+            case OP_IF_GT:
+            case OP_IF_LE:
+            case OP_IF_EQZ:
+            case OP_IF_NEZ:
+            case OP_IF_LTZ:
+            case OP_IF_GEZ:
+            case OP_IF_GTZ:
+            case OP_IF_LEZ:
+                if (depth > 1 || !inliner->allowBranches ||
+                    inliner->numBlocks == 2 * MAX_INLINED_PATHS - 1 ||
+                    branchOffset(&insn) <= 0 ||
+                    insnPtr + branchOffset(&insn) >= codeEnd ||
+                    !addBranch(inliner, method, frame, &insn)) {
+                    return false;
+                }
+                return inlineBranch(inliner, method, frame, codePtr,
+                                    insnPtr + branchOffset(&insn));
+            case OP_INVOKE_STATIC:
+            case OP_INVOKE_STATIC_RANGE:
+            case OP_INVOKE_DIRECT:
+            case OP_INVOKE_DIRECT_RANGE: {
+                const Method *callee =
+                    method->clazz->pDvmDex->pResMethods[insn.vB];
+                bool isRange = insn.opcode == OP_INVOKE_STATIC_RANGE ||
+                               insn.opcode == OP_INVOKE_DIRECT_RANGE;
+
+                if (depth == MAX_INLINE_DEPTH || !canInlineCallee(callee) ||
+                    insn.vA != callee->insSize) {
+                    return false;
+                }
+
+                InlineFrame calleeFrame;
+                int firstIn = callee->registersSize - callee->insSize;
+                initFrame(&calleeFrame, callee);
+                for (u4 i = 0; i < insn.vA; i++) {
+                    u4 reg = isRange ? insn.vC + i : insn.arg[i];
+                    if (frame->values[reg] < 0)
+                        return false;
+                    copyWords(&calleeFrame, firstIn + i, frame, reg, 1);
+                }
+                if (!dvmIsStaticMethod(callee) &&
+                    (calleeFrame.values[firstIn] < 0 ||
+                     !requireNonNull(inliner, calleeFrame.values[firstIn]))) {
+                    return false;
+                }
+                if (!inlineBody(inliner, callee, &calleeFrame,
+                                dvmGetMethodCode(callee)->insns, depth + 1,
+                                &callResult)) {
+                    return false;
+                }
+                inliner->numNestedCalls++;
+                break;
+            }
+            /*
+             * Object.<init> only has to register finalizable objects, and
+             * the class of a receiver fresh from a new-instance is known.
+             */
+            case OP_INVOKE_OBJECT_INIT_RANGE:
+                if (inliner->newObjectId < 0 ||
+                    frame->values[insn.vC] != inliner->newObjectId ||
+                    IS_CLASS_FLAG_SET(inliner->newObjectClass,
+                                      CLASS_ISFINALIZABLE)) {
+                    return false;
+                }
+                break;
+            default:
+                if (!addInsn(inliner, method, frame, &insn))
+                    return false;
+                break;
+        }
+    }
+    /* Ran off the end without returning */
+    return false;
+}
+
+/* Do two values share a caller register while one of them is needed? */
+static bool valuesConflict(const InlinedValue *a, const InlinedValue *b)
+{
+    int aEnd = a->reg + (a->wide ? 1 : 0);
+    int bEnd = b->reg + (b->wide ? 1 : 0);
+
+    if (aEnd < b->reg || bEnd < a->reg)
+        return false;
+    /* A value may be overwritten by the instruction that reads it last */
+    return (a->def < b->def && b->def < a->lastUse) ||
+           (b->def < a->def && a->def < b->lastUse);
+}
+
+static bool isListedReg(const int *regs, int numRegs, int reg)
+{
+    for (int i = 0; i < numRegs; i++) {
+        if (regs[i] == reg)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Give every callee local one of the caller registers in "regs".  A value
+ * some path returns must get the first of them, the move-result register,
+ * so those go first.  Returns false if the body needs more registers than
+ * the caller can spare.
+ */
+static bool allocateLocals(BodyInliner *inliner, const int *regs, int numRegs)
+{
+    for (int i = 0; i < inliner->numValues; i++) {
+        if (!inliner->values[i].isArg)
+            inliner->values[i].reg = -1;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < inliner->numValues; i++) {
+            InlinedValue *value = &inliner->values[i];
+            int numCandidates = value->isResult ? 1 : numRegs;
+
+            if (value->isArg || value->isResult != (pass == 0))
+                continue;
+
+            for (int k = 0; k < numCandidates && value->reg < 0; k++) {
+                bool conflict = false;
+
+                if (value->wide && !isListedReg(regs, numRegs, regs[k] + 1))
+                    continue;
+                value->reg = regs[k];
+                for (int j = 0; j < inliner->numValues && !conflict; j++) {
+                    InlinedValue *other = &inliner->values[j];
+                    if (j != i && other->reg >= 0)
+                        conflict = valuesConflict(value, other);
+                }
+                if (conflict)
+                    value->reg = -1;
+            }
+            if (value->reg < 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool readsReg(const DecodedInstruction *insn, u4 reg)
+{
+    int dfAttributes = dvmCompilerDataFlowAttributes[insn->opcode];
+
+    if (dfAttributes & DF_FORMAT_35C) {
+        for (u4 i = 0; i < insn->vA; i++) {
+            if (insn->arg[i] == reg)
+                return true;
+        }
+        return false;
+    }
+    if ((dfAttributes & DF_FORMAT_3RC) ||
+        insn->opcode == OP_INVOKE_OBJECT_INIT_RANGE) {
+        return reg >= insn->vC && reg < insn->vC + insn->vA;
+    }
+    return ((dfAttributes & DF_UA) && insn->vA == reg) ||
+           ((dfAttributes & DF_UA_WIDE) &&
+            (insn->vA == reg || insn->vA + 1 == reg)) ||
+           ((dfAttributes & DF_UB) && insn->vB == reg) ||
+           ((dfAttributes & DF_UB_WIDE) &&
+            (insn->vB == reg || insn->vB + 1 == reg)) ||
+           ((dfAttributes & DF_UC) && insn->vC == reg) ||
+           ((dfAttributes & DF_UC_WIDE) &&
+            (insn->vC == reg || insn->vC + 1 == reg));
+}
+
+static bool writesReg(const DecodedInstruction *insn, u4 reg)
+{
+    int dfAttributes = dvmCompilerDataFlowAttributes[insn->opcode];
+
+    return ((dfAttributes & DF_DA) && insn->vA == reg) ||
+           ((dfAttributes & DF_DA_WIDE) &&
+            (insn->vA == reg || insn->vA + 1 == reg));
+}
+
+/*
+ * Is "reg" of "method" written before it is read on every path from
+ * "startOffset", exception edges included?  Gives up after visiting
+ * DEAD_REG_SEARCH_LIMIT instructions.
+ */
+bool dvmCompilerIsDeadDalvikReg(const Method *method, u4 reg,
+                                unsigned int startOffset)
+{
+    const DexCode *dexCode = dvmGetMethodCode(method);
+    BitVector *visited =
+        dvmCompilerAllocBitVector(dexCode->insnsSize, false);
+    GrowableList worklist;
+    int numVisited = 0;
+
+    dvmInitGrowableList(&worklist, 8);
+    dvmInsertGrowableList(&worklist, startOffset);
+
+    while (worklist.numUsed > 0) {
+        unsigned int offset = worklist.elemList[--worklist.numUsed];
+
+        if (offset >= dexCode->insnsSize)
+            return false;
+        if (dvmIsBitSet(visited, offset))
+            continue;
+        if (++numVisited > DEAD_REG_SEARCH_LIMIT)
+            return false;
+        dvmSetBit(visited, offset);
+
+        const u2 *codePtr = dexCode->insns + offset;
+        DecodedInstruction insn;
+        dexDecodeInstruction(codePtr, &insn);
+        int flags = dexGetFlagsFromOpcode(insn.opcode);
+
+        if (readsReg(&insn, reg) || insn.opcode == OP_BREAKPOINT ||
+            (flags & kInstrCanSwitch)) {
+            return false;
+        }
+
+        /* A throwing instruction leaves its destination alone */
+        DexCatchIterator iterator;
+        if ((flags & kInstrCanThrow) &&
+            dexFindCatchHandler(&iterator, dexCode, offset)) {
+            DexCatchHandler *handler;
+            while ((handler = dexCatchIteratorNext(&iterator)) != NULL) {
+                dvmInsertGrowableList(&worklist, handler->address);
+            }
+        }
+
+        if (writesReg(&insn, reg))
+            continue;
+        if (flags & kInstrCanBranch)
+            dvmInsertGrowableList(&worklist, offset + branchOffset(&insn));
+        if (flags & kInstrCanContinue) {
+            dvmInsertGrowableList(&worklist,
+                                  offset + dexGetWidthFromInstruction(codePtr));
+        }
+    }
+    return true;
+}
+
+/*
+ * Collect up to MAX_BORROWED_REGS caller registers, other than the ones
+ * already in "regs", that are dead where the caller resumes.
+ */
+static int findDeadCallerRegs(const Method *method, unsigned int offset,
+                              int *regs, int numRegs)
+{
+    int numBorrowed = 0;
+
+    for (int reg = 0; reg < method->registersSize &&
+                      numBorrowed < MAX_BORROWED_REGS; reg++) {
+        if (!isListedReg(regs, numRegs, reg) &&
+            dvmCompilerIsDeadDalvikReg(method, reg, offset)) {
+            regs[numRegs + numBorrowed++] = reg;
+        }
+    }
+    return numBorrowed;
+}
+
+static MIR *appendCalleeMIR(BasicBlock *bb, const MIR *invokeMIR,
+                            const DecodedInstruction *insn,
+                            const Method *method)
+{
+    MIR *newMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+
+    newMIR->dalvikInsn = *insn;
+    newMIR->width = dexGetWidthFromOpcode(insn->opcode);
+    newMIR->OptimizationFlags |= MIR_CALLEE;
+    /* Exceptions punt to the interpreter and re-execute the invoke */
+    newMIR->offset = invokeMIR->offset;
+    newMIR->meta.calleeMethod = method;
+    dvmCompilerAppendMIR(bb, newMIR);
+    return newMIR;
+}
+
+/*
+ * Put the blocks of an inlined body right after the invoke's block, so
+ * that the blocks of the trace stay in the order they run in, which is the
+ * order SSA names are given out in.  A block's id is its index in the
+ * block list, so renumber the blocks and redo their predecessors.
+ */
+static void insertBodyBlocks(CompilationUnit *cUnit, BasicBlock *invokeBB,
+                             BasicBlock **bodyBlocks, int numBodyBlocks)
+{
+    GrowableList *blockList = &cUnit->blockList;
+    int numOldBlocks = blockList->numUsed;
+    BasicBlock **oldBlocks = (BasicBlock **)
+        dvmCompilerNew(sizeof(BasicBlock *) * numOldBlocks, false);
+
+    for (int i = 0; i < numOldBlocks; i++)
+        oldBlocks[i] = (BasicBlock *) blockList->elemList[i];
+    blockList->numUsed = 0;
+    for (int i = 0; i < numOldBlocks; i++) {
+        dvmInsertGrowableList(blockList, (intptr_t) oldBlocks[i]);
+        if (oldBlocks[i] == invokeBB) {
+            for (int k = 0; k < numBodyBlocks; k++)
+                dvmInsertGrowableList(blockList, (intptr_t) bodyBlocks[k]);
+        }
+    }
+    cUnit->numBlocks = blockList->numUsed;
+
+    for (size_t i = 0; i < blockList->numUsed; i++) {
+        BasicBlock *bb = (BasicBlock *) blockList->elemList[i];
+        bb->id = i;
+        dvmClearAllBits(bb->predecessors);
+    }
+    for (size_t i = 0; i < blockList->numUsed; i++) {
+        BasicBlock *bb = (BasicBlock *) blockList->elemList[i];
+        if (bb->taken != NULL)
+            dvmCompilerSetBit(bb->taken->predecessors, bb->id);
+        if (bb->fallThrough != NULL)
+            dvmCompilerSetBit(bb->fallThrough->predecessors, bb->id);
+        if (bb->successorBlockList.blockListType != kNotUsed) {
+            GrowableListIterator iterator;
+            dvmGrowableListIteratorInit(&bb->successorBlockList.blocks,
+                                        &iterator);
+            while (true) {
+                SuccessorBlockInfo *successorBlockInfo =
+                    (SuccessorBlockInfo *)
+                    dvmGrowableListIteratorNext(&iterator);
+                if (successorBlockInfo == NULL) break;
+                dvmCompilerSetBit(successorBlockInfo->block->predecessors,
+                                  bb->id);
+            }
+        }
+    }
+}
+
+/*
+ * Return the class "reg" was allocated as if the last write to it before
+ * the invoke is a new-instance in the same block, or NULL.
+ */
+static ClassObject *findNewInstanceClass(const CompilationUnit *cUnit,
+                                         const MIR *invokeMIR, u4 reg)
+{
+    const MIR *mir;
+
+    for (mir = invokeMIR->prev; mir != NULL; mir = mir->prev) {
+        if ((int) mir->dalvikInsn.opcode >= (int) kMirOpFirst)
+            return NULL;
+        if (writesReg(&mir->dalvikInsn, reg)) {
+            if (mir->dalvikInsn.opcode != OP_NEW_INSTANCE ||
+                (mir->OptimizationFlags & MIR_CALLEE)) {
+                return NULL;
+            }
+            return (ClassObject *) cUnit->method->clazz->pDvmDex->
+                pResClasses[mir->dalvikInsn.vB];
+        }
+    }
+    return NULL;
+}
+
+static bool inlineMethodBody(CompilationUnit *cUnit,
+                             const Method *calleeMethod,
+                             MIR *invokeMIR,
+                             BasicBlock *invokeBB,
+                             bool isRange)
+{
+    BasicBlock *moveResultBB = invokeBB->fallThrough;
+    MIR *moveResultMIR = NULL;
+    bool resultDiscarded = false;
+
+    if (!canInlineCallee(calleeMethod))
+        return false;
+
+    if (moveResultBB != NULL && moveResultBB->blockType == kDalvikByteCode &&
+        moveResultBB->firstMIRInsn != NULL) {
+        Opcode opcode = moveResultBB->firstMIRInsn->dalvikInsn.opcode;
+        if (opcode == OP_MOVE_RESULT || opcode == OP_MOVE_RESULT_OBJECT ||
+            opcode == OP_MOVE_RESULT_WIDE) {
+            moveResultMIR = moveResultBB->firstMIRInsn;
+        } else {
+            resultDiscarded = true;
+        }
+    }
+
+    BodyInliner *inliner =
+        (BodyInliner *) dvmCompilerNew(sizeof(BodyInliner), true);
+    inliner->values = (InlinedValue *)
+        dvmCompilerNew(sizeof(InlinedValue) *
+                       (calleeMethod->insSize + MAX_INLINED_BODY_SIZE), true);
+
+    InlineFrame frame;
+    int firstIn = calleeMethod->registersSize - calleeMethod->insSize;
+    initFrame(&frame, calleeMethod);
+    for (int reg = firstIn; reg < calleeMethod->registersSize; reg++) {
+        frame.values[reg] =
+            newValue(inliner, true,
+                     convertRegId(&invokeMIR->dalvikInsn, calleeMethod, reg,
+                                  isRange), false);
+    }
+    /*
+     * The first receiver check is always deferred to the body, unless the
+     * receiver was just allocated in this block.
+     */
+    inliner->newObjectId = -1;
+    if (!dvmIsStaticMethod(calleeMethod)) {
+        int receiverId = frame.values[firstIn];
+        ClassObject *newClass =
+            findNewInstanceClass(cUnit, invokeMIR,
+                                 inliner->values[receiverId].reg);
+        if (newClass != NULL) {
+            inliner->values[receiverId].nonNull = true;
+            inliner->newObjectId = receiverId;
+            inliner->newObjectClass = newClass;
+        } else {
+            requireNonNull(inliner, receiverId);
+        }
+    }
+
+    /*
+     * A loop body has been analyzed already, and new blocks would have to
+     * be fitted into the loop, so it only takes straight-line bodies.
+     */
+    inliner->allowBranches = cUnit->jitMode != kJitLoop && moveResultBB != NULL;
+    inliner->resultWords = -1;
+    inliner->numBlocks = 1;
+    startBlock(inliner, 0);
+    if (!inlineBody(inliner, calleeMethod, &frame,
+                    dvmGetMethodCode(calleeMethod)->insns, 1, NULL)) {
+        return false;
+    }
+
+    /* Nothing dereferenced the receiver */
+    if (inliner->numPendingChecks > 0 && inliner->numInsns == 0)
+        return false;
+
+    /* The caller may pick up the result outside of the trace */
+    if (inliner->resultWords > 0 && moveResultMIR == NULL && !resultDiscarded)
+        return false;
+
+    /* The move-result registers first, then any borrowed ones */
+    int regs[2 + MAX_BORROWED_REGS];
+    int numRegs = 0;
+    unsigned int resumeOffset = invokeMIR->offset + invokeMIR->width;
+
+    if (moveResultMIR != NULL) {
+        if (inliner->resultWords == 0)
+            return false;
+        resumeOffset = moveResultMIR->offset + moveResultMIR->width;
+        for (numRegs = 0; numRegs < inliner->resultWords; numRegs++)
+            regs[numRegs] = moveResultMIR->dalvikInsn.vA + numRegs;
+
+        /* Each path's result is needed up to the end of that path */
+        for (int b = 0; b < inliner->numBlocks; b++) {
+            InlinedBlock *block = &inliner->blocks[b];
+            if (block->fallThrough >= 0)
+                continue;
+            for (int i = 0; i < inliner->resultWords; i++) {
+                InlinedValue *value =
+                    &inliner->values[block->result.values[i]];
+                value->lastUse = MAX(value->lastUse, block->endInsn);
+                value->isResult |= !value->isArg;
+            }
+        }
+    }
+
+    int numBorrowed = 0;
+    if (!allocateLocals(inliner, regs, numRegs)) {
+        numBorrowed = findDeadCallerRegs(cUnit->method, resumeOffset, regs,
+                                         numRegs);
+        if (numBorrowed == 0 ||
+            !allocateLocals(inliner, regs, numRegs + numBorrowed)) {
+            return false;
+        }
+    }
+
+    /*
+     * A borrowed register is dead, but the register map may still call it
+     * a reference at the next GC point.  Leave null in it, which is a valid
+     * value of any type.
+     */
+    int numNulled = 0;
+    int nulledRegs[MAX_BORROWED_REGS];
+    for (int k = numRegs; k < numRegs + numBorrowed; k++) {
+        bool used = false;
+        for (int i = 0; i < inliner->numValues && !used; i++) {
+            InlinedValue *value = &inliner->values[i];
+            used = !value->isArg &&
+                   (value->reg == regs[k] ||
+                    (value->wide && value->reg + 1 == regs[k]));
+        }
+        if (used)
+            nulledRegs[numNulled++] = regs[k];
+    }
+
+    /* The first block of the body goes into the invoke's */
+    BasicBlock **blocks = (BasicBlock **)
+        dvmCompilerNew(sizeof(BasicBlock *) * inliner->numBlocks, false);
+    blocks[0] = invokeBB;
+    for (int b = 1; b < inliner->numBlocks; b++) {
+        blocks[b] = dvmCompilerNewBB(kDalvikByteCode, cUnit->numBlocks++);
+        blocks[b]->startOffset = invokeMIR->offset + invokeMIR->width;
+    }
+
+    for (int b = 0; b < inliner->numBlocks; b++) {
+        InlinedBlock *block = &inliner->blocks[b];
+        BasicBlock *bb = blocks[b];
+
+        for (int i = block->firstInsn; i < block->endInsn; i++) {
+            DecodedInstruction insn = inliner->insns[i].insn;
+            int dfAttributes = dvmCompilerDataFlowAttributes[insn.opcode];
+
+            if (dfAttributes & DF_A_IS_REG)
+                insn.vA = inliner->values[insn.vA].reg;
+            if (dfAttributes & DF_B_IS_REG)
+                insn.vB = inliner->values[insn.vB].reg;
+            if (dfAttributes & DF_C_IS_REG)
+                insn.vC = inliner->values[insn.vC].reg;
+            appendCalleeMIR(bb, invokeMIR, &insn, inliner->insns[i].method);
+        }
+
+        if (block->fallThrough >= 0) {
+            bb->taken = blocks[block->taken];
+            bb->fallThrough = blocks[block->fallThrough];
+            bb->needFallThroughBranch = false;
+            continue;
+        }
+
+        DecodedInstruction extra;
+        memset(&extra, 0, sizeof(extra));
+
+        /* A returned argument is still in its own register */
+        if (moveResultMIR != NULL) {
+            const InlinedValue *value =
+                &inliner->values[block->result.values[0]];
+            if (value->reg != regs[0]) {
+                Opcode opcode = moveResultMIR->dalvikInsn.opcode;
+
+                extra.opcode = opcode == OP_MOVE_RESULT_WIDE ? OP_MOVE_WIDE :
+                               opcode == OP_MOVE_RESULT_OBJECT ?
+                               OP_MOVE_OBJECT : OP_MOVE;
+                extra.vA = regs[0];
+                extra.vB = value->reg;
+                appendCalleeMIR(bb, invokeMIR, &extra, calleeMethod);
+            }
+        }
+        for (int k = 0; k < numNulled; k++) {
+            extra.opcode = OP_CONST_4;
+            extra.vA = nulledRegs[k];
+            extra.vB = 0;
+            appendCalleeMIR(bb, invokeMIR, &extra, calleeMethod);
+        }
+
+        /*
+         * The invoke becomes no-op so it needs an explicit branch to jump to
+         * the chaining cell.
+         */
+        bb->fallThrough = moveResultBB;
+        bb->needFallThroughBranch = true;
+    }
+
+    if (inliner->numBlocks > 1) {
+        BasicBlock **bodyBlocks = (BasicBlock **)
+            dvmCompilerNew(sizeof(BasicBlock *) * inliner->numBlocks, false);
+        for (int i = 1; i < inliner->numLaidOut; i++)
+            bodyBlocks[i - 1] = blocks[inliner->layout[i]];
+        insertBodyBlocks(cUnit, invokeBB, bodyBlocks, inliner->numBlocks - 1);
+    }
+
+    invokeMIR->OptimizationFlags |= MIR_INLINED;
+    if (moveResultMIR != NULL)
+        moveResultMIR->OptimizationFlags |= MIR_INLINED;
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.invokeMonoBodyInlined++;
+    gDvmJit.invokeNestedInlined += inliner->numNestedCalls;
+#endif
+    return true;
+}
+#endif
+
 static bool tryInlineSingletonCallsite(CompilationUnit *cUnit,
                                        const Method *calleeMethod,
                                        MIR *invokeMIR,
@@ -253,6 +1418,12 @@ static bool tryInlineSingletonCallsite(CompilationUnit *cUnit,
         return inlineSetter(cUnit, calleeMethod, invokeMIR, invokeBB, false,
                             isRange);
     }
+#ifndef ARCH_IA32
+    if (methodStats->dalvikSize <= MAX_INLINED_BODY_SIZE * 2) {
+        return inlineMethodBody(cUnit, calleeMethod, invokeMIR, invokeBB,
+                                isRange);
+    }
+#endif
     return false;
 }
 
@@ -270,12 +1441,189 @@ static bool inlineEmptyVirtualCallee(CompilationUnit *cUnit,
     return true;
 }
 
+/* Does an inlined body write one of the registers the invoke passes? */
+static bool clobbersArgs(const MIR *bodyMIR, const DecodedInstruction *invoke,
+                         bool isRange)
+{
+    int dfFlags = dvmCompilerDataFlowAttributes[bodyMIR->dalvikInsn.opcode];
+
+    if (!(dfFlags & (DF_DA | DF_DA_WIDE)))
+        return false;
+
+    u4 first = bodyMIR->dalvikInsn.vA;
+    u4 last = first + ((dfFlags & DF_DA_WIDE) ? 1 : 0);
+    for (u4 i = 0; i < invoke->vA; i++) {
+        u4 reg = isRange ? invoke->vC + i : invoke->arg[i];
+        if (reg >= first && reg <= last)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Inline another target of a predicted call site behind a guard of its
+ * own.  The guard and the body go right before the slow invoke, which is
+ * only reached once every guard has failed:
+ *
+ *     check class A       -> mispredicted: check class B
+ *     body of A.m
+ *     branch over         (emitted with the next guard)
+ *     check class B       -> mispredicted: slow invoke
+ *     body of B.m
+ *     branch over
+ *     slow invoke
+ *
+ * Returns the CallsiteInfo of the new guard, or NULL if "calleeMethod" has
+ * no body that can be inlined here.  The x86 lowering only knows about the
+ * guard in front of the first target.
+ */
+static CallsiteInfo *inlineAlternativeTarget(const Method *calleeMethod,
+                                             MIR *invokeMIRSlow,
+                                             BasicBlock *invokeBB,
+                                             CallsiteInfo *lastTarget,
+                                             bool isRange)
+{
+#if defined(ARCH_IA32)
+    return NULL;
+#else
+    if (dvmIsNativeMethod(calleeMethod))
+        return NULL;
+
+    CompilerMethodStats *methodStats =
+        dvmCompilerAnalyzeMethodBody(calleeMethod, true);
+    MIR *moveResultMIR = invokeBB->fallThrough->firstMIRInsn;
+    MIR *bodyMIR = NULL;
+
+    if (methodStats->attributes & METHOD_IS_GETTER) {
+        bodyMIR = buildGetterMIR(calleeMethod, invokeMIRSlow, moveResultMIR,
+                                 isRange);
+        if (bodyMIR == NULL)
+            return NULL;
+        moveResultMIR->OptimizationFlags |= MIR_INLINED_PRED;
+    } else if (methodStats->attributes & METHOD_IS_SETTER) {
+        bodyMIR = buildSetterMIR(calleeMethod, invokeMIRSlow, isRange);
+        if (bodyMIR == NULL)
+            return NULL;
+    } else if (!(methodStats->attributes & METHOD_IS_EMPTY)) {
+        return NULL;
+    }
+
+    CallsiteInfo *targetInfo =
+        (CallsiteInfo *) dvmCompilerNew(sizeof(CallsiteInfo), true);
+    targetInfo->method = calleeMethod;
+    targetInfo->prevTarget = lastTarget;
+    lastTarget->nextTarget = targetInfo;
+
+    MIR *guardMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+    *guardMIR = *invokeMIRSlow;
+    guardMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
+    guardMIR->OptimizationFlags = 0;
+    guardMIR->meta.callsiteInfo = targetInfo;
+    /* Use vC to denote the first argument (ie this) */
+    if (!isRange) {
+        guardMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
+    }
+
+    dvmCompilerInsertMIRAfter(invokeBB, invokeMIRSlow->prev, guardMIR);
+    if (bodyMIR != NULL)
+        dvmCompilerInsertMIRAfter(invokeBB, guardMIR, bodyMIR);
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.invokePolyTargetsInlined++;
+#endif
+    return targetInfo;
+#endif
+}
+
+/*
+ * The guard in front of a predicted inline only admits the class seen when
+ * the trace was selected.  Go through the other receiver classes that the
+ * call site profile has seen: those dispatching to the inlined callee are
+ * admitted by the same guard, and each other small target gets its own
+ * guard and inlined body, so that bimorphic and polymorphic sites stay on
+ * the inlined path.
+ */
+static void addProfiledReceivers(CompilationUnit *cUnit,
+                                 const Method *calleeMethod,
+                                 MIR *invokeMIR,
+                                 BasicBlock *invokeBB,
+                                 bool isRange)
+{
+    CallsiteInfo *callsiteInfo = invokeMIR->meta.callsiteInfo;
+    MIR *invokeMIRSlow = invokeBB->lastMIRInsn;
+    JitCallSiteProfile profile;
+
+    if (!dvmCompilerGetCallSiteProfile(
+            cUnit->method->insns + invokeMIR->offset, &profile)) {
+        return;
+    }
+
+    /* Guarding against a handful of classes won't help a megamorphic site */
+    if (profile.megamorphic)
+        return;
+
+    /*
+     * The guards after the first one read the arguments after the bodies
+     * before them have been laid down, so stop adding targets once a body
+     * writes one of them.
+     */
+    bool argsClobbered = false;
+    for (MIR *mir = invokeMIR->next; mir != invokeMIRSlow; mir = mir->next) {
+        argsClobbered |= clobbersArgs(mir, &invokeMIRSlow->dalvikInsn,
+                                      isRange);
+    }
+
+    for (int i = 0; i < JIT_POLY_IC_SIZE && profile.clazz[i] != NULL; i++) {
+        const ClassObject *clazz = profile.clazz[i];
+
+        /* Already the predicted class */
+        if (clazz->classLoader == callsiteInfo->classLoader &&
+            !strcmp(clazz->descriptor, callsiteInfo->classDescriptor)) {
+            continue;
+        }
+
+        /* Find the guard for the target, adding one if need be */
+        CallsiteInfo *targetInfo = callsiteInfo;
+        CallsiteInfo *lastTarget = callsiteInfo;
+        while (targetInfo != NULL && targetInfo->method != profile.method[i]) {
+            lastTarget = targetInfo;
+            targetInfo = targetInfo->nextTarget;
+        }
+        if (targetInfo == NULL) {
+            if (argsClobbered || profile.method[i] == NULL)
+                continue;
+            targetInfo = inlineAlternativeTarget(profile.method[i],
+                                                 invokeMIRSlow, invokeBB,
+                                                 lastTarget, isRange);
+            if (targetInfo == NULL)
+                continue;
+            argsClobbered = clobbersArgs(invokeMIRSlow->prev,
+                                         &invokeMIRSlow->dalvikInsn, isRange);
+        }
+
+        if (targetInfo->classDescriptor == NULL) {
+            targetInfo->classDescriptor = clazz->descriptor;
+            targetInfo->classLoader = clazz->classLoader;
+            continue;
+        }
+
+        CallsiteInfo *polyInfo =
+            (CallsiteInfo *) dvmCompilerNew(sizeof(CallsiteInfo), true);
+        polyInfo->classDescriptor = clazz->descriptor;
+        polyInfo->classLoader = clazz->classLoader;
+        polyInfo->method = profile.method[i];
+        polyInfo->polyNext = targetInfo->polyNext;
+        targetInfo->polyNext = polyInfo;
+    }
+}
+
 static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
                                      const Method *calleeMethod,
                                      MIR *invokeMIR,
                                      BasicBlock *invokeBB,
                                      bool isRange)
 {
+    bool inlined = false;
+
     /* Not a Java method */
     if (dvmIsNativeMethod(calleeMethod)) return false;
 
@@ -284,18 +1632,19 @@ static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
 
     /* Empty callee - do nothing by checking the clazz pointer */
     if (methodStats->attributes & METHOD_IS_EMPTY) {
-        return inlineEmptyVirtualCallee(cUnit, calleeMethod, invokeMIR,
-                                        invokeBB);
-    }
-
-    if (methodStats->attributes & METHOD_IS_GETTER) {
-        return inlineGetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
-                            isRange);
+        inlined = inlineEmptyVirtualCallee(cUnit, calleeMethod, invokeMIR,
+                                           invokeBB);
+    } else if (methodStats->attributes & METHOD_IS_GETTER) {
+        inlined = inlineGetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
+                               isRange);
     } else if (methodStats->attributes & METHOD_IS_SETTER) {
-        return inlineSetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
-                            isRange);
+        inlined = inlineSetter(cUnit, calleeMethod, invokeMIR, invokeBB, true,
+                               isRange);
     }
-    return false;
+
+    if (inlined)
+        addProfiledReceivers(cUnit, calleeMethod, invokeMIR, invokeBB, isRange);
+    return inlined;
 }
 
 
@@ -427,3 +1776,40 @@ void dvmCompilerInlineMIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         }
     }
 }
+
+/*
+ * Inline every call left in a loop body.  The loop can't be compiled with
+ * a call in it, so this fails if any of them can't be expanded.
+ */
+bool dvmCompilerInlineLoopInvokes(CompilationUnit *cUnit)
+{
+    GrowableListIterator iterator;
+
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->blockType != kDalvikByteCode || bb->hidden ||
+            bb->lastMIRInsn == NULL) {
+            continue;
+        }
+        MIR *lastMIRInsn = bb->lastMIRInsn;
+        Opcode opcode = lastMIRInsn->dalvikInsn.opcode;
+
+        if ((dexGetFlagsFromOpcode(opcode) & kInstrInvoke) == 0)
+            continue;
+
+        /* Only calls with a callee noted by the loop parser get here */
+        bool isRange = opcode == OP_INVOKE_STATIC_RANGE ||
+                       opcode == OP_INVOKE_DIRECT_RANGE;
+        if (lastMIRInsn->meta.callsiteInfo == NULL ||
+            !tryInlineSingletonCallsite(cUnit,
+                                        lastMIRInsn->meta.callsiteInfo->method,
+                                        lastMIRInsn, bb, isRange)) {
+            return false;
+        }
+        /* The return block isn't necessarily laid out next */
+        bb->needFallThroughBranch = true;
+    }
+    return true;
+}
@@ -18,6 +18,7 @@
 #include "CompilerInternals.h"
 #include "Dataflow.h"
 #include "Loop.h"
+#include "codegen/Optimizer.h"
 
 #define DEBUG_LOOP(X)
 
@@ -118,6 +119,53 @@ static BasicBlock *findPredecessorBlock(const CompilationUnit *cUnit,
     }
 }
 
+/*
+ * The loop body is a chain of blocks, each the immediate dominator of the
+ * next, starting at the block after the entry.  Return the block after
+ * "bb", or NULL at the back branch.
+ */
+BasicBlock *dvmCompilerNextLoopBlock(BasicBlock *firstBB, BasicBlock *bb)
+{
+    BasicBlock *succ[2] = {bb->fallThrough, bb->taken};
+    for (int i = 0; i < 2; i++) {
+        if (succ[i] != NULL && succ[i] != firstBB &&
+            succ[i]->blockType == kDalvikByteCode && !succ[i]->hidden &&
+            succ[i]->iDom == bb) {
+            return succ[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Return the basic induction variable carried around the back branch in
+ * "ssaReg", ie the one whose phi in the first loop block takes "ssaReg" as
+ * its incoming value from the loop body.
+ */
+static InductionVariableInfo *findLoopCarriedBIV(CompilationUnit *cUnit,
+                                                 int ssaReg)
+{
+    BasicBlock *firstBB = cUnit->entryBlock->fallThrough;
+    GrowableList *ivList = cUnit->loopAnalysis->ivList;
+    MIR *phi;
+    unsigned int i;
+
+    for (phi = firstBB->firstMIRInsn; phi; phi = phi->next) {
+        if ((int)phi->dalvikInsn.opcode != (int)kMirOpPhi) break;
+        if (phi->ssaRep->uses[1] != ssaReg) continue;
+
+        for (i = 0; i < ivList->numUsed; i++) {
+            InductionVariableInfo *ivInfo =
+                GET_ELEM_N(ivList, InductionVariableInfo*, i);
+            if (ivInfo->ssaReg == ivInfo->basicSSAReg &&
+                ivInfo->ssaReg == phi->ssaRep->defs[0]) {
+                return ivInfo;
+            }
+        }
+    }
+    return NULL;
+}
+
 /* Used for normalized loop exit condition checks */
 static Opcode negateOpcode(Opcode opcode)
 {
@@ -158,36 +206,23 @@ static Opcode negateOpcode(Opcode opcode)
 
 /*
  * A loop is considered optimizable if:
- * 1) It has one basic induction variable.
- * 2) The loop back branch compares the BIV with a constant.
- * 3) We need to normalize the loop exit condition so that the loop is exited
+ * 1) The loop back branch compares a basic induction variable with a
+ *    constant.  Other BIVs may be updated alongside it, but only array
+ *    accesses indexed by this one have their checks hoisted.
+ * 2) We need to normalize the loop exit condition so that the loop is exited
  *    via the taken path.
- * 4) If it is a count-up loop, the condition is GE/GT. Otherwise it is
+ * 3) If it is a count-up loop, the condition is GE/GT. Otherwise it is
  *    LE/LT/LEZ/LTZ for a count-down loop.
  *
  * Return false for loops that fail the above tests.
  */
 static bool isSimpleCountedLoop(CompilationUnit *cUnit)
 {
-    unsigned int i;
     BasicBlock *loopBackBlock = cUnit->entryBlock->fallThrough;
     LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    InductionVariableInfo *ivInfo;
 
-    if (loopAnalysis->numBasicIV != 1) return false;
-    for (i = 0; i < loopAnalysis->ivList->numUsed; i++) {
-        InductionVariableInfo *ivInfo;
-
-        ivInfo = GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
-        /* Count up or down loop? */
-        if (ivInfo->ssaReg == ivInfo->basicSSAReg) {
-            /* Infinite loop */
-            if (ivInfo->inc == 0) {
-                return false;
-            }
-            loopAnalysis->isCountUpLoop = ivInfo->inc > 0;
-            break;
-        }
-    }
+    if (loopAnalysis->numBasicIV == 0) return false;
 
     /* Find the block that ends with a branch to exit the loop */
     while (true) {
@@ -216,13 +251,18 @@ static bool isSimpleCountedLoop(CompilationUnit *cUnit)
 
     /* reg/reg comparison */
     if (branch->ssaRep->numUses == 2) {
-        if (branch->ssaRep->uses[0] == loopAnalysis->ssaBIV) {
+        ivInfo = findLoopCarriedBIV(cUnit, branch->ssaRep->uses[0]);
+        if (ivInfo != NULL) {
+            loopAnalysis->ssaBIV = branch->ssaRep->uses[0];
             endSSAReg = branch->ssaRep->uses[1];
-        } else if (branch->ssaRep->uses[1] == loopAnalysis->ssaBIV) {
+        } else {
+            ivInfo = findLoopCarriedBIV(cUnit, branch->ssaRep->uses[1]);
+            if (ivInfo == NULL) {
+                return false;
+            }
+            loopAnalysis->ssaBIV = branch->ssaRep->uses[1];
             endSSAReg = branch->ssaRep->uses[0];
             opcode = negateOpcode(opcode);
-        } else {
-            return false;
         }
         endDalvikReg = dvmConvertSSARegToDalvik(cUnit, endSSAReg);
         /*
@@ -238,16 +278,25 @@ static bool isSimpleCountedLoop(CompilationUnit *cUnit)
         }
     /* Compare against zero */
     } else if (branch->ssaRep->numUses == 1) {
-        if (branch->ssaRep->uses[0] == loopAnalysis->ssaBIV) {
-            /* Keep the compiler happy */
-            endDalvikReg = -1;
-        } else {
+        ivInfo = findLoopCarriedBIV(cUnit, branch->ssaRep->uses[0]);
+        if (ivInfo == NULL) {
             return false;
         }
+        loopAnalysis->ssaBIV = branch->ssaRep->uses[0];
+        /* Keep the compiler happy */
+        endDalvikReg = -1;
     } else {
         return false;
     }
 
+    /* Infinite loop */
+    if (ivInfo->inc == 0) {
+        return false;
+    }
+    /* Count up or down loop? */
+    loopAnalysis->isCountUpLoop = ivInfo->inc > 0;
+    loopAnalysis->ssaLoopBIV = ivInfo->basicSSAReg;
+
     /* Normalize the loop exit check as "if (iv op end) exit;" */
     if (loopBackBlock->taken->blockType == kDalvikByteCode) {
         opcode = negateOpcode(opcode);
@@ -295,8 +344,11 @@ static bool isSimpleCountedLoop(CompilationUnit *cUnit)
  * Record the upper and lower bound information for range checks for each
  * induction variable. If array A is accessed by index "i+5", the upper and
  * lower bound will be len(A)-5 and -5, respectively.
+ *
+ * Only the BIV tested by the loop branch, and the IVs derived from it, have
+ * known bounds.  Return false if "idxReg" is not one of them.
  */
-static void updateRangeCheckInfo(CompilationUnit *cUnit, int arrayReg,
+static bool updateRangeCheckInfo(CompilationUnit *cUnit, int arrayReg,
                                  int idxReg)
 {
     InductionVariableInfo *ivInfo;
@@ -306,6 +358,9 @@ static void updateRangeCheckInfo(CompilationUnit *cUnit, int arrayReg,
     for (i = 0; i < loopAnalysis->ivList->numUsed; i++) {
         ivInfo = GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
         if (ivInfo->ssaReg == idxReg) {
+            if (ivInfo->basicSSAReg != loopAnalysis->ssaLoopBIV) {
+                return false;
+            }
             ArrayAccessInfo *arrayAccessInfo = NULL;
             for (j = 0; j < loopAnalysis->arrayAccessInfo->numUsed; j++) {
                 ArrayAccessInfo *existingArrayAccessInfo =
@@ -334,45 +389,94 @@ static void updateRangeCheckInfo(CompilationUnit *cUnit, int arrayReg,
                 dvmInsertGrowableList(loopAnalysis->arrayAccessInfo,
                                       (intptr_t) arrayAccessInfo);
             }
-            break;
+            return true;
         }
     }
+    return false;
+}
+
+/* Instance field accesses through a quickened field offset */
+static bool isQuickFieldAccess(Opcode opcode)
+{
+    switch (opcode) {
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+            return true;
+        default:
+            return false;
+    }
 }
 
-/* Returns true if the loop body cannot throw any exceptions */
+/*
+ * The object in "ssaReg" is loop invariant, so check it for null once in the
+ * loop entry.  The check punts to the interpreter like the hoisted range
+ * checks do.
+ */
+static void hoistNullCheck(CompilationUnit *cUnit, MIR *mir, int ssaReg)
+{
+    int objReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaReg));
+
+    dvmSetBit(cUnit->loopAnalysis->nullCheckedRegs, objReg);
+    mir->OptimizationFlags |= MIR_IGNORE_NULL_CHECK;
+}
+
+/*
+ * Returns true if the loop body cannot throw any exceptions.  Every block of
+ * the body is visited; a hoisted check punts to the interpreter at the loop
+ * head, so it is safe even for accesses the loop may exit before reaching.
+ */
 static bool doLoopBodyCodeMotion(CompilationUnit *cUnit)
 {
-    BasicBlock *loopBody = cUnit->entryBlock->fallThrough;
+    BasicBlock *firstBB = cUnit->entryBlock->fallThrough;
+    BasicBlock *loopBody;
     MIR *mir;
     bool loopBodyCanThrow = false;
 
-    for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
-        DecodedInstruction *dInsn = &mir->dalvikInsn;
-        int dfAttributes =
-            dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+    for (loopBody = firstBB; loopBody != NULL;
+         loopBody = dvmCompilerNextLoopBlock(firstBB, loopBody)) {
+        for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
+            DecodedInstruction *dInsn = &mir->dalvikInsn;
+            int dfAttributes =
+                dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
 
-        /* Skip extended MIR instructions */
-        if (dInsn->opcode >= kNumPackedOpcodes) continue;
+            /* Skip extended MIR instructions */
+            if (dInsn->opcode >= kNumPackedOpcodes) continue;
 
-        int instrFlags = dexGetFlagsFromOpcode(dInsn->opcode);
+            int instrFlags = dexGetFlagsFromOpcode(dInsn->opcode);
 
-        /* Instruction is clean */
-        if ((instrFlags & kInstrCanThrow) == 0) continue;
+            /* Instruction is clean */
+            if ((instrFlags & kInstrCanThrow) == 0) continue;
 
-        /*
-         * Currently we can only optimize away null and range checks. Punt on
-         * instructions that can throw due to other exceptions.
-         */
-        if (!(dfAttributes & DF_HAS_NR_CHECKS)) {
-            loopBodyCanThrow = true;
-            continue;
-        }
+#ifndef ARCH_IA32
+            /*
+             * A field access on a loop invariant object can only throw on
+             * the null check.
+             */
+            if (isQuickFieldAccess(dInsn->opcode)) {
+                int objIdx = mir->ssaRep->numUses - 1;
+                int objReg = mir->ssaRep->uses[objIdx];
+                if (DECODE_SUB(dvmConvertSSARegToDalvik(cUnit, objReg)) == 0) {
+                    hoistNullCheck(cUnit, mir, objReg);
+                } else {
+                    loopBodyCanThrow = true;
+                }
+                continue;
+            }
+#endif
+
+            /*
+             * Currently we can only optimize away null and range checks. Punt
+             * on instructions that can throw due to other exceptions.
+             */
+            if (!(dfAttributes & DF_HAS_NR_CHECKS)) {
+                loopBodyCanThrow = true;
+                continue;
+            }
 
-        /*
-         * This comparison is redundant now, but we will have more than one
-         * group of flags to check soon.
-         */
-        if (dfAttributes & DF_HAS_NR_CHECKS) {
             /*
              * Check if the null check is applied on a loop invariant register?
              * If the register's SSA id is less than the number of Dalvik
@@ -401,8 +505,8 @@ static bool doLoopBodyCodeMotion(CompilationUnit *cUnit)
             int arraySub = DECODE_SUB(subNRegArray);
 
             /*
-             * If the register is never updated in the loop (ie subscript == 0),
-             * it is an optimization candidate.
+             * If the register is never updated in the loop (ie subscript ==
+             * 0), it is an optimization candidate.
              */
             if (arraySub != 0) {
                 loopBodyCanThrow = true;
@@ -411,14 +515,22 @@ static bool doLoopBodyCodeMotion(CompilationUnit *cUnit)
 
             /*
              * Then check if the range check can be hoisted out of the loop if
-             * it is basic or dependent induction variable.
+             * it is basic or dependent induction variable of the loop BIV.
+             * Otherwise only the null check goes.
              */
             if (dvmIsBitSet(cUnit->loopAnalysis->isIndVarV,
-                            mir->ssaRep->uses[useIdx])) {
+                            mir->ssaRep->uses[useIdx]) &&
+                updateRangeCheckInfo(cUnit, mir->ssaRep->uses[refIdx],
+                                     mir->ssaRep->uses[useIdx])) {
                 mir->OptimizationFlags |=
                     MIR_IGNORE_RANGE_CHECK | MIR_IGNORE_NULL_CHECK;
-                updateRangeCheckInfo(cUnit, mir->ssaRep->uses[refIdx],
-                                     mir->ssaRep->uses[useIdx]);
+            } else {
+                hoistNullCheck(cUnit, mir, mir->ssaRep->uses[refIdx]);
+                loopBodyCanThrow = true;
+            }
+            /* The array store check is still done in the body */
+            if (dInsn->opcode == OP_APUT_OBJECT) {
+                loopBodyCanThrow = true;
             }
         }
     }
@@ -509,8 +621,270 @@ static void genHoistedChecks(CompilationUnit *cUnit)
             }
         }
     }
+
+    /* Arrays with a range check above are null checked there already */
+    for (i = 0; i < loopAnalysis->arrayAccessInfo->numUsed; i++) {
+        ArrayAccessInfo *arrayAccessInfo =
+            GET_ELEM_N(loopAnalysis->arrayAccessInfo,
+                       ArrayAccessInfo*, i);
+        dvmClearBit(loopAnalysis->nullCheckedRegs, DECODE_REG(
+            dvmConvertSSARegToDalvik(cUnit, arrayAccessInfo->arrayReg)));
+    }
+
+    BitVectorIterator bvIterator;
+    dvmBitVectorIteratorInit(loopAnalysis->nullCheckedRegs, &bvIterator);
+    while (true) {
+        int objReg = dvmBitVectorIteratorNext(&bvIterator);
+        if (objReg == -1) break;
+        MIR *nullCheckMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+        nullCheckMIR->dalvikInsn.opcode = (Opcode)kMirOpNullCheck;
+        nullCheckMIR->dalvikInsn.vA = objReg;
+        dvmCompilerAppendMIR(entry, nullCheckMIR);
+    }
 }
 
+#ifndef ARCH_IA32
+/* Opcodes that cannot throw and produce one narrow value */
+static bool isHoistableOpcode(Opcode opcode)
+{
+    switch (opcode) {
+        case OP_MOVE:
+        case OP_MOVE_FROM16:
+        case OP_MOVE_16:
+        case OP_MOVE_OBJECT:
+        case OP_MOVE_OBJECT_FROM16:
+        case OP_MOVE_OBJECT_16:
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+        case OP_CONST_HIGH16:
+        case OP_NEG_INT:
+        case OP_NOT_INT:
+        case OP_ADD_INT:
+        case OP_SUB_INT:
+        case OP_MUL_INT:
+        case OP_AND_INT:
+        case OP_OR_INT:
+        case OP_XOR_INT:
+        case OP_SHL_INT:
+        case OP_SHR_INT:
+        case OP_USHR_INT:
+        case OP_ADD_INT_LIT16:
+        case OP_RSUB_INT:
+        case OP_MUL_INT_LIT16:
+        case OP_AND_INT_LIT16:
+        case OP_OR_INT_LIT16:
+        case OP_XOR_INT_LIT16:
+        case OP_ADD_INT_LIT8:
+        case OP_RSUB_INT_LIT8:
+        case OP_MUL_INT_LIT8:
+        case OP_AND_INT_LIT8:
+        case OP_OR_INT_LIT8:
+        case OP_XOR_INT_LIT8:
+        case OP_SHL_INT_LIT8:
+        case OP_SHR_INT_LIT8:
+        case OP_USHR_INT_LIT8:
+        case OP_IGET_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Returns true if "mir" may write an instance field, or may make another
+ * thread's writes visible.
+ */
+static bool mayChangeFields(MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+
+    if ((int)opcode >= (int)kMirOpFirst) {
+        return (int)opcode != (int)kMirOpPhi;
+    }
+
+    int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+    if ((dfAttributes & DF_IS_SETTER) && !(dfAttributes & DF_HAS_NR_CHECKS)) {
+        return true;
+    }
+    if (dexGetFlagsFromOpcode(opcode) & kInstrInvoke) {
+        return true;
+    }
+    switch (opcode) {
+        case OP_MONITOR_ENTER:
+        case OP_MONITOR_EXIT:
+        case OP_EXECUTE_INLINE:
+        case OP_EXECUTE_INLINE_RANGE:
+        case OP_IGET_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IGET_WIDE_VOLATILE:
+        case OP_SGET_VOLATILE:
+        case OP_SGET_OBJECT_VOLATILE:
+        case OP_SGET_WIDE_VOLATILE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Returns true if "mir" may leave the loop body, either by branching or by
+ * throwing.  Accesses whose checks have all been hoisted cannot throw.
+ */
+static bool mayLeaveLoop(MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+
+    if ((int)opcode >= (int)kMirOpFirst) {
+        return (int)opcode != (int)kMirOpPhi;
+    }
+
+    int flags = dexGetFlagsFromOpcode(opcode);
+    if (flags & (kInstrCanBranch | kInstrCanSwitch | kInstrCanReturn |
+                 kInstrInvoke)) {
+        return true;
+    }
+    if (!(flags & kInstrCanThrow)) {
+        return false;
+    }
+
+    int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+    if ((dfAttributes & DF_HAS_NR_CHECKS) && opcode != OP_APUT_OBJECT) {
+        return (mir->OptimizationFlags &
+                (MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK)) !=
+               (MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK);
+    }
+    if (isQuickFieldAccess(opcode)) {
+        return !(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK);
+    }
+    return true;
+}
+
+/*
+ * Returns true if every read of Dalvik register "vReg" in the loop body sees
+ * the value defined in "ssaReg".
+ */
+static bool allUsesSee(CompilationUnit *cUnit, int vReg, int ssaReg)
+{
+    BasicBlock *firstBB = cUnit->entryBlock->fallThrough;
+    BasicBlock *bb;
+    MIR *mir;
+
+    for (bb = firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            if ((int)mir->dalvikInsn.opcode == (int)kMirOpPhi ||
+                mir->ssaRep == NULL) {
+                continue;
+            }
+            for (int i = 0; i < mir->ssaRep->numUses; i++) {
+                int use = mir->ssaRep->uses[i];
+                if (use != ssaReg &&
+                    DECODE_REG(dvmConvertSSARegToDalvik(cUnit, use)) == vReg) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Move loop invariant computations from the head of the loop body to the
+ * loop entry, after the hoisted checks.  A candidate has to:
+ * 1) only read registers not written in the loop, or written by MIRs that
+ *    have been hoisted already.  Field loads also need their null check
+ *    hoisted and a loop that doesn't write fields.
+ * 2) define the only value its register takes in the loop, and every read
+ *    of the register has to see it.  The value is then the same all the way
+ *    around the loop, so a PC reconstruction after the hoisted copy has run
+ *    finds the frame as the interpreter would have left it.
+ * 3) come before anything that may leave the loop on its first iteration.
+ *    This keeps an exit from seeing the new value before its time.
+ */
+static void hoistLoopInvariants(CompilationUnit *cUnit)
+{
+    BasicBlock *entry = cUnit->entryBlock;
+    BasicBlock *firstBB = entry->fallThrough;
+    BasicBlock *bb;
+    MIR *mir;
+    MIR *nextMIR;
+    bool fieldsChange = false;
+    int numHoisted = 0;
+
+    /* Number of times each Dalvik register is written in the loop */
+    int *defCount = (int *)
+        dvmCompilerNew(sizeof(int) * cUnit->numDalvikRegisters, true);
+    BitVector *isHoistedV =
+        dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+
+    for (bb = firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            if ((int)mir->dalvikInsn.opcode == (int)kMirOpPhi ||
+                mir->ssaRep == NULL) {
+                continue;
+            }
+            fieldsChange |= mayChangeFields(mir);
+            for (int i = 0; i < mir->ssaRep->numDefs; i++) {
+                int vReg = DECODE_REG(
+                    dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->defs[i]));
+                if (vReg < cUnit->numDalvikRegisters) {
+                    defCount[vReg]++;
+                }
+            }
+        }
+    }
+
+    for (mir = firstBB->firstMIRInsn; mir; mir = nextMIR) {
+        nextMIR = mir->next;
+        Opcode opcode = mir->dalvikInsn.opcode;
+
+        if ((int)opcode == (int)kMirOpPhi) continue;
+        if (mayLeaveLoop(mir)) break;
+
+        if (!isHoistableOpcode(opcode) || mir->ssaRep->numDefs != 1 ||
+            (mir->OptimizationFlags &
+             (MIR_INLINED | MIR_INLINED_PRED | MIR_CALLEE))) {
+            continue;
+        }
+        if (isQuickFieldAccess(opcode) && fieldsChange) continue;
+
+        bool invariant = true;
+        for (int i = 0; i < mir->ssaRep->numUses; i++) {
+            int use = mir->ssaRep->uses[i];
+            if (DECODE_SUB(dvmConvertSSARegToDalvik(cUnit, use)) != 0 &&
+                !dvmIsBitSet(isHoistedV, use)) {
+                invariant = false;
+                break;
+            }
+        }
+        if (!invariant) continue;
+
+        int def = mir->ssaRep->defs[0];
+        int vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, def));
+        if (vReg >= cUnit->numDalvikRegisters || defCount[vReg] != 1 ||
+            !allUsesSee(cUnit, vReg, def)) {
+            continue;
+        }
+
+        dvmCompilerRemoveMIR(firstBB, mir);
+        dvmCompilerAppendMIR(entry, mir);
+        dvmSetBit(isHoistedV, def);
+        numHoisted++;
+    }
+
+    if (numHoisted && cUnit->printMe) {
+        ALOGD("LOOP %s@%#x: %d invariant MIRs hoisted",
+              cUnit->method->name, entry->startOffset, numHoisted);
+    }
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.loopInvariantsHoisted += numHoisted;
+#endif
+}
+#endif
+
 void resetBlockEdges(BasicBlock *bb)
 {
     bb->taken = NULL;
@@ -677,6 +1051,18 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
         (LoopAnalysis *)dvmCompilerNew(sizeof(LoopAnalysis), true);
     cUnit->loopAnalysis = loopAnalysis;
 
+    /* Reuse loads and arithmetic already done earlier in the iteration */
+    if (!(gDvmJit.disableOpt & (1 << kValueNumbering))) {
+        dvmCompilerValueNumbering(cUnit);
+    }
+
+#ifndef ARCH_IA32
+    /* Keep the fields of objects that don't outlive an iteration in regs */
+    if (!(gDvmJit.disableOpt & (1 << kEscapeAnalysis))) {
+        dvmCompilerEscapeAnalysis(cUnit);
+    }
+#endif
+
     /* Constant propagation */
     cUnit->isConstantV = dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
     cUnit->constantValues =
@@ -706,6 +1092,8 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
     loopAnalysis->arrayAccessInfo =
         (GrowableList *)dvmCompilerNew(sizeof(GrowableList), true);
     dvmInitGrowableList(loopAnalysis->arrayAccessInfo, 4);
+    loopAnalysis->nullCheckedRegs =
+        dvmCompilerAllocBitVector(cUnit->numDalvikRegisters, false);
     loopAnalysis->bodyIsClean = doLoopBodyCodeMotion(cUnit);
     DEBUG_LOOP(dumpHoistedChecks(cUnit);)
 
@@ -714,6 +1102,21 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
      * header.
      */
     genHoistedChecks(cUnit);
+
+#ifndef ARCH_IA32
+    /*
+     * The x86 backend generates the entry block on its own and only expects
+     * the hoisted checks there.
+     */
+    if (!(gDvmJit.disableOpt & (1 << kLoopInvariantMotion))) {
+        hoistLoopInvariants(cUnit);
+    }
+#else
+    /* Only the x86 backend lowers vector loops so far */
+    if (!(gDvmJit.disableOpt & (1 << kLoopVectorization))) {
+        dvmCompilerVectorizeLoop(cUnit);
+    }
+#endif
     return true;
 }
 
@@ -24,8 +24,10 @@ typedef struct LoopAnalysis {
     BitVector *isIndVarV;               // length == numSSAReg
     GrowableList *ivList;               // induction variables
     GrowableList *arrayAccessInfo;      // hoisted checks for array accesses
+    BitVector *nullCheckedRegs;         // hoisted null checks, by Dalvik reg
     int numBasicIV;                     // number of basic induction variables
     int ssaBIV;                         // basic IV in SSA name
+    int ssaLoopBIV;                     // phi of the BIV the loop tests
     bool isCountUpLoop;                 // count up or down loop
     Opcode loopBranchOpcode;            // OP_IF_XXX for the loop back branch
     int endConditionReg;                // vB in "vA op vB"
@@ -37,6 +39,10 @@ typedef struct LoopAnalysis {
 
 bool dvmCompilerFilterLoopBlocks(CompilationUnit *cUnit);
 
+BasicBlock *dvmCompilerNextLoopBlock(BasicBlock *firstBB, BasicBlock *bb);
+
+void dvmCompilerVectorizeLoop(CompilationUnit *cUnit);
+
 /*
  * An unexecuted code path may contain unresolved fields or classes. Before we
  * have a quiet resolver we simply bail out of the loop compilation mode.
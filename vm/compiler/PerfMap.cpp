@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Symbol output for Linux perf, so samples in the code cache can be
+ * attributed to Dalvik methods.
+ *
+ * -Xjitperfmap writes /tmp/perf-<pid>.map, one "start size name" line per
+ * translation.  The file only describes one point in time, so entries for
+ * code that is evicted or reset are dropped and the file is rewritten.
+ *
+ * -Xjitdump writes /tmp/jit-<pid>.dump in the jitdump format read by
+ * "perf inject --jit".  Each record is timestamped and carries a copy of
+ * the code, so reused addresses are told apart without rewriting anything.
+ * Record with "perf record -k mono" for the timestamps to line up.
+ *
+ * Translations are added and removed with compilerLock held.
+ * gDvmJit.jitDumpMarker is non-NULL while the jitdump is open.
+ */
+
+#include "Dalvik.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/* jitdump file format, from tools/perf/Documentation/jitdump-specification */
+#define JITDUMP_MAGIC           0x4A695444
+#define JITDUMP_VERSION         1
+#define JITDUMP_CODE_LOAD       0
+#define JITDUMP_CODE_CLOSE      3
+
+struct JitDumpHeader {
+    u4 magic;
+    u4 version;
+    u4 totalSize;
+    u4 elfMach;
+    u4 pad1;
+    u4 pid;
+    u8 timestamp;
+    u8 flags;
+};
+
+struct JitDumpRecordHeader {
+    u4 id;
+    u4 totalSize;
+    u8 timestamp;
+};
+
+struct JitDumpCodeLoad {
+    JitDumpRecordHeader header;
+    u4 pid;
+    u4 tid;
+    u8 vma;
+    u8 codeAddr;
+    u8 codeSize;
+    u8 codeIndex;
+    /* followed by the NUL-terminated name and the code bytes */
+};
+
+/* One translation known to the perf map */
+struct PerfMapEntry {
+    uintptr_t start;
+    unsigned int size;
+    const Method* method;
+    unsigned int offset;        /* Dalvik offset of the trace head */
+};
+
+#if defined(ARCH_IA32)
+#define JITDUMP_ELF_MACH        EM_386
+#elif defined(ARCH_MIPS)
+#define JITDUMP_ELF_MACH        EM_MIPS
+#else
+#define JITDUMP_ELF_MACH        EM_ARM
+#endif
+
+/* perf wants CLOCK_MONOTONIC for the jitdump timestamps */
+static u8 monotonicNsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u8) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static std::string traceName(const Method* method, unsigned int offset)
+{
+    std::string name(dvmHumanReadableMethod(method, false));
+    return name + StringPrintf("@%#x", offset);
+}
+
+static void writePerfMapLine(uintptr_t start, unsigned int size,
+                             const char* name)
+{
+    fprintf(gDvmJit.perfMapFile, "%lx %x %s\n",
+            (unsigned long) start, size, name);
+}
+
+/* Rewrite the whole map from gDvmJit.perfMapEntries */
+static void rewritePerfMap(void)
+{
+    FILE* fp = gDvmJit.perfMapFile;
+
+    rewind(fp);
+    if (ftruncate(fileno(fp), 0) != 0) {
+        ALOGW("JIT: unable to truncate the perf map: %s", strerror(errno));
+    }
+    writePerfMapLine((uintptr_t) gDvmJit.codeCache, gDvmJit.templateSize,
+                     "dalvik-jit-templates");
+    for (int i = 0; i < gDvmJit.perfMapCount; i++) {
+        const PerfMapEntry* entry = &gDvmJit.perfMapEntries[i];
+        writePerfMapLine(entry->start, entry->size,
+                         traceName(entry->method, entry->offset).c_str());
+    }
+    fflush(fp);
+}
+
+static bool writeFully(int fd, const void* buf, size_t count)
+{
+    const char* ptr = (const char*) buf;
+    while (count != 0) {
+        ssize_t actual = TEMP_FAILURE_RETRY(write(fd, ptr, count));
+        if (actual <= 0)
+            return false;
+        ptr += actual;
+        count -= actual;
+    }
+    return true;
+}
+
+static void closeJitDump(void)
+{
+    JitDumpRecordHeader record;
+    record.id = JITDUMP_CODE_CLOSE;
+    record.totalSize = sizeof(record);
+    record.timestamp = monotonicNsec();
+    writeFully(gDvmJit.jitDumpFd, &record, sizeof(record));
+
+    munmap(gDvmJit.jitDumpMarker, getpagesize());
+    close(gDvmJit.jitDumpFd);
+    gDvmJit.jitDumpMarker = NULL;
+}
+
+static void openJitDump(void)
+{
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "/tmp/jit-%d.dump", getpid());
+    int fd = open(fileName, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0) {
+        ALOGW("JIT: unable to create %s: %s", fileName, strerror(errno));
+        return;
+    }
+
+    /*
+     * perf finds the dump through an executable mapping of it, which
+     * shows up as an mmap event in the recording.
+     */
+    void* marker = mmap(NULL, getpagesize(), PROT_READ | PROT_EXEC,
+                        MAP_PRIVATE, fd, 0);
+    if (marker == MAP_FAILED) {
+        ALOGW("JIT: unable to map %s: %s", fileName, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    JitDumpHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.totalSize = sizeof(header);
+    header.elfMach = JITDUMP_ELF_MACH;
+    header.pid = getpid();
+    header.timestamp = monotonicNsec();
+    if (!writeFully(fd, &header, sizeof(header))) {
+        ALOGW("JIT: unable to write %s: %s", fileName, strerror(errno));
+        munmap(marker, getpagesize());
+        close(fd);
+        return;
+    }
+
+    gDvmJit.jitDumpFd = fd;
+    gDvmJit.jitDumpMarker = marker;
+    gDvmJit.jitDumpCodeIndex = 0;
+}
+
+/*
+ * Start the perf outputs requested on the command line.  Called by the
+ * compiler thread once the code cache and templates are in place.
+ */
+void dvmCompilerPerfMapOpen(void)
+{
+    if (gDvmJit.perfMap) {
+        char fileName[64];
+        snprintf(fileName, sizeof(fileName), "/tmp/perf-%d.map", getpid());
+        gDvmJit.perfMapFile = fopen(fileName, "w");
+        if (gDvmJit.perfMapFile == NULL) {
+            ALOGW("JIT: unable to create %s: %s", fileName, strerror(errno));
+        } else {
+            rewritePerfMap();
+        }
+    }
+
+    if (gDvmJit.jitDump)
+        openJitDump();
+}
+
+void dvmCompilerPerfMapClose(void)
+{
+    dvmLockMutex(&gDvmJit.compilerLock);
+    if (gDvmJit.perfMapFile != NULL) {
+        fclose(gDvmJit.perfMapFile);
+        gDvmJit.perfMapFile = NULL;
+    }
+    if (gDvmJit.jitDumpMarker != NULL)
+        closeJitDump();
+    free(gDvmJit.perfMapEntries);
+    gDvmJit.perfMapEntries = NULL;
+    gDvmJit.perfMapCount = gDvmJit.perfMapCapacity = 0;
+    dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
+/*
+ * A translation of the trace in "desc" has just been installed.
+ */
+void dvmCompilerPerfMapAdd(const JitTraceDescription* desc,
+                           const JitTranslationInfo* info)
+{
+    if (gDvmJit.perfMapFile == NULL && gDvmJit.jitDumpMarker == NULL)
+        return;
+
+    /* Drop the Thumb mode bit */
+    uintptr_t start = (uintptr_t) info->codeAddress & ~1;
+    unsigned int offset = desc->trace[0].info.frag.startOffset;
+    std::string name(traceName(desc->method, offset));
+
+    if (gDvmJit.perfMapFile != NULL) {
+        if (gDvmJit.perfMapCount == gDvmJit.perfMapCapacity) {
+            int newCapacity = gDvmJit.perfMapCapacity == 0 ?
+                256 : gDvmJit.perfMapCapacity * 2;
+            PerfMapEntry* newEntries = (PerfMapEntry*)
+                realloc(gDvmJit.perfMapEntries,
+                        newCapacity * sizeof(PerfMapEntry));
+            if (newEntries == NULL) {
+                ALOGW("JIT: out of memory for the perf map");
+                return;
+            }
+            gDvmJit.perfMapEntries = newEntries;
+            gDvmJit.perfMapCapacity = newCapacity;
+        }
+        PerfMapEntry* entry = &gDvmJit.perfMapEntries[gDvmJit.perfMapCount++];
+        entry->start = start;
+        entry->size = info->codeSize;
+        entry->method = desc->method;
+        entry->offset = offset;
+
+        writePerfMapLine(start, info->codeSize, name.c_str());
+        fflush(gDvmJit.perfMapFile);
+    }
+
+    if (gDvmJit.jitDumpMarker != NULL) {
+        JitDumpCodeLoad record;
+        record.header.id = JITDUMP_CODE_LOAD;
+        record.header.totalSize =
+            sizeof(record) + name.size() + 1 + info->codeSize;
+        record.header.timestamp = monotonicNsec();
+        record.pid = getpid();
+        record.tid = dvmGetSysThreadId();
+        record.vma = start;
+        record.codeAddr = start;
+        record.codeSize = info->codeSize;
+        record.codeIndex = gDvmJit.jitDumpCodeIndex++;
+        if (!writeFully(gDvmJit.jitDumpFd, &record, sizeof(record)) ||
+            !writeFully(gDvmJit.jitDumpFd, name.c_str(), name.size() + 1) ||
+            !writeFully(gDvmJit.jitDumpFd, (const void*) start,
+                        info->codeSize)) {
+            ALOGW("JIT: jitdump write failed, giving up: %s",
+                 strerror(errno));
+            closeJitDump();
+        }
+    }
+}
+
+/*
+ * The translations in [lo, hi) have been thrown away.  Forget them and
+ * rewrite the perf map; the jitdump needs nothing, since later loads at
+ * the same addresses carry later timestamps.
+ */
+void dvmCompilerPerfMapRemove(const void* lo, const void* hi)
+{
+    if (gDvmJit.perfMapFile == NULL)
+        return;
+
+    int kept = 0;
+    for (int i = 0; i < gDvmJit.perfMapCount; i++) {
+        const PerfMapEntry* entry = &gDvmJit.perfMapEntries[i];
+        if (entry->start < (uintptr_t) lo || entry->start >= (uintptr_t) hi)
+            gDvmJit.perfMapEntries[kept++] = *entry;
+    }
+    if (kept != gDvmJit.perfMapCount) {
+        gDvmJit.perfMapCount = kept;
+        rewritePerfMap();
+    }
+}
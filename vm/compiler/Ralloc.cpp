@@ -17,6 +17,8 @@
 #include "Dalvik.h"
 #include "CompilerInternals.h"
 #include "Dataflow.h"
+#include "Loop.h"
+#include "codegen/Optimizer.h"
 
 /*
  * Quick & dirty - make FP usage sticky.  This is strictly a hint - local
@@ -83,3 +85,224 @@ void dvmCompilerLocalRegAlloc(CompilationUnit *cUnit)
                 DECODE_REG(dvmConvertSSARegToDalvik(cUnit, loc[i].sRegLow));
     }
 }
+
+/* What a loop body does with one Dalvik register */
+typedef struct LoopRegUse {
+    int refs;                   // uses and defs in the body
+    int firstDef;               // seqNum of the first def, if not liveIn
+    int lastUse;                // seqNum of the last use
+    int firstBlock;             // body blocks holding the first and last ref
+    int lastBlock;
+    bool liveIn;                // read before it is written
+    bool defined;               // written somewhere in the body
+    bool indVar;                // an induction variable
+    bool excluded;              // touched as a wide or fp value
+} LoopRegUse;
+
+static LoopRegUse *loopRegRef(CompilationUnit *cUnit, LoopRegUse *regUse,
+                              int ssaReg, int blockIdx, bool isWide, bool isFP)
+{
+    int vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaReg));
+    if (vReg >= cUnit->numDalvikRegisters)
+        return NULL;
+
+    LoopRegUse *p = &regUse[vReg];
+    if (p->refs++ == 0)
+        p->firstBlock = blockIdx;
+    p->lastBlock = blockIdx;
+    if (isWide || isFP || cUnit->regLocation[ssaReg].fp)
+        p->excluded = true;
+    if (dvmIsBitSet(cUnit->loopAnalysis->isIndVarV, ssaReg))
+        p->indVar = true;
+    return p;
+}
+
+static void scanLoopMIR(CompilationUnit *cUnit, LoopRegUse *regUse, MIR *mir,
+                        int blockIdx)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int i;
+
+    /*
+     * Phis don't generate code, the body MIRs around them say it all.  Nor
+     * do inlined invokes and move-results, whose callee MIRs read and write
+     * the registers themselves.
+     */
+    if (ssaRep == NULL || mir->dalvikInsn.opcode == (Opcode) kMirOpPhi ||
+        (mir->OptimizationFlags & MIR_INLINED)) {
+        return;
+    }
+
+    int dfAttributes = dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+    bool isWide = dfAttributes & (DF_UA_WIDE | DF_UB_WIDE | DF_UC_WIDE |
+                                  DF_DA_WIDE);
+
+    for (i = 0; i < ssaRep->numUses; i++) {
+        bool isFP = ssaRep->fpUse && ssaRep->fpUse[i];
+        LoopRegUse *p = loopRegRef(cUnit, regUse, ssaRep->uses[i], blockIdx,
+                                   isWide, isFP);
+        if (p == NULL)
+            continue;
+        if (!p->defined)
+            p->liveIn = true;
+        p->lastUse = mir->seqNum;
+    }
+    for (i = 0; i < ssaRep->numDefs; i++) {
+        bool isFP = ssaRep->fpDef && ssaRep->fpDef[i];
+        LoopRegUse *p = loopRegRef(cUnit, regUse, ssaRep->defs[i], blockIdx,
+                                   isWide, isFP);
+        if (p == NULL)
+            continue;
+        if (!p->defined && !p->liveIn)
+            p->firstDef = mir->seqNum;
+        p->defined = true;
+    }
+}
+
+/* Order by start, heaviest first among equals */
+static int compareIntervals(const void *a, const void *b)
+{
+    const PromotedInterval *intervalA = (const PromotedInterval *) a;
+    const PromotedInterval *intervalB = (const PromotedInterval *) b;
+    if (intervalA->start != intervalB->start)
+        return intervalA->start - intervalB->start;
+    return intervalB->weight - intervalA->weight;
+}
+
+/*
+ * Global register allocation for loop traces.  Local allocation keeps
+ * values in temps within a block, but every block boundary and every trip
+ * around the back branch starts over from the Dalvik frame.  Here the MIRs
+ * of the loop body are numbered along its chain of blocks - a loop has no
+ * joins other than the back branch - and each narrow core Dalvik register
+ * gets one live interval.  Registers read before they are written, which
+ * covers the loop invariants and induction variables, are live from the
+ * entry block (position 0) around to the back branch; the rest from their
+ * first def to their last use.  Intervals inside a single block gain
+ * nothing over the live temps and are skipped.
+ *
+ * A linear scan in start order then hands out "numSlots" promotion
+ * registers.  When they run out, the lightest of the overlapping intervals
+ * stays in the frame.  Invariants and induction variables count double.
+ *
+ * Codegen is expected to lock the promotion registers, keep them live with
+ * their Dalvik registers across block boundaries and repair them after
+ * anything that clobbers them.  Stores still go through to the frame, so
+ * a side exit never needs to write anything back.
+ */
+void dvmCompilerLoopRegAlloc(CompilationUnit *cUnit, int numSlots)
+{
+    cUnit->numPromotedIntervals = 0;
+    if (numSlots == 0 || cUnit->jitMode != kJitLoop ||
+        (gDvmJit.disableOpt & ((1 << kLoopRegPromotion) |
+                               (1 << kTrackLiveTemps)))) {
+        return;
+    }
+
+    LoopRegUse *regUse = (LoopRegUse *)
+        dvmCompilerNew(cUnit->numDalvikRegisters * sizeof(*regUse), true);
+    BasicBlock *firstBB = cUnit->entryBlock->fallThrough;
+    BasicBlock *bb;
+    MIR *mir;
+    int seqNum = 0;
+    int blockIdx = 0;
+    int i;
+
+    for (mir = cUnit->entryBlock->firstMIRInsn; mir; mir = mir->next) {
+        mir->seqNum = 0;
+    }
+    for (bb = firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(firstBB, bb)) {
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            mir->seqNum = ++seqNum;
+            scanLoopMIR(cUnit, regUse, mir, blockIdx);
+        }
+        blockIdx++;
+    }
+    cUnit->loopBodyLength = seqNum;
+    if (seqNum == 0)
+        return;
+
+    /* Build the candidate intervals */
+    PromotedInterval *intervals = (PromotedInterval *)
+        dvmCompilerNew(cUnit->numDalvikRegisters * sizeof(*intervals), false);
+    int numIntervals = 0;
+    for (i = 0; i < cUnit->numDalvikRegisters; i++) {
+        LoopRegUse *p = &regUse[i];
+        PromotedInterval *interval = &intervals[numIntervals];
+        if (p->refs == 0 || p->excluded)
+            continue;
+        if (p->liveIn) {
+            interval->start = 0;
+            interval->end = seqNum;
+        } else {
+            if (p->lastUse <= p->firstDef || p->firstBlock == p->lastBlock)
+                continue;
+            interval->start = p->firstDef;
+            interval->end = p->lastUse;
+        }
+        interval->vReg = i;
+        interval->slot = -1;
+        interval->weight = p->refs;
+        if (!p->defined || p->indVar)
+            interval->weight *= 2;
+        numIntervals++;
+    }
+    qsort(intervals, numIntervals, sizeof(*intervals), compareIntervals);
+
+    /* Linear scan */
+    PromotedInterval **active = (PromotedInterval **)
+        dvmCompilerNew(numSlots * sizeof(*active), true);
+    int numDropped = 0;
+    for (i = 0; i < numIntervals; i++) {
+        PromotedInterval *cur = &intervals[i];
+        PromotedInterval *lightest = NULL;
+        int slot;
+
+        /* Ending where the next one starts still overlaps it */
+        for (slot = 0; slot < numSlots; slot++) {
+            if (active[slot] != NULL && active[slot]->end < cur->start)
+                active[slot] = NULL;
+        }
+        for (slot = 0; slot < numSlots; slot++) {
+            if (active[slot] == NULL)
+                break;
+            if (lightest == NULL || active[slot]->weight < lightest->weight)
+                lightest = active[slot];
+        }
+        if (slot == numSlots) {
+            numDropped++;
+            if (lightest->weight >= cur->weight)
+                continue;
+            slot = lightest->slot;
+            lightest->slot = -1;
+        }
+        cur->slot = slot;
+        active[slot] = cur;
+    }
+
+    /* Keep the survivors */
+    int numPromoted = 0;
+    for (i = 0; i < numIntervals; i++) {
+        if (intervals[i].slot >= 0)
+            intervals[numPromoted++] = intervals[i];
+    }
+    cUnit->promotedIntervals = intervals;
+    cUnit->numPromotedIntervals = numPromoted;
+
+    if (cUnit->printMe) {
+        for (i = 0; i < numPromoted; i++) {
+            ALOGD("Loop reg promotion: v%d -> slot %d [%d, %d] weight %d",
+                  intervals[i].vReg, intervals[i].slot, intervals[i].start,
+                  intervals[i].end, intervals[i].weight);
+        }
+    }
+
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.loopRegsPromoted += numPromoted;
+    gDvmJit.loopRegsDropped += numDropped;
+    for (i = 0; i < numPromoted; i++) {
+        gDvmJit.loopRegRefsPromoted += regUse[intervals[i].vReg].refs;
+    }
+#endif
+}
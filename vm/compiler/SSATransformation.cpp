@@ -602,6 +602,10 @@ bool dvmCompilerBuildLoop(CompilationUnit *cUnit)
     if (dvmCompilerFilterLoopBlocks(cUnit) == false)
         return false;
 
+    /* Calls left in the body have to be expanded before SSA naming */
+    if (cUnit->hasInvoke && !dvmCompilerInlineLoopInvokes(cUnit))
+        return false;
+
     /* Re-compute the DFS order just for the loop */
     computeDFSOrder(cUnit);
 
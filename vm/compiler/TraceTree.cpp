@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * JIT trace trees.
+ *
+ * Trace selection stops at the first conditional branch, so the side that
+ * wasn't taken while the trace was being built leaves through a chaining
+ * cell.  When that side gets hot the interpreter asks for a new trace
+ * starting there, which lands wherever the code cache happens to be, and
+ * every trip down it costs a chained branch into another translation, or a
+ * visit to the interpreter until the chain is made.
+ *
+ * Instead, the compiler remembers the side exits of each installed
+ * trace that was compiled from its whole description.  A request for a
+ * trace starting at one of them is rewritten into a recompilation of the
+ * trace it leaves, with the new runs appended to the description.  The
+ * frontend links the exit branch to the appended block as it would any
+ * other block in the trace, so the hot path stays in one translation, and
+ * the exits of the grown tree are remembered in turn until it reaches
+ * JIT_MAX_TRACE_LEN instructions.
+ *
+ * The grown tree replaces the root's JitTable entry.  All chains are
+ * dropped once the entry has been swapped, so that nothing keeps branching
+ * into the old translation, which is left in place until its code cache
+ * segment goes.
+ *
+ * Growing a tree only changes which blocks end up in one translation.  It
+ * does not change how a translation is laid out, and there is no separate
+ * region of the code cache for cold code.
+ */
+
+#include "Dalvik.h"
+#include "interp/Jit.h"
+#include "CompilerInternals.h"
+#include "codegen/Optimizer.h"
+
+/* A side exit of an installed trace */
+struct TraceTreeExit {
+    const u2* exitPC;
+    const u2* rootPC;
+    void* rootCode;                 /* translation the exit was taken from */
+    JitTraceDescription* rootDesc;  /* what it was compiled from */
+};
+
+static void freeTraceTreeExit(void* ptr)
+{
+    TraceTreeExit* exit = (TraceTreeExit*) ptr;
+    free(exit->rootDesc);
+    free(exit);
+}
+
+static int compareExitPC(const void* tableItem, const void* looseItem)
+{
+    return ((const TraceTreeExit*) tableItem)->exitPC !=
+           ((const TraceTreeExit*) looseItem)->exitPC;
+}
+
+static inline u4 exitHash(const u2* exitPC)
+{
+    return (u4) (uintptr_t) exitPC >> 1;
+}
+
+/* The root has been recompiled, evicted or reset since the exit was seen */
+static bool isStale(const TraceTreeExit* exit)
+{
+    JitEntry* entry = dvmJitFindEntry(exit->rootPC, false /* method entry */);
+    return entry == NULL || entry->codeAddress != exit->rootCode;
+}
+
+static int removeStaleExit(void* data)
+{
+    TraceTreeExit* exit = (TraceTreeExit*) data;
+    if (!isStale(exit))
+        return 0;
+    freeTraceTreeExit(exit);
+    return 1;
+}
+
+/* Entries of "desc" up to and including the last code run */
+static int countRuns(const JitTraceDescription* desc)
+{
+    int numRuns;
+    for (numRuns = 1; !desc->trace[numRuns - 1].isCode ||
+                      !desc->trace[numRuns - 1].info.frag.runEnd; numRuns++)
+        ;
+    return numRuns;
+}
+
+static int countInsts(const JitTraceDescription* desc, int numRuns)
+{
+    int numInsts = 0;
+    for (int i = 0; i < numRuns; i++) {
+        if (desc->trace[i].isCode)
+            numInsts += desc->trace[i].info.frag.numInsts;
+    }
+    return numInsts;
+}
+
+/*
+ * Returns the taken target of a forward conditional branch at "offset", or
+ * 0 if there's something else there.
+ */
+static unsigned int forwardBranchTarget(const Method* method,
+                                        unsigned int offset)
+{
+    DecodedInstruction insn;
+    unsigned int target;
+
+    dexDecodeInstruction(method->insns + offset, &insn);
+    switch (insn.opcode) {
+        case OP_IF_EQ:
+        case OP_IF_NE:
+        case OP_IF_LT:
+        case OP_IF_GE:
+        case OP_IF_GT:
+        case OP_IF_LE:
+            target = offset + (int) insn.vC;
+            break;
+        case OP_IF_EQZ:
+        case OP_IF_NEZ:
+        case OP_IF_LTZ:
+        case OP_IF_GEZ:
+        case OP_IF_GTZ:
+        case OP_IF_LEZ:
+            target = offset + (int) insn.vB;
+            break;
+        default:
+            return 0;
+    }
+    /* A backward branch is a loop, which compileLoop looks after */
+    return target > offset ? target : 0;
+}
+
+static bool isRunHead(const JitTraceDescription* desc, int numRuns,
+                      unsigned int offset)
+{
+    for (int i = 0; i < numRuns; i++) {
+        if (desc->trace[i].isCode &&
+            desc->trace[i].info.frag.numInsts != 0 &&
+            desc->trace[i].info.frag.startOffset == offset) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void recordExit(const u2* rootPC, const JitTraceDescription* desc,
+                       int numRuns, void* rootCode, unsigned int offset)
+{
+    HashTable* exits = gDvmJit.traceTreeExits;
+
+    if (dvmHashTableNumEntries(exits) >= JIT_TRACE_TREE_MAX_EXITS) {
+        dvmHashForeachRemove(exits, removeStaleExit);
+        if (dvmHashTableNumEntries(exits) >= JIT_TRACE_TREE_MAX_EXITS) {
+            gDvmJit.traceTreeExitsDropped++;
+            return;
+        }
+    }
+
+    size_t size = sizeof(JitTraceDescription) + numRuns * sizeof(JitTraceRun);
+    TraceTreeExit* exit = (TraceTreeExit*) malloc(sizeof(TraceTreeExit));
+    JitTraceDescription* copy = (JitTraceDescription*) malloc(size);
+    if (exit == NULL || copy == NULL) {
+        free(exit);
+        free(copy);
+        return;
+    }
+    memcpy(copy, desc, size);
+    exit->exitPC = desc->method->insns + offset;
+    exit->rootPC = rootPC;
+    exit->rootCode = rootCode;
+    exit->rootDesc = copy;
+
+    TraceTreeExit* found = (TraceTreeExit*)
+        dvmHashTableLookup(exits, exitHash(exit->exitPC), exit,
+                           compareExitPC, true);
+    if (found != exit) {
+        /* Another trace leaves to the same place - the newest one wins */
+        free(found->rootDesc);
+        *found = *exit;
+        free(exit);
+    }
+}
+
+/*
+ * Remember the side exits of a newly installed trace.  "desc" was compiled
+ * in full into "rootCode", now the translation for "rootPC".  Caller holds
+ * compilerLock.
+ */
+void dvmCompilerTraceTreeRecord(const u2* rootPC,
+                                const JitTraceDescription* desc,
+                                void* rootCode)
+{
+    if (gDvmJit.disableOpt & (1 << kTraceTreeFormation))
+        return;
+
+    int numRuns = countRuns(desc);
+    if (countInsts(desc, numRuns) >= JIT_MAX_TRACE_LEN)
+        return;
+
+    if (gDvmJit.traceTreeExits == NULL) {
+        gDvmJit.traceTreeExits = dvmHashTableCreate(
+            dvmHashSize(JIT_TRACE_TREE_MAX_EXITS), freeTraceTreeExit);
+    }
+
+    const Method* method = desc->method;
+    for (int i = 0; i < numRuns; i++) {
+        const JitTraceRun* run = &desc->trace[i];
+        if (!run->isCode || run->info.frag.numInsts == 0)
+            continue;
+
+        unsigned int offset = run->info.frag.startOffset;
+        for (int j = 1; j < run->info.frag.numInsts; j++)
+            offset += dexGetWidthFromInstruction(method->insns + offset);
+
+        unsigned int target = forwardBranchTarget(method, offset);
+        if (target == 0)
+            continue;
+
+        unsigned int fallThrough =
+            offset + dexGetWidthFromInstruction(method->insns + offset);
+        if (!isRunHead(desc, numRuns, target)) {
+            recordExit(rootPC, desc, numRuns, rootCode, target);
+        }
+        if (!isRunHead(desc, numRuns, fallThrough)) {
+            recordExit(rootPC, desc, numRuns, rootCode, fallThrough);
+        }
+    }
+}
+
+/*
+ * Append the runs of "child" to those of "root".  Returns NULL if the tree
+ * would be too long to compile in full.
+ */
+static JitTraceDescription* joinTraces(const JitTraceDescription* root,
+                                       const JitTraceDescription* child)
+{
+    int rootRuns = countRuns(root);
+    int childRuns = countRuns(child);
+
+    if (countInsts(root, rootRuns) + countInsts(child, childRuns) >
+        JIT_MAX_TRACE_LEN) {
+        return NULL;
+    }
+
+    /* Drop the empty end marker that follows the meta runs of an invoke */
+    if (root->trace[rootRuns - 1].info.frag.numInsts == 0)
+        rootRuns--;
+
+    size_t size = sizeof(JitTraceDescription) +
+                  (rootRuns + childRuns) * sizeof(JitTraceRun);
+    JitTraceDescription* tree = (JitTraceDescription*) malloc(size);
+    if (tree == NULL)
+        return NULL;
+    tree->method = root->method;
+    memcpy(&tree->trace[0], &root->trace[0], rootRuns * sizeof(JitTraceRun));
+    memcpy(&tree->trace[rootRuns], &child->trace[0],
+           childRuns * sizeof(JitTraceRun));
+
+    for (int i = rootRuns - 1; i >= 0; i--) {
+        if (tree->trace[i].isCode) {
+            tree->trace[i].info.frag.runEnd = false;
+            break;
+        }
+    }
+    return tree;
+}
+
+/*
+ * If "work" asks for a trace at a remembered side exit, rewrite it into a
+ * recompilation of the tree the exit leaves, to replace the installed
+ * translation.  Returns the PC the trace was asked for, whose JitTable
+ * entry is left without code, or NULL if "work" is unchanged.  Caller holds
+ * compilerLock.
+ */
+const u2* dvmCompilerGrowTraceTree(CompilerWorkOrder* work)
+{
+    if (work->kind != kWorkOrderTrace || gDvmJit.traceTreeExits == NULL)
+        return NULL;
+
+    TraceTreeExit key;
+    key.exitPC = work->pc;
+    u4 hash = exitHash(work->pc);
+    TraceTreeExit* exit = (TraceTreeExit*)
+        dvmHashTableLookup(gDvmJit.traceTreeExits, hash, &key,
+                           compareExitPC, false);
+    if (exit == NULL)
+        return NULL;
+    dvmHashTableRemove(gDvmJit.traceTreeExits, hash, exit);
+
+    JitTraceDescription* child = (JitTraceDescription*) work->info;
+    JitTraceDescription* tree = NULL;
+    const u2* rootPC = exit->rootPC;
+    if (!isStale(exit) && child->method == exit->rootDesc->method) {
+        tree = joinTraces(exit->rootDesc, child);
+    }
+    freeTraceTreeExit(exit);
+    if (tree == NULL)
+        return NULL;
+
+    const u2* exitPC = work->pc;
+    free(work->info);
+    work->info = tree;
+    work->pc = rootPC;
+    work->result.replaceTranslation = true;
+    gDvmJit.traceTreesGrown++;
+
+    if (gDvmJit.printMe) {
+        ALOGD("JIT: growing trace tree at %s.%s %#x from exit %#x",
+             tree->method->clazz->descriptor, tree->method->name,
+             (int) (rootPC - tree->method->insns),
+             (int) (exitPC - tree->method->insns));
+    }
+    return exitPC;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Inline caches for check-cast and instance-of sites in compiled code.
+ *
+ * Each site remembers the last JIT_TYPE_CHECK_IC_SIZE classes that passed
+ * it, so a hot cast is a compare against the object's class instead of a
+ * call into dvmInstanceofNonTrivial and a probe of the process-wide
+ * instanceof cache.  Only successes are cached: a class that fails a
+ * check-cast throws, and a failed instance-of is rare enough not to be
+ * worth the slot.
+ *
+ * Entries are keyed by the Dalvik PC of the bytecode rather than living in
+ * a translation, so a retranslated trace picks up the classes its
+ * predecessor learned.  The table never shrinks; once it is full new sites
+ * are compiled without a cache.  Classes are never unloaded, so a stale
+ * entry is still a correct answer for its site.
+ */
+
+#include "Dalvik.h"
+#include "interp/Jit.h"
+
+/*
+ * Find or claim the entry for the type check at "dPC".  Only called by the
+ * compiler thread, which is the only one to write dPC.  Returns NULL if
+ * the table is missing or full.
+ */
+JitTypeCheckSite* dvmCompilerGetTypeCheckSite(const u2* dPC)
+{
+    JitTypeCheckSite* table = gDvmJit.pTypeCheckSites;
+    if (table == NULL)
+        return NULL;
+
+    u4 idx = dvmJitHashMask(dPC, JIT_TYPE_CHECK_SITES - 1);
+    for (int probes = 0; probes < JIT_TYPE_CHECK_SITES; probes++) {
+        JitTypeCheckSite* site = &table[idx];
+        if (site->dPC == dPC)
+            return site;
+        if (site->dPC == NULL) {
+            site->dPC = dPC;
+            gDvmJit.typeCheckSitesUsed++;
+            return site;
+        }
+        idx = (idx + 1) & (JIT_TYPE_CHECK_SITES - 1);
+    }
+    return NULL;
+}
+
+/*
+ * Called by compiled code when "instance" missed the cache of "site".
+ * Does the full check and, if it passes, makes "instance" the most recent
+ * entry.  Racing mutators may lose an update, but every entry they can
+ * leave behind has passed this site.
+ */
+int dvmJitInstanceofAndCache(const ClassObject* instance,
+    const ClassObject* clazz, JitTypeCheckSite* site)
+{
+    int result = dvmInstanceofNonTrivial(instance, clazz);
+    if (result) {
+        for (int i = JIT_TYPE_CHECK_IC_SIZE - 1; i > 0; i--)
+            site->clazz[i] = site->clazz[i - 1];
+        site->clazz[0] = instance;
+    }
+    return result;
+}
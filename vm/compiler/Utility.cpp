@@ -17,31 +17,77 @@
 #include "Dalvik.h"
 #include "CompilerInternals.h"
 
-static ArenaMemBlock *arenaHead, *currentArena;
-static int numArenaBlocks;
+/*
+ * Each compiler thread allocates from its own arena, found through a
+ * pthread key since dvmCompilerNew has no compilation unit to go by.
+ */
+struct CompilerThreadState {
+    int index;                      /* slot in gDvmJit.compilerHandles */
+    bool holdsCodegenLock;
+    ArenaMemBlock *arenaHead;
+    ArenaMemBlock *currentArena;
+};
+
+static pthread_key_t compilerThreadKey;
+static pthread_once_t compilerThreadKeyOnce = PTHREAD_ONCE_INIT;
+static volatile int32_t numArenaBlocks;   /* across all compiler threads */
+
+static void createCompilerThreadKey(void)
+{
+    pthread_key_create(&compilerThreadKey, NULL);
+}
 
-/* Allocate the initial memory block for arena-based allocation */
-bool dvmCompilerHeapInit(void)
+static inline CompilerThreadState *getCompilerThreadState(void)
 {
-    assert(arenaHead == NULL);
-    arenaHead =
+    CompilerThreadState *state =
+        (CompilerThreadState *) pthread_getspecific(compilerThreadKey);
+    assert(state != NULL);
+    return state;
+}
+
+/*
+ * Allocate the initial memory block for arena-based allocation on the
+ * calling thread, which becomes compiler thread "threadIndex".
+ */
+bool dvmCompilerHeapInit(int threadIndex)
+{
+    pthread_once(&compilerThreadKeyOnce, createCompilerThreadKey);
+    assert(pthread_getspecific(compilerThreadKey) == NULL);
+
+    CompilerThreadState *state =
+        (CompilerThreadState *) calloc(1, sizeof(CompilerThreadState));
+    ArenaMemBlock *arenaHead =
         (ArenaMemBlock *) malloc(sizeof(ArenaMemBlock) + ARENA_DEFAULT_SIZE);
-    if (arenaHead == NULL) {
+    if (state == NULL || arenaHead == NULL) {
         ALOGE("No memory left to create compiler heap memory");
+        free(state);
+        free(arenaHead);
         return false;
     }
     arenaHead->blockSize = ARENA_DEFAULT_SIZE;
-    currentArena = arenaHead;
-    currentArena->bytesAllocated = 0;
-    currentArena->next = NULL;
-    numArenaBlocks = 1;
+    arenaHead->bytesAllocated = 0;
+    arenaHead->next = NULL;
+    state->index = threadIndex;
+    state->arenaHead = arenaHead;
+    state->currentArena = arenaHead;
+    android_atomic_inc(&numArenaBlocks);
+    pthread_setspecific(compilerThreadKey, state);
 
     return true;
 }
 
+/* Slot of the calling compiler thread */
+int dvmCompilerThreadIndex(void)
+{
+    return getCompilerThreadState()->index;
+}
+
 /* Arena-based malloc for compilation tasks */
 void * dvmCompilerNew(size_t size, bool zero)
 {
+    CompilerThreadState *state = getCompilerThreadState();
+    ArenaMemBlock *currentArena = state->currentArena;
+
     size = (size + 3) & ~3;
 retry:
     /* Normal case - space is available in the current page */
@@ -49,6 +95,7 @@ retry:
         void *ptr;
         ptr = &currentArena->ptr[currentArena->bytesAllocated];
         currentArena->bytesAllocated += size;
+        state->currentArena = currentArena;
         if (zero) {
             memset(ptr, 0, size);
         }
@@ -77,9 +124,9 @@ retry:
         newArena->next = NULL;
         currentArena->next = newArena;
         currentArena = newArena;
-        numArenaBlocks++;
-        if (numArenaBlocks > 10)
-            ALOGI("Total arena pages for JIT: %d", numArenaBlocks);
+        int numBlocks = android_atomic_inc(&numArenaBlocks) + 1;
+        if (numBlocks > 10 * gDvmJit.numCompilerThreads)
+            ALOGI("Total arena pages for JIT: %d", numBlocks);
         goto retry;
     }
     /* Should not reach here */
@@ -89,12 +136,44 @@ retry:
 /* Reclaim all the arena blocks allocated so far */
 void dvmCompilerArenaReset(void)
 {
+    CompilerThreadState *state = getCompilerThreadState();
     ArenaMemBlock *block;
 
-    for (block = arenaHead; block; block = block->next) {
+    for (block = state->arenaHead; block; block = block->next) {
         block->bytesAllocated = 0;
     }
-    currentArena = arenaHead;
+    state->currentArena = state->arenaHead;
+}
+
+/*
+ * Take compilerCodegenLock around the parts of code generation that other
+ * compiler threads mustn't run at the same time.  A compilation that is
+ * aborted with the lock held leaves it to dvmCompilerAbandonCodegen.
+ */
+void dvmCompilerLockCodegen(void)
+{
+    CompilerThreadState *state = getCompilerThreadState();
+    assert(!state->holdsCodegenLock);
+    dvmLockMutex(&gDvmJit.compilerCodegenLock);
+    state->holdsCodegenLock = true;
+}
+
+void dvmCompilerUnlockCodegen(void)
+{
+    CompilerThreadState *state = getCompilerThreadState();
+    assert(state->holdsCodegenLock);
+    state->holdsCodegenLock = false;
+    dvmUnlockMutex(&gDvmJit.compilerCodegenLock);
+}
+
+/* Release compilerCodegenLock if an aborted compilation still holds it */
+void dvmCompilerAbandonCodegen(void)
+{
+    CompilerThreadState *state = getCompilerThreadState();
+    if (state->holdsCodegenLock) {
+        state->holdsCodegenLock = false;
+        dvmUnlockMutex(&gDvmJit.compilerCodegenLock);
+    }
 }
 
 /* Growable List initialization */
@@ -243,11 +322,13 @@ void dvmCompilerDumpStats(void)
     ALOGD("%d compilations using %d + %d bytes",
          gDvmJit.numCompilations,
          gDvmJit.templateSize,
-         gDvmJit.codeCacheByteUsed - gDvmJit.templateSize);
+         dvmCompilerCodeCacheLiveBytes());
     ALOGD("Compiler arena uses %d blocks (%d bytes each)",
          numArenaBlocks, ARENA_DEFAULT_SIZE);
     ALOGD("Compiler work queue length is %d/%d", gDvmJit.compilerQueueLength,
          gDvmJit.compilerMaxQueued);
+    ALOGD("Compiler work orders: %d reprioritized, %d evicted",
+         gDvmJit.compilerWorkBumped, gDvmJit.compilerWorkEvicted);
     dvmJitStats();
     dvmCompilerArchDump();
     if (gDvmJit.methodStatsTable) {
@@ -0,0 +1,947 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Value numbering.
+ *
+ * Every value a Dalvik register holds gets a number, and two registers with
+ * the same number hold the same value.  Constants, pure arithmetic and loads
+ * are looked up by opcode and operand numbers, so a second computation of
+ * something already in a register is rewritten as a move from it.  A wide
+ * value numbered V has its high word numbered V+1.
+ *
+ * Loads are also keyed by the version of the memory they read.  Instance
+ * fields are versioned by byte offset, static fields by field and all array
+ * elements together; a store bumps the version of what it writes and makes
+ * the stored value available to later loads, and anything that may write
+ * memory behind our back (invokes, inlined bodies, monitors, volatile
+ * accesses) bumps every version at once.
+ *
+ * A reference that has been dereferenced or freshly allocated is known to
+ * be non-null, so later field and array accesses through it skip the null
+ * check.
+ *
+ * The pass runs over chains of blocks where each block after the first has
+ * the previous one as its only predecessor, copying the tables where a
+ * chain forks.  Values don't flow into merge points, so the SSA names of a
+ * non-loop trace, which are assigned in block order without phis, are only
+ * trusted along a chain.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+#include "Dataflow.h"
+
+/* What a value number was looked up by */
+typedef enum ValueKind {
+    kValueConst,                // literal of the given width
+    kValueExpr,                 // opcode applied to operand values
+    kValueInstField,            // key is the field's byte offset
+    kValueStaticField,          // key is the StaticField
+    kValueArray,                // operands are the array and the index
+} ValueKind;
+
+typedef struct ValueEntry {
+    ValueKind kind;
+    int op;                     // opcode, with stores mapped to their loads
+    int a;                      // operand values
+    int b;
+    intptr_t key;
+    s8 literal;
+    int version;                // memory version the value was read at
+    int value;
+} ValueEntry;
+
+/* Version of a field or of the array elements, bumped by stores */
+typedef struct MemoryVersion {
+    ValueKind kind;
+    intptr_t key;
+    int version;
+} MemoryVersion;
+
+typedef struct ValueNumberingState {
+    CompilationUnit *cUnit;
+    int numRegs;
+    int *regValue;              // value held by each Dalvik reg, 0 if unknown
+    int *regSSA;                // SSA name the reg holds it under
+    BitVector *nonNull;         // values known not to be null
+    int nextValue;
+    ValueEntry *entries;
+    int numEntries;
+    int maxEntries;
+    MemoryVersion *memory;
+    int numMemory;
+    int maxMemory;
+    int lastStamp;              // source of memory versions
+    int clobberStamp;           // version of the last write to all memory
+} ValueNumberingState;
+
+static ValueNumberingState *newState(CompilationUnit *cUnit)
+{
+    ValueNumberingState *state = (ValueNumberingState *)
+        dvmCompilerNew(sizeof(ValueNumberingState), true);
+    state->cUnit = cUnit;
+    state->numRegs = cUnit->numDalvikRegisters;
+    state->regValue = (int *) dvmCompilerNew(sizeof(int) * state->numRegs,
+                                             true);
+    state->regSSA = (int *) dvmCompilerNew(sizeof(int) * state->numRegs,
+                                           true);
+    state->nonNull = dvmCompilerAllocBitVector(64, true);
+    state->nextValue = 1;
+    state->maxEntries = 16;
+    state->entries = (ValueEntry *)
+        dvmCompilerNew(sizeof(ValueEntry) * state->maxEntries, false);
+    state->maxMemory = 8;
+    state->memory = (MemoryVersion *)
+        dvmCompilerNew(sizeof(MemoryVersion) * state->maxMemory, false);
+    return state;
+}
+
+/* Copy of the tables for the second successor of a fork */
+static ValueNumberingState *copyState(const ValueNumberingState *state)
+{
+    ValueNumberingState *copy = (ValueNumberingState *)
+        dvmCompilerNew(sizeof(ValueNumberingState), false);
+    *copy = *state;
+    copy->regValue = (int *) dvmCompilerNew(sizeof(int) * state->numRegs,
+                                            false);
+    memcpy(copy->regValue, state->regValue, sizeof(int) * state->numRegs);
+    copy->regSSA = (int *) dvmCompilerNew(sizeof(int) * state->numRegs,
+                                          false);
+    memcpy(copy->regSSA, state->regSSA, sizeof(int) * state->numRegs);
+    copy->nonNull =
+        dvmCompilerAllocBitVector(state->nonNull->storageSize * 32, true);
+    dvmCopyBitVector(copy->nonNull, state->nonNull);
+    copy->entries = (ValueEntry *)
+        dvmCompilerNew(sizeof(ValueEntry) * state->maxEntries, false);
+    memcpy(copy->entries, state->entries,
+           sizeof(ValueEntry) * state->numEntries);
+    copy->memory = (MemoryVersion *)
+        dvmCompilerNew(sizeof(MemoryVersion) * state->maxMemory, false);
+    memcpy(copy->memory, state->memory,
+           sizeof(MemoryVersion) * state->numMemory);
+    return copy;
+}
+
+static int newValue(ValueNumberingState *state, bool wide)
+{
+    int value = state->nextValue;
+    state->nextValue += wide ? 2 : 1;
+    return value;
+}
+
+static void setValue(ValueNumberingState *state, int reg, int value,
+                     int ssaName)
+{
+    state->regValue[reg] = value;
+    state->regSSA[reg] = ssaName;
+}
+
+/* Value in "reg", which the MIR reads under "ssaName" */
+static int getValue(ValueNumberingState *state, int reg, int ssaName)
+{
+    if (state->regValue[reg] == 0) {
+        setValue(state, reg, newValue(state, false), ssaName);
+    }
+    return state->regValue[reg];
+}
+
+/* Value in the pair starting at "reg" */
+static int getWideValue(ValueNumberingState *state, int reg, int lowName,
+                        int highName)
+{
+    if (state->regValue[reg] == 0 ||
+        state->regValue[reg + 1] != state->regValue[reg] + 1) {
+        int value = newValue(state, true);
+        setValue(state, reg, value, lowName);
+        setValue(state, reg + 1, value + 1, highName);
+    }
+    return state->regValue[reg];
+}
+
+static bool isNonNull(const ValueNumberingState *state, int value)
+{
+    return (unsigned int) value < state->nonNull->storageSize * 32 &&
+           dvmIsBitSet(state->nonNull, value);
+}
+
+/*
+ * Values of the registers the MIR reads, in vA, vB, vC order.  Returns the
+ * number of values.
+ */
+static int getOperands(ValueNumberingState *state, MIR *mir, int *values)
+{
+    int dfAttributes = dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+    DecodedInstruction *insn = &mir->dalvikInsn;
+    int *uses = mir->ssaRep->uses;
+    int numUses = 0;
+    int numValues = 0;
+
+    if (dfAttributes & DF_UA) {
+        values[numValues++] = getValue(state, insn->vA, uses[numUses++]);
+    } else if (dfAttributes & DF_UA_WIDE) {
+        values[numValues++] = getWideValue(state, insn->vA, uses[numUses],
+                                           uses[numUses + 1]);
+        numUses += 2;
+    }
+    if (dfAttributes & DF_UB) {
+        values[numValues++] = getValue(state, insn->vB, uses[numUses++]);
+    } else if (dfAttributes & DF_UB_WIDE) {
+        values[numValues++] = getWideValue(state, insn->vB, uses[numUses],
+                                           uses[numUses + 1]);
+        numUses += 2;
+    }
+    if (dfAttributes & DF_UC) {
+        values[numValues++] = getValue(state, insn->vC, uses[numUses++]);
+    } else if (dfAttributes & DF_UC_WIDE) {
+        values[numValues++] = getWideValue(state, insn->vC, uses[numUses],
+                                           uses[numUses + 1]);
+        numUses += 2;
+    }
+    return numValues;
+}
+
+/* Give every register the MIR defines a value nothing else has */
+static void defineNewValues(ValueNumberingState *state, MIR *mir)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int i;
+
+    if (ssaRep == NULL) {
+        return;
+    }
+    int value = newValue(state, ssaRep->numDefs == 2);
+
+    for (i = 0; i < ssaRep->numDefs; i++) {
+        int reg = DECODE_REG(dvmConvertSSARegToDalvik(state->cUnit,
+                                                      ssaRep->defs[i]));
+        if (reg < state->numRegs) {
+            setValue(state, reg, value + i, ssaRep->defs[i]);
+        }
+    }
+}
+
+/* Define the result of the MIR, which is in vA, as "value" */
+static void defineValue(ValueNumberingState *state, MIR *mir, int value)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int reg = mir->dalvikInsn.vA;
+
+    setValue(state, reg, value, ssaRep->defs[0]);
+    if (ssaRep->numDefs == 2) {
+        setValue(state, reg + 1, value + 1, ssaRep->defs[1]);
+    }
+}
+
+/* Current version of a memory location, 0 if it hasn't been written */
+static int getMemoryVersion(const ValueNumberingState *state, ValueKind kind,
+                            intptr_t key)
+{
+    int version = 0;
+    int i;
+
+    for (i = 0; i < state->numMemory; i++) {
+        if (state->memory[i].kind == kind && state->memory[i].key == key) {
+            version = state->memory[i].version;
+            break;
+        }
+    }
+    return MAX(version, state->clobberStamp);
+}
+
+static void writeMemory(ValueNumberingState *state, ValueKind kind,
+                        intptr_t key)
+{
+    int i;
+
+    for (i = 0; i < state->numMemory; i++) {
+        if (state->memory[i].kind == kind && state->memory[i].key == key) {
+            break;
+        }
+    }
+    if (i == state->maxMemory) {
+        MemoryVersion *memory = (MemoryVersion *)
+            dvmCompilerNew(sizeof(MemoryVersion) * state->maxMemory * 2,
+                           false);
+        memcpy(memory, state->memory, sizeof(MemoryVersion) * i);
+        state->memory = memory;
+        state->maxMemory *= 2;
+    }
+    if (i == state->numMemory) {
+        state->memory[i].kind = kind;
+        state->memory[i].key = key;
+        state->numMemory++;
+    }
+    state->memory[i].version = ++state->lastStamp;
+}
+
+/* Something may have written any field or array element */
+static void clobberMemory(ValueNumberingState *state)
+{
+    state->clobberStamp = ++state->lastStamp;
+}
+
+/*
+ * Look up the value computed by "key", which only needs kind, op, a, b, key
+ * and literal filled in.  If it isn't known yet, it is recorded as
+ * "newValue".  Returns 0 if it wasn't found.
+ */
+static int lookupValue(ValueNumberingState *state, ValueEntry *key,
+                       int value)
+{
+    int i;
+
+    switch (key->kind) {
+        case kValueInstField:
+        case kValueStaticField:
+            key->version = getMemoryVersion(state, key->kind, key->key);
+            break;
+        case kValueArray:
+            key->version = getMemoryVersion(state, kValueArray, 0);
+            break;
+        default:
+            key->version = 0;
+            break;
+    }
+
+    for (i = 0; i < state->numEntries; i++) {
+        ValueEntry *entry = &state->entries[i];
+        if (entry->kind == key->kind && entry->op == key->op &&
+            entry->a == key->a && entry->b == key->b &&
+            entry->key == key->key && entry->literal == key->literal &&
+            entry->version == key->version) {
+            return entry->value;
+        }
+    }
+
+    if (state->numEntries == state->maxEntries) {
+        ValueEntry *entries = (ValueEntry *)
+            dvmCompilerNew(sizeof(ValueEntry) * state->maxEntries * 2, false);
+        memcpy(entries, state->entries,
+               sizeof(ValueEntry) * state->numEntries);
+        state->entries = entries;
+        state->maxEntries *= 2;
+    }
+    key->value = value;
+    state->entries[state->numEntries++] = *key;
+    return 0;
+}
+
+/*
+ * Rewrite the MIR as a move into vA from a register that already holds
+ * "value".  Returns false if no register does.
+ */
+static bool reuseValue(ValueNumberingState *state, MIR *mir, int value,
+                       bool isObject)
+{
+    SSARepresentation *ssaRep = mir->ssaRep;
+    bool wide = ssaRep->numDefs == 2;
+    int maxReg = state->numRegs - (wide ? 1 : 0);
+    int src;
+
+#if defined(ARCH_IA32)
+    /* The x86 backend lowers the move from its 12x encoding */
+    if (mir->dalvikInsn.vA > 0xf) {
+        return false;
+    }
+    maxReg = MIN(maxReg, 0x10);
+#endif
+
+    for (src = 0; src < maxReg; src++) {
+        if (state->regValue[src] == value &&
+            (!wide || state->regValue[src + 1] == value + 1)) {
+            break;
+        }
+    }
+    if (src == maxReg) {
+        return false;
+    }
+
+    ssaRep->numUses = wide ? 2 : 1;
+    ssaRep->uses = (int *) dvmCompilerNew(sizeof(int) * ssaRep->numUses,
+                                          false);
+    ssaRep->fpUse = (bool *) dvmCompilerNew(sizeof(bool) * ssaRep->numUses,
+                                            false);
+    ssaRep->uses[0] = state->regSSA[src];
+    ssaRep->fpUse[0] = ssaRep->fpDef[0];
+    if (wide) {
+        ssaRep->uses[1] = state->regSSA[src + 1];
+        ssaRep->fpUse[1] = ssaRep->fpDef[1];
+    }
+
+    mir->dalvikInsn.opcode = wide ? OP_MOVE_WIDE :
+                             isObject ? OP_MOVE_OBJECT : OP_MOVE;
+    mir->dalvikInsn.vB = src;
+    mir->dalvikInsn.vC = 0;
+    mir->OptimizationFlags |= MIR_VALUE_REUSED;
+    return true;
+}
+
+/*
+ * Number the result of a MIR that computes "key", and rewrite the MIR if an
+ * earlier one already computed it.  Returns true if the MIR was rewritten.
+ */
+static bool numberResult(ValueNumberingState *state, MIR *mir,
+                         ValueEntry *key, bool isObject, bool canReuse)
+{
+    int value = newValue(state, mir->ssaRep->numDefs == 2);
+    int oldValue = lookupValue(state, key, value);
+    bool reused = false;
+
+    if (oldValue != 0 && canReuse) {
+        reused = reuseValue(state, mir, oldValue, isObject);
+        value = oldValue;
+    }
+    defineValue(state, mir, value);
+    return reused;
+}
+
+static void initKey(ValueEntry *key, ValueKind kind, int op)
+{
+    memset(key, 0, sizeof(ValueEntry));
+    key->kind = kind;
+    key->op = op;
+}
+
+/* The non-volatile field a get or put accesses, or NULL */
+static const Field *getField(const CompilationUnit *cUnit, MIR *mir)
+{
+    const Field *field = (const Field *)
+        cUnit->method->clazz->pDvmDex->pResFields[mir->dalvikInsn.vC];
+    if (field == NULL || dvmIsVolatileField(field)) {
+        return NULL;
+    }
+    return field;
+}
+
+static const Field *getStaticField(const CompilationUnit *cUnit, MIR *mir)
+{
+    const Field *field = (const Field *)
+        cUnit->method->clazz->pDvmDex->pResFields[mir->dalvikInsn.vB];
+    if (field == NULL || dvmIsVolatileField(field)) {
+        return NULL;
+    }
+    return field;
+}
+
+/* Skip the null check of an access through "object" if it can't be null */
+static void checkNonNull(ValueNumberingState *state, MIR *mir, int object)
+{
+    if (isNonNull(state, object)) {
+        if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+            mir->OptimizationFlags |= MIR_IGNORE_NULL_CHECK;
+#if defined(WITH_JIT_TUNING)
+            gDvmJit.gvnNullChecksEliminated++;
+#endif
+        }
+    } else {
+        dvmCompilerSetBit(state->nonNull, object);
+    }
+}
+
+/*
+ * Number an instance field get or put.  "loadOp" is the get that reads the
+ * field, and stores only make their value available to it if they write
+ * the whole register.
+ */
+static void numberInstField(ValueNumberingState *state, MIR *mir, int loadOp,
+                            bool isStore, bool forwardStore)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int values[3];
+    int fieldOffset;
+
+    getOperands(state, mir, values);
+    if (opcode >= OP_IGET_QUICK && opcode <= OP_IPUT_OBJECT_QUICK) {
+        fieldOffset = mir->dalvikInsn.vC;
+    } else {
+        const InstField *field =
+            (const InstField *) getField(state->cUnit, mir);
+        if (field == NULL) {
+            clobberMemory(state);
+            if (!isStore) {
+                defineNewValues(state, mir);
+            }
+            return;
+        }
+        fieldOffset = field->byteOffset;
+    }
+
+    ValueEntry key;
+    initKey(&key, kValueInstField, loadOp);
+    key.key = fieldOffset;
+    if (isStore) {
+        checkNonNull(state, mir, values[1]);
+        writeMemory(state, kValueInstField, fieldOffset);
+        if (forwardStore) {
+            key.a = values[1];
+            lookupValue(state, &key, values[0]);
+        }
+    } else {
+        checkNonNull(state, mir, values[0]);
+        key.a = values[0];
+        if (numberResult(state, mir, &key, loadOp == OP_IGET_OBJECT,
+                         true)) {
+#if defined(WITH_JIT_TUNING)
+            gDvmJit.gvnLoadsEliminated++;
+#endif
+        }
+    }
+}
+
+static void numberStaticField(ValueNumberingState *state, MIR *mir,
+                              int loadOp, bool isStore, bool forwardStore)
+{
+    const Field *field = getStaticField(state->cUnit, mir);
+    int values[3];
+
+    getOperands(state, mir, values);
+    if (field == NULL) {
+        clobberMemory(state);
+        if (!isStore) {
+            defineNewValues(state, mir);
+        }
+        return;
+    }
+
+    ValueEntry key;
+    initKey(&key, kValueStaticField, loadOp);
+    key.key = (intptr_t) field;
+    if (isStore) {
+        writeMemory(state, kValueStaticField, key.key);
+        if (forwardStore) {
+            lookupValue(state, &key, values[0]);
+        }
+    } else if (numberResult(state, mir, &key, loadOp == OP_SGET_OBJECT,
+                            true)) {
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.gvnLoadsEliminated++;
+#endif
+    }
+}
+
+static void numberArrayElement(ValueNumberingState *state, MIR *mir,
+                               int loadOp, bool isStore, bool forwardStore)
+{
+    int values[3];
+
+    getOperands(state, mir, values);
+
+    ValueEntry key;
+    initKey(&key, kValueArray, loadOp);
+    if (isStore) {
+        checkNonNull(state, mir, values[1]);
+        writeMemory(state, kValueArray, 0);
+        if (forwardStore) {
+            key.a = values[1];
+            key.b = values[2];
+            lookupValue(state, &key, values[0]);
+        }
+    } else {
+        checkNonNull(state, mir, values[0]);
+        key.a = values[0];
+        key.b = values[1];
+        if (numberResult(state, mir, &key, loadOp == OP_AGET_OBJECT,
+                         true)) {
+#if defined(WITH_JIT_TUNING)
+            gDvmJit.gvnLoadsEliminated++;
+#endif
+        }
+    }
+}
+
+/* Number a constant, which is cheaper to rematerialize than to move */
+static void numberConst(ValueNumberingState *state, MIR *mir, bool wide,
+                        s8 literal)
+{
+    ValueEntry key;
+    initKey(&key, kValueConst, wide);
+    key.literal = literal;
+
+    int value = newValue(state, wide);
+    int oldValue = lookupValue(state, &key, value);
+    defineValue(state, mir, oldValue != 0 ? oldValue : value);
+}
+
+static bool isCommutative(int opcode)
+{
+    switch (opcode) {
+        case OP_ADD_INT:
+        case OP_MUL_INT:
+        case OP_AND_INT:
+        case OP_OR_INT:
+        case OP_XOR_INT:
+        case OP_ADD_LONG:
+        case OP_MUL_LONG:
+        case OP_AND_LONG:
+        case OP_OR_LONG:
+        case OP_XOR_LONG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Number a compare, unary, binary or literal op */
+static void numberExpr(ValueNumberingState *state, MIR *mir)
+{
+    int opcode = mir->dalvikInsn.opcode;
+    int values[3] = { 0, 0, 0 };
+    ValueEntry key;
+
+    getOperands(state, mir, values);
+
+    /* Key "vA op= vB" the same as "vA = vA op vB" */
+    if (opcode >= OP_ADD_INT_2ADDR && opcode <= OP_REM_DOUBLE_2ADDR) {
+        opcode += OP_ADD_INT - OP_ADD_INT_2ADDR;
+    } else if (opcode >= OP_ADD_INT_LIT8 && opcode <= OP_XOR_INT_LIT8) {
+        opcode += OP_ADD_INT_LIT16 - OP_ADD_INT_LIT8;
+    }
+    if (isCommutative(opcode) && values[0] > values[1]) {
+        int temp = values[0];
+        values[0] = values[1];
+        values[1] = temp;
+    }
+
+    initKey(&key, kValueExpr, opcode);
+    key.a = values[0];
+    key.b = values[1];
+    if (opcode >= OP_ADD_INT_LIT16) {
+        key.literal = mir->dalvikInsn.vC;
+    }
+
+    /*
+     * Leave updates like "v0 = v0 + 1" alone, so induction variables still
+     * look like one to the loop optimizations.
+     */
+    DecodedInstruction *insn = &mir->dalvikInsn;
+    int dfAttributes = dvmCompilerDataFlowAttributes[insn->opcode];
+    bool updatesOperand =
+        (dfAttributes & (DF_UA | DF_UA_WIDE)) ||
+        ((dfAttributes & DF_B_IS_REG) && insn->vB == insn->vA) ||
+        ((dfAttributes & DF_C_IS_REG) && insn->vC == insn->vA);
+    if (numberResult(state, mir, &key, false, !updatesOperand)) {
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.gvnExprsEliminated++;
+#endif
+    }
+}
+
+/* A new instance runs the class initializer unless it has already run */
+static bool mayInitializeClass(const CompilationUnit *cUnit, MIR *mir)
+{
+    ClassObject *classPtr = (ClassObject *)
+        cUnit->method->clazz->pDvmDex->pResClasses[mir->dalvikInsn.vB];
+    return classPtr == NULL || !dvmIsClassInitialized(classPtr);
+}
+
+static void numberMIR(ValueNumberingState *state, MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    DecodedInstruction *insn = &mir->dalvikInsn;
+    int values[3];
+
+    /*
+     * Inlined bodies are skipped: a mispredicted inline runs the real
+     * invoke instead, which may write anything.
+     */
+    if ((int) opcode >= (int) kMirOpFirst ||
+        (mir->OptimizationFlags &
+         (MIR_INLINED | MIR_INLINED_PRED | MIR_CALLEE))) {
+        clobberMemory(state);
+        defineNewValues(state, mir);
+        return;
+    }
+
+    if (dexGetFlagsFromOpcode(opcode) & kInstrInvoke) {
+        clobberMemory(state);
+        if (opcode != OP_INVOKE_STATIC && opcode != OP_INVOKE_STATIC_RANGE &&
+            mir->ssaRep->numUses > 0) {
+            /* The receiver was checked if the invoke returns */
+            int reg = (dvmCompilerDataFlowAttributes[opcode] & DF_FORMAT_35C) ?
+                      insn->arg[0] : insn->vC;
+            dvmCompilerSetBit(state->nonNull,
+                              getValue(state, reg, mir->ssaRep->uses[0]));
+        }
+        return;
+    }
+
+    switch (opcode) {
+        case OP_MOVE:
+        case OP_MOVE_FROM16:
+        case OP_MOVE_16:
+        case OP_MOVE_OBJECT:
+        case OP_MOVE_OBJECT_FROM16:
+        case OP_MOVE_OBJECT_16:
+        case OP_MOVE_WIDE:
+        case OP_MOVE_WIDE_FROM16:
+        case OP_MOVE_WIDE_16:
+            getOperands(state, mir, values);
+            defineValue(state, mir, values[0]);
+            break;
+
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+            numberConst(state, mir, false, (s4) insn->vB);
+            break;
+        case OP_CONST_HIGH16:
+            numberConst(state, mir, false, (s4) (insn->vB << 16));
+            break;
+        case OP_CONST_WIDE_16:
+        case OP_CONST_WIDE_32:
+            numberConst(state, mir, true, (s4) insn->vB);
+            break;
+        case OP_CONST_WIDE:
+            numberConst(state, mir, true, insn->vB_wide);
+            break;
+        case OP_CONST_WIDE_HIGH16:
+            numberConst(state, mir, true, ((s8) insn->vB) << 48);
+            break;
+
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+        case OP_NEW_ARRAY:
+            defineNewValues(state, mir);
+            dvmCompilerSetBit(state->nonNull, state->regValue[insn->vA]);
+            break;
+        case OP_NEW_INSTANCE:
+            if (mayInitializeClass(state->cUnit, mir)) {
+                clobberMemory(state);
+            }
+            defineNewValues(state, mir);
+            dvmCompilerSetBit(state->nonNull, state->regValue[insn->vA]);
+            break;
+
+        case OP_ARRAY_LENGTH: {
+            /* The length of an array never changes */
+            ValueEntry key;
+            getOperands(state, mir, values);
+            dvmCompilerSetBit(state->nonNull, values[0]);
+            initKey(&key, kValueExpr, opcode);
+            key.a = values[0];
+            if (numberResult(state, mir, &key, false, true)) {
+#if defined(WITH_JIT_TUNING)
+                gDvmJit.gvnLoadsEliminated++;
+#endif
+            }
+            break;
+        }
+
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+            numberInstField(state, mir, opcode, false, false);
+            break;
+        case OP_IGET_QUICK:
+            numberInstField(state, mir, OP_IGET, false, false);
+            break;
+        case OP_IGET_WIDE_QUICK:
+            numberInstField(state, mir, OP_IGET_WIDE, false, false);
+            break;
+        case OP_IGET_OBJECT_QUICK:
+            numberInstField(state, mir, OP_IGET_OBJECT, false, false);
+            break;
+        case OP_IPUT:
+        case OP_IPUT_WIDE:
+        case OP_IPUT_OBJECT:
+            numberInstField(state, mir, opcode - (OP_IPUT - OP_IGET), true,
+                            true);
+            break;
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+            numberInstField(state, mir, opcode - (OP_IPUT - OP_IGET), true,
+                            false);
+            break;
+        case OP_IPUT_QUICK:
+            numberInstField(state, mir, OP_IGET, true, true);
+            break;
+        case OP_IPUT_WIDE_QUICK:
+            numberInstField(state, mir, OP_IGET_WIDE, true, true);
+            break;
+        case OP_IPUT_OBJECT_QUICK:
+            numberInstField(state, mir, OP_IGET_OBJECT, true, true);
+            break;
+
+        case OP_SGET:
+        case OP_SGET_WIDE:
+        case OP_SGET_OBJECT:
+        case OP_SGET_BOOLEAN:
+        case OP_SGET_BYTE:
+        case OP_SGET_CHAR:
+        case OP_SGET_SHORT:
+            numberStaticField(state, mir, opcode, false, false);
+            break;
+        case OP_SPUT:
+        case OP_SPUT_WIDE:
+        case OP_SPUT_OBJECT:
+            numberStaticField(state, mir, opcode - (OP_SPUT - OP_SGET), true,
+                              true);
+            break;
+        case OP_SPUT_BOOLEAN:
+        case OP_SPUT_BYTE:
+        case OP_SPUT_CHAR:
+        case OP_SPUT_SHORT:
+            numberStaticField(state, mir, opcode - (OP_SPUT - OP_SGET), true,
+                              false);
+            break;
+
+        case OP_AGET:
+        case OP_AGET_WIDE:
+        case OP_AGET_OBJECT:
+        case OP_AGET_BOOLEAN:
+        case OP_AGET_BYTE:
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+            numberArrayElement(state, mir, opcode, false, false);
+            break;
+        case OP_APUT:
+        case OP_APUT_WIDE:
+        case OP_APUT_OBJECT:
+            numberArrayElement(state, mir, opcode - (OP_APUT - OP_AGET), true,
+                               true);
+            break;
+        case OP_APUT_BOOLEAN:
+        case OP_APUT_BYTE:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            numberArrayElement(state, mir, opcode - (OP_APUT - OP_AGET), true,
+                               false);
+            break;
+        case OP_FILL_ARRAY_DATA:
+            writeMemory(state, kValueArray, 0);
+            break;
+
+        case OP_MONITOR_ENTER:
+            getOperands(state, mir, values);
+            dvmCompilerSetBit(state->nonNull, values[0]);
+            clobberMemory(state);
+            break;
+
+        case OP_NOP:
+        case OP_MOVE_RESULT:
+        case OP_MOVE_RESULT_WIDE:
+        case OP_MOVE_RESULT_OBJECT:
+        case OP_MOVE_EXCEPTION:
+        case OP_RETURN_VOID:
+        case OP_RETURN:
+        case OP_RETURN_WIDE:
+        case OP_RETURN_OBJECT:
+        case OP_CHECK_CAST:
+        case OP_INSTANCE_OF:
+        case OP_FILLED_NEW_ARRAY:
+        case OP_FILLED_NEW_ARRAY_RANGE:
+        case OP_THROW:
+        case OP_GOTO:
+        case OP_GOTO_16:
+        case OP_GOTO_32:
+        case OP_PACKED_SWITCH:
+        case OP_SPARSE_SWITCH:
+            defineNewValues(state, mir);
+            break;
+
+        default:
+            if ((opcode >= OP_CMPL_FLOAT && opcode <= OP_CMP_LONG) ||
+                (opcode >= OP_NEG_INT && opcode <= OP_XOR_INT_LIT8) ||
+                (opcode >= OP_SHL_INT_LIT8 && opcode <= OP_USHR_INT_LIT8)) {
+                numberExpr(state, mir);
+            } else if (opcode < OP_IF_EQ || opcode > OP_IF_LEZ) {
+                /* Volatile accesses, monitor-exit, execute-inline, ... */
+                clobberMemory(state);
+                defineNewValues(state, mir);
+            }
+            break;
+    }
+}
+
+/*
+ * Returns true if "bb" continues the chain of "pred", which is when "pred"
+ * is the only way into it.
+ */
+static bool continuesChain(const BasicBlock *pred, const BasicBlock *bb)
+{
+    return bb != NULL && bb != pred && !bb->hidden && !bb->visited &&
+           bb->blockType == kDalvikByteCode &&
+           pred->successorBlockList.blockListType != kCatch &&
+           dvmCountSetBits(bb->predecessors) == 1 &&
+           dvmIsBitSet(bb->predecessors, pred->id);
+}
+
+static void numberChain(ValueNumberingState *state, BasicBlock *bb)
+{
+    while (true) {
+        MIR *mir;
+
+        bb->visited = true;
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            numberMIR(state, mir);
+        }
+
+        bool fallThrough = continuesChain(bb, bb->fallThrough);
+        bool taken = continuesChain(bb, bb->taken) &&
+                     bb->taken != bb->fallThrough;
+        if (fallThrough && taken) {
+            numberChain(copyState(state), bb->taken);
+        } else if (taken) {
+            bb = bb->taken;
+            continue;
+        }
+        if (!fallThrough) {
+            break;
+        }
+        bb = bb->fallThrough;
+    }
+}
+
+/* Start a chain at each block that is not continuing one */
+static bool numberChainsFrom(CompilationUnit *cUnit, BasicBlock *bb)
+{
+    if (bb->visited || bb->hidden || bb->blockType != kDalvikByteCode) {
+        return false;
+    }
+    if (dvmCountSetBits(bb->predecessors) == 1) {
+        BitVectorIterator bvIterator;
+        dvmBitVectorIteratorInit(bb->predecessors, &bvIterator);
+        int predIdx = dvmBitVectorIteratorNext(&bvIterator);
+        BasicBlock *pred = (BasicBlock *)
+            dvmGrowableListGetElement(&cUnit->blockList, predIdx);
+        if (pred->blockType == kDalvikByteCode && !pred->hidden &&
+            (pred->fallThrough == bb || pred->taken == bb) &&
+            continuesChain(pred, bb)) {
+            return false;
+        }
+    }
+    numberChain(newState(cUnit), bb);
+    return false;
+}
+
+/* Main entry point of value numbering, run on the SSA form */
+void dvmCompilerValueNumbering(CompilationUnit *cUnit)
+{
+    dvmCompilerDataFlowAnalysisDispatcher(cUnit, dvmCompilerClearVisitedFlag,
+                                          kAllNodes,
+                                          false /* isIterative */);
+    dvmCompilerDataFlowAnalysisDispatcher(cUnit, numberChainsFrom,
+                                          kAllNodes,
+                                          false /* isIterative */);
+}
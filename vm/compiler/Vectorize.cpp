@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loop vectorization.
+ *
+ * A counted loop whose body is straight-line code over arrays indexed by
+ * the loop counter can run several iterations at once, one per lane of a
+ * vector register.  The body is rewritten as a list of vector ops and
+ * attached to a kMirOpVectorLoop MIR at the end of the loop entry block,
+ * after the hoisted checks.  The backend runs it as a prologue over whole
+ * vectors of iterations, stores the counter and any sums back to the frame
+ * and falls into the scalar body, which does the remaining iterations.  At
+ * least one scalar iteration is always left, so every temp of the body is
+ * recomputed before anything after the loop can see it.
+ *
+ * The loop must count up by one with the exit test at the bottom against a
+ * limit that the body doesn't write.  Every array access must have had its
+ * null and range checks hoisted, and be indexed by the counter plus a
+ * constant.  Every value read in the body must be loop invariant, written
+ * earlier in the same iteration, or an int sum "s += x" that nothing else
+ * in the body reads.  All accesses must use the same element size.
+ */
+
+#include "Dalvik.h"
+#include "CompilerInternals.h"
+#include "Dataflow.h"
+#include "Loop.h"
+
+/* An array access of the body, for the aliasing checks */
+typedef struct VectorAccess {
+    int vReg;
+    int offset;
+    bool isStore;
+} VectorAccess;
+
+typedef struct VectorizeState {
+    CompilationUnit *cUnit;
+    VectorLoopInfo *info;
+    int *laneReg;               // vector register of each Dalvik reg, or -1
+    bool *isDefined;            // Dalvik reg has been written in the body
+    int numAccesses;
+    VectorAccess accesses[VECTOR_MAX_OPS];
+    bool needsWordLanes;        // sums, shifts or float ops
+    int narrowSize;             // lane size assumed by int-to-byte/char/short
+    bool hasSideEffect;         // a store or a sum
+} VectorizeState;
+
+/* Element size of an array access, or 0 if it isn't a narrow one */
+static int arrayElemSize(Opcode opcode, bool *isStore)
+{
+    *isStore = false;
+    switch (opcode) {
+        case OP_APUT:
+            *isStore = true;
+            /* Intentional fallthrough */
+        case OP_AGET:
+            return 4;
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            *isStore = true;
+            /* Intentional fallthrough */
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+            return 2;
+        case OP_APUT_BYTE:
+        case OP_APUT_BOOLEAN:
+            *isStore = true;
+            /* Intentional fallthrough */
+        case OP_AGET_BYTE:
+        case OP_AGET_BOOLEAN:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * If "ssaReg" is the loop counter plus a constant, return the constant in
+ * "offset".
+ */
+static bool getIndexOffset(CompilationUnit *cUnit, int ssaReg, int *offset)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    unsigned int i;
+
+    for (i = 0; i < loopAnalysis->ivList->numUsed; i++) {
+        InductionVariableInfo *ivInfo =
+            GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
+        if (ivInfo->ssaReg == ssaReg) {
+            if (ivInfo->basicSSAReg != loopAnalysis->ssaLoopBIV ||
+                ivInfo->m != 1) {
+                return false;
+            }
+            *offset = ivInfo->c;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int newVectorReg(VectorLoopInfo *info, VectorRegKind kind, int vReg,
+                        int value)
+{
+    if (info->numRegs == VECTOR_MAX_REGS) return -1;
+    VectorReg *reg = &info->regs[info->numRegs];
+    reg->kind = kind;
+    reg->vReg = vReg;
+    reg->value = value;
+    return info->numRegs++;
+}
+
+static int constantVectorReg(VectorLoopInfo *info, int value)
+{
+    for (int i = 0; i < info->numRegs; i++) {
+        if (info->regs[i].kind == kVectorConstant &&
+            info->regs[i].value == value) {
+            return i;
+        }
+    }
+    return newVectorReg(info, kVectorConstant, -1, value);
+}
+
+static VectorOp *newVectorOp(VectorLoopInfo *info, VectorOpKind kind)
+{
+    if (info->numOps == VECTOR_MAX_OPS) return NULL;
+    VectorOp *op = &info->ops[info->numOps++];
+    memset(op, 0, sizeof(VectorOp));
+    op->kind = kind;
+    return op;
+}
+
+/*
+ * Vector register holding the value read through "ssaReg", or -1 if it
+ * can't be read lane by lane.
+ */
+static int useVectorReg(VectorizeState *state, int ssaReg)
+{
+    int sReg = dvmConvertSSARegToDalvik(state->cUnit, ssaReg);
+    int vReg = DECODE_REG(sReg);
+
+    /* Not written in the loop */
+    if (DECODE_SUB(sReg) == 0) {
+        if (state->laneReg[vReg] < 0) {
+            state->laneReg[vReg] =
+                newVectorReg(state->info, kVectorInvariant, vReg, 0);
+        }
+        return state->laneReg[vReg];
+    }
+    /* Carried around the loop, or an index */
+    if (!state->isDefined[vReg]) return -1;
+    return state->laneReg[vReg];
+}
+
+/* The Dalvik reg written by "mir" now lives in vector register "reg" */
+static bool defineVectorReg(VectorizeState *state, MIR *mir, int reg)
+{
+    int vReg = DECODE_REG(dvmConvertSSARegToDalvik(state->cUnit,
+                                                   mir->ssaRep->defs[0]));
+    if (state->isDefined[vReg]) return false;
+    state->isDefined[vReg] = true;
+    state->laneReg[vReg] = reg;
+    return true;
+}
+
+static bool vectorizeAccess(VectorizeState *state, MIR *mir)
+{
+    VectorLoopInfo *info = state->info;
+    bool isStore;
+    int elemSize = arrayElemSize(mir->dalvikInsn.opcode, &isStore);
+    int refIdx = isStore ? 1 : 0;
+    int offset;
+
+    if (elemSize == 0) return false;
+    if (info->elemSize == 0) {
+        info->elemSize = elemSize;
+    } else if (info->elemSize != elemSize) {
+        return false;
+    }
+
+    /* The checks have to be covered by the ones in the entry block */
+    const int hoisted = MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK;
+    if ((mir->OptimizationFlags & hoisted) != hoisted) return false;
+    if (!getIndexOffset(state->cUnit, mir->ssaRep->uses[refIdx + 1],
+                        &offset)) {
+        return false;
+    }
+    int arrayReg = dvmConvertSSARegToDalvik(state->cUnit,
+                                            mir->ssaRep->uses[refIdx]);
+    if (DECODE_SUB(arrayReg) != 0) return false;
+
+    if (state->numAccesses == VECTOR_MAX_OPS) return false;
+    VectorAccess *access = &state->accesses[state->numAccesses++];
+    access->vReg = DECODE_REG(arrayReg);
+    access->offset = offset;
+    access->isStore = isStore;
+
+    VectorOp *op = newVectorOp(info, isStore ? kVectorStore : kVectorLoad);
+    if (op == NULL) return false;
+    op->vReg = access->vReg;
+    op->imm = offset;
+    if (isStore) {
+        op->src1 = useVectorReg(state, mir->ssaRep->uses[0]);
+        state->hasSideEffect = true;
+        return op->src1 >= 0;
+    }
+    op->dst = newVectorReg(info, kVectorTemp, -1, 0);
+    return op->dst >= 0 && defineVectorReg(state, mir, op->dst);
+}
+
+/* "dst = src1 op src2", or "dst = src1 op imm" for the shifts */
+static bool vectorizeBinaryOp(VectorizeState *state, MIR *mir,
+                              VectorOpKind kind, int src1, int src2, int imm)
+{
+    VectorOp *op = newVectorOp(state->info, kind);
+
+    if (op == NULL || src1 < 0 || src2 < 0) return false;
+    op->src1 = src1;
+    op->src2 = src2;
+    op->imm = imm;
+    op->dst = newVectorReg(state->info, kVectorTemp, -1, 0);
+    return op->dst >= 0 && defineVectorReg(state, mir, op->dst);
+}
+
+/*
+ * "s += x" where s is carried around the loop and read nowhere else.  The
+ * lanes keep partial sums, which int overflow makes exact in any order.
+ */
+static bool vectorizeSum(VectorizeState *state, MIR *mir, bool *handled)
+{
+    CompilationUnit *cUnit = state->cUnit;
+    int vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit,
+                                                   mir->ssaRep->defs[0]));
+    *handled = false;
+
+    for (int i = 0; i < 2; i++) {
+        int sReg = dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->uses[i]);
+        if (DECODE_REG(sReg) != vReg || DECODE_SUB(sReg) == 0 ||
+            state->isDefined[vReg]) {
+            continue;
+        }
+        *handled = true;
+        int src = useVectorReg(state, mir->ssaRep->uses[1 - i]);
+        int sum = newVectorReg(state->info, kVectorSum, vReg, 0);
+        VectorOp *op = newVectorOp(state->info, kVectorAdd);
+        if (src < 0 || sum < 0 || op == NULL) return false;
+        op->dst = op->src1 = sum;
+        op->src2 = src;
+        state->needsWordLanes = true;
+        state->hasSideEffect = true;
+        /* Nothing else may read the partial sums */
+        return defineVectorReg(state, mir, -1);
+    }
+    return false;
+}
+
+static bool vectorizeMIR(VectorizeState *state, MIR *mir)
+{
+    VectorLoopInfo *info = state->info;
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int *uses = mir->ssaRep->uses;
+    int offset;
+
+    /* Counter plus a constant, only good as an index */
+    if (mir->ssaRep->numDefs == 1 &&
+        dvmIsBitSet(state->cUnit->loopAnalysis->isIndVarV,
+                    mir->ssaRep->defs[0]) &&
+        getIndexOffset(state->cUnit, mir->ssaRep->defs[0], &offset)) {
+        return defineVectorReg(state, mir, -1);
+    }
+
+    switch (dInsn->opcode) {
+        case OP_AGET:
+        case OP_AGET_BYTE:
+        case OP_AGET_BOOLEAN:
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+        case OP_APUT:
+        case OP_APUT_BYTE:
+        case OP_APUT_BOOLEAN:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            return vectorizeAccess(state, mir);
+
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+            return defineVectorReg(state, mir,
+                                   constantVectorReg(info, dInsn->vB));
+        case OP_CONST_HIGH16:
+            return defineVectorReg(state, mir,
+                                   constantVectorReg(info, dInsn->vB << 16));
+
+        case OP_MOVE:
+        case OP_MOVE_FROM16:
+        case OP_MOVE_16: {
+            int src = useVectorReg(state, uses[0]);
+            return src >= 0 && defineVectorReg(state, mir, src);
+        }
+
+        /* Lanes of the same size already hold the truncated value */
+        case OP_INT_TO_BYTE:
+        case OP_INT_TO_CHAR:
+        case OP_INT_TO_SHORT: {
+            int size = dInsn->opcode == OP_INT_TO_BYTE ? 1 : 2;
+            int src = useVectorReg(state, uses[0]);
+            if (state->narrowSize != 0 && state->narrowSize != size) {
+                return false;
+            }
+            state->narrowSize = size;
+            return src >= 0 && defineVectorReg(state, mir, src);
+        }
+
+        case OP_ADD_INT:
+        case OP_ADD_INT_2ADDR: {
+            bool handled;
+            bool res = vectorizeSum(state, mir, &handled);
+            if (handled) return res;
+            return vectorizeBinaryOp(state, mir, kVectorAdd,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+        }
+        case OP_SUB_INT:
+        case OP_SUB_INT_2ADDR:
+            return vectorizeBinaryOp(state, mir, kVectorSub,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+        case OP_AND_INT:
+        case OP_AND_INT_2ADDR:
+            return vectorizeBinaryOp(state, mir, kVectorAnd,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+        case OP_OR_INT:
+        case OP_OR_INT_2ADDR:
+            return vectorizeBinaryOp(state, mir, kVectorOr,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+        case OP_XOR_INT:
+        case OP_XOR_INT_2ADDR:
+            return vectorizeBinaryOp(state, mir, kVectorXor,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+
+        case OP_ADD_INT_LIT8:
+        case OP_ADD_INT_LIT16:
+            return vectorizeBinaryOp(state, mir, kVectorAdd,
+                                     useVectorReg(state, uses[0]),
+                                     constantVectorReg(info, dInsn->vC), 0);
+        case OP_AND_INT_LIT8:
+        case OP_AND_INT_LIT16:
+            return vectorizeBinaryOp(state, mir, kVectorAnd,
+                                     useVectorReg(state, uses[0]),
+                                     constantVectorReg(info, dInsn->vC), 0);
+        case OP_OR_INT_LIT8:
+        case OP_OR_INT_LIT16:
+            return vectorizeBinaryOp(state, mir, kVectorOr,
+                                     useVectorReg(state, uses[0]),
+                                     constantVectorReg(info, dInsn->vC), 0);
+        case OP_XOR_INT_LIT8:
+        case OP_XOR_INT_LIT16:
+            return vectorizeBinaryOp(state, mir, kVectorXor,
+                                     useVectorReg(state, uses[0]),
+                                     constantVectorReg(info, dInsn->vC), 0);
+
+        case OP_SHL_INT_LIT8:
+        case OP_SHR_INT_LIT8:
+        case OP_USHR_INT_LIT8:
+        case OP_MUL_INT_LIT8:
+        case OP_MUL_INT_LIT16: {
+            int src = useVectorReg(state, uses[0]);
+            int shift = dInsn->vC & 31;
+            VectorOpKind kind = kVectorShl;
+            if (dInsn->opcode == OP_MUL_INT_LIT8 ||
+                dInsn->opcode == OP_MUL_INT_LIT16) {
+                /* Only multiplies by a power of two */
+                int c = dInsn->vC;
+                if (c <= 0 || (c & (c - 1)) != 0) return false;
+                shift = 0;
+                while ((1 << shift) != c) shift++;
+            } else if (dInsn->opcode == OP_SHR_INT_LIT8) {
+                kind = kVectorShr;
+            } else if (dInsn->opcode == OP_USHR_INT_LIT8) {
+                kind = kVectorUshr;
+            }
+            state->needsWordLanes = true;
+            if (shift == 0) {
+                return src >= 0 && defineVectorReg(state, mir, src);
+            }
+            return vectorizeBinaryOp(state, mir, kind, src, src, shift);
+        }
+
+        case OP_ADD_FLOAT:
+        case OP_ADD_FLOAT_2ADDR:
+        case OP_SUB_FLOAT:
+        case OP_SUB_FLOAT_2ADDR:
+        case OP_MUL_FLOAT:
+        case OP_MUL_FLOAT_2ADDR:
+        case OP_DIV_FLOAT:
+        case OP_DIV_FLOAT_2ADDR: {
+            VectorOpKind kind;
+            switch (dInsn->opcode) {
+                case OP_ADD_FLOAT:
+                case OP_ADD_FLOAT_2ADDR:
+                    kind = kVectorAddFloat;
+                    break;
+                case OP_SUB_FLOAT:
+                case OP_SUB_FLOAT_2ADDR:
+                    kind = kVectorSubFloat;
+                    break;
+                case OP_MUL_FLOAT:
+                case OP_MUL_FLOAT_2ADDR:
+                    kind = kVectorMulFloat;
+                    break;
+                default:
+                    kind = kVectorDivFloat;
+                    break;
+            }
+            state->needsWordLanes = true;
+            return vectorizeBinaryOp(state, mir, kind,
+                                     useVectorReg(state, uses[0]),
+                                     useVectorReg(state, uses[1]), 0);
+        }
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * A store and another access to the same array at a different offset
+ * would see lanes in the wrong order.  Reject that when the array
+ * registers are the same, and leave a run time check when they may hold
+ * the same array.  Accesses at the same offset only touch elements of
+ * their own iteration, which the lanes keep in body order.
+ */
+static bool checkAliasing(VectorizeState *state)
+{
+    VectorLoopInfo *info = state->info;
+
+    for (int i = 0; i < state->numAccesses; i++) {
+        VectorAccess *store = &state->accesses[i];
+        if (!store->isStore) continue;
+        for (int j = 0; j < state->numAccesses; j++) {
+            VectorAccess *other = &state->accesses[j];
+            if (j == i || other->offset == store->offset) continue;
+            if (other->vReg == store->vReg) return false;
+
+            bool found = false;
+            for (int k = 0; k < info->numAliasChecks; k++) {
+                int *pair = info->aliasChecks[k];
+                if ((pair[0] == store->vReg && pair[1] == other->vReg) ||
+                    (pair[1] == store->vReg && pair[0] == other->vReg)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found) continue;
+            if (info->numAliasChecks == VECTOR_MAX_ALIAS_CHECKS) return false;
+            info->aliasChecks[info->numAliasChecks][0] = store->vReg;
+            info->aliasChecks[info->numAliasChecks][1] = other->vReg;
+            info->numAliasChecks++;
+        }
+    }
+    return true;
+}
+
+/*
+ * Called after the loop checks have been hoisted.  If the loop body can be
+ * vectorized, describe it in a kMirOpVectorLoop at the end of the entry
+ * block.
+ */
+void dvmCompilerVectorizeLoop(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    BasicBlock *entry = cUnit->entryBlock;
+    BasicBlock *firstBB = entry->fallThrough;
+    BasicBlock *bb;
+    BasicBlock *lastBB = NULL;
+    unsigned int i;
+
+    if (!loopAnalysis->isCountUpLoop) return;
+
+    /* The counter has to step by one */
+    InductionVariableInfo *counter = NULL;
+    for (i = 0; i < loopAnalysis->ivList->numUsed; i++) {
+        InductionVariableInfo *ivInfo =
+            GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
+        if (ivInfo->ssaReg == loopAnalysis->ssaLoopBIV) {
+            counter = ivInfo;
+            break;
+        }
+    }
+    if (counter == NULL || counter->inc != 1) return;
+
+    /* The exit test has to be the last thing in the body */
+    for (bb = firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(firstBB, bb)) {
+        lastBB = bb;
+    }
+    MIR *branch = lastBB->lastMIRInsn;
+    if (branch == NULL || branch->ssaRep == NULL ||
+        (lastBB->taken != firstBB && lastBB->fallThrough != firstBB) ||
+        dexGetFlagsFromOpcode(branch->dalvikInsn.opcode) !=
+            (kInstrCanContinue | kInstrCanBranch) ||
+        branch->ssaRep->numUses != 2 ||
+        (branch->ssaRep->uses[0] != loopAnalysis->ssaBIV &&
+         branch->ssaRep->uses[1] != loopAnalysis->ssaBIV)) {
+        return;
+    }
+
+    VectorizeState *state =
+        (VectorizeState *) dvmCompilerNew(sizeof(VectorizeState), true);
+    state->cUnit = cUnit;
+    state->info =
+        (VectorLoopInfo *) dvmCompilerNew(sizeof(VectorLoopInfo), true);
+    state->laneReg =
+        (int *) dvmCompilerNew(sizeof(int) * cUnit->numDalvikRegisters, false);
+    state->isDefined =
+        (bool *) dvmCompilerNew(sizeof(bool) * cUnit->numDalvikRegisters, true);
+    for (int vReg = 0; vReg < cUnit->numDalvikRegisters; vReg++) {
+        state->laneReg[vReg] = -1;
+    }
+
+    VectorLoopInfo *info = state->info;
+    info->ivReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit,
+                                                      counter->basicSSAReg));
+    info->endReg = loopAnalysis->endConditionReg;
+    info->endInclusive = loopAnalysis->loopBranchOpcode == OP_IF_GT;
+
+    for (bb = firstBB; bb != NULL;
+         bb = dvmCompilerNextLoopBlock(firstBB, bb)) {
+        for (MIR *mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            Opcode opcode = mir->dalvikInsn.opcode;
+
+            if ((int) opcode == (int) kMirOpPhi) continue;
+            if (opcode >= kNumPackedOpcodes) return;
+            if (mir == branch) continue;
+            if (opcode == OP_GOTO || opcode == OP_GOTO_16 ||
+                opcode == OP_GOTO_32) {
+                continue;
+            }
+            if (mir->ssaRep->numDefs == 1 &&
+                mir->ssaRep->defs[0] == loopAnalysis->ssaBIV) {
+                if (!defineVectorReg(state, mir, -1)) return;
+                continue;
+            }
+            if (!vectorizeMIR(state, mir)) return;
+        }
+    }
+
+    if (info->elemSize == 0 || !state->hasSideEffect ||
+        (state->needsWordLanes && info->elemSize != 4) ||
+        (state->narrowSize != 0 && state->narrowSize != info->elemSize) ||
+        state->isDefined[info->endReg] || !checkAliasing(state)) {
+        return;
+    }
+
+    MIR *vectorMIR = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+    vectorMIR->dalvikInsn.opcode = (Opcode) kMirOpVectorLoop;
+    vectorMIR->meta.vectorLoopInfo = info;
+    dvmCompilerAppendMIR(entry, vectorMIR);
+
+    if (cUnit->printMe) {
+        ALOGD("LOOP %s@%#x: vectorized, %d-byte lanes, %d ops, "
+              "%d alias checks", cUnit->method->name, entry->startOffset,
+              info->elemSize, info->numOps, info->numAliasChecks);
+    }
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.loopsVectorized++;
+#endif
+}
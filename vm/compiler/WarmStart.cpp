@@ -0,0 +1,706 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * JIT warm start.
+ *
+ * The trace descriptions of installed translations are remembered by the
+ * compiler thread and written to the file named with -Xjitwarmstart, at
+ * shutdown and periodically while the compiler is idle.  When the next
+ * process starts, the file is read before the compiler thread begins work,
+ * and each saved trace is queued for compilation as soon as its class has
+ * been initialized, instead of waiting for the interpreter to find it hot
+ * again.
+ *
+ * Saved traces are keyed by class descriptor, method name and signature,
+ * and the checksum of the dex file the class came from.  A class whose
+ * checksum doesn't match the saved one drops all of its traces.  The class
+ * and method pointers in the meta runs of an invoke are saved by name and
+ * looked up again; if they can't be found the trace is left for the
+ * interpreter to rediscover.
+ *
+ * File layout (native byte order; the file never leaves the device):
+ *
+ *   header:  magic[8] version:u4 numTraces:u4
+ *   trace:   dexChecksum:u4 classDescriptor methodName methodSignature
+ *            numRuns:u2 run[numRuns]
+ *   run:     1:u1 startOffset:u2 numInsts:u1 (hint << 1 | runEnd):u1
+ *        or  0:u1 thisClass calleeClass calleeName calleeSignature
+ *
+ * Strings are a u2 length (including the trailing NUL) followed by the
+ * bytes.  An empty string stands for a NULL pointer in a meta run.
+ */
+
+#include "Dalvik.h"
+#include "interp/Jit.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+static const char kWarmStartMagic[8] = "dvmjws\n";
+#define WARM_START_VERSION      1
+
+/* Don't write the profile more often than this while the app is running */
+#define WARM_START_SAVE_INTERVAL_MS (60 * 1000)
+
+/* A saved trace, pointing into the loaded file image */
+struct WarmStartTrace {
+    WarmStartTrace* next;
+    const char* methodName;
+    const char* methodSig;
+    const u1* runs;
+    const u1* runsEnd;
+    unsigned int numRuns;
+    int numEntries;             /* JitTraceRun entries the runs expand to */
+};
+
+/* The saved traces of one class */
+struct WarmStartClass {
+    WarmStartClass* next;       /* link on gDvmJit.warmStartReady */
+    const char* descriptor;
+    u4 dexChecksum;
+    ClassObject* clazz;         /* set when the class is initialized */
+    WarmStartTrace* traces;
+};
+
+/* Bounds-checked cursor over the file image */
+struct WarmStartReader {
+    const u1* ptr;
+    const u1* end;
+};
+
+static bool readBytes(WarmStartReader* reader, void* dst, size_t len)
+{
+    if ((size_t) (reader->end - reader->ptr) < len)
+        return false;
+    memcpy(dst, reader->ptr, len);
+    reader->ptr += len;
+    return true;
+}
+
+static bool readU1(WarmStartReader* reader, u1* pVal)
+{
+    return readBytes(reader, pVal, sizeof(*pVal));
+}
+
+static bool readU2(WarmStartReader* reader, u2* pVal)
+{
+    return readBytes(reader, pVal, sizeof(*pVal));
+}
+
+static bool readU4(WarmStartReader* reader, u4* pVal)
+{
+    return readBytes(reader, pVal, sizeof(*pVal));
+}
+
+/* Returns a pointer to the string in the image, or NULL if malformed */
+static const char* readString(WarmStartReader* reader)
+{
+    u2 len;
+    if (!readU2(reader, &len) || len == 0 ||
+        (size_t) (reader->end - reader->ptr) < len ||
+        reader->ptr[len - 1] != '\0') {
+        return NULL;
+    }
+    const char* str = (const char*) reader->ptr;
+    reader->ptr += len;
+    return str;
+}
+
+/*
+ * Check the encoded runs of a trace and advance past them.  Returns the
+ * number of JitTraceRun entries they expand to, or -1 if malformed.
+ */
+static int checkRuns(WarmStartReader* reader, unsigned int numRuns)
+{
+    int numEntries = 0;
+    bool lastWasCode = false;
+    bool ended = false;
+
+    for (unsigned int i = 0; i < numRuns; i++) {
+        u1 isCode;
+        if (ended || !readU1(reader, &isCode))
+            return -1;
+        if (isCode) {
+            u2 startOffset;
+            u1 numInsts, flags;
+            if (!readU2(reader, &startOffset) ||
+                !readU1(reader, &numInsts) || !readU1(reader, &flags)) {
+                return -1;
+            }
+            ended = (flags & 1) != 0;
+            numEntries++;
+        } else {
+            /* Meta runs only follow the code run ending in an invoke */
+            if (!lastWasCode)
+                return -1;
+            for (int j = 0; j < 4; j++) {
+                if (readString(reader) == NULL)
+                    return -1;
+            }
+            numEntries += JIT_TRACE_CUR_METHOD;
+        }
+        lastWasCode = isCode;
+    }
+    if (!ended || numEntries > MAX_JIT_RUN_LEN)
+        return -1;
+    return numEntries;
+}
+
+static int compareClassDescriptor(const void* tableItem, const void* looseItem)
+{
+    return strcmp(((const WarmStartClass*) tableItem)->descriptor,
+                  ((const WarmStartClass*) looseItem)->descriptor);
+}
+
+static void freeWarmStartClass(WarmStartClass* wsClass)
+{
+    WarmStartTrace* trace = wsClass->traces;
+    while (trace != NULL) {
+        WarmStartTrace* next = trace->next;
+        free(trace);
+        trace = next;
+    }
+    free(wsClass);
+}
+
+/* Parse the file image into gDvmJit.warmStartPending */
+static bool parseImage(const u1* image, size_t length)
+{
+    WarmStartReader reader = { image, image + length };
+    char magic[sizeof(kWarmStartMagic)];
+    u4 version, numTraces;
+
+    if (!readBytes(&reader, magic, sizeof(magic)) ||
+        memcmp(magic, kWarmStartMagic, sizeof(magic)) != 0 ||
+        !readU4(&reader, &version) || version != WARM_START_VERSION ||
+        !readU4(&reader, &numTraces)) {
+        return false;
+    }
+
+    for (u4 i = 0; i < numTraces; i++) {
+        WarmStartClass key;
+        u4 dexChecksum;
+        u2 numRuns;
+
+        if (!readU4(&reader, &dexChecksum))
+            return false;
+        key.descriptor = readString(&reader);
+        const char* methodName = readString(&reader);
+        const char* methodSig = readString(&reader);
+        if (key.descriptor == NULL || methodName == NULL ||
+            methodSig == NULL || !readU2(&reader, &numRuns)) {
+            return false;
+        }
+        const u1* runs = reader.ptr;
+        int numEntries = checkRuns(&reader, numRuns);
+        if (numEntries < 0)
+            return false;
+
+        u4 hash = dvmComputeUtf8Hash(key.descriptor);
+        WarmStartClass* wsClass = (WarmStartClass*)
+            dvmHashTableLookup(gDvmJit.warmStartPending, hash, &key,
+                               compareClassDescriptor, false);
+        if (wsClass == NULL) {
+            wsClass = (WarmStartClass*) calloc(1, sizeof(*wsClass));
+            if (wsClass == NULL)
+                return false;
+            wsClass->descriptor = key.descriptor;
+            wsClass->dexChecksum = dexChecksum;
+            dvmHashTableLookup(gDvmJit.warmStartPending, hash, wsClass,
+                               compareClassDescriptor, true);
+        } else if (wsClass->dexChecksum != dexChecksum) {
+            /* Same name in another dex file - keep the first one seen */
+            continue;
+        }
+
+        WarmStartTrace* trace = (WarmStartTrace*) malloc(sizeof(*trace));
+        if (trace == NULL)
+            return false;
+        trace->methodName = methodName;
+        trace->methodSig = methodSig;
+        trace->runs = runs;
+        trace->runsEnd = reader.ptr;
+        trace->numRuns = numRuns;
+        trace->numEntries = numEntries;
+        trace->next = wsClass->traces;
+        wsClass->traces = trace;
+        gDvmJit.numWarmStartLoaded++;
+    }
+    return reader.ptr == reader.end;
+}
+
+static int freePendingClass(void* data)
+{
+    freeWarmStartClass((WarmStartClass*) data);
+    return 1;
+}
+
+/*
+ * Called with gDvmJit.warmStartLock held.  Move the saved traces of an
+ * initialized class from the pending table to the ready list, or drop
+ * them if the class came from a different dex file.
+ */
+static void markClassReady(ClassObject* clazz)
+{
+    /* Array and primitive classes have no code */
+    if (clazz->pDvmDex == NULL)
+        return;
+
+    WarmStartClass key;
+    key.descriptor = clazz->descriptor;
+    u4 hash = dvmComputeUtf8Hash(clazz->descriptor);
+    WarmStartClass* wsClass = (WarmStartClass*)
+        dvmHashTableLookup(gDvmJit.warmStartPending, hash, &key,
+                           compareClassDescriptor, false);
+    if (wsClass == NULL)
+        return;
+
+    dvmHashTableRemove(gDvmJit.warmStartPending, hash, wsClass);
+    if (wsClass->dexChecksum != clazz->pDvmDex->pHeader->checksum) {
+        for (WarmStartTrace* trace = wsClass->traces; trace != NULL;
+             trace = trace->next) {
+            gDvmJit.numWarmStartDropped++;
+        }
+        freeWarmStartClass(wsClass);
+        return;
+    }
+    wsClass->clazz = clazz;
+    wsClass->next = gDvmJit.warmStartReady;
+    gDvmJit.warmStartReady = wsClass;
+}
+
+static int markLoadedClassReady(void* data, void* arg)
+{
+    ClassObject* clazz = (ClassObject*) data;
+    if (dvmIsClassInitialized(clazz))
+        markClassReady(clazz);
+    return 0;
+}
+
+/*
+ * Read the warm start profile.  Classes that are already initialized
+ * (e.g. preloaded by the zygote) go straight to the ready list.  Returns
+ * true if there are saved traces to compile.
+ *
+ * Called on the compiler thread before the JitTable is set up.
+ */
+bool dvmCompilerWarmStartLoad(void)
+{
+    if (gDvmJit.warmStartFile == NULL)
+        return false;
+
+    gDvmJit.warmStartTraces = dvmHashTableCreate(256, free);
+    gDvmJit.warmStartLastSave = dvmGetRelativeTimeMsec();
+
+    int fd = open(gDvmJit.warmStartFile, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            ALOGW("JIT warm start: unable to open %s: %s",
+                 gDvmJit.warmStartFile, strerror(errno));
+        }
+        return false;
+    }
+
+    struct stat sb;
+    u1* image = NULL;
+    ssize_t actual = -1;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0 &&
+        (image = (u1*) malloc(sb.st_size)) != NULL) {
+        actual = TEMP_FAILURE_RETRY(read(fd, image, sb.st_size));
+    }
+    close(fd);
+    if (actual != sb.st_size) {
+        ALOGW("JIT warm start: unable to read %s", gDvmJit.warmStartFile);
+        free(image);
+        return false;
+    }
+
+    dvmLockMutex(&gDvmJit.warmStartLock);
+    gDvmJit.warmStartPending = dvmHashTableCreate(64, NULL);
+    if (!parseImage(image, sb.st_size)) {
+        ALOGW("JIT warm start: ignoring malformed %s", gDvmJit.warmStartFile);
+        dvmHashForeachRemove(gDvmJit.warmStartPending, freePendingClass);
+        gDvmJit.numWarmStartLoaded = 0;
+        dvmUnlockMutex(&gDvmJit.warmStartLock);
+        free(image);
+        return false;
+    }
+    gDvmJit.warmStartImage = image;
+    dvmUnlockMutex(&gDvmJit.warmStartLock);
+
+    /* Lock order is loadedClasses, then warmStartLock */
+    dvmHashTableLock(gDvm.loadedClasses);
+    dvmLockMutex(&gDvmJit.warmStartLock);
+    dvmHashForeach(gDvm.loadedClasses, markLoadedClassReady, NULL);
+    dvmUnlockMutex(&gDvmJit.warmStartLock);
+    dvmHashTableUnlock(gDvm.loadedClasses);
+
+    ALOGD("JIT warm start: %d traces from %s",
+         gDvmJit.numWarmStartLoaded, gDvmJit.warmStartFile);
+    return gDvmJit.numWarmStartLoaded != 0;
+}
+
+/*
+ * A class has just been initialized.  If it has saved traces, hand them
+ * to the compiler thread.
+ */
+void dvmCompilerWarmStartClassReady(ClassObject* clazz)
+{
+    dvmLockMutex(&gDvmJit.warmStartLock);
+    markClassReady(clazz);
+    bool wake = gDvmJit.warmStartReady != NULL;
+    dvmUnlockMutex(&gDvmJit.warmStartLock);
+
+    /* Don't cut the start-up delay short - the JitTable isn't ready yet */
+    if (wake && gDvmJit.pJitEntryTable != NULL) {
+        dvmLockMutex(&gDvmJit.compilerLock);
+        pthread_cond_signal(&gDvmJit.compilerQueueActivity);
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+    }
+}
+
+static const Method* findMethod(const ClassObject* clazz, const char* name,
+                                const char* sig)
+{
+    const Method* method = dvmFindDirectMethodByDescriptor(clazz, name, sig);
+    if (method == NULL)
+        method = dvmFindVirtualMethodByDescriptor(clazz, name, sig);
+    return method;
+}
+
+/* Look up a class named in a meta run as "clazz" would see it */
+static ClassObject* findLoadedClass(const ClassObject* clazz,
+                                    const char* descriptor)
+{
+    ClassObject* found = dvmLookupClass(descriptor, clazz->classLoader, false);
+    if (found == NULL && clazz->classLoader != NULL)
+        found = dvmLookupClass(descriptor, NULL, false);
+    return found;
+}
+
+/*
+ * Rebuild the trace description of a saved trace.  Returns NULL if the
+ * method, or a class or callee named in its meta runs, can't be found.
+ */
+static JitTraceDescription* resolveTrace(const ClassObject* clazz,
+                                         const WarmStartTrace* trace)
+{
+    const Method* method =
+        findMethod(clazz, trace->methodName, trace->methodSig);
+    if (method == NULL || dvmIsNativeMethod(method) ||
+        dvmIsAbstractMethod(method)) {
+        return NULL;
+    }
+    u4 insnsSize = dvmGetMethodInsnsSize(method);
+
+    JitTraceDescription* desc = (JitTraceDescription*)
+        calloc(1, sizeof(JitTraceDescription) +
+                  sizeof(JitTraceRun) * trace->numEntries);
+    if (desc == NULL)
+        return NULL;
+    desc->method = method;
+
+    /* The runs were checked when the file was loaded */
+    WarmStartReader reader = { trace->runs, trace->runsEnd };
+    JitTraceRun* run = &desc->trace[0];
+    for (unsigned int i = 0; i < trace->numRuns; i++) {
+        u1 isCode;
+        readU1(&reader, &isCode);
+        if (isCode) {
+            u2 startOffset;
+            u1 numInsts, flags;
+            readU2(&reader, &startOffset);
+            readU1(&reader, &numInsts);
+            readU1(&reader, &flags);
+            if (startOffset >= insnsSize)
+                goto fail;
+            run->info.frag.startOffset = startOffset;
+            run->info.frag.numInsts = numInsts;
+            run->info.frag.runEnd = flags & 1;
+            run->info.frag.hint = (JitHint) (flags >> 1);
+            run->isCode = true;
+            run++;
+        } else {
+            const char* thisDescriptor = readString(&reader);
+            const char* calleeDescriptor = readString(&reader);
+            const char* calleeName = readString(&reader);
+            const char* calleeSig = readString(&reader);
+            ClassObject* thisClass = NULL;
+            const Method* callee = NULL;
+
+            if (thisDescriptor[0] != '\0') {
+                thisClass = findLoadedClass(clazz, thisDescriptor);
+                if (thisClass == NULL)
+                    goto fail;
+            }
+            if (calleeDescriptor[0] != '\0') {
+                ClassObject* calleeClass =
+                    findLoadedClass(clazz, calleeDescriptor);
+                if (calleeClass == NULL)
+                    goto fail;
+                callee = findMethod(calleeClass, calleeName, calleeSig);
+                if (callee == NULL)
+                    goto fail;
+            }
+            run[JIT_TRACE_CLASS_DESC - 1].info.meta =
+                thisClass ? (void*) thisClass->descriptor : NULL;
+            run[JIT_TRACE_CLASS_LOADER - 1].info.meta =
+                thisClass ? (void*) thisClass->classLoader : NULL;
+            run[JIT_TRACE_CUR_METHOD - 1].info.meta = (void*) callee;
+            run += JIT_TRACE_CUR_METHOD;
+        }
+    }
+    return desc;
+
+fail:
+    free(desc);
+    return NULL;
+}
+
+/*
+ * The compiler thread has nothing to do.  Queue saved traces whose classes
+ * are ready, up to half a queue's worth, and return true if any were
+ * queued.  Otherwise write the profile if it is due; "*pWaitMsec" is set
+ * to the time until the next write is due, or 0 if none is pending.
+ *
+ * Called on the compiler thread without compilerLock.
+ */
+bool dvmCompilerWarmStartIdle(int* pWaitMsec)
+{
+    int queued = 0;
+
+    *pWaitMsec = 0;
+    while (queued < COMPILER_WORK_QUEUE_SIZE / 2) {
+        WarmStartClass* wsClass;
+        WarmStartTrace* trace = NULL;
+        bool lastTrace = false;
+
+        dvmLockMutex(&gDvmJit.warmStartLock);
+        wsClass = gDvmJit.warmStartReady;
+        if (wsClass != NULL) {
+            trace = wsClass->traces;
+            wsClass->traces = trace->next;
+            if (wsClass->traces == NULL) {
+                gDvmJit.warmStartReady = wsClass->next;
+                lastTrace = true;
+            }
+        }
+        dvmUnlockMutex(&gDvmJit.warmStartLock);
+        if (wsClass == NULL)
+            break;
+
+        JitTraceDescription* desc = resolveTrace(wsClass->clazz, trace);
+        if (desc != NULL &&
+            dvmJitRequestTranslation(desc->method->insns +
+                                     desc->trace[0].info.frag.startOffset,
+                                     desc)) {
+            gDvmJit.numWarmStartQueued++;
+            queued++;
+        } else {
+            /* Unresolvable, or the interpreter got there first */
+            free(desc);
+            gDvmJit.numWarmStartDropped++;
+        }
+        free(trace);
+        if (lastTrace)
+            free(wsClass);
+    }
+    if (queued != 0)
+        return true;
+
+    if (gDvmJit.warmStartDirty) {
+        u4 sinceSave = dvmGetRelativeTimeMsec() - gDvmJit.warmStartLastSave;
+        if (sinceSave >= WARM_START_SAVE_INTERVAL_MS) {
+            dvmCompilerWarmStartSave();
+        } else {
+            *pWaitMsec = WARM_START_SAVE_INTERVAL_MS - sinceSave;
+        }
+    }
+    return false;
+}
+
+static const u2* traceHead(const JitTraceDescription* desc)
+{
+    return desc->method->insns + desc->trace[0].info.frag.startOffset;
+}
+
+static int compareTraceHead(const void* tableItem, const void* looseItem)
+{
+    return traceHead((const JitTraceDescription*) tableItem) !=
+           traceHead((const JitTraceDescription*) looseItem);
+}
+
+/*
+ * Remember the description of a newly installed trace for the next
+ * profile write.  Called on the compiler thread.
+ */
+void dvmCompilerWarmStartRecord(const JitTraceDescription* desc)
+{
+    if (gDvmJit.warmStartTraces == NULL ||
+        dvmHashTableNumEntries(gDvmJit.warmStartTraces) >=
+            JIT_WARM_START_MAX_TRACES) {
+        return;
+    }
+
+    int numRuns;
+    for (numRuns = 1; !desc->trace[numRuns - 1].isCode ||
+                      !desc->trace[numRuns - 1].info.frag.runEnd; numRuns++)
+        ;
+    size_t size = sizeof(JitTraceDescription) + numRuns * sizeof(JitTraceRun);
+    JitTraceDescription* copy = (JitTraceDescription*) malloc(size);
+    if (copy == NULL)
+        return;
+    memcpy(copy, desc, size);
+
+    u4 hash = (u4) (uintptr_t) traceHead(copy) >> 1;
+    if (dvmHashTableLookup(gDvmJit.warmStartTraces, hash, copy,
+                           compareTraceHead, true) != copy) {
+        /* Retranslation of a trace we already have */
+        free(copy);
+    } else {
+        gDvmJit.warmStartDirty = true;
+    }
+}
+
+static void writeU1(FILE* fp, u1 val)
+{
+    fwrite(&val, sizeof(val), 1, fp);
+}
+
+static void writeU2(FILE* fp, u2 val)
+{
+    fwrite(&val, sizeof(val), 1, fp);
+}
+
+static void writeU4(FILE* fp, u4 val)
+{
+    fwrite(&val, sizeof(val), 1, fp);
+}
+
+static void writeString(FILE* fp, const char* str)
+{
+    if (str == NULL)
+        str = "";
+    u2 len = strlen(str) + 1;
+    writeU2(fp, len);
+    fwrite(str, 1, len, fp);
+}
+
+static void writeMethodName(FILE* fp, const Method* method)
+{
+    char* sig = dexProtoCopyMethodDescriptor(&method->prototype);
+    writeString(fp, method->name);
+    writeString(fp, sig);
+    free(sig);
+}
+
+static void writeTrace(FILE* fp, const JitTraceDescription* desc)
+{
+    const Method* method = desc->method;
+    int numRuns = 0;
+
+    /* The meta runs of an invoke are written as a single run */
+    for (int i = 0; ; i++) {
+        if (desc->trace[i].isCode) {
+            numRuns++;
+            if (desc->trace[i].info.frag.runEnd)
+                break;
+        } else {
+            numRuns++;
+            i += JIT_TRACE_CUR_METHOD - 1;
+        }
+    }
+
+    writeU4(fp, method->clazz->pDvmDex->pHeader->checksum);
+    writeString(fp, method->clazz->descriptor);
+    writeMethodName(fp, method);
+    writeU2(fp, numRuns);
+    for (const JitTraceRun* run = &desc->trace[0]; ; ) {
+        if (run->isCode) {
+            writeU1(fp, 1);
+            writeU2(fp, run->info.frag.startOffset);
+            writeU1(fp, run->info.frag.numInsts);
+            writeU1(fp, (run->info.frag.hint << 1) | run->info.frag.runEnd);
+            if (run->info.frag.runEnd)
+                break;
+            run++;
+        } else {
+            const Method* callee = (const Method*)
+                run[JIT_TRACE_CUR_METHOD - 1].info.meta;
+            writeU1(fp, 0);
+            writeString(fp, (const char*)
+                        run[JIT_TRACE_CLASS_DESC - 1].info.meta);
+            if (callee != NULL) {
+                writeString(fp, callee->clazz->descriptor);
+                writeMethodName(fp, callee);
+            } else {
+                writeString(fp, NULL);
+                writeString(fp, NULL);
+                writeString(fp, NULL);
+            }
+            run += JIT_TRACE_CUR_METHOD;
+        }
+    }
+}
+
+/*
+ * Write the descriptions of every trace installed so far.  The file is
+ * replaced atomically so a crash mid-write leaves the old one intact.
+ *
+ * Called on the compiler thread, or after it has exited.
+ */
+void dvmCompilerWarmStartSave(void)
+{
+    if (gDvmJit.warmStartTraces == NULL || !gDvmJit.warmStartDirty)
+        return;
+
+    char tmpName[PATH_MAX];
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", gDvmJit.warmStartFile);
+    FILE* fp = fopen(tmpName, "w");
+    if (fp == NULL) {
+        ALOGW("JIT warm start: unable to create %s: %s",
+             tmpName, strerror(errno));
+    } else {
+        fwrite(kWarmStartMagic, sizeof(kWarmStartMagic), 1, fp);
+        writeU4(fp, WARM_START_VERSION);
+        writeU4(fp, dvmHashTableNumEntries(gDvmJit.warmStartTraces));
+
+        HashIter iter;
+        for (dvmHashIterBegin(gDvmJit.warmStartTraces, &iter);
+             !dvmHashIterDone(&iter); dvmHashIterNext(&iter)) {
+            writeTrace(fp,
+                       (const JitTraceDescription*) dvmHashIterData(&iter));
+        }
+
+        bool failed = ferror(fp) != 0;
+        failed |= fclose(fp) != 0;
+        if (failed || rename(tmpName, gDvmJit.warmStartFile) != 0) {
+            ALOGW("JIT warm start: unable to write %s",
+                 gDvmJit.warmStartFile);
+            unlink(tmpName);
+        } else if (gDvm.verboseShutdown) {
+            ALOGD("JIT warm start: saved %d traces to %s",
+                 dvmHashTableNumEntries(gDvmJit.warmStartTraces),
+                 gDvmJit.warmStartFile);
+        }
+    }
+
+    /* Don't retry a failed write until there is something new */
+    gDvmJit.warmStartDirty = false;
+    gDvmJit.warmStartLastSave = dvmGetRelativeTimeMsec();
+}
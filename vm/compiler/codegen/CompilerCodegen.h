@@ -57,6 +57,9 @@ void dvmCompilerPatchInlineCache(void);
 /* Implemented in codegen/<target>/Ralloc.c */
 void dvmCompilerLocalRegAlloc(CompilationUnit *cUnit);
 
+/* Implemented in Ralloc.cpp */
+void dvmCompilerLoopRegAlloc(CompilationUnit *cUnit, int numSlots);
+
 /* Implemented in codegen/<target>/Thumb<version>Util.c */
 void dvmCompilerInitializeRegAlloc(CompilationUnit *cUnit);
 
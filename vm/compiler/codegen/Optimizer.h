@@ -31,6 +31,12 @@ enum optControlVector {
     kMethodInlining,
     kMethodJit,
     kShiftArithmetic,
+    kLoopRegPromotion,
+    kLoopInvariantMotion,
+    kLoopVectorization,
+    kValueNumbering,
+    kEscapeAnalysis,
+    kTraceTreeFormation,
 };
 
 /* Forward declarations */
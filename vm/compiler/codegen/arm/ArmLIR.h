@@ -792,6 +792,6 @@ typedef struct ArmLIR {
 #define CHAIN_CELL_OFFSET_TAG   0xcdab
 
 #define CHAIN_CELL_NORMAL_SIZE 12
-#define CHAIN_CELL_PREDICTED_SIZE 16
+#define CHAIN_CELL_PREDICTED_SIZE 20
 
 #endif  // DALVIK_VM_COMPILER_CODEGEN_ARM_ARMLIR_H_
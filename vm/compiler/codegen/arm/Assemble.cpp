@@ -1210,7 +1210,7 @@ static int assignLiteralOffset(CompilationUnit *cUnit, int offset)
  *   |  .                            .
  *   |  |                            |
  *   |  +----------------------------+
- *   |  | Chaining Cells             |  -> 12/16 bytes, 4 byte aligned
+ *   |  | Chaining Cells             |  -> 12/20 bytes, 4 byte aligned
  *   |  .                            .
  *   |  .                            .
  *   |  |                            |
@@ -1360,7 +1360,7 @@ static void matchSignatureBreakpoint(const CompilationUnit *cUnit,
  * before sending them off to the assembler. If out-of-range branch distance is
  * seen rearrange the instructions a bit to correct it.
  */
-void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+static void assembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 {
     ArmLIR *armLIR;
     int offset = 0;
@@ -1434,7 +1434,7 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 
     cUnit->totalSize = offset;
 
-    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheSize) {
+    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheByteLimit) {
         gDvmJit.codeCacheFull = true;
         info->discardResult = true;
         return;
@@ -1550,6 +1550,18 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         info->codeAddress = (char*)info->codeAddress + 1;
     /* transfer the size of the profiling code */
     info->profileCodeSize = cUnit->profileCodeSize;
+    info->codeSize = cUnit->totalSize - cUnit->headerSize;
+}
+
+/*
+ * Code is assembled for the address it will be installed at, so another
+ * compiler thread mustn't allocate from the code cache in between.
+ */
+void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+{
+    dvmCompilerLockCodegen();
+    assembleLIR(cUnit, info);
+    dvmCompilerUnlockCodegen();
 }
 
 /*
@@ -1766,6 +1778,9 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
 #else
     PredictedChainingCell newCell;
     int baseAddr, branchOffset, tgtAddr;
+
+    dvmCompilerRecordCallSite(cell->siteDalvikPC, clazz, method);
+
     if (dvmIsNativeMethod(method)) {
         UNPROTECT_CODE_CACHE(cell, sizeof(*cell));
 
@@ -1805,6 +1820,7 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
     newCell.clazz = clazz;
     newCell.method = method;
     newCell.stagedClazz = NULL;
+    newCell.siteDalvikPC = cell->siteDalvikPC;
 
     /*
      * Enter the work order to the queue and the chaining cell will be patched
@@ -1839,7 +1855,7 @@ void dvmCompilerPatchInlineCache(void)
      */
     dvmLockMutex(&gDvmJit.compilerICPatchLock);
 
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     //ALOGD("Number of IC patch work orders: %d", gDvmJit.compilerICPatchIndex);
 
@@ -1878,7 +1894,7 @@ void dvmCompilerPatchInlineCache(void)
     dvmCompilerCacheFlush((long) minAddr, (long) (maxAddr+1), 0);
     UPDATE_CODE_CACHE_PATCHES();
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     gDvmJit.compilerICPatchIndex = 0;
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
@@ -1965,7 +1981,7 @@ void dvmJitUnchainAll()
         COMPILER_TRACE_CHAINING(LOGD("Jit Runtime: unchaining all"));
         dvmLockMutex(&gDvmJit.tableLock);
 
-        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         for (size_t i = 0; i < gDvmJit.jitTableSize; i++) {
             if (gDvmJit.pJitEntryTable[i].dPC &&
@@ -1986,7 +2002,7 @@ void dvmJitUnchainAll()
         dvmCompilerCacheFlush((long)lowAddress, (long)highAddress, 0);
         UPDATE_CODE_CACHE_PATCHES();
 
-        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         dvmUnlockMutex(&gDvmJit.tableLock);
         gDvmJit.translationChains = 0;
@@ -2238,12 +2254,14 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
  */
 void dvmJitScanAllClassPointers(void (*callback)(void *))
 {
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
-    /* Handle the inflight compilation first */
-    if (gDvmJit.inflightBaseAddr)
-        findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr,
-                                     callback);
+    /* Handle the inflight compilations first */
+    for (int i = 0; i < JIT_MAX_COMPILER_THREADS; i++) {
+        if (gDvmJit.inflightBaseAddr[i])
+            findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr[i],
+                                         callback);
+    }
 
     if (gDvmJit.pJitEntryTable != NULL) {
         unsigned int traceIdx;
@@ -2262,7 +2280,7 @@ void dvmJitScanAllClassPointers(void (*callback)(void *))
     }
     UPDATE_CODE_CACHE_PATCHES();
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 }
 
 /*
@@ -2287,7 +2305,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * thread if there is a pending request before the state is actually
      * changed to RUNNING.
      */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_RUNNING);
+    dvmChangeStatus(NULL, THREAD_RUNNING);
 
     /*
      * Unprotecting the code cache will need to acquire the code cache
@@ -2317,7 +2335,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * in the JIT table, its content can be patched if class objects are
      * moved.
      */
-    gDvmJit.inflightBaseAddr = base;
+    gDvmJit.inflightBaseAddr[dvmCompilerThreadIndex()] = base;
 
 #if defined(WITH_JIT_TUNING)
     u8 blockTime = dvmGetRelativeTimeUsec() - startTime;
@@ -2331,7 +2349,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
     PROTECT_CODE_CACHE(startClassPointerP, numClassPointers * sizeof(intptr_t));
 
     /* Change the thread state back to VMWAIT */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_VMWAIT);
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
 }
 
 #if defined(WITH_SELF_VERIFICATION)
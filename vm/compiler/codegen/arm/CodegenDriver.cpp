@@ -308,8 +308,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -329,8 +331,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -354,8 +358,10 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
@@ -380,8 +386,10 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, kST);
@@ -2814,11 +2822,12 @@ static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
 /*
  * See the example of predicted inlining listed before the
  * genValidationForPredictedInline function. The function here takes care the
- * branch over at 0x4858de78 and the misprediction target at 0x4858de7a.
+ * branch over at 0x4858de78 and the misprediction target at 0x4858de7a, for
+ * the guard described by "callsiteInfo".
  */
-static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
-                                               BasicBlock *bb,
-                                               ArmLIR *labelList)
+static void genMispredictionTarget(CompilationUnit *cUnit,
+                                   CallsiteInfo *callsiteInfo,
+                                   BasicBlock *bb, ArmLIR *labelList)
 {
     BasicBlock *fallThrough = bb->fallThrough;
 
@@ -2835,11 +2844,23 @@ static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
     dvmCompilerClobberAllRegs(cUnit);
     dvmCompilerResetNullCheck(cUnit);
 
-    /* Target for the slow invoke path */
+    /* Target for the next guard or the slow invoke path */
     ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
     target->defMask = ENCODE_ALL;
     /* Hook up the target to the verification branch */
-    mir->meta.callsiteInfo->misPredBranchOver->target = (LIR *) target;
+    callsiteInfo->misPredBranchOver->target = (LIR *) target;
+}
+
+/* The slow invoke is reached once the guard of the last target has failed */
+static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
+                                               BasicBlock *bb,
+                                               ArmLIR *labelList)
+{
+    CallsiteInfo *lastTarget = mir->meta.callsiteInfo;
+
+    while (lastTarget->nextTarget != NULL)
+        lastTarget = lastTarget->nextTarget;
+    genMispredictionTarget(cUnit, lastTarget, bb, labelList);
 }
 
 static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
@@ -3670,7 +3691,8 @@ static void handleInvokeSingletonChainingCell(CompilationUnit *cUnit,
 }
 
 /* Chaining cell for monomorphic method invocations. */
-static void handleInvokePredictedChainingCell(CompilationUnit *cUnit)
+static void handleInvokePredictedChainingCell(CompilationUnit *cUnit,
+                                              unsigned int offset)
 {
 
     /* Should not be executed in the initial state */
@@ -3684,6 +3706,8 @@ static void handleInvokePredictedChainingCell(CompilationUnit *cUnit)
      * the first invocation of this callsite.
      */
     addWordData(cUnit, NULL, PREDICTED_CHAIN_COUNTER_INIT);
+    /* Dalvik PC of the invoke, for the call site profile */
+    addWordData(cUnit, NULL, (int) (cUnit->method->insns + offset));
 }
 
 /* Load the Dalvik PC into r0 and jump to the specified target */
@@ -3718,6 +3742,8 @@ static const char *extendedMIROpNames[kMirOpLast - kMirOpFirst] = {
     "kMirOpLowerBound",
     "kMirOpPunt",
     "kMirOpCheckInlinePrediction",
+    "kMirOpNullCheck",
+    "kMirOpVectorLoop",
 };
 
 /*
@@ -3829,6 +3855,20 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
                    (ArmLIR *) cUnit->loopAnalysis->branchToPCR);
 }
 
+/*
+ * vA = objReg;
+ */
+static void genHoistedNullCheck(CompilationUnit *cUnit, MIR *mir)
+{
+    RegLocation rlObj = cUnit->regLocation[mir->dalvikInsn.vA];
+
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+
+    /* Punt if "objReg != NULL" is false */
+    genRegImmCheck(cUnit, kArmCondEq, rlObj.lowReg, 0, 0,
+                   (ArmLIR *) cUnit->loopAnalysis->branchToPCR);
+}
+
 /*
  * vC = this
  *
@@ -3913,9 +3953,20 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
  * D/dalvikvm(   86): 0x4858dece (006a): data    0x0000(0)
  * :
  */
-static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
+static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir,
+                                            BasicBlock *bb,
+                                            ArmLIR *labelList)
 {
     CallsiteInfo *callsiteInfo = mir->meta.callsiteInfo;
+
+    /*
+     * Another target of the same call site is inlined right before this
+     * one.  Its body ends here, and its guard lands here on a misprediction.
+     */
+    if (callsiteInfo->prevTarget != NULL) {
+        genMispredictionTarget(cUnit, callsiteInfo->prevTarget, bb, labelList);
+    }
+
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
@@ -3925,16 +3976,41 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
                  NULL);/* null object? */
     int regActualClass = dvmCompilerAllocTemp(cUnit);
     loadWordDisp(cUnit, rlThis.lowReg, offsetof(Object, clazz), regActualClass);
+
+    /* Other receiver classes known to reach the inlined callee */
+    ArmLIR *polyHits[JIT_POLY_IC_SIZE];
+    int numPolyHits = 0;
+    if (callsiteInfo->polyNext != NULL) {
+        int regPolyClass = dvmCompilerAllocTemp(cUnit);
+        CallsiteInfo *polyInfo;
+        for (polyInfo = callsiteInfo->polyNext;
+             polyInfo != NULL && numPolyHits < JIT_POLY_IC_SIZE;
+             polyInfo = polyInfo->polyNext) {
+            loadClassPointer(cUnit, regPolyClass, (int) polyInfo);
+            opRegReg(cUnit, kOpCmp, regPolyClass, regActualClass);
+            polyHits[numPolyHits++] = opCondBranch(cUnit, kArmCondEq);
+        }
+    }
+
     opRegReg(cUnit, kOpCmp, regPredictedClass, regActualClass);
     /*
      * Set the misPredBranchOver target so that it will be generated when the
      * code for the non-optimized invoke is generated.
      */
     callsiteInfo->misPredBranchOver = (LIR *) opCondBranch(cUnit, kArmCondNe);
+
+    if (numPolyHits != 0) {
+        ArmLIR *inlinedLabel = newLIR0(cUnit, kArmPseudoTargetLabel);
+        inlinedLabel->defMask = ENCODE_ALL;
+        for (int i = 0; i < numPolyHits; i++) {
+            polyHits[i]->generic.target = (LIR *) inlinedLabel;
+        }
+    }
 }
 
 /* Extended MIR instructions like PHI */
-static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
+static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir,
+                              BasicBlock *bb, ArmLIR *labelList)
 {
     int opOffset = mir->dalvikInsn.opcode - kMirOpFirst;
     char *msg = (char *)dvmCompilerNew(strlen(extendedMIROpNames[opOffset]) + 1,
@@ -3966,7 +4042,11 @@ static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
             break;
         }
         case kMirOpCheckInlinePrediction: {
-            genValidationForPredictedInline(cUnit, mir);
+            genValidationForPredictedInline(cUnit, mir, bb, labelList);
+            break;
+        }
+        case kMirOpNullCheck: {
+            genHoistedNullCheck(cUnit, mir);
             break;
         }
         default:
@@ -4010,6 +4090,103 @@ static void setupLoopEntryBlock(CompilationUnit *cUnit, BasicBlock *entry,
     cUnit->loopAnalysis->branchToPCR = (LIR *) branchToPCR;
 }
 
+/*
+ * Loop register promotion.  dvmCompilerLoopRegAlloc gives some Dalvik
+ * registers a promotion register over an interval of MIR sequence numbers.
+ * Codegen still works through the live temp tracking: promotion registers
+ * are locked so the allocator never hands them out, and are marked live
+ * with their Dalvik register wherever the interval says the value is
+ * there.  Whatever clobbers one along the way is repaired before control
+ * moves on to the next position.
+ */
+
+/* Position reached after the MIR at "seqNum" */
+static int nextLoopPosition(CompilationUnit *cUnit, int seqNum)
+{
+    return seqNum == cUnit->loopBodyLength ? 1 : seqNum + 1;
+}
+
+/* Is the interval's value in its register on arrival at "pos"? */
+static bool promotedLiveAt(const PromotedInterval *interval, int pos)
+{
+    return interval->start < pos && pos <= interval->end;
+}
+
+static void bindPromotedReg(CompilationUnit *cUnit, int reg, int vReg)
+{
+    dvmCompilerMarkLive(cUnit, reg, vReg);
+    dvmCompilerMarkClean(cUnit, reg);
+    dvmCompilerResetDef(cUnit, reg);
+    dvmCompilerMarkInUse(cUnit, reg);
+}
+
+static void lockPromotedRegs(CompilationUnit *cUnit)
+{
+    for (int i = 0; i < cUnit->numPromotedIntervals; i++) {
+        dvmCompilerMarkInUse(cUnit,
+            loopPromotionReg(cUnit->promotedIntervals[i].slot));
+    }
+}
+
+/*
+ * The register state has just been reset at the top of a body block.
+ * Every path into it repaired the promotion registers for "pos", so they
+ * can simply be marked live again.
+ */
+static void bindPromotedRegs(CompilationUnit *cUnit, int pos)
+{
+    for (int i = 0; i < cUnit->numPromotedIntervals; i++) {
+        PromotedInterval *interval = &cUnit->promotedIntervals[i];
+        if (promotedLiveAt(interval, pos)) {
+            bindPromotedReg(cUnit, loopPromotionReg(interval->slot),
+                            interval->vReg);
+        }
+    }
+    lockPromotedRegs(cUnit);
+}
+
+/*
+ * An interval starting at "mir" starts with a def that doesn't read the
+ * old value, so let the result be computed straight into its register.
+ */
+static void bindPromotedDefs(CompilationUnit *cUnit, MIR *mir)
+{
+    for (int i = 0; i < cUnit->numPromotedIntervals; i++) {
+        PromotedInterval *interval = &cUnit->promotedIntervals[i];
+        if (interval->start == mir->seqNum) {
+            bindPromotedReg(cUnit, loopPromotionReg(interval->slot),
+                            interval->vReg);
+        }
+    }
+}
+
+/*
+ * Make the promotion registers hold what position "pos" expects, copying
+ * from a temp where the value is live or reloading it from the frame.
+ * Stores are write-through, so the frame copy is always current.
+ */
+static void repairPromotedRegs(CompilationUnit *cUnit, int pos)
+{
+    for (int i = 0; i < cUnit->numPromotedIntervals; i++) {
+        PromotedInterval *interval = &cUnit->promotedIntervals[i];
+        if (!promotedLiveAt(interval, pos))
+            continue;
+        int reg = loopPromotionReg(interval->slot);
+        RegisterInfo *info = dvmCompilerIsLive(cUnit, reg);
+        if (info == NULL || info->sReg != interval->vReg) {
+            RegLocation loc = {kLocDalvikFrame, 0, 0, INVALID_REG,
+                               INVALID_REG, interval->vReg};
+            loc = dvmCompilerUpdateLoc(cUnit, loc);
+            if (loc.location == kLocPhysReg) {
+                genRegCopy(cUnit, reg, loc.lowReg);
+            } else {
+                loadWordDisp(cUnit, rFP, interval->vReg << 2, reg);
+            }
+        }
+        bindPromotedReg(cUnit, reg, interval->vReg);
+    }
+}
+
 #if defined(WITH_SELF_VERIFICATION)
 static bool selfVerificationPuntOps(MIR *mir)
 {
@@ -4063,6 +4240,11 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
     /* Traces start with a profiling entry point.  Generate it here */
     cUnit->profileCodeSize = genTraceProfileEntry(cUnit);
 
+    /* Keep the hot Dalvik registers of a loop body in registers */
+    if (cUnit->jitMode == kJitLoop) {
+        dvmCompilerLoopRegAlloc(cUnit, numLoopPromotionRegs());
+    }
+
     /* Handle the content in each basic block */
     for (i = 0; ; i++) {
         MIR *mir;
@@ -4087,6 +4269,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
         if (bb->blockType == kEntryBlock) {
             labelList[i].opcode = kArmPseudoEntryBlock;
             if (bb->firstMIRInsn == NULL) {
+                repairPromotedRegs(cUnit, 1);
                 continue;
             } else {
               setupLoopEntryBlock(cUnit, bb,
@@ -4102,6 +4285,9 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
             dvmCompilerResetRegPool(cUnit);
             dvmCompilerClobberAllRegs(cUnit);
             dvmCompilerResetNullCheck(cUnit);
+            if (bb->firstMIRInsn != NULL) {
+                bindPromotedRegs(cUnit, bb->firstMIRInsn->seqNum);
+            }
         } else {
             switch (bb->blockType) {
                 case kChainingCellNormal:
@@ -4183,6 +4369,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
             for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
 
                 dvmCompilerResetRegPool(cUnit);
+                lockPromotedRegs(cUnit);
                 if (gDvmJit.disableOpt & (1 << kTrackLiveTemps)) {
                     dvmCompilerClobberAllRegs(cUnit);
                 }
@@ -4192,7 +4379,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
                 }
 
                 if ((int)mir->dalvikInsn.opcode >= (int)kMirOpFirst) {
-                    handleExtendedMIR(cUnit, mir);
+                    handleExtendedMIR(cUnit, mir, bb, labelList);
                     continue;
                 }
 
@@ -4239,6 +4426,21 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
                     newLIR1(cUnit, kArmPseudoSSARep, (int) ssaString);
                 }
 
+                /*
+                 * A branch leaves the block, so the promotion registers
+                 * have to be right before it rather than after it.
+                 */
+                bool promotedRegs = cUnit->numPromotedIntervals != 0 &&
+                                    bb->blockType == kDalvikByteCode;
+                bool repairFirst = promotedRegs &&
+                    (dexGetFlagsFromOpcode(dalvikOpcode) & kInstrCanBranch);
+                if (repairFirst) {
+                    repairPromotedRegs(cUnit,
+                        nextLoopPosition(cUnit, mir->seqNum));
+                } else if (promotedRegs) {
+                    bindPromotedDefs(cUnit, mir);
+                }
+
                 bool notHandled;
                 /*
                  * Debugging: screen the opcode first to see if it is in the
@@ -4346,10 +4548,15 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
                     dvmCompilerAbort(cUnit);
                     break;
                 }
+                if (promotedRegs && !repairFirst) {
+                    repairPromotedRegs(cUnit,
+                        nextLoopPosition(cUnit, mir->seqNum));
+                }
             }
         }
 
         if (bb->blockType == kEntryBlock) {
+            repairPromotedRegs(cUnit, 1);
             dvmCompilerAppendLIR(cUnit,
                                  (LIR *) cUnit->loopAnalysis->branchToBody);
             dvmCompilerAppendLIR(cUnit,
@@ -4414,7 +4621,8 @@ gen_fallthrough:
                         chainingBlock->containingMethod);
                     break;
                 case kChainingCellInvokePredicted:
-                    handleInvokePredictedChainingCell(cUnit);
+                    handleInvokePredictedChainingCell(cUnit,
+                        chainingBlock->startOffset);
                     break;
                 case kChainingCellHot:
                     handleHotChainingCell(cUnit, chainingBlock->startOffset);
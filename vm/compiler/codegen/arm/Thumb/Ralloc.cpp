@@ -42,3 +42,18 @@ int dvmCompilerAllocTypedTemp(CompilationUnit *cUnit, bool fpHint, int regClass)
 {
     return dvmCompilerAllocTemp(cUnit);
 }
+
+/*
+ * With only r0-r4 and r7 to allocate from, no registers are set aside for
+ * loop register promotion.
+ */
+static int numLoopPromotionRegs(void)
+{
+    return 0;
+}
+
+static int loopPromotionReg(int slot)
+{
+    assert(false);
+    return -1;
+}
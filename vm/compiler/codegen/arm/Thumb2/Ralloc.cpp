@@ -61,3 +61,20 @@ int dvmCompilerAllocTypedTemp(CompilationUnit *cUnit, bool fpHint,
         return dvmCompilerAllocTempFloat(cUnit);
     return dvmCompilerAllocTemp(cUnit);
 }
+
+/*
+ * Registers set aside for loop register promotion, in slot order.  They
+ * are callee-saved, so C calls leave them alone; r9 is skipped as the
+ * platform ABI may reserve it.
+ */
+static const int loopPromotionRegs[] = {r7, r8, r10};
+
+static int numLoopPromotionRegs(void)
+{
+    return sizeof(loopPromotionRegs) / sizeof(int);
+}
+
+static int loopPromotionReg(int slot)
+{
+    return loopPromotionRegs[slot];
+}
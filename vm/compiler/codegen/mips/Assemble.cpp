@@ -591,7 +591,7 @@ static int assignLiteralOffset(CompilationUnit *cUnit, int offset)
  *   |  .                            .
  *   |  |                            |
  *   |  +----------------------------+
- *   |  | Chaining Cells             |  -> 16/20 bytes, 4 byte aligned
+ *   |  | Chaining Cells             |  -> 16/24 bytes, 4 byte aligned
  *   |  .                            .
  *   |  .                            .
  *   |  |                            |
@@ -740,7 +740,7 @@ static void matchSignatureBreakpoint(const CompilationUnit *cUnit,
  * before sending them off to the assembler. If out-of-range branch distance is
  * seen rearrange the instructions a bit to correct it.
  */
-void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+static void assembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 {
     MipsLIR *mipsLIR;
     int offset = 0;
@@ -807,7 +807,7 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 
     cUnit->totalSize = offset;
 
-    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheSize) {
+    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheByteLimit) {
         gDvmJit.codeCacheFull = true;
         info->discardResult = true;
         return;
@@ -921,6 +921,18 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
     info->codeAddress = (char*)cUnit->baseAddr + cUnit->headerSize;
     /* transfer the size of the profiling code */
     info->profileCodeSize = cUnit->profileCodeSize;
+    info->codeSize = cUnit->totalSize - cUnit->headerSize;
+}
+
+/*
+ * Code is assembled for the address it will be installed at, so another
+ * compiler thread mustn't allocate from the code cache in between.
+ */
+void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+{
+    dvmCompilerLockCodegen();
+    assembleLIR(cUnit, info);
+    dvmCompilerUnlockCodegen();
 }
 
 /*
@@ -1105,6 +1117,9 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
 #else
     PredictedChainingCell newCell;
     int baseAddr, tgtAddr;
+
+    dvmCompilerRecordCallSite(cell->siteDalvikPC, clazz, method);
+
     if (dvmIsNativeMethod(method)) {
         UNPROTECT_CODE_CACHE(cell, sizeof(*cell));
 
@@ -1151,6 +1166,7 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
     newCell.clazz = clazz;
     newCell.method = method;
     newCell.stagedClazz = NULL;
+    newCell.siteDalvikPC = cell->siteDalvikPC;
 
     /*
      * Enter the work order to the queue and the chaining cell will be patched
@@ -1185,7 +1201,7 @@ void dvmCompilerPatchInlineCache(void)
      */
     dvmLockMutex(&gDvmJit.compilerICPatchLock);
 
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     //ALOGD("Number of IC patch work orders: %d", gDvmJit.compilerICPatchIndex);
 
@@ -1224,7 +1240,7 @@ void dvmCompilerPatchInlineCache(void)
     dvmCompilerCacheFlush((long) minAddr, (long) (maxAddr+1), 0);
     UPDATE_CODE_CACHE_PATCHES();
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     gDvmJit.compilerICPatchIndex = 0;
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
@@ -1329,7 +1345,7 @@ void dvmJitUnchainAll()
         COMPILER_TRACE_CHAINING(ALOGD("Jit Runtime: unchaining all"));
         dvmLockMutex(&gDvmJit.tableLock);
 
-        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         for (i = 0; i < gDvmJit.jitTableSize; i++) {
             if (gDvmJit.pJitEntryTable[i].dPC &&
@@ -1352,7 +1368,7 @@ void dvmJitUnchainAll()
 
         UPDATE_CODE_CACHE_PATCHES();
 
-        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         dvmUnlockMutex(&gDvmJit.tableLock);
         gDvmJit.translationChains = 0;
@@ -1605,12 +1621,14 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
  */
 void dvmJitScanAllClassPointers(void (*callback)(void *))
 {
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
-    /* Handle the inflight compilation first */
-    if (gDvmJit.inflightBaseAddr)
-        findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr,
-                                     callback);
+    /* Handle the inflight compilations first */
+    for (int i = 0; i < JIT_MAX_COMPILER_THREADS; i++) {
+        if (gDvmJit.inflightBaseAddr[i])
+            findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr[i],
+                                         callback);
+    }
 
     if (gDvmJit.pJitEntryTable != NULL) {
         unsigned int traceIdx;
@@ -1629,7 +1647,7 @@ void dvmJitScanAllClassPointers(void (*callback)(void *))
     }
     UPDATE_CODE_CACHE_PATCHES();
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 }
 
 /*
@@ -1653,7 +1671,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * thread if there is a pending request before the state is actually
      * changed to RUNNING.
      */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_RUNNING);
+    dvmChangeStatus(NULL, THREAD_RUNNING);
 
     /*
      * Unprotecting the code cache will need to acquire the code cache
@@ -1683,7 +1701,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * in the JIT table, its content can be patched if class objects are
      * moved.
      */
-    gDvmJit.inflightBaseAddr = base;
+    gDvmJit.inflightBaseAddr[dvmCompilerThreadIndex()] = base;
 
 #if defined(WITH_JIT_TUNING)
     u8 blockTime = dvmGetRelativeTimeUsec() - startTime;
@@ -1697,7 +1715,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
     PROTECT_CODE_CACHE(startClassPointerP, numClassPointers * sizeof(intptr_t));
 
     /* Change the thread state back to VMWAIT */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_VMWAIT);
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
 }
 
 #if defined(WITH_SELF_VERIFICATION)
@@ -374,8 +374,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -395,8 +397,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -420,8 +424,10 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
@@ -446,8 +452,10 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, 0);
@@ -3044,11 +3052,12 @@ static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
 /*
  * See the example of predicted inlining listed before the
  * genValidationForPredictedInline function. The function here takes care the
- * branch over at 0x4858de78 and the misprediction target at 0x4858de7a.
+ * branch over at 0x4858de78 and the misprediction target at 0x4858de7a, for
+ * the guard described by "callsiteInfo".
  */
-static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
-                                               BasicBlock *bb,
-                                               MipsLIR *labelList)
+static void genMispredictionTarget(CompilationUnit *cUnit,
+                                   CallsiteInfo *callsiteInfo,
+                                   BasicBlock *bb, MipsLIR *labelList)
 {
     BasicBlock *fallThrough = bb->fallThrough;
 
@@ -3065,11 +3074,23 @@ static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
     dvmCompilerClobberAllRegs(cUnit);
     dvmCompilerResetNullCheck(cUnit);
 
-    /* Target for the slow invoke path */
+    /* Target for the next guard or the slow invoke path */
     MipsLIR *target = newLIR0(cUnit, kMipsPseudoTargetLabel);
     target->defMask = ENCODE_ALL;
     /* Hook up the target to the verification branch */
-    mir->meta.callsiteInfo->misPredBranchOver->target = (LIR *) target;
+    callsiteInfo->misPredBranchOver->target = (LIR *) target;
+}
+
+/* The slow invoke is reached once the guard of the last target has failed */
+static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
+                                               BasicBlock *bb,
+                                               MipsLIR *labelList)
+{
+    CallsiteInfo *lastTarget = mir->meta.callsiteInfo;
+
+    while (lastTarget->nextTarget != NULL)
+        lastTarget = lastTarget->nextTarget;
+    genMispredictionTarget(cUnit, lastTarget, bb, labelList);
 }
 
 static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
@@ -3910,7 +3931,8 @@ static void handleInvokeSingletonChainingCell(CompilationUnit *cUnit,
 }
 
 /* Chaining cell for monomorphic method invocations. */
-static void handleInvokePredictedChainingCell(CompilationUnit *cUnit)
+static void handleInvokePredictedChainingCell(CompilationUnit *cUnit,
+                                              unsigned int offset)
 {
     /* Should not be executed in the initial state */
     addWordData(cUnit, NULL, PREDICTED_CHAIN_BX_PAIR_INIT);
@@ -3925,6 +3947,8 @@ static void handleInvokePredictedChainingCell(CompilationUnit *cUnit)
      * the first invocation of this callsite.
      */
     addWordData(cUnit, NULL, PREDICTED_CHAIN_COUNTER_INIT);
+    /* Dalvik PC of the invoke, for the call site profile */
+    addWordData(cUnit, NULL, (int) (cUnit->method->insns + offset));
 }
 
 /* Load the Dalvik PC into a0 and jump to the specified target */
@@ -3959,6 +3983,8 @@ static const char *extendedMIROpNames[kMirOpLast - kMirOpFirst] = {
     "kMirOpLowerBound",
     "kMirOpPunt",
     "kMirOpCheckInlinePrediction",
+    "kMirOpNullCheck",
+    "kMirOpVectorLoop",
 };
 
 /*
@@ -4070,6 +4096,20 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
                    (MipsLIR *) cUnit->loopAnalysis->branchToPCR);
 }
 
+/*
+ * vA = objReg;
+ */
+static void genHoistedNullCheck(CompilationUnit *cUnit, MIR *mir)
+{
+    RegLocation rlObj = cUnit->regLocation[mir->dalvikInsn.vA];
+
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+
+    /* Punt if "objReg != NULL" is false */
+    genRegImmCheck(cUnit, kMipsCondEq, rlObj.lowReg, 0, 0,
+                   (MipsLIR *) cUnit->loopAnalysis->branchToPCR);
+}
+
 /*
  * vC = this
  *
@@ -4171,9 +4211,20 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
  * D/dalvikvm( 2377): 0x2f130e30 (012c):  data     0x0000(0)
  * D/dalvikvm( 2377): 0x2f130e34 (0130):  data     0x0000(0)
  */
-static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
+static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir,
+                                            BasicBlock *bb,
+                                            MipsLIR *labelList)
 {
     CallsiteInfo *callsiteInfo = mir->meta.callsiteInfo;
+
+    /*
+     * Another target of the same call site is inlined right before this
+     * one.  Its body ends here, and its guard lands here on a misprediction.
+     */
+    if (callsiteInfo->prevTarget != NULL) {
+        genMispredictionTarget(cUnit, callsiteInfo->prevTarget, bb, labelList);
+    }
+
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
@@ -4183,16 +4234,41 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
                  NULL);/* null object? */
     int regActualClass = dvmCompilerAllocTemp(cUnit);
     loadWordDisp(cUnit, rlThis.lowReg, offsetof(Object, clazz), regActualClass);
+
+    /* Other receiver classes known to reach the inlined callee */
+    MipsLIR *polyHits[JIT_POLY_IC_SIZE];
+    int numPolyHits = 0;
+    if (callsiteInfo->polyNext != NULL) {
+        int regPolyClass = dvmCompilerAllocTemp(cUnit);
+        CallsiteInfo *polyInfo;
+        for (polyInfo = callsiteInfo->polyNext;
+             polyInfo != NULL && numPolyHits < JIT_POLY_IC_SIZE;
+             polyInfo = polyInfo->polyNext) {
+            loadClassPointer(cUnit, regPolyClass, (int) polyInfo);
+            polyHits[numPolyHits++] =
+                opCompareBranch(cUnit, kMipsBeq, regPolyClass, regActualClass);
+        }
+    }
+
 //    opRegReg(cUnit, kOpCmp, regPredictedClass, regActualClass);
     /*
      * Set the misPredBranchOver target so that it will be generated when the
      * code for the non-optimized invoke is generated.
      */
     callsiteInfo->misPredBranchOver = (LIR *) opCompareBranch(cUnit, kMipsBne, regPredictedClass, regActualClass);
+
+    if (numPolyHits != 0) {
+        MipsLIR *inlinedLabel = newLIR0(cUnit, kMipsPseudoTargetLabel);
+        inlinedLabel->defMask = ENCODE_ALL;
+        for (int i = 0; i < numPolyHits; i++) {
+            polyHits[i]->generic.target = (LIR *) inlinedLabel;
+        }
+    }
 }
 
 /* Extended MIR instructions like PHI */
-static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
+static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir,
+                              BasicBlock *bb, MipsLIR *labelList)
 {
     int opOffset = mir->dalvikInsn.opcode - kMirOpFirst;
     char *msg = (char *)dvmCompilerNew(strlen(extendedMIROpNames[opOffset]) + 1,
@@ -4224,7 +4300,11 @@ static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
             break;
         }
         case kMirOpCheckInlinePrediction: {
-            genValidationForPredictedInline(cUnit, mir);
+            genValidationForPredictedInline(cUnit, mir, bb, labelList);
+            break;
+        }
+        case kMirOpNullCheck: {
+            genHoistedNullCheck(cUnit, mir);
             break;
         }
         default:
@@ -4451,7 +4531,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
                 }
 
                 if ((int)mir->dalvikInsn.opcode >= (int)kMirOpFirst) {
-                    handleExtendedMIR(cUnit, mir);
+                    handleExtendedMIR(cUnit, mir, bb, labelList);
                     continue;
                 }
 
@@ -4660,7 +4740,8 @@ gen_fallthrough:
                         chainingBlock->containingMethod);
                     break;
                 case kChainingCellInvokePredicted:
-                    handleInvokePredictedChainingCell(cUnit);
+                    handleInvokePredictedChainingCell(cUnit,
+                        chainingBlock->startOffset);
                     break;
                 case kChainingCellHot:
                     handleHotChainingCell(cUnit, chainingBlock->startOffset);
@@ -638,7 +638,7 @@ typedef struct MipsLIR {
 #define IS_SIMM16_2WORD(v) ((-32764 <= (v)) && ((v) <= 32763)) /* 2 offsets must fit */
 
 #define CHAIN_CELL_NORMAL_SIZE    16
-#define CHAIN_CELL_PREDICTED_SIZE 20
+#define CHAIN_CELL_PREDICTED_SIZE 24
 
 
 #endif  // DALVIK_VM_COMPILER_CODEGEN_MIPS_MIPSLIR_H_
@@ -675,7 +675,7 @@ int collectInfoOfBasicBlock(Method* method, BasicBlock_O1* bb) {
 #else
         if(mir->dalvikInsn.opcode >= kNumPackedOpcodes) continue;
 #endif
-        inst = FETCH(0);
+        inst = fetchMIRInst(mir);
         u2 inst_op = INST_INST(inst);
         /* update bb->hasAccessToGlue */
         if((inst_op >= OP_MOVE_RESULT && inst_op <= OP_RETURN_OBJECT) ||
@@ -785,7 +785,7 @@ int codeGenBasicBlock(const Method* method, BasicBlock_O1* bb) {
             continue;
         }
 
-        inst = FETCH(0);
+        inst = fetchMIRInst(mir);
         //before handling a bytecode, import info of temporary registers to compileTable including refCount
         num_temp_regs_per_bytecode = getTempRegInfo(infoByteCodeTemp);
         for(k = 0; k < num_temp_regs_per_bytecode; k++) {
@@ -856,8 +856,7 @@ int codeGenBasicBlock(const Method* method, BasicBlock_O1* bb) {
             if(isCurrentByteCodeJump()) lastByteCodeIsJump = true;
             //lowerByteCode will call globalVREndOfBB if it is jump
             int retCode = lowerByteCodeJit(method, rPC, mir);
-            if(gDvmJit.codeCacheByteUsed + (stream - streamStart) +
-                 CODE_CACHE_PADDING > gDvmJit.codeCacheSize) {
+            if(stream > streamEnd) {
                  ALOGE("JIT code cache full");
                  gDvmJit.codeCacheFull = true;
                  return -1;
@@ -3156,7 +3155,7 @@ void getDeadStmts() {
 #ifdef DEBUG_DSE
         ALOGI("DSE: offsetPC %x", offsetPC);
 #endif
-        inst = FETCH(0);
+        inst = fetchMIRInst(mir);
         bool isDeadStmt = true;
         getVirtualRegInfo(infoByteCode);
         u2 inst_op = INST_INST(inst);
@@ -3704,6 +3703,7 @@ int beforeCall(const char* target) { //spill all live registers
 
     /* these functions use %eax for the return value */
     if((!strcmp(target, "dvmInstanceofNonTrivial")) ||
+       (!strcmp(target, "dvmJitInstanceofAndCache")) ||
        (!strcmp(target, "dvmUnlockObject")) ||
        (!strcmp(target, "dvmAllocObject")) ||
        (!strcmp(target, "dvmAllocArrayByClass")) ||
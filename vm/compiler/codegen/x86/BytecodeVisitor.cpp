@@ -1468,6 +1468,7 @@ int getVirtualRegInfo(VirtualRegInfo* infoArray) {
         infoArray[0].refCount = 1;
         infoArray[0].accessType = REGACCESS_U;
         infoArray[0].physicalType = LowOpndRegType_gp;
+        updateCurrentBBWithConstraints(PhysicalReg_EAX); //eax is the cmpxchg comparand
         num_regs_per_bytecode = 1;
         break;
     case OP_MONITOR_EXIT:
@@ -3195,8 +3196,81 @@ int updateReturnCommon(TempRegInfo* infoArray) {
     return numTmps;
 }
 
+/* update temporaries used by CHECK_CAST & INSTANCE_OF
+   they depend on whether the class is resolved, in a display or cached */
+int updateCheckCast(TempRegInfo* infoArray, bool instance) {
+    TypeCheckLowering lowering;
+    getTypeCheckLowering((u4)FETCH(1), &lowering);
+    int numTmps = 0;
+    infoArray[numTmps].regNum = 1;
+    infoArray[numTmps].refCount = 4; //DU
+    infoArray[numTmps].physicalType = LowOpndRegType_gp;
+    numTmps++;
+    if(instance) {
+        infoArray[numTmps].regNum = 3;
+        infoArray[numTmps].refCount = 4; //DU
+        infoArray[numTmps].physicalType = LowOpndRegType_gp;
+        numTmps++;
+    }
+    infoArray[numTmps].regNum = 6; //object->clazz
+    infoArray[numTmps].refCount = 3; //DU
+    if(lowering.site != NULL)
+        infoArray[numTmps].refCount += JIT_TYPE_CHECK_IC_SIZE;
+    infoArray[numTmps].physicalType = LowOpndRegType_gp;
+    numTmps++;
+
+    infoArray[numTmps].regNum = 1;
+    infoArray[numTmps].refCount = 2; //DU
+    infoArray[numTmps].physicalType = LowOpndRegType_scratch;
+    numTmps++;
+    infoArray[numTmps].regNum = 2;
+    infoArray[numTmps].refCount = 2; //DU
+    infoArray[numTmps].physicalType = LowOpndRegType_scratch;
+    numTmps++;
+
+    /* the first live range of %eax holds the resolved class
+       1> 6 accesses if it has to be resolved by calling class_resolve
+       2> 3 accesses if the class is a constant
+       the call to dvmInstanceofNonTrivial starts a new version, as does
+       moving the object to %eax to throw ClassCastException */
+    infoArray[numTmps].regNum = PhysicalReg_EAX;
+    infoArray[numTmps].refCount = lowering.classPtr == NULL ? 6 : 3;
+    infoArray[numTmps].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+    numTmps++;
+    if(!instance) {
+        infoArray[numTmps].regNum = PhysicalReg_ECX;
+        infoArray[numTmps].refCount = 1;
+        infoArray[numTmps].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        numTmps++;
+    }
+    if(lowering.classPtr == NULL) {
+        infoArray[numTmps].regNum = 4; //resolved classes
+        infoArray[numTmps].refCount = 2; //DU
+        infoArray[numTmps].physicalType = LowOpndRegType_gp;
+        numTmps++;
+        infoArray[numTmps].regNum = PhysicalReg_EDX;
+        infoArray[numTmps].refCount = 2; //export_pc for class_resolve
+        infoArray[numTmps].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        numTmps++;
+    }
+    if(lowering.displayOffset < 0) {
+        infoArray[numTmps].regNum = 3; //call to dvmInstanceofNonTrivial
+        infoArray[numTmps].refCount = 2; //DU
+        infoArray[numTmps].physicalType = LowOpndRegType_scratch;
+        numTmps++;
+    }
+    if(lowering.site != NULL) {
+        infoArray[numTmps].regNum = 5; //inline cache
+        infoArray[numTmps].refCount = 1+JIT_TYPE_CHECK_IC_SIZE; //DU
+        infoArray[numTmps].physicalType = LowOpndRegType_gp;
+        numTmps++;
+    }
+    return numTmps;
+}
+
 /* update temporaries used by predicted INVOKE_VIRTUAL & INVOKE_INTERFACE */
 int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
+    int numTmps;
     infoArray[0].regNum = 40;
     infoArray[0].physicalType = LowOpndRegType_gp;
     infoArray[1].regNum = 41;
@@ -3241,11 +3315,10 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
         infoArray[13].regNum = 7;
         infoArray[13].refCount = 4;
         infoArray[13].physicalType = LowOpndRegType_scratch;
-        return 14;
+        numTmps = 14;
     } else { //virtual or virtual_quick
         infoArray[0].refCount = 2+2;
-        infoArray[1].refCount = 3+2-2; //for temp41, -2 for gingerbread
-        infoArray[2].refCount++; //for temp32 gingerbread
+        infoArray[1].refCount = 3+2-2+1; //for temp41, -2 for gingerbread, +1 for the last entry's clazz
         infoArray[3].regNum = 33;
         infoArray[3].refCount = 4+1;
         infoArray[3].physicalType = LowOpndRegType_gp;
@@ -3273,8 +3346,25 @@ int updateGenPrediction(TempRegInfo* infoArray, bool isInterface) {
         infoArray[11].regNum = 7;
         infoArray[11].refCount = 4;
         infoArray[11].physicalType = LowOpndRegType_scratch;
-        return 12;
+        infoArray[12].regNum = 45;
+        infoArray[12].refCount = 2;
+        infoArray[12].physicalType = LowOpndRegType_gp;
+        numTmps = 13;
     }
+    /* probing the other inline cache entries:
+       temp40 is compared and temp41 conditionally moved once per entry,
+       temp41 is also copied to temp46 and passed to .invokeArgsDone_normal */
+    infoArray[0].refCount += JIT_POLY_IC_SIZE-1;
+    infoArray[1].refCount += JIT_POLY_IC_SIZE+1;
+    infoArray[numTmps].regNum = 46;
+    infoArray[numTmps].refCount = 1+2*(JIT_POLY_IC_SIZE-1);
+    infoArray[numTmps].physicalType = LowOpndRegType_gp;
+    numTmps++;
+    infoArray[numTmps].regNum = 47;
+    infoArray[numTmps].refCount = 2*(JIT_POLY_IC_SIZE-1);
+    infoArray[numTmps].physicalType = LowOpndRegType_gp;
+    numTmps++;
+    return numTmps;
 }
 
 int updateMarkCard(TempRegInfo* infoArray, int j1/*valReg*/,
@@ -3417,10 +3507,10 @@ int getTempRegInfo(TempRegInfo* infoArray) { //returns an array of TempRegInfo
 
     case OP_MONITOR_ENTER:
         infoArray[0].regNum = 1;
-        infoArray[0].refCount = 3; //DU
+        infoArray[0].refCount = 6; //DU
         infoArray[0].physicalType = LowOpndRegType_gp;
         infoArray[1].regNum = 3;
-        infoArray[1].refCount = 2; //DU
+        infoArray[1].refCount = 3; //DU
         infoArray[1].physicalType = LowOpndRegType_gp;
         infoArray[2].regNum = 1;
         infoArray[2].refCount = 2; //DU
@@ -3431,13 +3521,22 @@ int getTempRegInfo(TempRegInfo* infoArray) { //returns an array of TempRegInfo
         infoArray[4].regNum = PhysicalReg_EDX;
         infoArray[4].refCount = 2;
         infoArray[4].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        return 5;
+        infoArray[5].regNum = 2; //owner field
+        infoArray[5].refCount = 4; //DU
+        infoArray[5].physicalType = LowOpndRegType_gp;
+        infoArray[6].regNum = 4; //new lock word
+        infoArray[6].refCount = 8; //DU
+        infoArray[6].physicalType = LowOpndRegType_gp;
+        infoArray[7].regNum = PhysicalReg_EAX;
+        infoArray[7].refCount = 4; //DU
+        infoArray[7].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        return 8;
     case OP_MONITOR_EXIT:
         infoArray[0].regNum = 1;
-        infoArray[0].refCount = 3; //DU
+        infoArray[0].refCount = 6; //DU
         infoArray[0].physicalType = LowOpndRegType_gp;
         infoArray[1].regNum = PhysicalReg_EAX;
-        infoArray[1].refCount = 2; //DU
+        infoArray[1].refCount = 6; //DU
         infoArray[1].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[2].regNum = 1;
         infoArray[2].refCount = 2; //DU
@@ -3451,75 +3550,20 @@ int getTempRegInfo(TempRegInfo* infoArray) { //returns an array of TempRegInfo
         infoArray[5].regNum = 3;
         infoArray[5].refCount = 2; //DU
         infoArray[5].physicalType = LowOpndRegType_scratch;
-        return 6;
-    case OP_CHECK_CAST:
-        infoArray[0].regNum = 1;
-        infoArray[0].refCount = 4; //DU
-        infoArray[0].physicalType = LowOpndRegType_gp;
-        infoArray[1].regNum = 4;
-        infoArray[1].refCount = 2; //DU
-        infoArray[1].physicalType = LowOpndRegType_gp;
-        infoArray[2].regNum = 6;
-        infoArray[2].refCount = 3; //DU
-        infoArray[2].physicalType = LowOpndRegType_gp;
-
-        infoArray[3].regNum = 1;
-        infoArray[3].refCount = 2; //DU
-        infoArray[3].physicalType = LowOpndRegType_scratch;
-        infoArray[4].regNum = 2;
-        infoArray[4].refCount = 2; //DU
-        infoArray[4].physicalType = LowOpndRegType_scratch;
-
-        infoArray[5].regNum = PhysicalReg_EAX;
-        /* %eax has 3 live ranges
-           1> 5 accesses: to resolve the class object
-           2> call dvmInstanceofNonTrivial to define %eax, then use it once
-           3> move exception object to %eax, then jump to throw_exception
-           if WITH_JIT is true, the first live range has 6 accesses
-        */
-        infoArray[5].refCount = 6;
-        infoArray[5].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        infoArray[6].regNum = PhysicalReg_EDX;
-        infoArray[6].refCount = 2; //export_pc
-        infoArray[6].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        infoArray[7].regNum = PhysicalReg_ECX;
-        infoArray[7].refCount = 1;
-        infoArray[7].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        infoArray[8].regNum = 3;
-        infoArray[8].refCount = 2; //DU
-        infoArray[8].physicalType = LowOpndRegType_scratch;
-        return 9;
-    case OP_INSTANCE_OF:
-        infoArray[0].regNum = 1;
-        infoArray[0].refCount = 4; //DU
-        infoArray[0].physicalType = LowOpndRegType_gp;
-        infoArray[1].regNum = 3;
-        infoArray[1].refCount = 4; //DU
-        infoArray[1].physicalType = LowOpndRegType_gp;
-        infoArray[2].regNum = 4;
-        infoArray[2].refCount = 2; //DU
-        infoArray[2].physicalType = LowOpndRegType_gp;
-        infoArray[3].regNum = 6;
-        infoArray[3].refCount = 3; //DU
-        infoArray[3].physicalType = LowOpndRegType_gp;
-
-        infoArray[4].regNum = 1;
-        infoArray[4].refCount = 2; //DU
-        infoArray[4].physicalType = LowOpndRegType_scratch;
-        infoArray[5].regNum = 2;
-        infoArray[5].refCount = 2; //DU
-        infoArray[5].physicalType = LowOpndRegType_scratch;
-
-        infoArray[6].regNum = PhysicalReg_EAX;
-        infoArray[6].refCount = 6;
-        infoArray[6].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        infoArray[7].regNum = 3;
+        infoArray[6].regNum = 2; //owner field
+        infoArray[6].refCount = 3; //DU
+        infoArray[6].physicalType = LowOpndRegType_gp;
+        infoArray[7].regNum = 3; //self
         infoArray[7].refCount = 2; //DU
-        infoArray[7].physicalType = LowOpndRegType_scratch;
-        infoArray[8].regNum = PhysicalReg_EDX;
-        infoArray[8].refCount = 2; //export_pc for class_resolve
-        infoArray[8].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        infoArray[7].physicalType = LowOpndRegType_gp;
+        infoArray[8].regNum = 4; //lock word
+        infoArray[8].refCount = 4; //DU
+        infoArray[8].physicalType = LowOpndRegType_gp;
         return 9;
+    case OP_CHECK_CAST:
+        return updateCheckCast(infoArray, false);
+    case OP_INSTANCE_OF:
+        return updateCheckCast(infoArray, true);
 
     case OP_ARRAY_LENGTH:
         vA = INST_A(inst);
@@ -3536,73 +3580,75 @@ int getTempRegInfo(TempRegInfo* infoArray) { //returns an array of TempRegInfo
         return 3;
     case OP_NEW_INSTANCE:
         infoArray[0].regNum = PhysicalReg_EAX;
-        //6: class object
+        //2: chunk from the allocation cache
         //3: defined by C function, used twice
-        infoArray[0].refCount = 6; //next version has 3 references
+        infoArray[0].refCount = 5; //next version has 3 references
         infoArray[0].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[1].regNum = PhysicalReg_ECX; //before common_throw_message
         infoArray[1].refCount = 1;
         infoArray[1].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
 
-        infoArray[2].regNum = 3;
-        infoArray[2].refCount = 2; //DU
+        infoArray[2].regNum = 3; //self
+        infoArray[2].refCount = 5; //DU
         infoArray[2].physicalType = LowOpndRegType_gp;
-        infoArray[3].regNum = 5;
-        infoArray[3].refCount = 2; //DU
+        infoArray[3].regNum = 6; //cache top
+        infoArray[3].refCount = 3; //DU
         infoArray[3].physicalType = LowOpndRegType_gp;
-        infoArray[3].is8Bit = true;
-        infoArray[4].regNum = 6;
-        infoArray[4].refCount = 2; //DU
-        infoArray[4].physicalType = LowOpndRegType_gp;
 
-        infoArray[5].regNum = 1;
+        infoArray[4].regNum = 1;
+        infoArray[4].refCount = 2; //DU
+        infoArray[4].physicalType = LowOpndRegType_scratch;
+        infoArray[5].regNum = 2;
         infoArray[5].refCount = 2; //DU
         infoArray[5].physicalType = LowOpndRegType_scratch;
-        infoArray[6].regNum = 2;
+        infoArray[6].regNum = 3;
         infoArray[6].refCount = 2; //DU
         infoArray[6].physicalType = LowOpndRegType_scratch;
-        infoArray[7].regNum = 3;
-        infoArray[7].refCount = 2; //DU
-        infoArray[7].physicalType = LowOpndRegType_scratch;
 
-        infoArray[8].regNum = PhysicalReg_EDX; //before common_throw_message
-        infoArray[8].refCount = 2;
-        infoArray[8].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
-        infoArray[9].regNum = 4;
-        infoArray[9].refCount = 2; //DU
-        infoArray[9].physicalType = LowOpndRegType_scratch;
-        return 10;
+        infoArray[7].regNum = PhysicalReg_EDX; //before common_throw_message
+        infoArray[7].refCount = 2;
+        infoArray[7].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
+        infoArray[8].regNum = 4;
+        infoArray[8].refCount = 2; //DU
+        infoArray[8].physicalType = LowOpndRegType_scratch;
+        return 9;
 
     case OP_NEW_ARRAY:
         infoArray[0].regNum = PhysicalReg_EAX;
-        //4: class object
+        //3: chunk from the allocation cache
         //3: defined by C function, used twice
-        infoArray[0].refCount = 4; //next version has 3 references
+        infoArray[0].refCount = 6; //next version has 3 references
         infoArray[0].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
         infoArray[1].regNum = PhysicalReg_EDX; //before common_throw_message
         infoArray[1].refCount = 2;
         infoArray[1].physicalType = LowOpndRegType_gp | LowOpndRegType_hard;
 
-        infoArray[2].regNum = 3;
-        infoArray[2].refCount = 2; //DU
+        infoArray[2].regNum = 3; //self
+        infoArray[2].refCount = 5; //DU
         infoArray[2].physicalType = LowOpndRegType_gp;
-        infoArray[3].regNum = 5;
-        infoArray[3].refCount = 3; //DU
+        infoArray[3].regNum = 5; //length
+        infoArray[3].refCount = 6; //DU
         infoArray[3].physicalType = LowOpndRegType_gp;
+        infoArray[4].regNum = 4; //chunk size
+        infoArray[4].refCount = 4; //DU
+        infoArray[4].physicalType = LowOpndRegType_gp;
+        infoArray[5].regNum = 6; //cache top
+        infoArray[5].refCount = 3; //DU
+        infoArray[5].physicalType = LowOpndRegType_gp;
 
-        infoArray[4].regNum = 1;
-        infoArray[4].refCount = 2; //DU
-        infoArray[4].physicalType = LowOpndRegType_scratch;
-        infoArray[5].regNum = 2;
-        infoArray[5].refCount = 2; //DU
-        infoArray[5].physicalType = LowOpndRegType_scratch;
-        infoArray[6].regNum = 3;
+        infoArray[6].regNum = 1;
         infoArray[6].refCount = 2; //DU
         infoArray[6].physicalType = LowOpndRegType_scratch;
-        infoArray[7].regNum = 4;
+        infoArray[7].regNum = 2;
         infoArray[7].refCount = 2; //DU
         infoArray[7].physicalType = LowOpndRegType_scratch;
-        return 8;
+        infoArray[8].regNum = 3;
+        infoArray[8].refCount = 2; //DU
+        infoArray[8].physicalType = LowOpndRegType_scratch;
+        infoArray[9].regNum = 4;
+        infoArray[9].refCount = 2; //DU
+        infoArray[9].physicalType = LowOpndRegType_scratch;
+        return 10;
 
     case OP_FILLED_NEW_ARRAY:
         length = INST_B(inst);
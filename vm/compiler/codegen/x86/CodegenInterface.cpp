@@ -95,7 +95,7 @@ void dvmCompilerPatchInlineCache(void)
      */
     dvmLockMutex(&gDvmJit.compilerICPatchLock);
 
-    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     //ALOGD("Number of IC patch work orders: %d", gDvmJit.compilerICPatchIndex);
 
@@ -138,7 +138,7 @@ void dvmCompilerPatchInlineCache(void)
         maxAddr = (cellAddr > maxAddr) ? cellAddr : maxAddr;
     }
 
-    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
     gDvmJit.compilerICPatchIndex = 0;
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
@@ -417,6 +417,21 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
                                           const ClassObject *clazz)
 {
     int newRechainCount = PREDICTED_CHAIN_COUNTER_RECHAIN;
+
+    dvmCompilerRecordCallSite(cell->siteDalvikPC, clazz, method);
+
+    /*
+     * "cell" is the first entry of the call site's polymorphic inline cache.
+     * Entries are filled in order; once they are all taken the first one is
+     * replaced, as a monomorphic cache would be.
+     */
+    for (int i = 0; i < JIT_POLY_IC_SIZE; i++) {
+        if (cell[i].clazz == NULL) {
+            cell = &cell[i];
+            break;
+        }
+    }
+
     /* Don't come back here for a long time if the method is native */
     if (dvmIsNativeMethod(method)) {
         UNPROTECT_CODE_CACHE(cell, sizeof(*cell));
@@ -468,6 +483,8 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
 
     newCell.clazz = clazz;
     newCell.method = method;
+    newCell.stagedClazz = NULL;
+    newCell.siteDalvikPC = cell->siteDalvikPC;
 
     /*
      * Enter the work order to the queue and the chaining cell will be patched
@@ -529,11 +546,11 @@ u4* dvmJitUnchain(void* codeAddr)
                call reg2
            Space occupied by the chaining cell in bytes: nop is for padding,
                 jump 0, the target 0 is 4 bytes aligned.
-           Space for predicted chaining: 5 words = 20 bytes
+           Space for predicted chaining: JIT_POLY_IC_SIZE cells of 6 words
         */
         int elemSize = 0;
         if (i == kChainingCellInvokePredicted) {
-            elemSize = 20;
+            elemSize = sizeof(PredictedChainingCell) * JIT_POLY_IC_SIZE;
         }
         COMPILER_TRACE_CHAINING(
             ALOGI("Jit Runtime: unchaining type %d count %d", i, pChainCellCounts->u.count[i]));
@@ -564,7 +581,9 @@ u4* dvmJitUnchain(void* codeAddr)
                      * method and branch but it is safe to clear the clazz,
                      * which serves as the key.
                      */
-                    predChainCell->clazz = PREDICTED_CHAIN_CLAZZ_INIT;
+                    for (int k = 0; k < JIT_POLY_IC_SIZE; k++) {
+                        predChainCell[k].clazz = PREDICTED_CHAIN_CLAZZ_INIT;
+                    }
                     break;
                 default:
                     ALOGE("Unexpected chaining type: %d", i);
@@ -586,7 +605,7 @@ void dvmJitUnchainAll()
         COMPILER_TRACE_CHAINING(ALOGI("Jit Runtime: unchaining all"));
         dvmLockMutex(&gDvmJit.tableLock);
 
-        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         for (size_t i = 0; i < gDvmJit.jitTableSize; i++) {
             if (gDvmJit.pJitEntryTable[i].dPC &&
@@ -596,7 +615,7 @@ void dvmJitUnchainAll()
             }
         }
 
-        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+        PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheHighMark);
 
         dvmUnlockMutex(&gDvmJit.tableLock);
         gDvmJit.translationChains = 0;
@@ -667,6 +686,24 @@ static void handleHotChainingCell(CompilationUnit *cUnit,
     //move_imm_to_reg(OpndSize_32, (int) (cUnit->method->insns + offset), P_GPR_1, true); /* used when unchaining */
 }
 
+/*
+ * Return the code offset of the block of a whole-method trace that starts at
+ * Dalvik offset "offset", or -1 if it isn't in the translation.
+ */
+static int findLoopHeadLabel(CompilationUnit *cUnit, unsigned int offset,
+                             LowOpBlockLabel* labelList)
+{
+    GrowableList *blockList = &cUnit->blockList;
+    for (unsigned int i = 0; i < blockList->numUsed; i++) {
+        BasicBlock *bb = (BasicBlock *) blockList->elemList[i];
+        if (bb->blockType == kDalvikByteCode && bb->firstMIRInsn != NULL &&
+            bb->startOffset == offset) {
+            return labelList[i].lop.generic.offset;
+        }
+    }
+    return -1;
+}
+
 /* Chaining cell for branches that branch back into the same basic block */
 static void handleBackwardBranchChainingCell(CompilationUnit *cUnit,
                                      unsigned int offset, int blockId, LowOpBlockLabel* labelList)
@@ -680,6 +717,16 @@ static void handleBackwardBranchChainingCell(CompilationUnit *cUnit,
      * reslove the multithreading issue.
      */
     insertJumpHelp();
+    /*
+     * A whole-method trace has the loop head in this translation: chain to
+     * it right away.  Unchaining still resets the jump to leave here.
+     */
+    int headOffset = cUnit->jitMode == kJitMethod ?
+        findLoopHeadLabel(cUnit, offset, labelList) : -1;
+    if (headOffset >= 0) {
+        *((int *) stream - 1) = (streamMethodStart + headOffset) - stream;
+        gDvmJit.hasNewChain = true;
+    }
     move_imm_to_reg(OpndSize_32, (int) (cUnit->method->insns + offset), P_GPR_1, true);
     scratchRegs[0] = PhysicalReg_EAX;
     call_dvmJitToInterpNormal();
@@ -706,8 +753,12 @@ static void handleInvokeSingletonChainingCell(CompilationUnit *cUnit,
 }
 #undef P_GPR_1
 
-/* Chaining cell for monomorphic method invocations. */
-static void handleInvokePredictedChainingCell(CompilationUnit *cUnit, int blockId)
+/*
+ * Polymorphic inline cache for virtual and interface invocations: a row of
+ * JIT_POLY_IC_SIZE predicted chaining cells, one per receiver class.
+ */
+static void handleInvokePredictedChainingCell(CompilationUnit *cUnit,
+                                              unsigned int offset, int blockId)
 {
     if(dump_x86_inst)
         ALOGI("LOWER InvokePredictedChainingCell at block %d offsetNCG %x @%p",
@@ -720,24 +771,28 @@ static void handleInvokePredictedChainingCell(CompilationUnit *cUnit, int blockI
     /* make sure section for predicited chaining cell is 4-byte aligned */
     //int padding = (4 - ((u4)stream & 3)) & 3;
     //stream += padding;
-    int* streamData = (int*)stream;
-    /* Should not be executed in the initial state */
-    streamData[0] = PREDICTED_CHAIN_BX_PAIR_INIT;
-    streamData[1] = 0;
-    /* To be filled: class */
-    streamData[2] = PREDICTED_CHAIN_CLAZZ_INIT;
-    /* To be filled: method */
-    streamData[3] = PREDICTED_CHAIN_METHOD_INIT;
-    /*
-     * Rechain count. The initial value of 0 here will trigger chaining upon
-     * the first invocation of this callsite.
-     */
-    streamData[4] = PREDICTED_CHAIN_COUNTER_INIT;
+    for (int k = 0; k < JIT_POLY_IC_SIZE; k++) {
+        int* streamData = (int*)stream;
+        /* Should not be executed in the initial state */
+        streamData[0] = PREDICTED_CHAIN_BX_PAIR_INIT;
+        streamData[1] = 0;
+        /* To be filled: class */
+        streamData[2] = PREDICTED_CHAIN_CLAZZ_INIT;
+        /* To be filled: method */
+        streamData[3] = PREDICTED_CHAIN_METHOD_INIT;
+        /*
+         * Rechain count. The initial value of 0 here will trigger chaining upon
+         * the first invocation of this callsite.
+         */
+        streamData[4] = PREDICTED_CHAIN_COUNTER_INIT;
+        /* Dalvik PC of the invoke, for the call site profile */
+        streamData[5] = (int) (cUnit->method->insns + offset);
 #if 0
-    ALOGI("--- DATA @ %p: %x %x %x %x", stream, *((int*)stream), *((int*)(stream+4)),
-          *((int*)(stream+8)), *((int*)(stream+12)));
+        ALOGI("--- DATA @ %p: %x %x %x %x", stream, *((int*)stream), *((int*)(stream+4)),
+              *((int*)(stream+8)), *((int*)(stream+12)));
 #endif
-    stream += 20; //5 *4
+        stream += sizeof(PredictedChainingCell); //6 *4
+    }
 #endif
 }
 
@@ -855,8 +910,167 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
     compare_imm_reg(OpndSize_32, -minC, P_GPR_1, true);
     condJumpToBasicBlock(stream, Condition_C, cUnit->exceptionBlockId);
 }
+
+/*
+ * vA = objReg;
+ */
+static void genHoistedNullCheck(CompilationUnit *cUnit, MIR *mir)
+{
+    get_virtual_reg(mir->dalvikInsn.vA, OpndSize_32, P_GPR_1, true); //object
+    export_pc();
+    compare_imm_reg(OpndSize_32, 0, P_GPR_1, true);
+    condJumpToBasicBlock(stream, Condition_E, cUnit->exceptionBlockId);
+}
 #undef P_GPR_1
 
+/* SSE2 instruction for a lane-wise op on "elemSize"-byte lanes */
+static Mnemonic getVectorMnemonic(VectorOpKind kind, int elemSize)
+{
+    switch (kind) {
+        case kVectorAdd:
+            return elemSize == 1 ? Mnemonic_PADDB :
+                   elemSize == 2 ? Mnemonic_PADDW : Mnemonic_PADDD;
+        case kVectorSub:
+            return elemSize == 1 ? Mnemonic_PSUBB :
+                   elemSize == 2 ? Mnemonic_PSUBW : Mnemonic_PSUBD;
+        case kVectorAnd:        return Mnemonic_PAND;
+        case kVectorOr:         return Mnemonic_POR;
+        case kVectorXor:        return Mnemonic_PXOR;
+        case kVectorShl:        return Mnemonic_PSLLD;
+        case kVectorShr:        return Mnemonic_PSRAD;
+        case kVectorUshr:       return Mnemonic_PSRLD;
+        case kVectorAddFloat:   return Mnemonic_ADDPS;
+        case kVectorSubFloat:   return Mnemonic_SUBPS;
+        case kVectorMulFloat:   return Mnemonic_MULPS;
+        case kVectorDivFloat:   return Mnemonic_DIVPS;
+        default:                return Mnemonic_Null;
+    }
+}
+
+/* Copy EAX to every lane of "xmm" */
+static void broadcastToVector(int elemSize, int xmm)
+{
+    if (elemSize == 1) {
+        alu_binary_imm_reg(OpndSize_32, and_opc, 0xff, PhysicalReg_EAX, true);
+        alu_binary_imm_reg(OpndSize_32, imul_opc, 0x01010101, PhysicalReg_EAX, true);
+    } else if (elemSize == 2) {
+        alu_binary_imm_reg(OpndSize_32, and_opc, 0xffff, PhysicalReg_EAX, true);
+        alu_binary_imm_reg(OpndSize_32, imul_opc, 0x00010001, PhysicalReg_EAX, true);
+    }
+    move_gp_to_xmm(PhysicalReg_EAX, true, xmm, true);
+    alu_packed_binary_reg_reg(Mnemonic_PUNPCKLDQ, xmm, true, xmm, true);
+    alu_packed_binary_reg_reg(Mnemonic_PUNPCKLQDQ, xmm, true, xmm, true);
+}
+
+/*
+ * Vectorized prologue of a loop, see Vectorize.cpp.  Vector register k
+ * lives in XMMk and XMM7 is scratch; the counter is kept in ECX and the
+ * last counter value that starts a whole vector, plus one, in EDX.
+ */
+#define VECTOR_XMM(reg) (PhysicalReg_XMM0 + (reg))
+#define P_SCRATCH PhysicalReg_XMM7
+static void genVectorLoop(CompilationUnit *cUnit, MIR *mir)
+{
+    VectorLoopInfo *info = mir->meta.vectorLoopInfo;
+    const int elemSize = info->elemSize;
+    const int lanes = 16 / elemSize;
+    int i;
+
+    /* Leave at least one iteration to the scalar loop */
+    get_virtual_reg(info->ivReg, OpndSize_32, PhysicalReg_ECX, true);
+    get_virtual_reg(info->endReg, OpndSize_32, PhysicalReg_EDX, true);
+    alu_binary_imm_reg(OpndSize_32, sub_opc,
+                       lanes - (info->endInclusive ? 1 : 0),
+                       PhysicalReg_EDX, true);
+    compare_reg_reg(PhysicalReg_EDX, true, PhysicalReg_ECX, true);
+    conditional_jump(Condition_GE, ".vector_loop_done", true);
+
+    for (i = 0; i < info->numAliasChecks; i++) {
+        get_virtual_reg(info->aliasChecks[i][0], OpndSize_32, PhysicalReg_EAX, true);
+        compare_VR_reg(OpndSize_32, info->aliasChecks[i][1], PhysicalReg_EAX, true);
+        conditional_jump(Condition_E, ".vector_loop_done", true);
+    }
+
+    for (i = 0; i < info->numRegs; i++) {
+        VectorReg *reg = &info->regs[i];
+        if (reg->kind == kVectorInvariant) {
+            get_virtual_reg(reg->vReg, OpndSize_32, PhysicalReg_EAX, true);
+            broadcastToVector(elemSize, VECTOR_XMM(i));
+        } else if (reg->kind == kVectorConstant) {
+            move_imm_to_reg(OpndSize_32, reg->value, PhysicalReg_EAX, true);
+            broadcastToVector(elemSize, VECTOR_XMM(i));
+        } else if (reg->kind == kVectorSum) {
+            alu_packed_binary_reg_reg(Mnemonic_PXOR, VECTOR_XMM(i), true,
+                                      VECTOR_XMM(i), true);
+        }
+    }
+
+    insertLabel(".vector_loop", true);
+    for (i = 0; i < info->numOps; i++) {
+        VectorOp *op = &info->ops[i];
+        if (op->kind == kVectorLoad || op->kind == kVectorStore) {
+            get_virtual_reg(op->vReg, OpndSize_32, PhysicalReg_EAX, true);
+            load_effective_addr_scale(PhysicalReg_EAX, true, PhysicalReg_ECX, true,
+                                      elemSize, PhysicalReg_EBX, true);
+            int disp = offArrayObject_contents + op->imm * elemSize;
+            if (op->kind == kVectorLoad) {
+                move_dqu_mem_to_reg(disp, PhysicalReg_EBX, true,
+                                    VECTOR_XMM(op->dst), true);
+            } else {
+                move_dqu_reg_to_mem(VECTOR_XMM(op->src1), true,
+                                    disp, PhysicalReg_EBX, true);
+            }
+            continue;
+        }
+
+        Mnemonic m = getVectorMnemonic(op->kind, elemSize);
+        if (op->kind == kVectorShl || op->kind == kVectorShr ||
+            op->kind == kVectorUshr) {
+            if (op->dst != op->src1) {
+                alu_packed_binary_reg_reg(Mnemonic_MOVDQU, VECTOR_XMM(op->src1), true,
+                                          VECTOR_XMM(op->dst), true);
+            }
+            alu_packed_imm_reg(m, op->imm, VECTOR_XMM(op->dst), true);
+        } else if (op->dst == op->src1) {
+            alu_packed_binary_reg_reg(m, VECTOR_XMM(op->src2), true,
+                                      VECTOR_XMM(op->dst), true);
+        } else {
+            /* dst may be src2, so build the result in the scratch register */
+            alu_packed_binary_reg_reg(Mnemonic_MOVDQU, VECTOR_XMM(op->src1), true,
+                                      P_SCRATCH, true);
+            alu_packed_binary_reg_reg(m, VECTOR_XMM(op->src2), true,
+                                      P_SCRATCH, true);
+            alu_packed_binary_reg_reg(Mnemonic_MOVDQU, P_SCRATCH, true,
+                                      VECTOR_XMM(op->dst), true);
+        }
+    }
+    alu_binary_imm_reg(OpndSize_32, add_opc, lanes, PhysicalReg_ECX, true);
+    compare_reg_reg(PhysicalReg_EDX, true, PhysicalReg_ECX, true);
+    conditional_jump(Condition_L, ".vector_loop", true);
+
+    /* Hand the counter and the folded sums to the scalar loop */
+    set_virtual_reg(info->ivReg, OpndSize_32, PhysicalReg_ECX, true);
+    for (i = 0; i < info->numRegs; i++) {
+        if (info->regs[i].kind != kVectorSum) continue;
+        int xmm = VECTOR_XMM(i);
+        alu_packed_binary_reg_reg(Mnemonic_MOVDQU, xmm, true, P_SCRATCH, true);
+        alu_packed_imm_reg(Mnemonic_PSRLDQ, 8, P_SCRATCH, true);
+        alu_packed_binary_reg_reg(Mnemonic_PADDD, P_SCRATCH, true, xmm, true);
+        alu_packed_binary_reg_reg(Mnemonic_MOVDQU, xmm, true, P_SCRATCH, true);
+        alu_packed_imm_reg(Mnemonic_PSRLDQ, 4, P_SCRATCH, true);
+        alu_packed_binary_reg_reg(Mnemonic_PADDD, P_SCRATCH, true, xmm, true);
+        move_xmm_to_gp(xmm, true, PhysicalReg_EAX, true);
+        get_virtual_reg(info->regs[i].vReg, OpndSize_32, PhysicalReg_EBX, true);
+        alu_binary_reg_reg(OpndSize_32, add_opc, PhysicalReg_EAX, true,
+                           PhysicalReg_EBX, true);
+        set_virtual_reg(info->regs[i].vReg, OpndSize_32, PhysicalReg_EBX, true);
+    }
+    insertLabel(".vector_loop_done", true);
+    freeShortMap();
+}
+#undef VECTOR_XMM
+#undef P_SCRATCH
+
 #ifdef WITH_JIT_INLINING
 static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
 {
@@ -907,6 +1121,14 @@ void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
         case kMirOpPunt: {
             break;
         }
+        case kMirOpNullCheck: {
+            genHoistedNullCheck(cUnit, mir);
+            break;
+        }
+        case kMirOpVectorLoop: {
+            genVectorLoop(cUnit, mir);
+            break;
+        }
 #ifdef WITH_JIT_INLINING
         case kMirOpCheckInlinePrediction: { //handled in ncg_o1_data.c
             genValidationForPredictedInline(cUnit, mir);
@@ -1036,8 +1258,7 @@ void printEmittedCodeBlock(unsigned char *startAddr, unsigned char *endAddr)
  * 2 bytes for chaining cell count offset and 2 bytes for chaining cell offset */
 #define EXTRA_BYTES_FOR_CHAINING 4
 
-/* Entry function to invoke the backend of the JIT compiler */
-void dvmCompilerMIR2LIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+static void lowerTrace(CompilationUnit *cUnit, JitTranslationInfo *info)
 {
     dump_x86_inst = cUnit->printMe;
     /* Used to hold the labels of each block */
@@ -1070,11 +1291,14 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 
     info->codeAddress = NULL;
     stream = (char*)gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
+    /* The cache may be reset or evicted under us, so don't go back to
+     * gDvmJit for the limit while we are emitting */
+    streamEnd = (char*)gDvmJit.codeCache + gDvmJit.codeCacheByteLimit - CODE_CACHE_PADDING;
 
     // TODO: compile into a temporary buffer and then copy into the code cache.
     // That would let us leave the code cache unprotected for a shorter time.
     size_t unprotected_code_cache_bytes =
-            gDvmJit.codeCacheSize - gDvmJit.codeCacheByteUsed - CODE_CACHE_PADDING;
+            gDvmJit.codeCacheByteLimit - gDvmJit.codeCacheByteUsed - CODE_CACHE_PADDING;
     UNPROTECT_CODE_CACHE(stream, unprotected_code_cache_bytes);
 
     streamStart = stream; /* trace start before alignment */
@@ -1093,7 +1317,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit, JitTranslationInfo *info)
     startOfTrace(cUnit->method, labelList, cUnit->exceptionBlockId, cUnit);
     if(gDvm.executionMode == kExecutionModeNcgO1) {
         //merge blocks ending with "goto" with the fall through block
-        if (cUnit->jitMode != kJitLoop)
+        if (cUnit->jitMode != kJitLoop && cUnit->jitMode != kJitMethod)
             for (i = 0; i < blockList->numUsed; i++) {
                 bb = (BasicBlock *) blockList->elemList[i];
                 bool merged = mergeBlock(bb);
@@ -1273,8 +1497,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit, JitTranslationInfo *info)
                 codePtr = startCodePtr + mir->offset;
                 //lower each byte code, update LIR
                 notHandled = lowerByteCodeJit(cUnit->method, cUnit->method->insns+mir->offset, mir);
-                if(gDvmJit.codeCacheByteUsed + (stream - streamStart) +
-                   CODE_CACHE_PADDING > gDvmJit.codeCacheSize) {
+                if(stream > streamEnd) {
                     ALOGI("JIT code cache full after lowerByteCodeJit (trace uses %uB)", (stream - streamStart));
                     gDvmJit.codeCacheFull = true;
                     cUnit->baseAddr = NULL;
@@ -1352,7 +1575,8 @@ gen_fallthrough:
                         chainingBlock->containingMethod, blockId, labelList);
                     break;
                 case kChainingCellInvokePredicted:
-                    handleInvokePredictedChainingCell(cUnit, blockId);
+                    handleInvokePredictedChainingCell(cUnit,
+                        chainingBlock->startOffset, blockId);
                     break;
                 case kChainingCellHot:
                     handleHotChainingCell(cUnit,
@@ -1368,7 +1592,7 @@ gen_fallthrough:
                     break;
             }
 
-            if (gDvmJit.codeCacheByteUsed + (stream - streamStart) + CODE_CACHE_PADDING > gDvmJit.codeCacheSize) {
+            if (stream > streamEnd) {
                 ALOGI("JIT code cache full after ChainingCell (trace uses %uB)", (stream - streamStart));
                 gDvmJit.codeCacheFull = true;
                 cUnit->baseAddr = NULL;
@@ -1407,7 +1631,7 @@ gen_fallthrough:
 
     cUnit->baseAddr = streamMethodStart;
     cUnit->totalSize = (stream - streamStart);
-    if(gDvmJit.codeCacheByteUsed + cUnit->totalSize + CODE_CACHE_PADDING > gDvmJit.codeCacheSize) {
+    if(stream > streamEnd) {
         ALOGI("JIT code cache full after ChainingCellCounts (trace uses %uB)", (stream - streamStart));
         gDvmJit.codeCacheFull = true;
         cUnit->baseAddr = NULL;
@@ -1422,7 +1646,21 @@ gen_fallthrough:
 
     PROTECT_CODE_CACHE(stream, unprotected_code_cache_bytes);
 
+    /*
+     * The code cache is reset, or has a segment evicted, with all threads
+     * suspended, which doesn't stop us since we compile in VMWAIT.  Either
+     * way the space we wrote into isn't ours any more, so drop the trace.
+     */
+    dvmLockMutex(&gDvmJit.compilerLock);
+    if (info->cacheVersion != gDvmJit.cacheVersion) {
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        ALOGI("JIT code cache changed during compilation - discarding trace");
+        info->discardResult = true;
+        cUnit->baseAddr = NULL;
+        return;
+    }
     gDvmJit.codeCacheByteUsed += (stream - streamStart);
+    dvmUnlockMutex(&gDvmJit.compilerLock);
     if (cUnit->printMe) {
         unsigned char* codeBaseAddr = (unsigned char *) cUnit->baseAddr;
         unsigned char* codeBaseAddrNext = ((unsigned char *) gDvmJit.codeCache) + gDvmJit.codeCacheByteUsed;
@@ -1440,6 +1678,19 @@ gen_fallthrough:
     gDvmJit.numCompilations++;
 
     info->codeAddress = (char*)cUnit->baseAddr;// + cUnit->headerSize;
+    info->codeSize = stream - (char*)cUnit->baseAddr;
+}
+
+/*
+ * Entry function to invoke the backend of the JIT compiler.  The lowering
+ * keeps its state in globals and writes straight into the code cache, so
+ * only one compiler thread runs it at a time.
+ */
+void dvmCompilerMIR2LIR(CompilationUnit *cUnit, JitTranslationInfo *info)
+{
+    dvmCompilerLockCodegen();
+    lowerTrace(cUnit, info);
+    dvmCompilerUnlockCodegen();
 }
 
 /*
@@ -1499,6 +1750,12 @@ bool dvmCompilerDoWork(CompilerWorkOrder *work)
             success = dvmCompileTrace(desc, JIT_MAX_TRACE_LEN, &work->result,
                                         work->bailPtr, 0 /* no hints */);
             break;
+        case kWorkOrderMethod:
+            isCompile = true;
+            desc = (JitTraceDescription *)work->info;
+            success = dvmCompileMethodTrace(desc, &work->result,
+                                            work->bailPtr);
+            break;
         case kWorkOrderTraceDebug: {
             bool oldPrintMe = gDvmJit.printMe;
             gDvmJit.printMe = true;
@@ -47,6 +47,7 @@ int ncg_rPC;
 //! map from PC in bytecode to PC in native code
 int mapFromBCtoNCG[BYTECODE_SIZE_PER_METHOD]; //initially mapped to -1
 char* streamStart = NULL; //start of the Pure CodeItem?, not include the global symbols
+char* streamEnd = NULL; //end of the code cache segment, less CODE_CACHE_PADDING
 char* streamCode = NULL; //start of the Pure CodeItem?, not include the global symbols
 char* streamMethodStart; //start of the method
 char* stream; //current stream pointer
@@ -406,11 +407,23 @@ void initGlobalMethods() {
     dump_x86_inst = false;
 }
 
+//! first code unit of the bytecode for a MIR
+
+//! A load that value numbering found redundant is lowered as the move it was
+//! rewritten to, with rPC still at the original bytecode
+u2 fetchMIRInst(const MIR* mir) {
+    if(mir->OptimizationFlags & MIR_VALUE_REUSED) {
+        return (u2)(mir->dalvikInsn.opcode | (mir->dalvikInsn.vA << 8) |
+                    (mir->dalvikInsn.vB << 12));
+    }
+    return FETCH(0);
+}
+
 ExecutionMode origMode;
 //when to update streamMethodStart
 bool lowerByteCodeJit(const Method* method, const u2* codePtr, MIR* mir) {
     rPC = (u2*)codePtr;
-    inst = FETCH(0);
+    inst = fetchMIRInst(mir);
     traceCurrentMIR = mir;
     int retCode = lowerByteCode(method);
     traceCurrentMIR = NULL;
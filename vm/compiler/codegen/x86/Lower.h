@@ -86,6 +86,7 @@
 #define offEBP_self 8
 #define offEBP_spill -56
 #define offThread_exception 68
+#define offThread_threadId 36
 #define offClassObject_descriptor 24
 #define offArrayObject_length 8
 #ifdef PROFILE_FIELD_ACCESS
@@ -124,6 +125,7 @@
 
 #define offField_clazz 0
 #define offObject_clazz 0
+#define offObject_lock 4
 #define offClassObject_vtable 116
 #define offClassObject_pDvmDex 40
 #define offClassObject_super 72
@@ -528,6 +530,7 @@ extern int offsetPC;
 extern int offsetNCG;
 extern int mapFromBCtoNCG[BYTECODE_SIZE_PER_METHOD];
 extern char* streamStart;
+extern char* streamEnd; //end of the space the trace may use
 
 extern char* streamCode;
 
@@ -673,6 +676,15 @@ void move_sd_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
                          int reg, bool isPhysical);
 void move_sd_reg_to_mem(LowOp* op, int reg, bool isPhysical,
                          int disp, int base_reg, bool isBasePhysical);
+void move_dqu_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
+                         int reg, bool isPhysical);
+void move_dqu_reg_to_mem(int reg, bool isPhysical,
+                         int disp, int base_reg, bool isBasePhysical);
+void move_gp_to_xmm(int reg, bool isPhysical, int xmm, bool isPhysical2);
+void move_xmm_to_gp(int xmm, bool isPhysical, int reg, bool isPhysical2);
+void alu_packed_binary_reg_reg(Mnemonic m, int reg, bool isPhysical,
+                               int reg2, bool isPhysical2);
+void alu_packed_imm_reg(Mnemonic m, int imm, int reg, bool isPhysical);
 
 void conditional_jump(ConditionCode cc, const char* target, bool isShortTerm);
 void unconditional_jump(const char* target, bool isShortTerm);
@@ -702,6 +714,8 @@ void alu_binary_reg_reg(OpndSize size, ALU_Opcode opc,
 void alu_binary_reg_mem(OpndSize size, ALU_Opcode opc,
                          int reg, bool isPhysical,
                          int disp, int base_reg, bool isBasePhysical);
+void compare_and_swap_reg_mem(OpndSize size, int reg, bool isPhysical,
+                         int disp, int base_reg, bool isBasePhysical);
 
 void fpu_mem(LowOp* op, ALU_Opcode opc, OpndSize size, int disp, int base_reg, bool isBasePhysical);
 void alu_ss_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
@@ -828,6 +842,7 @@ int call_dvmAllocArrayByClass();
 int call_dvmResolveMethod();
 int call_dvmResolveClass();
 int call_dvmInstanceofNonTrivial();
+int call_dvmJitInstanceofAndCache();
 int call_dvmThrow();
 int call_dvmThrowWithMessage();
 int call_dvmCheckSuspendPending();
@@ -935,6 +950,13 @@ int op_monitor_enter();
 int op_monitor_exit();
 int op_check_cast();
 int op_instance_of();
+//! how the CHECK_CAST or INSTANCE_OF at rPC is lowered
+struct TypeCheckLowering {
+    ClassObject* classPtr;          //resolved class, or NULL to resolve it at run time
+    int displayOffset;              //its slot in the display of its subclasses, or -1
+    JitTypeCheckSite* site;         //inline cache, used when there is no display slot
+};
+void getTypeCheckLowering(u4 classIdx, TypeCheckLowering* lowering);
 
 int op_array_length();
 int op_new_instance();
@@ -1202,6 +1224,7 @@ LowOpLabel* dump_label(Mnemonic m, OpndSize size, int imm,
 
 unsigned getJmpCallInstSize(OpndSize size, JmpCall_type type);
 bool lowerByteCodeJit(const Method* method, const u2* codePtr, MIR* mir);
+u2 fetchMIRInst(const MIR* mir);
 void startOfBasicBlock(struct BasicBlock* bb);
 extern LowOpBlockLabel* traceLabelList;
 extern struct BasicBlock* traceCurrentBB;
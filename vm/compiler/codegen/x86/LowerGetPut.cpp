@@ -459,10 +459,15 @@ int iget_iput_common_nohelper(int tmp, int flag, u2 vA, u2 vB, int isObj, bool i
     // Request VR delay before transfer to temporary. Only vB needs delay.
     // vA will have non-zero reference count since transfer to temporary for
     // it happens after null check, thus no delay is needed.
-    requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK))
+        requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
     get_virtual_reg(vB, OpndSize_32, 7, false);
-    nullCheck(7, false, 2, vB); //maybe optimized away, if not, call
-    cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        nullCheck(7, false, 2, vB); //maybe optimized away, if not, call
+        cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    } else {
+        updateRefCount2(7, LowOpndRegType_gp, false); //update reference count for tmp7
+    }
     if(flag == IGET) {
         move_mem_scale_to_reg(OpndSize_32, 7, false, 8, false, 1, 9, false);
         set_virtual_reg(vA, OpndSize_32, 9, false);
@@ -832,10 +837,15 @@ int op_iget_quick() {
     u2 vB = INST_B(inst); //object
     u2 tmp = FETCH(1);
 
-    requestVRFreeDelay(vB,VRDELAY_NULLCHECK); // Request VR delay before transfer to temporary
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK))
+        requestVRFreeDelay(vB,VRDELAY_NULLCHECK); // Request VR delay before transfer to temporary
     get_virtual_reg(vB, OpndSize_32, 1, false);
-    nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
-    cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
+        cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    } else {
+        updateRefCount2(1, LowOpndRegType_gp, false); //update reference count for tmp1
+    }
 
     move_mem_to_reg(OpndSize_32, tmp, 1, false, 2, false);
     set_virtual_reg(vA, OpndSize_32, 2, false);
@@ -853,10 +863,15 @@ int op_iget_wide_quick() {
     u2 vB = INST_B(inst); //object
     u2 tmp = FETCH(1);
 
-    requestVRFreeDelay(vB,VRDELAY_NULLCHECK); // Request VR delay before transfer to temporary
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK))
+        requestVRFreeDelay(vB,VRDELAY_NULLCHECK); // Request VR delay before transfer to temporary
     get_virtual_reg(vB, OpndSize_32, 1, false);
-    nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
-    cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
+        cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    } else {
+        updateRefCount2(1, LowOpndRegType_gp, false); //update reference count for tmp1
+    }
 
     move_mem_to_reg(OpndSize_64, tmp, 1, false, 1, false);
     set_virtual_reg(vA, OpndSize_64, 1, false);
@@ -883,10 +898,15 @@ int iput_quick_common(bool isObj) {
     // Request VR delay before transfer to temporary. Only vB needs delay.
     // vA will have non-zero reference count since transfer to temporary for
     // it happens after null check, thus no delay is needed.
-    requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK))
+        requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
     get_virtual_reg(vB, OpndSize_32, 1, false);
-    nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
-    cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
+        cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    } else {
+        updateRefCount2(1, LowOpndRegType_gp, false); //update reference count for tmp1
+    }
 
     get_virtual_reg(vA, OpndSize_32, 2, false);
     move_reg_to_mem(OpndSize_32, 2, false, tmp, 1, false);
@@ -913,10 +933,15 @@ int op_iput_wide_quick() {
     // Request VR delay before transfer to temporary. Only vB needs delay.
     // vA will have non-zero reference count since transfer to temporary for
     // it happens after null check, thus no delay is needed.
-    requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK))
+        requestVRFreeDelay(vB,VRDELAY_NULLCHECK);
     get_virtual_reg(vB, OpndSize_32, 1, false);
-    nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
-    cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    if(!(traceCurrentMIR->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        nullCheck(1, false, 1, vB); //maybe optimized away, if not, call
+        cancelVRFreeDelayRequest(vB,VRDELAY_NULLCHECK);
+    } else {
+        updateRefCount2(1, LowOpndRegType_gp, false); //update reference count for tmp1
+    }
 
     get_virtual_reg(vA, OpndSize_64, 1, false);
     move_reg_to_mem(OpndSize_64, 1, false, tmp, 1, false);
@@ -1389,6 +1389,30 @@ void alu_binary_reg_mem(OpndSize size, ALU_Opcode opc,
         m = map_of_alu_opcode_2_mnemonic[opc];
     dump_reg_mem(m, ATOM_NORMAL_ALU, size, reg, isPhysical, disp, base_reg, isBasePhysical, MemoryAccess_Unknown, -1, getTypeFromIntSize(size));
 }
+//!lock cmpxchg: if mem equals %eax, store reg to mem, otherwise load mem to %eax
+
+//!the caller sets up %eax, which is touched here; ZF is set if the swap happened
+void compare_and_swap_reg_mem(OpndSize size, int reg, bool isPhysical,
+             int disp, int base_reg, bool isBasePhysical) {
+    if(gDvm.executionMode == kExecutionModeNcgO1) {
+        startNativeCode(-1, -1);
+        freeReg(true);
+        int baseAll = registerAlloc(LowOpndRegType_gp, base_reg, isBasePhysical, true);
+        donotSpillReg(baseAll);
+        int regAll = registerAlloc(LowOpndRegType_gp, reg, isPhysical, true);
+        donotSpillReg(regAll);
+        registerAlloc(LowOpndRegType_gp, PhysicalReg_EAX, true, true);
+        endNativeCode();
+        //nothing may be spilled between the prefix and the instruction
+        stream = encoder_prefix(lock_prefix, stream);
+        lower_reg_mem(Mnemonic_CMPXCHG, ATOM_NORMAL, size, regAll, disp, baseAll,
+                      MemoryAccess_Unknown, -1, LowOpndRegType_gp);
+    } else {
+        stream = encoder_prefix(lock_prefix, stream);
+        stream = encoder_reg_mem(Mnemonic_CMPXCHG, size, reg, isPhysical, disp,
+                                 base_reg, isBasePhysical, LowOpndRegType_gp, stream);
+    }
+}
 //!FPU ops with one mem operand
 
 //!
@@ -1695,6 +1719,48 @@ void move_sd_reg_to_mem(LowOp* op, int reg, bool isPhysical,
                         disp, base_reg, isBasePhysical,
                         MemoryAccess_Unknown, -1, LowOpndRegType_xmm);
 }
+//!movdqu from memory to reg
+
+//!the whole 128-bit register is loaded, the size only selects the xmm alias
+void move_dqu_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
+                         int reg, bool isPhysical) {
+    dump_mem_reg(Mnemonic_MOVDQU, ATOM_NORMAL, OpndSize_64, disp, base_reg, isBasePhysical,
+        MemoryAccess_Unknown, -1, reg, isPhysical, LowOpndRegType_xmm);
+}
+//!movdqu from reg to memory
+
+//!
+void move_dqu_reg_to_mem(int reg, bool isPhysical,
+                         int disp, int base_reg, bool isBasePhysical) {
+    dump_reg_mem(Mnemonic_MOVDQU, ATOM_NORMAL, OpndSize_64, reg, isPhysical,
+                        disp, base_reg, isBasePhysical,
+                        MemoryAccess_Unknown, -1, LowOpndRegType_xmm);
+}
+//!movd from a gp reg to the low lane of an xmm reg
+
+//!
+void move_gp_to_xmm(int reg, bool isPhysical, int xmm, bool isPhysical2) {
+    dump_reg_reg(Mnemonic_MOVD, ATOM_NORMAL, OpndSize_32, reg, isPhysical, xmm, isPhysical2, LowOpndRegType_xmm);
+}
+//!movd from the low lane of an xmm reg to a gp reg
+
+//!
+void move_xmm_to_gp(int xmm, bool isPhysical, int reg, bool isPhysical2) {
+    dump_reg_reg(Mnemonic_MOVD, ATOM_NORMAL, OpndSize_32, xmm, isPhysical, reg, isPhysical2, LowOpndRegType_xmm);
+}
+//!packed SSE2 ALU: reg2 = reg2 op reg
+
+//!
+void alu_packed_binary_reg_reg(Mnemonic m, int reg, bool isPhysical,
+                               int reg2, bool isPhysical2) {
+    dump_reg_reg(m, ATOM_NORMAL_ALU, OpndSize_64, reg, isPhysical, reg2, isPhysical2, LowOpndRegType_xmm);
+}
+//!packed SSE2 shift by an immediate
+
+//!
+void alu_packed_imm_reg(Mnemonic m, int imm, int reg, bool isPhysical) {
+    dump_imm_reg(m, ATOM_NORMAL_ALU, OpndSize_64, imm, reg, isPhysical, LowOpndRegType_xmm, false);
+}
 //!load from VR to a temporary
 
 //!
@@ -2481,6 +2547,21 @@ int call_dvmInstanceofNonTrivial() {
     }
     return 0;
 }
+//!generate native code to call dvmJitInstanceofAndCache
+
+//!
+int call_dvmJitInstanceofAndCache() {
+    typedef int (*vmHelper)(const ClassObject*, const ClassObject*, JitTypeCheckSite*);
+    vmHelper funcPtr = dvmJitInstanceofAndCache;
+    if(gDvm.executionMode == kExecutionModeNcgO1) {
+        beforeCall("dvmJitInstanceofAndCache");
+        callFuncPtr((int)funcPtr, "dvmJitInstanceofAndCache");
+        afterCall("dvmJitInstanceofAndCache");
+    } else {
+        callFuncPtr((int)funcPtr, "dvmJitInstanceofAndCache");
+    }
+    return 0;
+}
 //!generate native code to call dvmThrowException
 
 //!
@@ -589,6 +589,18 @@ int common_invokeMethod_Jmp(ArgsDoneType form) {
     return 0;
 }
 
+//! same as common_invokeMethod_Jmp(ArgsDone_Normal), except that the callee's chaining cell is the inline cache entry in temporary cellReg
+static int common_invokeMethod_JmpToEntry(int cellReg) {
+    nextVersionOfHardReg(PhysicalReg_EDX, 1);
+    move_imm_to_reg(OpndSize_32, (int)rPC, PhysicalReg_EDX, true);
+    load_effective_addr(-8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
+    insertChainingWorklist(traceCurrentBB->fallThrough->id, stream);
+    move_chain_to_mem(OpndSize_32, traceCurrentBB->fallThrough->id, 4, PhysicalReg_ESP, true);
+    move_reg_to_mem(OpndSize_32, cellReg, false, 0, PhysicalReg_ESP, true);
+    unconditional_jump_global_API(".invokeArgsDone_normal", false);
+    return 0;
+}
+
 int common_invokeMethodNoRange(ArgsDoneType form) {
     common_invokeMethodNoRange_noJmp();
     common_invokeMethod_Jmp(form);
@@ -1310,6 +1322,7 @@ int op_invoke_super_quick_range() {
 #define offChainingCell_clazz 8
 #define offChainingCell_method 12
 #define offChainingCell_counter 16
+#define offLastPolyEntry_clazz ((JIT_POLY_IC_SIZE - 1) * sizeof(PredictedChainingCell) + offChainingCell_clazz)
 #define P_GPR_1 PhysicalReg_EBX
 #define P_GPR_2 PhysicalReg_EAX
 #define P_GPR_3 PhysicalReg_ESI
@@ -1391,9 +1404,9 @@ void predicted_chain_interface_O1(u2 tmp) {
     insertLabel(".find_interface_done", true);
 #if 1 //
     /* for gingerbread, counter is stored in glue structure
-       if clazz is not initialized, set icRechainCount to 0, otherwise, reduce it by 1 */
+       if the inline cache has a free entry, set icRechainCount to 0, otherwise, reduce it by 1 */
     /* for gingerbread: t43 = 0 t44 = t33 t33-- cmov_ne t43 = t33 cmov_ne t44 = t33 */
-    move_mem_to_reg(OpndSize_32, offChainingCell_clazz, 41, false, 45, false);
+    move_mem_to_reg(OpndSize_32, offLastPolyEntry_clazz, 41, false, 45, false);
     move_imm_to_reg(OpndSize_32, 0, 43, false);
     get_self_pointer(PhysicalReg_SCRATCH_7, isScratchPhysical);
     move_mem_to_reg(OpndSize_32, offsetof(Thread, icRechainCount), PhysicalReg_SCRATCH_7, isScratchPhysical, 33, false); //counter
@@ -1470,7 +1483,6 @@ void predicted_chain_virtual_O0(u2 IMMC) {
 }
 
 // 2 inputs: ChainingCell in temp 41, current class object in temp 40
-// extra input: predicted clazz in temp 32
 void predicted_chain_virtual_O1(u2 IMMC) {
 
     /* reduce counter in chaining cell by 1 */
@@ -1479,9 +1491,10 @@ void predicted_chain_virtual_O1(u2 IMMC) {
     move_imm_to_reg(OpndSize_32, 0, 43, false);
     move_mem_to_reg(OpndSize_32, offsetof(Thread, icRechainCount), PhysicalReg_SCRATCH_7, isScratchPhysical, 33, false); //counter
     move_mem_to_reg(OpndSize_32, offClassObject_vtable, 40, false, 34, false);
+    move_mem_to_reg(OpndSize_32, offLastPolyEntry_clazz, 41, false, 45, false); //free entry if 0
     move_reg_to_reg(OpndSize_32, 33, false, 44, false);
     alu_binary_imm_reg(OpndSize_32, sub_opc, 0x1, 33, false);
-    compare_imm_reg(OpndSize_32, 0, 32, false); // after sub_opc
+    compare_imm_reg(OpndSize_32, 0, 45, false); // after sub_opc
     move_mem_to_reg(OpndSize_32, IMMC, 34, false, PhysicalReg_ECX, true);
     conditional_move_reg_to_reg(OpndSize_32, Condition_NZ, 33, false/*src*/, 43, false/*dst*/);
     conditional_move_reg_to_reg(OpndSize_32, Condition_NZ, 33, false/*src*/, 44, false/*dst*/);
@@ -1624,6 +1637,17 @@ void gen_predicted_chain_O1(bool isRange, u2 tmp, int IMMC, bool isInterface, in
         insertChainingWorklist(traceCurrentBB->taken->id, stream);
     int traceTakenId = traceCurrentBB->taken ? traceCurrentBB->taken->id : 0;
     move_chain_to_reg(OpndSize_32, traceTakenId, 41, false); //predictedChainCell
+
+    /* the chaining cell is a polymorphic inline cache:
+       point temp 41 at the entry holding the current class, if there is one */
+    move_reg_to_reg(OpndSize_32, 41, false, 46, false);
+    int k;
+    for(k = 1; k < JIT_POLY_IC_SIZE; k++) {
+        int entryOffset = k * sizeof(PredictedChainingCell);
+        load_effective_addr(entryOffset, 46, false, 47, false);
+        compare_mem_reg(OpndSize_32, entryOffset + offChainingCell_clazz, 46, false, 40, false);
+        conditional_move_reg_to_reg(OpndSize_32, Condition_E, 47, false/*src*/, 41, false/*dst*/);
+    }
     move_mem_to_reg(OpndSize_32, offChainingCell_clazz, 41, false, 32, false);//predicted clazz
     move_mem_to_reg(OpndSize_32, offChainingCell_method, 41, false, PhysicalReg_ECX, true);//predicted method
 
@@ -1632,7 +1656,8 @@ void gen_predicted_chain_O1(bool isRange, u2 tmp, int IMMC, bool isInterface, in
     else common_invokeMethodNoRange_noJmp();
 
     /* compare current class object against predicted clazz
-       if equal, prediction is still valid, jump to .invokeChain */
+       if equal, prediction is still valid, jump to .invokeChain
+       on a miss, temp 41 is still the first entry */
     compare_reg_reg(40, false, 32, false);
     conditional_jump(Condition_E, ".invokeChain", true);
     rememberState(1);
@@ -1649,7 +1674,7 @@ void gen_predicted_chain_O1(bool isRange, u2 tmp, int IMMC, bool isInterface, in
 
     insertLabel(".invokeChain", true);
     goToState(1);
-    common_invokeMethod_Jmp(ArgsDone_Normal);
+    common_invokeMethod_JmpToEntry(41);
 }
 
 void gen_predicted_chain(bool isRange, u2 tmp, int IMMC, bool isInterface, int inputReg) {
@@ -471,11 +471,19 @@ int getRelativeOffset(const char* target, bool isShortTerm, JmpCall_type type, b
                but there are special cases where we should use 32 bit offset
             */
             if(!strcmp(target, ".check_cast_null") || !strcmp(target, ".stackOverflow") ||
+               !strcmp(target, ".check_cast_equal") ||
+               !strcmp(target, ".instance_of_equal") ||
                !strcmp(target, ".invokeChain") ||
                !strcmp(target, ".new_instance_done") ||
+               !strcmp(target, ".new_instance_called") ||
                !strcmp(target, ".new_array_done") ||
+               !strcmp(target, ".new_array_called") ||
                !strcmp(target, ".fill_array_data_done") ||
                !strcmp(target, ".inlined_string_compare_done") ||
+               !strcmp(target, ".vector_loop_done") ||
+               !strcmp(target, ".monitor_enter_locked") ||
+               !strcmp(target, ".monitor_enter_done") ||
+               !strcmp(target, ".monitor_exit_done") ||
                !strncmp(target, "after_exception", 15)) {
 #ifdef SUPPORT_IMM_16
                 *immSize = OpndSize_16;
@@ -763,7 +771,7 @@ int performDataWorklist() {
     DataWorklist* ptr = methodDataWorklist;
     if(ptr == NULL) return 0;
 
-    char* codeCacheEnd = ((char *) gDvmJit.codeCache) + gDvmJit.codeCacheSize - CODE_CACHE_PADDING;
+    char* codeCacheEnd = streamEnd;
     u2 insnsSize = dvmGetMethodInsnsSize(currentMethod); //bytecode
     //align stream to multiple of 4
     int alignBytes = (int)stream & 3;
@@ -25,25 +25,61 @@
 
 extern void markCard_filled(int tgtAddrReg, bool isTgtPhysical, int scratchReg, bool isScratchPhysical);
 
+//! the answer getTypeCheckLowering gave for typeCheckPC
+static const u2* typeCheckPC = NULL;
+static TypeCheckLowering typeCheckPlan;
+
+//! decide how the CHECK_CAST or INSTANCE_OF at rPC is lowered
+
+//! getTempRegInfo asks first and check_cast_nohelper gets the same answer,
+//! so the temporaries counted match the code even if another thread
+//! resolves the class in between
+void getTypeCheckLowering(u4 classIdx, TypeCheckLowering* lowering) {
+    if(typeCheckPC != rPC) {
+        ClassObject *classPtr = currentMethod->clazz->pDvmDex->pResClasses[classIdx];
+        typeCheckPlan.classPtr = classPtr;
+        typeCheckPlan.displayOffset = -1;
+        typeCheckPlan.site = NULL;
+        if(classPtr != NULL && classPtr->classDepth < CLASS_DISPLAY_SIZE &&
+           !dvmIsInterfaceClass(classPtr) && !dvmIsArrayClass(classPtr)) {
+            typeCheckPlan.displayOffset = offsetof(ClassObject, display) +
+                                          classPtr->classDepth * sizeof(ClassObject*);
+        }
+        if(typeCheckPlan.displayOffset < 0)
+            typeCheckPlan.site = dvmCompilerGetTypeCheckSite(rPC);
+        typeCheckPC = rPC;
+    }
+    *lowering = typeCheckPlan;
+}
+
 #define P_GPR_1 PhysicalReg_EBX
 #define P_GPR_2 PhysicalReg_ECX
 #define P_GPR_3 PhysicalReg_ESI
 //! LOWER bytecode CHECK_CAST and INSTANCE_OF
 //!   CALL class_resolve (%ebx is live across the call)
-//!        dvmInstanceofNonTrivial
+//!        dvmJitInstanceofAndCache or dvmInstanceofNonTrivial
 //!   NO register is live through function check_cast_helper
+//!   The classes in the site's inline cache (see TypeCheckSites.cpp) are
+//!   handled like an exact match
+//!   A class resolved at compile time and found in the superclass display
+//!   is checked inline with no call at all
 int check_cast_nohelper(u2 vA, u4 tmp, bool instance, u2 vDest) {
     get_virtual_reg(vA, OpndSize_32, 1, false); //object
     scratchRegs[2] = PhysicalReg_Null; scratchRegs[3] = PhysicalReg_Null;
+    //must agree with the temporaries getTempRegInfo counted
+    TypeCheckLowering lowering;
+    getTypeCheckLowering(tmp, &lowering);
+    typeCheckPC = NULL;
     /* for trace-based JIT, it is likely that the class is already resolved */
     bool needToResolve = true;
-    ClassObject *classPtr =
-                (currentMethod->clazz->pDvmDex->pResClasses[tmp]);
+    ClassObject *classPtr = lowering.classPtr;
     ALOGV("in check_cast, class is resolved to %p", classPtr);
     if(classPtr != NULL) {
         needToResolve = false;
         ALOGV("check_cast class %s", classPtr->descriptor);
     }
+    //offset of classPtr's slot in the display of its subclasses, if it has one
+    int displayOffset = lowering.displayOffset;
     if(needToResolve) {
         //get_res_classes is moved here for NCG O1 to improve performance of GLUE optimization
         scratchRegs[0] = PhysicalReg_SCRATCH_1; scratchRegs[1] = PhysicalReg_SCRATCH_2;
@@ -88,6 +124,10 @@ int check_cast_nohelper(u2 vA, u4 tmp, bool instance, u2 vDest) {
     else insertLabel(".instance_of_resolved", true);
 
     move_mem_to_reg(OpndSize_32, offObject_clazz, 1, false, 6, false); //object->clazz
+    JitTypeCheckSite* site = lowering.site;
+    if(site != NULL) {
+        move_imm_to_reg(OpndSize_32, (int)site, 5, false);
+    }
 
     //%eax: resolved class
     //compare resolved class and object->clazz
@@ -99,27 +139,57 @@ int check_cast_nohelper(u2 vA, u4 tmp, bool instance, u2 vDest) {
     } else {
         conditional_jump(Condition_E, ".check_cast_equal", true);
     }
+    //so do the classes that passed this site before
+    for(int k = 0; site != NULL && k < JIT_TYPE_CHECK_IC_SIZE; k++) {
+        compare_mem_reg(OpndSize_32, offsetof(JitTypeCheckSite, clazz) + k * sizeof(ClassObject*),
+                        5, false, 6, false);
+        if(instance) {
+            conditional_jump(Condition_E, ".instance_of_equal", true);
+        } else {
+            conditional_jump(Condition_E, ".check_cast_equal", true);
+        }
+    }
 
-    //prepare to call dvmInstanceofNonTrivial
-    //INPUT: the resolved class & object reference
-    load_effective_addr(-8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
-    move_reg_to_mem(OpndSize_32, 6, false, 0, PhysicalReg_ESP, true);
-    move_reg_to_mem(OpndSize_32, PhysicalReg_EAX, true, 4, PhysicalReg_ESP, true); //resolved class
-    scratchRegs[0] = PhysicalReg_SCRATCH_3;
-    nextVersionOfHardReg(PhysicalReg_EAX, 2); //next version has 2 refs
-    call_dvmInstanceofNonTrivial();
-    load_effective_addr(8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
-    //
-    if(instance) {
-        //move return value to P_GPR_2
-        move_reg_to_reg(OpndSize_32, PhysicalReg_EAX, true, 3, false);
-        rememberState(4);
-        unconditional_jump(".instance_of_okay", true);
+    if(displayOffset >= 0) {
+        //the object is an instance iff classPtr is in its class's display
+        compare_mem_reg(OpndSize_32, displayOffset, 6, false, PhysicalReg_EAX, true);
+        if(instance) {
+            conditional_jump(Condition_E, ".instance_of_equal", true);
+            move_imm_to_reg(OpndSize_32, 0, 3, false);
+            rememberState(4);
+            unconditional_jump(".instance_of_okay", true);
+        } else {
+            rememberState(4);
+            conditional_jump(Condition_E, ".check_cast_okay", true);
+        }
     } else {
-        //if return value of dvmInstanceofNonTrivial is zero, throw exception
-        compare_imm_reg(OpndSize_32, 0,  PhysicalReg_EAX, true);
-        rememberState(4);
-        conditional_jump(Condition_NE, ".check_cast_okay", true);
+        //prepare to call dvmJitInstanceofAndCache (or dvmInstanceofNonTrivial)
+        //INPUT: the resolved class & object reference (& the inline cache)
+        load_effective_addr(-12, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
+        move_reg_to_mem(OpndSize_32, 6, false, 0, PhysicalReg_ESP, true);
+        move_reg_to_mem(OpndSize_32, PhysicalReg_EAX, true, 4, PhysicalReg_ESP, true); //resolved class
+        move_imm_to_mem(OpndSize_32, (int)site, 8, PhysicalReg_ESP, true);
+        scratchRegs[0] = PhysicalReg_SCRATCH_3;
+        nextVersionOfHardReg(PhysicalReg_EAX, 2); //next version has 2 refs
+        if(site != NULL)
+            call_dvmJitInstanceofAndCache();
+        else
+            call_dvmInstanceofNonTrivial();
+        load_effective_addr(12, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
+        //
+        if(instance) {
+            //move return value to P_GPR_2
+            move_reg_to_reg(OpndSize_32, PhysicalReg_EAX, true, 3, false);
+            rememberState(4);
+            unconditional_jump(".instance_of_okay", true);
+        } else {
+            //if return value of dvmInstanceofNonTrivial is zero, throw exception
+            compare_imm_reg(OpndSize_32, 0,  PhysicalReg_EAX, true);
+            rememberState(4);
+            conditional_jump(Condition_NE, ".check_cast_okay", true);
+        }
+    }
+    if(!instance) {
         //two inputs for common_throw_message: object reference in eax, exception pointer in ecx
         nextVersionOfHardReg(PhysicalReg_EAX, 1); //next version has 1 ref
         move_reg_to_reg(OpndSize_32, 1, false, PhysicalReg_EAX, true);
@@ -195,10 +265,18 @@ int op_instance_of() {
     return 0;
 }
 
+/* Lock word bits other than the hash state */
+#define LW_NOT_HASH_STATE (~(LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT))
+/* Shape and owner bits, which must be zero for a recursive thin lock of ours */
+#define LW_BELOW_COUNT ((1 << LW_LOCK_COUNT_SHIFT) - 1)
+
 #define P_GPR_1 PhysicalReg_EBX
 #define P_GPR_2 PhysicalReg_ECX
 //! LOWER bytecode MONITOR_ENTER without usage of helper function
 
+//! An unowned thin lock is taken with lock cmpxchg and a thin lock already
+//! held by this thread gets its recursion count bumped in place.  Fat locks,
+//! locks owned by other threads and a count about to overflow are left to
 //!   CALL dvmLockObject
 int monitor_enter_nohelper(u2 vA) {
     scratchRegs[0] = PhysicalReg_SCRATCH_1;
@@ -212,6 +290,36 @@ int monitor_enter_nohelper(u2 vA) {
     nullCheck(1, false, 1, vA); //maybe optimized away
     cancelVRFreeDelayRequest(vA,VRDELAY_NULLCHECK);
 
+    //%eax: lock word, temp 2: owner field for this thread
+    move_mem_to_reg(OpndSize_32, offObject_lock, 1, false, PhysicalReg_EAX, true);
+    move_mem_to_reg(OpndSize_32, offThread_threadId, 3, false, 2, false);
+    alu_binary_imm_reg(OpndSize_32, shl_opc, LW_LOCK_OWNER_SHIFT, 2, false);
+    move_reg_to_reg(OpndSize_32, PhysicalReg_EAX, true, 4, false);
+    alu_binary_imm_reg(OpndSize_32, and_opc, LW_NOT_HASH_STATE, 4, false);
+    rememberState(2);
+    conditional_jump(Condition_E, ".monitor_enter_unowned", true);
+    //a thin lock held by this thread leaves only the count in temp 4
+    alu_binary_reg_reg(OpndSize_32, xor_opc, 2, false, 4, false);
+    compare_imm_reg(OpndSize_32, (LW_LOCK_COUNT_MASK - 1) << LW_LOCK_COUNT_SHIFT, 4, false);
+    conditional_jump(Condition_AE, ".monitor_enter_slow", true);
+    test_imm_reg(OpndSize_32, LW_BELOW_COUNT, 4, false);
+    conditional_jump(Condition_NE, ".monitor_enter_slow", true);
+    alu_binary_imm_mem(OpndSize_32, add_opc, 1 << LW_LOCK_COUNT_SHIFT, offObject_lock, 1, false);
+    rememberState(3);
+    unconditional_jump(".monitor_enter_done", true);
+
+    //install the owner, keeping the hash state
+    insertLabel(".monitor_enter_unowned", true);
+    goToState(2);
+    alu_binary_reg_reg(OpndSize_32, or_opc, PhysicalReg_EAX, true, 4, false);
+    alu_binary_reg_reg(OpndSize_32, or_opc, 2, false, 4, false);
+    compare_and_swap_reg_mem(OpndSize_32, 4, false, offObject_lock, 1, false);
+    rememberState(4);
+    conditional_jump(Condition_E, ".monitor_enter_locked", true);
+    transferToState(2);
+
+    insertLabel(".monitor_enter_slow", true);
+    goToState(2);
     /////////////////////////////
     //prepare to call dvmLockObject, inputs: object reference and self
     // TODO: Should reset inJitCodeCache before calling dvmLockObject
@@ -231,7 +339,14 @@ int monitor_enter_nohelper(u2 vA) {
     scratchRegs[0] = PhysicalReg_SCRATCH_2;
     call_dvmLockObject();
     load_effective_addr(8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
+    transferToState(3);
+    unconditional_jump(".monitor_enter_done", true);
     /////////////////////////////
+
+    insertLabel(".monitor_enter_locked", true);
+    goToState(4);
+    transferToState(3);
+    insertLabel(".monitor_enter_done", true);
     return 0;
 }
 //! lower bytecode MONITOR_ENTER
@@ -251,7 +366,10 @@ int op_monitor_enter() {
 #define P_GPR_2 PhysicalReg_ECX
 //! lower bytecode MONITOR_EXIT
 
-//! It will use helper function if switch is on
+//! A thin lock held by this thread is released with a plain store, which
+//! has release semantics on x86, or has its recursion count dropped.
+//! Anything else goes to dvmUnlockObject, which also throws
+//! IllegalMonitorStateException
 int op_monitor_exit() {
     u2 vA = INST_AA(inst);
     ////////////////////
@@ -264,6 +382,33 @@ int op_monitor_exit() {
     nullCheck(1, false, 1, vA); //maybe optimized away
     cancelVRFreeDelayRequest(vA,VRDELAY_NULLCHECK);
 
+    //%eax: lock word, temp 4: lock word without hash state and our owner field
+    move_mem_to_reg(OpndSize_32, offObject_lock, 1, false, PhysicalReg_EAX, true);
+    get_self_pointer(3, false);
+    move_mem_to_reg(OpndSize_32, offThread_threadId, 3, false, 2, false);
+    alu_binary_imm_reg(OpndSize_32, shl_opc, LW_LOCK_OWNER_SHIFT, 2, false);
+    move_reg_to_reg(OpndSize_32, PhysicalReg_EAX, true, 4, false);
+    alu_binary_imm_reg(OpndSize_32, and_opc, LW_NOT_HASH_STATE, 4, false);
+    alu_binary_reg_reg(OpndSize_32, xor_opc, 2, false, 4, false);
+    rememberState(3);
+    conditional_jump(Condition_E, ".monitor_exit_release", true);
+    //held recursively by this thread if only the count is left
+    test_imm_reg(OpndSize_32, LW_BELOW_COUNT, 4, false);
+    conditional_jump(Condition_NE, ".monitor_exit_slow", true);
+    alu_binary_imm_mem(OpndSize_32, sub_opc, 1 << LW_LOCK_COUNT_SHIFT, offObject_lock, 1, false);
+    rememberState(4);
+    unconditional_jump(".monitor_exit_done", true);
+
+    //clear everything but the hash state
+    insertLabel(".monitor_exit_release", true);
+    goToState(3);
+    alu_binary_imm_reg(OpndSize_32, and_opc, LW_HASH_STATE_MASK << LW_HASH_STATE_SHIFT, PhysicalReg_EAX, true);
+    move_reg_to_mem(OpndSize_32, PhysicalReg_EAX, true, offObject_lock, 1, false);
+    transferToState(4);
+    unconditional_jump(".monitor_exit_done", true);
+
+    insertLabel(".monitor_exit_slow", true);
+    goToState(3);
     /////////////////////////////
     //prepare to call dvmUnlockObject, inputs: object reference and self
     push_reg_to_stack(OpndSize_32, 1, false);
@@ -278,12 +423,16 @@ int op_monitor_exit() {
     scratchRegs[0] = PhysicalReg_SCRATCH_3;
     jumpToExceptionThrown(2/*exception number*/);
     insertLabel(".unlock_object_done", true);
+    transferToState(4);
+    insertLabel(".monitor_exit_done", true);
     ///////////////////////////
     rPC += 1;
     return 0;
 }
 #undef P_GPR_1
 #undef P_GPR_2
+#undef LW_NOT_HASH_STATE
+#undef LW_BELOW_COUNT
 
 #define P_GPR_1 PhysicalReg_EBX
 #define P_GPR_2 PhysicalReg_ECX
@@ -316,7 +465,9 @@ int op_array_length() {
 #define P_GPR_3 PhysicalReg_ESI
 //! lower bytecode NEW_INSTANCE
 
-//! It will use helper function if switch is on
+//! Small classes without finalizers are allocated inline by popping a chunk
+//! of the right size off the thread's allocation cache (see AllocCache in
+//! Thread.h).  The call to dvmAllocObject refills the cache when it misses
 int op_new_instance() {
     u4 tmp = (u4)FETCH(1);
     u2 vA = INST_AA(inst);
@@ -331,11 +482,33 @@ int op_new_instance() {
      * with.  However, Alloc might throw, so we need to genExportPC()
      */
     assert((classPtr->accessFlags & (ACC_INTERFACE|ACC_ABSTRACT)) == 0);
+    bool allocInline = !IS_CLASS_FLAG_SET(classPtr, CLASS_ISFINALIZABLE) &&
+                       classPtr->objectSize <= kAllocCacheMaxSize;
+    if(allocInline) {
+        //temp 6: next chunk in the cache, taken if the size matches and there is one left
+        get_self_pointer(3, false);
+        move_mem_to_reg(OpndSize_32, offsetof(Thread, allocCache.top), 3, false, 6, false);
+        compare_imm_mem(OpndSize_32, classPtr->objectSize, offsetof(Thread, allocCache.size), 3, false);
+        rememberState(1);
+        conditional_jump(Condition_NE, ".new_instance_call", true);
+        compare_mem_reg(OpndSize_32, offsetof(Thread, allocCache.end), 3, false, 6, false);
+        conditional_jump(Condition_AE, ".new_instance_call", true);
+        move_mem_to_reg(OpndSize_32, 0, 6, false, PhysicalReg_EAX, true);
+        alu_binary_imm_mem(OpndSize_32, add_opc, sizeof(Object*), offsetof(Thread, allocCache.top), 3, false);
+        //the chunk is zeroed; the class is a root, so no card mark is needed
+        move_imm_to_mem(OpndSize_32, (int)classPtr, offObject_clazz, PhysicalReg_EAX, true);
+        rememberState(2);
+        unconditional_jump(".new_instance_done", true);
+
+        insertLabel(".new_instance_call", true);
+        goToState(1);
+    }
     //prepare to call dvmAllocObject, inputs: resolved class & flag ALLOC_DONT_TRACK
     load_effective_addr(-8, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
     /* 1st argument to dvmAllocObject at -8(%esp) */
     move_imm_to_mem(OpndSize_32, (int)classPtr, 0, PhysicalReg_ESP, true);
-    move_imm_to_mem(OpndSize_32, ALLOC_DONT_TRACK, 4, PhysicalReg_ESP, true);
+    move_imm_to_mem(OpndSize_32, allocInline ? ALLOC_DONT_TRACK | ALLOC_FILL_CACHE : ALLOC_DONT_TRACK,
+                    4, PhysicalReg_ESP, true);
     scratchRegs[0] = PhysicalReg_SCRATCH_3;
     nextVersionOfHardReg(PhysicalReg_EAX, 3); //next version has 3 refs
     call_dvmAllocObject();
@@ -343,10 +516,13 @@ int op_new_instance() {
     //return value of dvmAllocObject is in %eax
     //if return value is null, throw exception
     compare_imm_reg(OpndSize_32, 0, PhysicalReg_EAX, true);
-    conditional_jump(Condition_NE, ".new_instance_done", true);
+    conditional_jump(Condition_NE, ".new_instance_called", true);
     //jump to dvmJitToExceptionThrown
     scratchRegs[0] = PhysicalReg_SCRATCH_4;
     jumpToExceptionThrown(3/*exception number*/);
+    insertLabel(".new_instance_called", true);
+    if(allocInline)
+        transferToState(2);
     insertLabel(".new_instance_done", true);
     set_virtual_reg(vA, OpndSize_32, PhysicalReg_EAX, true);
     rPC += 2;
@@ -384,7 +560,8 @@ int new_instance_needinit() {
 #define P_GPR_3 PhysicalReg_EDX
 //! lower bytecode NEW_ARRAY
 
-//! It will use helper function if switch is on
+//! Arrays short enough to fit the largest cached chunk are allocated inline
+//! from the thread's allocation cache like NEW_INSTANCE
 int op_new_array() {
     u4 tmp = (u4)FETCH(1);
     u2 vA = INST_A(inst); //destination
@@ -398,17 +575,42 @@ int op_new_array() {
     compare_imm_reg(OpndSize_32, 0, 5, false);
     handlePotentialException(Condition_S, Condition_NS,
                              1, "common_errNegArraySize");
-    void *classPtr = (void*)
+    ClassObject *classPtr =
         (currentMethod->clazz->pDvmDex->pResClasses[tmp]);
     assert(classPtr != NULL);
-    //here, class is already resolved, the class object is in %eax
+    //the chunk size is only known at run time: contents offset + (length << shift)
+    int elemShift = 0;
+    while((1 << elemShift) < (int)dvmArrayClassElementWidth(classPtr)) elemShift++;
+    int maxLength = (kAllocCacheMaxSize - offArrayObject_contents) >> elemShift;
+    get_self_pointer(3, false);
+    move_mem_to_reg(OpndSize_32, offsetof(Thread, allocCache.top), 3, false, 6, false);
+    move_reg_to_reg(OpndSize_32, 5, false, 4, false);
+    alu_binary_imm_reg(OpndSize_32, shl_opc, elemShift, 4, false);
+    alu_binary_imm_reg(OpndSize_32, add_opc, offArrayObject_contents, 4, false);
+    compare_imm_reg(OpndSize_32, maxLength, 5, false);
+    rememberState(3);
+    conditional_jump(Condition_A, ".new_array_call", true);
+    compare_mem_reg(OpndSize_32, offsetof(Thread, allocCache.size), 3, false, 4, false);
+    conditional_jump(Condition_NE, ".new_array_call", true);
+    compare_mem_reg(OpndSize_32, offsetof(Thread, allocCache.end), 3, false, 6, false);
+    conditional_jump(Condition_AE, ".new_array_call", true);
+    move_mem_to_reg(OpndSize_32, 0, 6, false, PhysicalReg_EAX, true);
+    alu_binary_imm_mem(OpndSize_32, add_opc, sizeof(Object*), offsetof(Thread, allocCache.top), 3, false);
+    move_imm_to_mem(OpndSize_32, (int)classPtr, offObject_clazz, PhysicalReg_EAX, true);
+    move_reg_to_mem(OpndSize_32, 5, false, offArrayObject_length, PhysicalReg_EAX, true);
+    rememberState(4);
+    unconditional_jump(".new_array_done", true);
+
+    insertLabel(".new_array_call", true);
+    goToState(3);
+    //here, class is already resolved
     //prepare to call dvmAllocArrayByClass with inputs: resolved class, array length, flag ALLOC_DONT_TRACK
     insertLabel(".new_array_resolved", true);
     load_effective_addr(-12, PhysicalReg_ESP, true, PhysicalReg_ESP, true);
     /* 1st argument to dvmAllocArrayByClass at 0(%esp) */
     move_imm_to_mem(OpndSize_32, (int)classPtr, 0, PhysicalReg_ESP, true);
     move_reg_to_mem(OpndSize_32, 5, false, 4, PhysicalReg_ESP, true);
-    move_imm_to_mem(OpndSize_32, ALLOC_DONT_TRACK, 8, PhysicalReg_ESP, true);
+    move_imm_to_mem(OpndSize_32, ALLOC_DONT_TRACK | ALLOC_FILL_CACHE, 8, PhysicalReg_ESP, true);
     scratchRegs[0] = PhysicalReg_SCRATCH_3;
     nextVersionOfHardReg(PhysicalReg_EAX, 3); //next version has 3 refs
     call_dvmAllocArrayByClass();
@@ -417,10 +619,12 @@ int op_new_array() {
     //the allocated object is in %eax
     //check whether it is null, throw exception if null
     compare_imm_reg(OpndSize_32, 0, PhysicalReg_EAX, true);
-    conditional_jump(Condition_NE, ".new_array_done", true);
+    conditional_jump(Condition_NE, ".new_array_called", true);
     //jump to dvmJitToExceptionThrown
     scratchRegs[0] = PhysicalReg_SCRATCH_4;
     jumpToExceptionThrown(2/*exception number*/);
+    insertLabel(".new_array_called", true);
+    transferToState(4);
     insertLabel(".new_array_done", true);
     set_virtual_reg(vA, OpndSize_32, PhysicalReg_EAX, true);
     //////////////////////////////////////
@@ -267,6 +267,23 @@ Mnemonic_PANDN,
 Mnemonic_PSLLQ,
 Mnemonic_PSRLQ,
 Mnemonic_PXOR,                          // Logical Exclusive OR
+Mnemonic_MOVDQU,                        // Move Unaligned Double Quadword
+Mnemonic_PADDB,                         // Add Packed Byte Integers
+Mnemonic_PADDW,                         // Add Packed Word Integers
+Mnemonic_PADDD,                         // Add Packed Doubleword Integers
+Mnemonic_PSUBB,                         // Subtract Packed Byte Integers
+Mnemonic_PSUBW,                         // Subtract Packed Word Integers
+Mnemonic_PSUBD,                         // Subtract Packed Doubleword Integers
+Mnemonic_PSLLD,                         // Shift Packed Doublewords Left Logical
+Mnemonic_PSRAD,                         // Shift Packed Doublewords Right Arithmetic
+Mnemonic_PSRLD,                         // Shift Packed Doublewords Right Logical
+Mnemonic_PSRLDQ,                        // Shift Double Quadword Right Logical
+Mnemonic_PUNPCKLDQ,                     // Unpack Low Doublewords
+Mnemonic_PUNPCKLQDQ,                    // Unpack Low Quadwords
+Mnemonic_ADDPS,                         // Add Packed Single-Precision Floating-Point Values
+Mnemonic_SUBPS,                         // Subtract Packed Single-Precision Floating-Point Values
+Mnemonic_MULPS,                         // Multiply Packed Single-Precision Floating-Point Values
+Mnemonic_DIVPS,                         // Divide Packed Single-Precision Floating-Point Values
 Mnemonic_POP,                           // Pop a Value from the Stack
 Mnemonic_POPFD,                         // Pop a Value of EFLAGS register from the Stack
 Mnemonic_PUSH,                          // Push Word or Doubleword Onto the Stack
@@ -333,6 +333,7 @@ extern "C" ENCODER_DECLARE_EXPORT char * encoder_reg_mem(Mnemonic m, OpndSize si
     EncoderBase::Operands args;
     add_m(args, base_reg, disp, size);
     add_r(args, reg, size);
+    if(m == Mnemonic_CMPXCHG) add_r(args, 0/*eax*/, size); //implicit comparand
     char* stream_start = stream;
     stream = (char *)EncoderBase::encode(stream, m, args);
 #ifdef PRINT_ENCODER_STREAM
@@ -347,7 +348,9 @@ extern "C" ENCODER_DECLARE_EXPORT char * encoder_imm_reg(Mnemonic m, OpndSize si
     add_r(args, reg, size); //dst
     if(m == Mnemonic_IMUL) add_r(args, reg, size); //src CHECK
     if(m == Mnemonic_SAL || m == Mnemonic_SHR || m == Mnemonic_SHL
-       || m == Mnemonic_SAR || m == Mnemonic_ROR)  //fix for shift opcodes
+       || m == Mnemonic_SAR || m == Mnemonic_ROR  //fix for shift opcodes
+       || m == Mnemonic_PSLLD || m == Mnemonic_PSRAD || m == Mnemonic_PSRLD
+       || m == Mnemonic_PSRLDQ)
       add_imm(args, OpndSize_8, imm, true/*is_signed*/);
     else
       add_imm(args, size, imm, true/*is_signed*/);
@@ -419,6 +422,9 @@ extern "C" ENCODER_DECLARE_EXPORT char * encoder_mem_fp(Mnemonic m, OpndSize siz
     return stream;
 }
 
+extern "C" ENCODER_DECLARE_EXPORT char * encoder_prefix(InstrPrefix p, char * stream) {
+    return (char *)EncoderBase::prefix(stream, (InstPrefix)p);
+}
 extern "C" ENCODER_DECLARE_EXPORT char * encoder_return(char * stream) {
     EncoderBase::Operands args;
     char* stream_start = stream;
@@ -218,6 +218,7 @@ ENCODER_DECLARE_EXPORT char* encoder_fp_mem(Mnemonic m, OpndSize size, int reg,
 ENCODER_DECLARE_EXPORT char* encoder_mem_fp(Mnemonic m, OpndSize size,
                   int disp, int base_reg, bool isBasePhysical,
                   int reg, char* stream);
+ENCODER_DECLARE_EXPORT char* encoder_prefix(InstrPrefix p, char* stream);
 ENCODER_DECLARE_EXPORT char* encoder_return(char* stream);
 ENCODER_DECLARE_EXPORT char* encoder_compare_fp_stack(bool pop, int reg, bool isDouble, char* stream);
 ENCODER_DECLARE_EXPORT char* encoder_movez_mem_to_reg(OpndSize size,
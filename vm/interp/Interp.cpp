@@ -1257,6 +1257,13 @@ Method* dvmInterpFindInterfaceMethod(ClassObject* thisClass, u4 methodIdx,
     /* make sure absMethod->methodIndex means what we think it means */
     assert(dvmIsAbstractMethod(absMethod));
 
+    /* no search needed unless the imtable slot is shared */
+    if (thisClass->imtable != NULL) {
+        const ImtEntry* entry = &thisClass->imtable[dvmImtIndex(absMethod)];
+        if (entry->absMethod == absMethod)
+            return entry->method;
+    }
+
     /*
      * Run through the "this" object's iftable.  Find the entry for
      * absMethod's class, then use absMethod->methodIndex to find
@@ -1598,6 +1605,51 @@ void dvmCheckInterpStateConsistency()
     dvmUnlockThreadList();
 }
 
+/*
+ * Arm a safepoint callback for a thread, unless a different one is
+ * already pending.  Returns false, leaving the pending callback in
+ * place, if so.  Callers that share the safe point with other users
+ * must use this instead of checking thread->callback first, since the
+ * callback may be armed by someone else between the check and the arm.
+ */
+bool dvmTryArmSafePointCallback(Thread* thread, SafePointCallback funct,
+                                void* arg)
+{
+    bool armed = true;
+
+    assert(funct != NULL);
+    dvmLockMutex(&thread->callbackMutex);
+    if (thread->callback == NULL) {
+        thread->callback = funct;
+        thread->callbackArg = arg;
+        dvmEnableSubMode(thread, kSubModeCallbackPending);
+    } else if ((funct != thread->callback) ||
+               (arg != thread->callbackArg)) {
+        armed = false;
+    }
+    dvmUnlockMutex(&thread->callbackMutex);
+    return armed;
+}
+
+/*
+ * Cancel a thread's pending safepoint callback, but only if it is
+ * "funct".  Returns false if another callback (or none) was pending.
+ */
+bool dvmDisarmSafePointCallback(Thread* thread, SafePointCallback funct)
+{
+    bool disarmed = false;
+
+    dvmLockMutex(&thread->callbackMutex);
+    if (thread->callback == funct) {
+        thread->callback = NULL;
+        thread->callbackArg = NULL;
+        dvmDisableSubMode(thread, kSubModeCallbackPending);
+        disarmed = true;
+    }
+    dvmUnlockMutex(&thread->callbackMutex);
+    return disarmed;
+}
+
 /*
  * Arm a safepoint callback for a thread.  If funct is null,
  * clear any pending callback.
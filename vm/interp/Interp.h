@@ -108,6 +108,18 @@ void dvmInitializeInterpBreak(Thread* thread);
 void dvmArmSafePointCallback(Thread* thread, SafePointCallback funct,
                              void* arg);
 
+/*
+ * Like dvmArmSafePointCallback, but returns false instead of aborting if
+ * a different callback is already registered.
+ */
+bool dvmTryArmSafePointCallback(Thread* thread, SafePointCallback funct,
+                                void* arg);
+
+/*
+ * Cancel the pending callback if it is funct; returns false otherwise.
+ */
+bool dvmDisarmSafePointCallback(Thread* thread, SafePointCallback funct);
+
 
 #ifndef DVM_NO_ASM_INTERP
 extern void* dvmAsmInstructionStart[];
@@ -473,26 +473,59 @@ void dvmJitStats()
     int not_hit;
     int chains;
     int stubs;
-    if (gDvmJit.pJitEntryTable) {
+    const JitTable* table = gDvmJit.pJitTable;
+    if (table) {
         for (i=0, stubs=chains=hit=not_hit=0;
-             i < (int) gDvmJit.jitTableSize;
+             i < (int) table->size;
              i++) {
-            if (gDvmJit.pJitEntryTable[i].dPC != 0) {
+            if (table->entries[i].dPC != 0) {
                 hit++;
-                if (gDvmJit.pJitEntryTable[i].codeAddress ==
+                if (table->entries[i].codeAddress ==
                       dvmCompilerGetInterpretTemplate())
                     stubs++;
             } else
                 not_hit++;
-            if (gDvmJit.pJitEntryTable[i].u.info.chain != gDvmJit.jitTableSize)
+            if (table->entries[i].u.info.chain != table->size)
                 chains++;
         }
-        ALOGD("JIT: table size is %d, entries used is %d",
-             gDvmJit.jitTableSize,  gDvmJit.jitTableEntriesUsed);
+        ALOGD("JIT: table size is %d, entries used is %d, %d resizes",
+             table->size,  gDvmJit.jitTableEntriesUsed,
+             gDvmJit.jitTableResizes);
         ALOGD("JIT: %d traces, %d slots, %d chains, %d thresh, %s",
              hit, not_hit + hit, chains, gDvmJit.threshold,
              gDvmJit.blockingMode ? "Blocking" : "Non-blocking");
 
+        /*
+         * Fragmentation is the space stranded at the ends of filled
+         * segments, as a share of all the segments in use.
+         */
+        unsigned int live = dvmCompilerCodeCacheLiveBytes();
+        unsigned int span = gDvmJit.codeCacheHighMark - gDvmJit.templateSize;
+        unsigned int unfilled =
+            gDvmJit.codeCacheByteLimit - gDvmJit.codeCacheByteUsed;
+        ALOGD("JIT: code cache %u/%u bytes live in segment %d/%d, "
+             "%d evictions (%d translations), %u%% fragmented",
+             live, gDvmJit.codeCacheSize - gDvmJit.templateSize,
+             gDvmJit.codeCacheCurrentSegment, JIT_CODE_CACHE_SEGMENTS,
+             gDvmJit.numCodeCacheEvictions, gDvmJit.numTranslationsEvicted,
+             span == 0 ? 0 : (span - live - unfilled) * 100 / span);
+
+        if (gDvmJit.warmStartFile != NULL) {
+            ALOGD("JIT: warm start %d traces loaded, %d queued, %d dropped",
+                 gDvmJit.numWarmStartLoaded, gDvmJit.numWarmStartQueued,
+                 gDvmJit.numWarmStartDropped);
+        }
+
+        ALOGD("JIT: call sites: %d profiled, %d polymorphic, %d megamorphic",
+             gDvmJit.callSitesProfiled, gDvmJit.callSitesPolymorphic,
+             gDvmJit.callSitesMegamorphic);
+        ALOGD("JIT: type check sites: %d cached", gDvmJit.typeCheckSitesUsed);
+        ALOGD("JIT: trace trees: %d grown, %d exits tracked, %d dropped",
+             gDvmJit.traceTreesGrown,
+             gDvmJit.traceTreeExits == NULL ? 0 :
+                 dvmHashTableNumEntries(gDvmJit.traceTreeExits),
+             gDvmJit.traceTreeExitsDropped);
+
 #if defined(WITH_JIT_TUNING)
         ALOGD("JIT: Code cache patches: %d", gDvmJit.codeCachePatches);
 
@@ -520,6 +553,22 @@ void dvmJitStats()
         ALOGD("JIT: Inline: %d mgetter, %d msetter, %d pgetter, %d psetter",
              gDvmJit.invokeMonoGetterInlined, gDvmJit.invokeMonoSetterInlined,
              gDvmJit.invokePolyGetterInlined, gDvmJit.invokePolySetterInlined);
+        ALOGD("JIT: Inline: %d mbody, %d nested calls, %d extra ptargets",
+             gDvmJit.invokeMonoBodyInlined, gDvmJit.invokeNestedInlined,
+             gDvmJit.invokePolyTargetsInlined);
+        ALOGD("JIT: Loop promotion: %d regs promoted, %d left in the frame, "
+             "%d body refs covered",
+             gDvmJit.loopRegsPromoted, gDvmJit.loopRegsDropped,
+             gDvmJit.loopRegRefsPromoted);
+        ALOGD("JIT: Loop invariant motion: %d MIRs hoisted",
+             gDvmJit.loopInvariantsHoisted);
+        ALOGD("JIT: Loop vectorization: %d loops", gDvmJit.loopsVectorized);
+        ALOGD("JIT: Value numbering: %d loads, %d exprs, %d null checks "
+              "eliminated", gDvmJit.gvnLoadsEliminated,
+              gDvmJit.gvnExprsEliminated, gDvmJit.gvnNullChecksEliminated);
+        ALOGD("JIT: Escape analysis: %d allocations eliminated in %d loops, "
+              "%d rebuilt at exits", gDvmJit.allocsEliminated,
+              gDvmJit.loopsWithAllocsEliminated, gDvmJit.allocsMaterialized);
         ALOGD("JIT: Total compilation time: %llu ms", gDvmJit.jitTime / 1000);
         ALOGD("JIT: Avg unit compilation time: %llu us",
              gDvmJit.numCompilations == 0 ? 0 :
@@ -555,36 +604,46 @@ void dvmJitEndTraceSelect(Thread* self, const u2* dPC)
 }
 
 /*
- * Find an entry in the JitTable, creating if necessary.
- * Returns null if table is full.
+ * Find an entry in "table", creating if necessary.  Returns null if the
+ * table is full.  Unless the caller holds tableLock, creating an entry
+ * switches to the current table once the lock is held, since a resize may
+ * have replaced "table" in the meantime.
  */
-static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
-                              bool isMethodEntry)
+static JitEntry *lookupAndAddInTable(JitTable* table, const u2* dPC,
+                                     bool callerLocked, bool isMethodEntry)
 {
-    u4 chainEndMarker = gDvmJit.jitTableSize;
-    u4 idx = dvmJitHash(dPC);
+    JitEntry* entries = table->entries;
+    u4 chainEndMarker = table->size;
+    u4 idx = dvmJitHash(table, dPC);
 
     /*
      * Walk the bucket chain to find an exact match for our PC and trace/method
      * type
      */
-    while ((gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) &&
-           ((gDvmJit.pJitEntryTable[idx].dPC != dPC) ||
-            (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry !=
-             isMethodEntry))) {
-        idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
+    while ((entries[idx].u.info.chain != chainEndMarker) &&
+           ((entries[idx].dPC != dPC) ||
+            (entries[idx].u.info.isMethodEntry != isMethodEntry))) {
+        idx = entries[idx].u.info.chain;
     }
 
-    if (gDvmJit.pJitEntryTable[idx].dPC != dPC ||
-        gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry != isMethodEntry) {
+    if (entries[idx].dPC != dPC ||
+        entries[idx].u.info.isMethodEntry != isMethodEntry) {
         /*
          * No match.  Aquire jitTableLock and find the last
          * slot in the chain. Possibly continue the chain walk in case
          * some other thread allocated the slot we were looking
          * at previuosly (perhaps even the dPC we're trying to enter).
          */
-        if (!callerLocked)
+        if (!callerLocked) {
             dvmLockMutex(&gDvmJit.tableLock);
+            if (gDvmJit.pJitTable != table) {
+                /* Resized while we waited - start over in the new table */
+                table = gDvmJit.pJitTable;
+                entries = table->entries;
+                chainEndMarker = table->size;
+                idx = dvmJitHash(table, dPC);
+            }
+        }
         /*
          * At this point, if .dPC is NULL, then the slot we're
          * looking at is the target slot from the primary hash
@@ -592,29 +651,30 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
          * to have to find a free slot and chain it.
          */
         ANDROID_MEMBAR_FULL(); /* Make sure we reload [].dPC after lock */
-        if (gDvmJit.pJitEntryTable[idx].dPC != NULL) {
+        if (entries[idx].dPC != NULL) {
             u4 prev;
-            while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-                if (gDvmJit.pJitEntryTable[idx].dPC == dPC &&
-                    gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
-                        isMethodEntry) {
+            while (true) {
+                if (entries[idx].dPC == dPC &&
+                    entries[idx].u.info.isMethodEntry == isMethodEntry) {
                     /* Another thread got there first for this dPC */
                     if (!callerLocked)
                         dvmUnlockMutex(&gDvmJit.tableLock);
-                    return &gDvmJit.pJitEntryTable[idx];
+                    return &entries[idx];
                 }
-                idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
+                if (entries[idx].u.info.chain == chainEndMarker)
+                    break;
+                idx = entries[idx].u.info.chain;
             }
             /* Here, idx should be pointing to the last cell of an
              * active chain whose last member contains a valid dPC */
-            assert(gDvmJit.pJitEntryTable[idx].dPC != NULL);
+            assert(entries[idx].dPC != NULL);
             /* Linear walk to find a free cell and add it to the end */
             prev = idx;
             while (true) {
                 idx++;
                 if (idx == chainEndMarker)
                     idx = 0;  /* Wraparound */
-                if ((gDvmJit.pJitEntryTable[idx].dPC == NULL) ||
+                if ((entries[idx].dPC == NULL) ||
                     (idx == prev))
                     break;
             }
@@ -627,25 +687,25 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
                  * packed into the word may be in use by other threads.
                  */
                 do {
-                    oldValue = gDvmJit.pJitEntryTable[prev].u;
+                    oldValue = entries[prev].u;
                     newValue = oldValue;
                     newValue.info.chain = idx;
                 } while (android_atomic_release_cas(oldValue.infoWord,
                         newValue.infoWord,
-                        &gDvmJit.pJitEntryTable[prev].u.infoWord) != 0);
+                        &entries[prev].u.infoWord) != 0);
             }
         }
-        if (gDvmJit.pJitEntryTable[idx].dPC == NULL) {
-            gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry = isMethodEntry;
+        if (entries[idx].dPC == NULL) {
+            entries[idx].u.info.isMethodEntry = isMethodEntry;
             /*
              * Initialize codeAddress and allocate the slot.  Must
              * happen in this order (since dPC is set, the entry is live.
              */
             android_atomic_release_store((int32_t)dPC,
-                 (volatile int32_t *)(void *)&gDvmJit.pJitEntryTable[idx].dPC);
+                 (volatile int32_t *)(void *)&entries[idx].dPC);
             /* for simulator mode, we need to initialized codeAddress to null */
-            gDvmJit.pJitEntryTable[idx].codeAddress = NULL;
-            gDvmJit.pJitEntryTable[idx].dPC = dPC;
+            entries[idx].codeAddress = NULL;
+            entries[idx].dPC = dPC;
             gDvmJit.jitTableEntriesUsed++;
         } else {
             /* Table is full */
@@ -654,7 +714,18 @@ static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
         if (!callerLocked)
             dvmUnlockMutex(&gDvmJit.tableLock);
     }
-    return (idx == chainEndMarker) ? NULL : &gDvmJit.pJitEntryTable[idx];
+    return (idx == chainEndMarker) ? NULL : &entries[idx];
+}
+
+/*
+ * Find an entry in the JitTable, creating if necessary.
+ * Returns null if table is full.
+ */
+static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
+                              bool isMethodEntry)
+{
+    return lookupAndAddInTable(gDvmJit.pJitTable, dPC, callerLocked,
+                               isMethodEntry);
 }
 
 /* Dump a trace description */
@@ -1000,20 +1071,22 @@ void dvmCheckJit(const u2* pc, Thread* self)
 
 JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry)
 {
-    int idx = dvmJitHash(pc);
+    JitTable* table = gDvmJit.pJitTable;
+    JitEntry* entries = table->entries;
+    int idx = dvmJitHash(table, pc);
 
     /* Expect a high hit rate on 1st shot */
-    if ((gDvmJit.pJitEntryTable[idx].dPC == pc) &&
-        (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry == isMethodEntry))
-        return &gDvmJit.pJitEntryTable[idx];
+    if ((entries[idx].dPC == pc) &&
+        (entries[idx].u.info.isMethodEntry == isMethodEntry))
+        return &entries[idx];
     else {
-        int chainEndMarker = gDvmJit.jitTableSize;
-        while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-            idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
-            if ((gDvmJit.pJitEntryTable[idx].dPC == pc) &&
-                (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
+        int chainEndMarker = table->size;
+        while (entries[idx].u.info.chain != chainEndMarker) {
+            idx = entries[idx].u.info.chain;
+            if ((entries[idx].dPC == pc) &&
+                (entries[idx].u.info.isMethodEntry ==
                 isMethodEntry))
-                return &gDvmJit.pJitEntryTable[idx];
+                return &entries[idx];
         }
     }
     return NULL;
@@ -1025,33 +1098,35 @@ JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry)
  */
 void* getCodeAddrCommon(const u2* dPC, bool methodEntry)
 {
-    int idx = dvmJitHash(dPC);
-    const u2* pc = gDvmJit.pJitEntryTable[idx].dPC;
+    JitTable* table = gDvmJit.pJitTable;
+    JitEntry* entries = table->entries;
+    int idx = dvmJitHash(table, dPC);
+    const u2* pc = entries[idx].dPC;
     if (pc != NULL) {
         bool hideTranslation = dvmJitHideTranslation();
         if (pc == dPC &&
-            gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry == methodEntry) {
+            entries[idx].u.info.isMethodEntry == methodEntry) {
             int offset = (gDvmJit.profileMode >= kTraceProfilingContinuous) ?
-                 0 : gDvmJit.pJitEntryTable[idx].u.info.profileOffset;
+                 0 : entries[idx].u.info.profileOffset;
             intptr_t codeAddress =
-                (intptr_t)gDvmJit.pJitEntryTable[idx].codeAddress;
+                (intptr_t)entries[idx].codeAddress;
 #if defined(WITH_JIT_TUNING)
             gDvmJit.addrLookupsFound++;
 #endif
             return hideTranslation || !codeAddress ?  NULL :
                   (void *)(codeAddress + offset);
         } else {
-            int chainEndMarker = gDvmJit.jitTableSize;
-            while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-                idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
-                if (gDvmJit.pJitEntryTable[idx].dPC == dPC &&
-                    gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
+            int chainEndMarker = table->size;
+            while (entries[idx].u.info.chain != chainEndMarker) {
+                idx = entries[idx].u.info.chain;
+                if (entries[idx].dPC == dPC &&
+                    entries[idx].u.info.isMethodEntry ==
                         methodEntry) {
                     int offset = (gDvmJit.profileMode >=
                         kTraceProfilingContinuous) ? 0 :
-                        gDvmJit.pJitEntryTable[idx].u.info.profileOffset;
+                        entries[idx].u.info.profileOffset;
                     intptr_t codeAddress =
-                        (intptr_t)gDvmJit.pJitEntryTable[idx].codeAddress;
+                        (intptr_t)entries[idx].codeAddress;
 #if defined(WITH_JIT_TUNING)
                     gDvmJit.addrLookupsFound++;
 #endif
@@ -1117,19 +1192,24 @@ void* dvmJitGetMethodAddrThread(const u2* dPC, Thread* self)
  * template cannot handle a non-zero prefix.
  * NOTE: JitTable must not be in danger of reset while this
  * code is executing. see Issue 4271784 for details.
+ * NOTE: the lookup and the update are done under tableLock, so that a
+ * resize can't copy the entry in between and leave the update behind in
+ * the old table.
  */
 void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
                        bool isMethodEntry, int profilePrefixSize)
 {
     JitEntryInfoUnion oldValue;
     JitEntryInfoUnion newValue;
+
+    dvmLockMutex(&gDvmJit.tableLock);
     /*
      * Get the JitTable slot for this dPC (or create one if JitTable
      * has been reset between the time the trace was requested and
      * now.
      */
     JitEntry *jitEntry = isMethodEntry ?
-        lookupAndAdd(dPC, false /* caller holds tableLock */, isMethodEntry) :
+        lookupAndAdd(dPC, true /* caller holds tableLock */, isMethodEntry) :
                      dvmJitFindEntry(dPC, isMethodEntry);
     assert(jitEntry);
     /* Note: order of update is important */
@@ -1139,10 +1219,154 @@ void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
         newValue.info.isMethodEntry = isMethodEntry;
         newValue.info.instructionSet = set;
         newValue.info.profileOffset = profilePrefixSize;
+        newValue.info.retranslate = false;
     } while (android_atomic_release_cas(
              oldValue.infoWord, newValue.infoWord,
              &jitEntry->u.infoWord) != 0);
     jitEntry->codeAddress = nPC;
+    dvmUnlockMutex(&gDvmJit.tableLock);
+}
+
+/*
+ * Set or clear the flag that lets the interpreter request a new
+ * translation for a JitTable entry that has no code.  Caller holds
+ * tableLock, and found "jitEntry" while holding it.
+ */
+static void setRetranslate(JitEntry* jitEntry, bool retranslate)
+{
+    JitEntryInfoUnion oldValue;
+    JitEntryInfoUnion newValue;
+
+    do {
+        oldValue = jitEntry->u;
+        newValue = oldValue;
+        newValue.info.retranslate = retranslate;
+    } while (android_atomic_release_cas(
+             oldValue.infoWord, newValue.infoWord,
+             &jitEntry->u.infoWord) != 0);
+}
+
+/*
+ * The translation for this trace head was discarded (the code cache
+ * filled up while compiling it).  Normally an entry without code means a
+ * request is in progress, so flag it to let the next request through.
+ */
+void dvmJitMarkForRetranslation(const u2* dPC)
+{
+    dvmLockMutex(&gDvmJit.tableLock);
+    JitEntry *jitEntry = dvmJitFindEntry(dPC, false /* method entry */);
+    if (jitEntry != NULL && jitEntry->codeAddress == NULL)
+        setRetranslate(jitEntry, true);
+    dvmUnlockMutex(&gDvmJit.tableLock);
+}
+
+/*
+ * The whole-method translation starting at dPC couldn't be built.  Flag the
+ * entry so later requests for the method build ordinary traces instead,
+ * starting with one at dPC itself.
+ */
+void dvmJitMethodTraceFailed(const u2* dPC)
+{
+    JitEntryInfoUnion oldValue;
+    JitEntryInfoUnion newValue;
+
+    dvmLockMutex(&gDvmJit.tableLock);
+    JitEntry *jitEntry = dvmJitFindEntry(dPC, false /* method entry */);
+    if (jitEntry != NULL && jitEntry->codeAddress == NULL) {
+        do {
+            oldValue = jitEntry->u;
+            newValue = oldValue;
+            newValue.info.traceOnly = true;
+            newValue.info.retranslate = true;
+        } while (android_atomic_release_cas(
+                 oldValue.infoWord, newValue.infoWord,
+                 &jitEntry->u.infoWord) != 0);
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+}
+
+/*
+ * Queue a trace the interpreter hasn't asked for yet (JIT warm start).
+ * Returns false, leaving "desc" with the caller, if the trace head is
+ * already known or the request can't be queued.
+ */
+bool dvmJitRequestTranslation(const u2* dPC, JitTraceDescription* desc)
+{
+    if (dvmJitFindEntry(dPC, false /* method entry */) != NULL)
+        return false;
+
+    JitEntry *slot = lookupAndAdd(dPC, false /* lock */,
+                                  false /* method entry */);
+    if (slot == NULL)
+        return false;
+
+    if (!dvmCompilerWorkEnqueue(dPC, kWorkOrderTrace, desc)) {
+        /* Don't leave the entry looking like a request in progress */
+        dvmJitMarkForRetranslation(dPC);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * -Xjitmode:method: a hot trace head asks for the whole method holding it,
+ * compiled from its first instruction.  A request at the method entry is
+ * used up here; one at a loop head still builds its own trace, as the
+ * invocation that is looping can't move into the method translation.
+ */
+static void requestMethodTrace(Thread* self)
+{
+    const Method* method = self->interpSave.method;
+    const u2* insns = method->insns;
+
+    if (dvmIsNativeMethod(method) ||
+        dvmGetMethodInsnsSize(method) > JIT_MAX_METHOD_TRACE_SIZE) {
+        return;
+    }
+
+    dvmLockMutex(&gDvmJit.tableLock);
+    JitEntry *entry = dvmJitFindEntry(insns, false /* method entry */);
+    if (entry != NULL &&
+        (entry->u.info.traceOnly || !entry->u.info.retranslate)) {
+        /* Compiled, in progress, or left to ordinary traces */
+        dvmUnlockMutex(&gDvmJit.tableLock);
+        return;
+    }
+    if (entry != NULL) {
+        setRetranslate(entry, false);
+    } else {
+        entry = lookupAndAdd(insns, true /* lock */,
+                             false /* method entry */);
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+    if (entry == NULL) {
+        return;
+    }
+
+    JitTraceDescription* desc =
+        (JitTraceDescription*)calloc(1, sizeof(JitTraceDescription) +
+                                        sizeof(JitTraceRun));
+    if (desc == NULL) {
+        dvmJitMarkForRetranslation(insns);
+        return;
+    }
+    desc->method = method;
+    desc->trace[0].isCode = true;
+    desc->trace[0].info.frag.startOffset = 0;
+    desc->trace[0].info.frag.runEnd = true;
+    desc->trace[0].info.frag.hint = kJitHintNone;
+
+    if (!dvmCompilerWorkEnqueue(insns, kWorkOrderMethod, desc)) {
+        free(desc);
+        dvmJitMarkForRetranslation(insns);
+        return;
+    }
+    if (gDvmJit.blockingMode) {
+        dvmCompilerDrainQueue();
+    }
+    if (self->interpSave.pc == insns) {
+        self->jitState = kJitDone;
+    }
 }
 
 /*
@@ -1211,7 +1435,7 @@ void dvmJitCheckTraceRequest(Thread* self)
     assert((self->interpBreak.ctl.subMode & kSubModeJitTraceBuild)==0);
 
     /* Check if the JIT request can be handled now */
-    if ((gDvmJit.pJitEntryTable != NULL) &&
+    if ((gDvmJit.pJitTable != NULL) &&
         ((self->interpBreak.ctl.breakFlags & kInterpSingleStep) == 0)){
         /* Bypass the filter for hot trace requests or during stress mode */
         if (self->jitState == kJitTSelectRequest &&
@@ -1235,32 +1459,59 @@ void dvmJitCheckTraceRequest(Thread* self)
             }
         }
 
-        /* If the compiler is backlogged, cancel any JIT actions */
+        /*
+         * If the compiler is backlogged, cancel any JIT actions.  A request
+         * for a trace that is already queued still tells us it's hot.
+         */
         if (gDvmJit.compilerQueueLength >= gDvmJit.compilerHighWater) {
+            if (self->jitState == kJitTSelectRequest ||
+                self->jitState == kJitTSelectRequestHot) {
+                dvmCompilerBumpWorkOrder(self->interpSave.pc);
+            }
             self->jitState = kJitDone;
         }
 
+        if (gDvmJit.methodTraces &&
+            (self->jitState == kJitTSelectRequest ||
+             self->jitState == kJitTSelectRequestHot)) {
+            requestMethodTrace(self);
+        }
+
         /*
          * Check for additional reasons that might force the trace select
          * request to be dropped
          */
         if (self->jitState == kJitTSelectRequest ||
             self->jitState == kJitTSelectRequestHot) {
-            if (dvmJitFindEntry(self->interpSave.pc, false)) {
-                /* In progress - nothing do do */
-               self->jitState = kJitDone;
+            dvmLockMutex(&gDvmJit.tableLock);
+            JitEntry *entry = dvmJitFindEntry(self->interpSave.pc, false);
+            bool inProgress = false;
+            bool tableFull = false;
+            if (entry != NULL && entry->u.info.retranslate) {
+                /* Translation was evicted or discarded - build it again */
+                setRetranslate(entry, false);
+            } else if (entry != NULL) {
+                inProgress = true;
             } else {
-                JitEntry *slot = lookupAndAdd(self->interpSave.pc,
-                                              false /* lock */,
-                                              false /* method entry */);
-                if (slot == NULL) {
-                    /*
-                     * Table is full.  This should have been
-                     * detected by the compiler thread and the table
-                     * resized before we run into it here.  Assume bad things
-                     * are afoot and disable profiling.
-                     */
-                    self->jitState = kJitDone;
+                tableFull = lookupAndAdd(self->interpSave.pc,
+                                         true /* lock */,
+                                         false /* method entry */) == NULL;
+            }
+            dvmUnlockMutex(&gDvmJit.tableLock);
+
+            if (inProgress) {
+                /* In progress - nothing do do but move it up the queue */
+               dvmCompilerBumpWorkOrder(self->interpSave.pc);
+               self->jitState = kJitDone;
+            } else if (tableFull) {
+                /*
+                 * Table is full.  The compiler thread grows it as
+                 * it fills up, so drop this request and let a later
+                 * one in.  If it can't grow any more, assume bad
+                 * things are afoot and disable profiling.
+                 */
+                self->jitState = kJitDone;
+                if (gDvmJit.jitTableSize * 2 >= JIT_MAX_ENTRIES) {
                     ALOGD("JIT: JitTable full, disabling profiling");
                     dvmJitStopTranslationRequests();
                 }
@@ -1304,76 +1555,135 @@ void dvmJitCheckTraceRequest(Thread* self)
 }
 
 /*
- * Resizes the JitTable.  Must be a power of 2, and returns true on failure.
- * Stops all threads, and thus is a heavyweight operation. May only be called
- * by the compiler thread.
+ * Allocate an empty JitTable of "size" entries.  Returns NULL if it can't
+ * be allocated, or if "size" doesn't fit the chain field.
  */
-bool dvmJitResizeJitTable( unsigned int size )
+JitTable *dvmJitAllocTable(unsigned int size)
 {
-    JitEntry *pNewTable;
-    JitEntry *pOldTable;
     JitEntry tempEntry;
-    unsigned int oldSize;
     unsigned int i;
 
-    assert(gDvmJit.pJitEntryTable != NULL);
     assert(size && !(size & (size - 1)));   /* Is power of 2? */
 
-    ALOGI("Jit: resizing JitTable from %d to %d", gDvmJit.jitTableSize, size);
-
-    if (size <= gDvmJit.jitTableSize) {
-        return true;
-    }
-
     /* Make sure requested size is compatible with chain field width */
     tempEntry.u.info.chain = size;
     if (tempEntry.u.info.chain != size) {
         ALOGD("Jit: JitTable request of %d too big", size);
-        return true;
+        return NULL;
     }
 
-    pNewTable = (JitEntry*)calloc(size, sizeof(*pNewTable));
-    if (pNewTable == NULL) {
-        return true;
+    JitTable *table = (JitTable*)calloc(1, sizeof(*table));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->entries = (JitEntry*)calloc(size, sizeof(*table->entries));
+    if (table->entries == NULL) {
+        free(table);
+        return NULL;
     }
     for (i=0; i< size; i++) {
-        pNewTable[i].u.info.chain = size;  /* Initialize chain termination */
+        table->entries[i].u.info.chain = size;  /* Initialize chain termination */
     }
+    table->size = size;
+    return table;
+}
+
+/*
+ * Resizes the JitTable.  Must be a power of 2, and returns true on failure.
+ * May only be called by compiler threads.
+ *
+ * Other threads keep running.  Entries are only added with tableLock held,
+ * so copying under it gets all of them, and the new table is published
+ * before the lock is released; a thread that was waiting to add to the old
+ * table moves on to the new one.  Lookups already walking the old table
+ * can finish there, so it's retired rather than freed.
+ */
+bool dvmJitResizeJitTable( unsigned int size )
+{
+    JitTable *pNewTable;
+    JitTable *pOldTable;
+    unsigned int i;
+
+    assert(gDvmJit.pJitTable != NULL);
+    assert(size && !(size & (size - 1)));   /* Is power of 2? */
+
+    ALOGI("Jit: resizing JitTable from %d to %d", gDvmJit.jitTableSize, size);
 
-    /* Stop all other interpreting/jit'ng threads */
-    dvmSuspendAllThreads(SUSPEND_FOR_TBL_RESIZE);
+    if (size <= gDvmJit.jitTableSize) {
+        return true;
+    }
 
-    pOldTable = gDvmJit.pJitEntryTable;
-    oldSize = gDvmJit.jitTableSize;
+    pNewTable = dvmJitAllocTable(size);
+    if (pNewTable == NULL) {
+        return true;
+    }
 
     dvmLockMutex(&gDvmJit.tableLock);
-    gDvmJit.pJitEntryTable = pNewTable;
-    gDvmJit.jitTableSize = size;
-    gDvmJit.jitTableMask = size - 1;
+
+    /* Another compiler thread may have grown the table in the meantime */
+    if (size <= gDvmJit.jitTableSize) {
+        dvmUnlockMutex(&gDvmJit.tableLock);
+        free(pNewTable->entries);
+        free(pNewTable);
+        return false;
+    }
+
+    pOldTable = gDvmJit.pJitTable;
     gDvmJit.jitTableEntriesUsed = 0;
 
-    for (i=0; i < oldSize; i++) {
-        if (pOldTable[i].dPC) {
+    for (i=0; i < pOldTable->size; i++) {
+        const JitEntry *old = &pOldTable->entries[i];
+        if (old->dPC) {
             JitEntry *p;
             u2 chain;
-            p = lookupAndAdd(pOldTable[i].dPC, true /* holds tableLock*/,
-                             pOldTable[i].u.info.isMethodEntry);
-            p->codeAddress = pOldTable[i].codeAddress;
+            p = lookupAndAddInTable(pNewTable, old->dPC,
+                                    true /* holds tableLock*/,
+                                    old->u.info.isMethodEntry);
+            p->codeAddress = old->codeAddress;
             /* We need to preserve the new chain field, but copy the rest */
             chain = p->u.info.chain;
-            p->u = pOldTable[i].u;
+            p->u = old->u;
             p->u.info.chain = chain;
         }
     }
 
+    /* The entries have to be visible before the table is */
+    pNewTable->retired = pOldTable;
+    android_atomic_release_store((int32_t)pNewTable,
+                                 (volatile int32_t *)(void *)&gDvmJit.pJitTable);
+    gDvmJit.pJitEntryTable = pNewTable->entries;
+    gDvmJit.jitTableSize = size;
+    gDvmJit.jitTableMask = size - 1;
+    gDvmJit.jitTableResizes++;
+
     dvmUnlockMutex(&gDvmJit.tableLock);
 
-    free(pOldTable);
+    return false;
+}
+
+/*
+ * Free the JitTables replaced by resizing.  Must be called with all
+ * mutator threads suspended, so none of them is part way through a
+ * lookup in an old table.
+ */
+void dvmJitFreeRetiredTables()
+{
+    JitTable *retired;
+
+    if (gDvmJit.pJitTable == NULL)
+        return;
 
-    /* Restart the world */
-    dvmResumeAllThreads(SUSPEND_FOR_TBL_RESIZE);
+    dvmLockMutex(&gDvmJit.tableLock);
+    retired = gDvmJit.pJitTable->retired;
+    gDvmJit.pJitTable->retired = NULL;
+    dvmUnlockMutex(&gDvmJit.tableLock);
 
-    return false;
+    while (retired != NULL) {
+        JitTable *next = retired->retired;
+        free(retired->entries);
+        free(retired);
+        retired = next;
+    }
 }
 
 /*
@@ -1381,11 +1691,14 @@ bool dvmJitResizeJitTable( unsigned int size )
  */
 void dvmJitResetTable()
 {
-    JitEntry *jitEntry = gDvmJit.pJitEntryTable;
-    unsigned int size = gDvmJit.jitTableSize;
+    JitEntry *jitEntry;
+    unsigned int size;
     unsigned int i;
 
+    /* The compiler thread may be resizing the table */
     dvmLockMutex(&gDvmJit.tableLock);
+    jitEntry = gDvmJit.pJitEntryTable;
+    size = gDvmJit.jitTableSize;
 
     /* Note: If need to preserve any existing counts. Do so here. */
     if (gDvmJit.pJitTraceProfCounters) {
@@ -24,6 +24,10 @@
 
 #define JIT_MAX_TRACE_LEN 100
 
+/* Largest method (in code units and basic blocks) -Xjitmode:method takes */
+#define JIT_MAX_METHOD_TRACE_SIZE 2000
+#define JIT_MAX_METHOD_TRACE_BLOCKS 256
+
 #if defined (WITH_SELF_VERIFICATION)
 
 #define REG_SPACE 256                /* default size of shadow space */
@@ -91,10 +95,6 @@ static inline u4 dvmJitHashMask( const u2* p, u4 mask ) {
     return ((((u4)p>>12)^(u4)p)>>1) & (mask);
 }
 
-static inline u4 dvmJitHash( const u2* p ) {
-    return dvmJitHashMask( p, gDvmJit.jitTableMask );
-}
-
 /*
  * The width of the chain field in JitEntryInfo sets the upper
  * bound on the number of translations.  Be careful if changing
@@ -130,7 +130,9 @@ struct JitEntryInfo {
     unsigned int           profileEnabled:1;
     JitInstructionSetType  instructionSet:3;
     unsigned int           profileOffset:5;
-    unsigned int           unused:5;
+    unsigned int           retranslate:1;         /* translation discarded */
+    unsigned int           traceOnly:1;           /* whole method failed */
+    unsigned int           unused:3;
     u2                     chain;                 /* Index of next in chain */
 };
 
@@ -145,6 +147,22 @@ struct JitEntry {
     void*               codeAddress;    /* Code address of native translation */
 };
 
+/*
+ * One generation of the JitTable.  Lock-free lookups load gDvmJit.pJitTable
+ * once and stay on that generation, so a resize can publish a bigger one
+ * while they run.  Replaced generations are kept on the retired list until
+ * the next safe point, when no thread can still be looking at them.
+ */
+struct JitTable {
+    JitEntry*           entries;
+    unsigned int        size;           /* Power of 2, also the chain end */
+    JitTable*           retired;        /* Older generation still to free */
+};
+
+static inline u4 dvmJitHash( const JitTable* table, const u2* p ) {
+    return dvmJitHashMask( p, table->size - 1 );
+}
+
 extern "C" {
 void dvmCheckJit(const u2* pc, Thread* self);
 void* dvmJitGetTraceAddr(const u2* dPC);
@@ -153,13 +171,18 @@ void* dvmJitGetTraceAddrThread(const u2* dPC, Thread* self);
 void* dvmJitGetMethodAddrThread(const u2* dPC, Thread* self);
 void dvmJitCheckTraceRequest(Thread* self);
 void dvmJitStopTranslationRequests(void);
+void dvmJitMarkForRetranslation(const u2* dPC);
+void dvmJitMethodTraceFailed(const u2* dPC);
+bool dvmJitRequestTranslation(const u2* dPC, JitTraceDescription* desc);
 #if defined(WITH_JIT_TUNING)
 void dvmBumpNoChain(int from);
 void dvmBumpNormal(void);
 void dvmBumpPunt(int from);
 #endif
 void dvmJitStats(void);
+JitTable *dvmJitAllocTable(unsigned int size);
 bool dvmJitResizeJitTable(unsigned int size);
+void dvmJitFreeRetiredTables(void);
 void dvmJitResetTable(void);
 JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry);
 s8 dvmJitd2l(double d);
@@ -29,6 +29,20 @@ extern "C" {
 INLINE Method* dvmFindInterfaceMethodInCache(ClassObject* thisClass,
     u4 methodIdx, const Method* method, DvmDex* methodClassDex)
 {
+    /*
+     * Once the interface method is resolved, the receiver's imtable
+     * usually has the answer.  A hit also proves that the class
+     * implements the interface.
+     */
+    if (thisClass->imtable != NULL) {
+        Method* absMethod = dvmDexGetResolvedMethod(methodClassDex, methodIdx);
+        if (absMethod != NULL) {
+            const ImtEntry* entry = &thisClass->imtable[dvmImtIndex(absMethod)];
+            if (entry->absMethod == absMethod)
+                return entry->method;
+        }
+    }
+
 #define ATOMIC_CACHE_CALC \
     dvmInterpFindInterfaceMethod(thisClass, methodIdx, method, methodClassDex)
 
@@ -55,6 +55,7 @@ static void Dalvik_dalvik_system_VMDebug_getVmFeatureList(const u4* args, JValue
     std::vector<std::string> features;
     features.push_back("method-trace-profiling");
     features.push_back("method-trace-profiling-streaming");
+    features.push_back("method-sample-profiling");
     features.push_back("hprof-heap-dump");
     features.push_back("hprof-heap-dump-streaming");
 
@@ -223,17 +224,10 @@ static void Dalvik_dalvik_system_VMDebug_resetAllocCount(const u4* args,
 }
 
 /*
- * static void startMethodTracingNative(String traceFileName,
- *     FileDescriptor fd, int bufferSize, int flags)
- *
- * Start method trace profiling.
- *
- * If both "traceFileName" and "fd" are null, the result will be sent
- * directly to DDMS.  (The non-DDMS versions of the calls are expected
- * to enforce non-NULL filenames.)
+ * Common code for the startMethodTracingNative variants.
  */
-static void Dalvik_dalvik_system_VMDebug_startMethodTracingNative(const u4* args,
-    JValue* pResult)
+static void startMethodTracing(const u4* args, bool samplingEnabled,
+    int intervalUs)
 {
     StringObject* traceFileStr = (StringObject*) args[0];
     Object* traceFd = (Object*) args[1];
@@ -245,9 +239,9 @@ static void Dalvik_dalvik_system_VMDebug_startMethodTracingNative(const u4* args
         bufferSize = 8 * 1024 * 1024;
     }
 
-    if (bufferSize < 1024) {
+    if (bufferSize < 1024 || (samplingEnabled && intervalUs <= 0)) {
         dvmThrowIllegalArgumentException(NULL);
-        RETURN_VOID();
+        return;
     }
 
     char* traceFileName = NULL;
@@ -257,20 +251,59 @@ static void Dalvik_dalvik_system_VMDebug_startMethodTracingNative(const u4* args
     int fd = -1;
     if (traceFd != NULL) {
         int origFd = getFileDescriptor(traceFd);
-        if (origFd < 0)
-            RETURN_VOID();
+        if (origFd < 0) {
+            free(traceFileName);
+            return;
+        }
 
         fd = dup(origFd);
         if (fd < 0) {
             dvmThrowExceptionFmt(gDvm.exRuntimeException,
                 "dup(%d) failed: %s", origFd, strerror(errno));
-            RETURN_VOID();
+            free(traceFileName);
+            return;
         }
     }
 
     dvmMethodTraceStart(traceFileName != NULL ? traceFileName : "[DDMS]",
-        fd, bufferSize, flags, (traceFileName == NULL && fd == -1));
+        fd, bufferSize, flags, (traceFileName == NULL && fd == -1),
+        samplingEnabled, intervalUs);
     free(traceFileName);
+}
+
+/*
+ * static void startMethodTracingNative(String traceFileName,
+ *     FileDescriptor fd, int bufferSize, int flags)
+ *
+ * Start method trace profiling.
+ *
+ * If both "traceFileName" and "fd" are null, the result will be sent
+ * directly to DDMS.  (The non-DDMS versions of the calls are expected
+ * to enforce non-NULL filenames.)
+ */
+static void Dalvik_dalvik_system_VMDebug_startMethodTracingNative(const u4* args,
+    JValue* pResult)
+{
+    startMethodTracing(args, false, 0);
+    RETURN_VOID();
+}
+
+/*
+ * static void startMethodTracingNative(String traceFileName,
+ *     FileDescriptor fd, int bufferSize, int flags, boolean samplingEnabled,
+ *     int intervalUs)
+ *
+ * Start method trace profiling, optionally sampling each running thread's
+ * stack every "intervalUs" microseconds instead of instrumenting every
+ * method entry and exit.  The output format is the same either way.
+ */
+static void Dalvik_dalvik_system_VMDebug_startMethodTracingSampling(
+    const u4* args, JValue* pResult)
+{
+    bool samplingEnabled = (args[4] != 0);
+    int intervalUs = args[5];
+
+    startMethodTracing(args, samplingEnabled, intervalUs);
     RETURN_VOID();
 }
 
@@ -435,6 +468,48 @@ static void Dalvik_dalvik_system_VMDebug_resetInstructionCount(const u4* args,
     RETURN_VOID();
 }
 
+/*
+ * static void getSafepointHistogram(int cause, int[] counts)
+ *
+ * Copy out a time-to-safepoint histogram.  If "cause" is a SuspendCause
+ * value, the histogram is of total suspend-all latency for that cause;
+ * if it's zero, it's of the time each thread took to stop.  Bucket N
+ * counts latencies in [2^(N-1), 2^N) usec.
+ */
+static void Dalvik_dalvik_system_VMDebug_getSafepointHistogram(const u4* args,
+    JValue* pResult)
+{
+    int cause = args[0];
+    ArrayObject* countArray = (ArrayObject*) args[1];
+
+    if (cause < 0 || cause >= kNumSuspendCauses) {
+        dvmThrowIllegalArgumentException(NULL);
+        RETURN_VOID();
+    }
+
+    if (countArray != NULL) {
+        const SafepointStats* stats = &gDvm.safepointStats;
+        const u4* histogram = (cause == SUSPEND_NOT) ?
+            stats->threadHistogram : stats->suspendHistogram[cause];
+        int* storage = (int*)(void*)countArray->contents;
+        u4 length = MIN(countArray->length, kSafepointHistogramBuckets);
+
+        for (u4 i = 0; i < length; i++)
+            storage[i] = histogram[i];
+    }
+    RETURN_VOID();
+}
+
+/*
+ * static void resetSafepointStats()
+ */
+static void Dalvik_dalvik_system_VMDebug_resetSafepointStats(const u4* args,
+    JValue* pResult)
+{
+    dvmResetSafepointStats();
+    RETURN_VOID();
+}
+
 /*
  * static void printLoadedClasses(int flags)
  *
@@ -758,6 +833,8 @@ const DalvikNativeMethod dvm_dalvik_system_VMDebug[] = {
         Dalvik_dalvik_system_VMDebug_stopAllocCounting },
     { "startMethodTracingNative",   "(Ljava/lang/String;Ljava/io/FileDescriptor;II)V",
         Dalvik_dalvik_system_VMDebug_startMethodTracingNative },
+    { "startMethodTracingNative",   "(Ljava/lang/String;Ljava/io/FileDescriptor;IIZI)V",
+        Dalvik_dalvik_system_VMDebug_startMethodTracingSampling },
     { "isMethodTracingActive",      "()Z",
         Dalvik_dalvik_system_VMDebug_isMethodTracingActive },
     { "stopMethodTracing",          "()V",
@@ -780,6 +857,10 @@ const DalvikNativeMethod dvm_dalvik_system_VMDebug[] = {
         Dalvik_dalvik_system_VMDebug_isDebuggingEnabled },
     { "lastDebuggerActivity",       "()J",
         Dalvik_dalvik_system_VMDebug_lastDebuggerActivity },
+    { "getSafepointHistogram",      "(I[I)V",
+        Dalvik_dalvik_system_VMDebug_getSafepointHistogram },
+    { "resetSafepointStats",        "()V",
+        Dalvik_dalvik_system_VMDebug_resetSafepointStats },
     { "printLoadedClasses",         "(I)V",
         Dalvik_dalvik_system_VMDebug_printLoadedClasses },
     { "getLoadedClassCount",        "()I",
@@ -382,6 +382,7 @@ static ClassObject* createArrayClass(const char* descriptor, Object* loader)
                       OFFSETOF_MEMBER(ClassObject, classLoader),
                       (Object *)elementClass->classLoader);
     newClass->arrayDim = arrayDim;
+    dvmSetClassDisplay(newClass);
     newClass->status = CLASS_INITIALIZED;
 
     /* don't need to set newClass->objectSize */
@@ -433,6 +434,11 @@ static ClassObject* createArrayClass(const char* descriptor, Object* loader)
     newClass->iftable[0].clazz = newClass->interfaces[0];
     newClass->iftable[1].clazz = newClass->interfaces[1];
     dvmLinearReadOnly(newClass->classLoader, newClass->iftable);
+    if (!dvmCreateInterfaceHash(newClass)) {
+        dvmFreeClassInnards(newClass);
+        dvmReleaseTrackedAlloc((Object*) newClass, NULL);
+        return NULL;
+    }
 
     /*
      * Inherit access flags from the element.  Arrays can't be used as a
@@ -188,6 +188,7 @@ static void computeRefOffsets(ClassObject* clazz);
 static void freeMethodInnards(Method* meth);
 static bool createVtable(ClassObject* clazz);
 static bool createIftable(ClassObject* clazz);
+static bool createImtable(ClassObject* clazz);
 static bool insertMethodStubs(ClassObject* clazz);
 static bool computeFieldOffsets(ClassObject* clazz);
 static void throwEarlierClassFailure(ClassObject* clazz);
@@ -350,6 +351,7 @@ static bool createPrimitiveType(PrimitiveType primitiveType, ClassObject** pClas
     newClass->descriptorAlloc = NULL;
     newClass->descriptor = descriptor;
     newClass->super = NULL;
+    newClass->display[0] = newClass;
     newClass->status = CLASS_INITIALIZED;
 
     /* don't need to set newClass->objectSize */
@@ -2082,6 +2084,9 @@ void dvmFreeClassInnards(ClassObject* clazz)
     clazz->ifviPoolCount = -1;
     NULL_AND_LINEAR_FREE(clazz->ifviPool);
 
+    NULL_AND_LINEAR_FREE(clazz->imtable);
+    NULL_AND_LINEAR_FREE(clazz->ifHash);
+
     clazz->sfieldCount = -1;
     /* The sfields are attached to the ClassObject, and will be freed
      * with it. */
@@ -2749,6 +2754,11 @@ bool dvmLinkClass(ClassObject* clazz)
         }
     }
 
+    /*
+     * The superclass is final now, so the display can be filled in.
+     */
+    dvmSetClassDisplay(clazz);
+
     /*
      * Populate vtable.
      */
@@ -2781,6 +2791,18 @@ bool dvmLinkClass(ClassObject* clazz)
     if (!createIftable(clazz))
         goto bail;
 
+    /*
+     * Hash the complete iftable for interface tests.
+     */
+    if (!dvmCreateInterfaceHash(clazz))
+        goto bail;
+
+    /*
+     * Hash the interface methods into the imtable.  Needs the final vtable.
+     */
+    if (!createImtable(clazz))
+        goto bail;
+
     /*
      * Insert special-purpose "stub" method implementations.
      */
@@ -3460,6 +3482,134 @@ bail:
 }
 
 
+/*
+ * Create the interface method table.
+ *
+ * Every method of every interface in "iftable" is hashed into one of
+ * IMT_SIZE slots along with the vtable entry it dispatches to.  When two
+ * interface methods land in the same slot, the slot is left empty and
+ * calls through either of them take the slow path (the interface cache and
+ * an iftable search).
+ *
+ * Interfaces and abstract classes never appear as the receiver class of an
+ * invoke-interface, so they don't get one.
+ */
+static bool createImtable(ClassObject* clazz)
+{
+    assert(clazz->imtable == NULL);
+
+    if (dvmIsInterfaceClass(clazz) || dvmIsAbstractClass(clazz))
+        return true;
+
+    int methodCount = 0;
+    for (int i = 0; i < clazz->iftableCount; i++)
+        methodCount += clazz->iftable[i].clazz->virtualMethodCount;
+    if (methodCount == 0)
+        return true;
+
+    ImtEntry* imtable = (ImtEntry*) dvmLinearAlloc(clazz->classLoader,
+                            sizeof(ImtEntry) * IMT_SIZE);
+    if (imtable == NULL)
+        return false;
+    memset(imtable, 0, sizeof(ImtEntry) * IMT_SIZE);
+
+    bool conflict[IMT_SIZE];
+    memset(conflict, 0, sizeof(conflict));
+    int conflictCount = 0;
+
+    for (int i = 0; i < clazz->iftableCount; i++) {
+        const InterfaceEntry* ent = &clazz->iftable[i];
+        Method* absMethod = ent->clazz->virtualMethods;
+
+        for (int j = 0; j < ent->clazz->virtualMethodCount; j++, absMethod++) {
+            u4 slot = dvmImtIndex(absMethod);
+            if (conflict[slot])
+                continue;
+
+            if (imtable[slot].absMethod != NULL) {
+                imtable[slot].absMethod = imtable[slot].method = NULL;
+                conflict[slot] = true;
+                conflictCount++;
+                continue;
+            }
+
+            int vtableIndex = ent->methodIndexArray[j];
+            assert(vtableIndex >= 0 && vtableIndex < clazz->vtableCount);
+            imtable[slot].absMethod = absMethod;
+            imtable[slot].method = clazz->vtable[vtableIndex];
+        }
+    }
+
+    LOGVV("IMT: %s has %d interface methods, %d slots in conflict",
+        clazz->descriptor, methodCount, conflictCount);
+
+    dvmLinearReadOnly(clazz->classLoader, imtable);
+    clazz->imtable = imtable;
+    return true;
+}
+
+/*
+ * Fill in the superclass display: the display of the superclass, up to its
+ * own depth, followed by this class.  Classes deeper than the display only
+ * record their depth; the display ends with their ancestor at depth
+ * CLASS_DISPLAY_SIZE-1.
+ */
+void dvmSetClassDisplay(ClassObject* clazz)
+{
+    ClassObject* super = clazz->super;
+    int depth = 0;
+
+    if (super != NULL) {
+        depth = super->classDepth + 1;
+        int count = (depth < CLASS_DISPLAY_SIZE) ? depth : CLASS_DISPLAY_SIZE;
+        memcpy(clazz->display, super->display, count * sizeof(ClassObject*));
+    }
+    clazz->classDepth = depth;
+    if (depth < CLASS_DISPLAY_SIZE)
+        clazz->display[depth] = clazz;
+}
+
+/*
+ * Create the interface hash.
+ *
+ * Every interface in "iftable" goes into a power-of-two table at least
+ * twice its size, with linear probing from dvmIfHashIndex().  A probe that
+ * reaches an empty slot means the interface isn't implemented.
+ */
+bool dvmCreateInterfaceHash(ClassObject* clazz)
+{
+    assert(clazz->ifHash == NULL);
+
+    if (clazz->iftableCount == 0)
+        return true;
+
+    u4 size = 4;
+    while (size < (u4) clazz->iftableCount * 2)
+        size <<= 1;
+
+    ClassObject** ifHash = (ClassObject**) dvmLinearAlloc(clazz->classLoader,
+                                sizeof(ClassObject*) * size);
+    if (ifHash == NULL)
+        return false;
+    memset(ifHash, 0, sizeof(ClassObject*) * size);
+
+    u4 mask = size - 1;
+    for (int i = 0; i < clazz->iftableCount; i++) {
+        ClassObject* interface = clazz->iftable[i].clazz;
+        u4 slot = dvmIfHashIndex(interface, mask);
+        while (ifHash[slot] != NULL) {
+            assert(ifHash[slot] != interface);
+            slot = (slot + 1) & mask;
+        }
+        ifHash[slot] = interface;
+    }
+
+    dvmLinearReadOnly(clazz->classLoader, ifHash);
+    clazz->ifHashMask = mask;
+    clazz->ifHash = ifHash;
+    return true;
+}
+
 /*
  * Provide "stub" implementations for methods without them.
  *
@@ -4506,6 +4656,12 @@ noverify:
             gDvm.allocProf.classInitCount++;
             self->allocProf.classInitCount++;
         }
+
+#if defined(WITH_JIT)
+        /* Queue any traces saved by a previous run */
+        if (gDvmJit.warmStartPending != NULL)
+            dvmCompilerWarmStartClassReady(clazz);
+#endif
     }
 
 bail_notify:
@@ -117,6 +117,18 @@ ClassObject* dvmDefineClass(DvmDex* pDvmDex, const char* descriptor,
  */
 bool dvmLinkClass(ClassObject* clazz);
 
+/*
+ * Fill in the superclass display from "super", which must already have
+ * its own.  Done by dvmLinkClass, and directly for array classes.
+ */
+void dvmSetClassDisplay(ClassObject* clazz);
+
+/*
+ * Hash the interfaces in "iftable" into "ifHash".  Done by dvmLinkClass,
+ * and directly for array classes.
+ */
+bool dvmCreateInterfaceHash(ClassObject* clazz);
+
 /*
  * Determine if a class has been initialized.
  */
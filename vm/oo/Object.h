@@ -191,6 +191,35 @@ struct InterfaceEntry {
     int*            methodIndexArray;
 };
 
+/*
+ * Number of entries in a class's interface method table (imtable).  Must
+ * be a power of two.
+ */
+#define IMT_SIZE            16
+
+/*
+ * Number of classes remembered in a class's instanceofHits.
+ */
+#define INSTANCEOF_HITS     2
+
+/*
+ * Number of levels of the class hierarchy kept in a class's display.
+ * Subclass tests against classes deeper than this walk the superclass
+ * chain instead.
+ */
+#define CLASS_DISPLAY_SIZE  8
+
+/*
+ * Used for imtable in ClassObject.  "absMethod" is the interface method and
+ * "method" the concrete method it dispatches to in this class.  Both are
+ * NULL if the slot is unused or if more than one interface method hashes
+ * to it.
+ */
+struct ImtEntry {
+    Method*         absMethod;
+    Method*         method;
+};
+
 
 
 /*
@@ -448,6 +477,43 @@ struct ClassObject : Object {
     int             ifviPoolCount;
     int*            ifviPool;
 
+    /*
+     * Interface method table (imtable), IMT_SIZE entries hashed on the
+     * interface method, so that most invoke-interface calls are resolved
+     * with one probe instead of a search through iftable.  Only concrete
+     * classes that implement at least one interface method have one;
+     * otherwise this is NULL.
+     */
+    ImtEntry*       imtable;
+
+    /*
+     * The first classes found to be instances of this one by
+     * dvmInstanceofNonTrivial.  Each slot is written once, when empty.
+     * Checked before the process-wide instanceof cache, where unrelated
+     * casts collide.
+     */
+    const ClassObject* instanceofHits[INSTANCEOF_HITS];
+
+    /*
+     * Superclass display.  "classDepth" is the number of superclasses
+     * above this one (0 for java.lang.Object and the primitive classes),
+     * and display[d] is the ancestor at depth d, ending with this class at
+     * display[classDepth].  Slots past classDepth are NULL, so "sub" is a
+     * subclass of a class C no deeper than CLASS_DISPLAY_SIZE-1 exactly when
+     * sub->display[C->classDepth] == C.
+     */
+    int             classDepth;
+    ClassObject*    display[CLASS_DISPLAY_SIZE];
+
+    /*
+     * The interfaces in iftable, hashed on the class pointer into
+     * ifHashMask+1 slots (a power of two, at most half full) so that
+     * interface tests take one probe in the common case.  NULL if the
+     * class implements no interfaces.
+     */
+    ClassObject**   ifHash;
+    u4              ifHashMask;
+
     /* instance fields
      *
      * These describe the layout of the contents of a DataObject-compatible
@@ -667,6 +733,23 @@ INLINE int dvmFindFieldOffset(const ClassObject* clazz,
         return pField->byteOffset;
 }
 
+/*
+ * Slot for interface method "absMethod" in an imtable.  The methods of an
+ * interface are stored in one array, so dividing by the struct size puts
+ * them in consecutive slots.
+ */
+INLINE u4 dvmImtIndex(const Method* absMethod) {
+    return ((uintptr_t) absMethod / sizeof(Method)) & (IMT_SIZE - 1);
+}
+
+/*
+ * First slot probed for "interface" in a class's ifHash.  Class objects
+ * are at least 8-byte aligned, so the low bits carry no information.
+ */
+INLINE u4 dvmIfHashIndex(const ClassObject* interface, u4 mask) {
+    return ((uintptr_t) interface >> 3) & mask;
+}
+
 /*
  * Helpers.
  */
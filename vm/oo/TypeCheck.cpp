@@ -169,16 +169,27 @@ static int isArrayInstanceOf(const ClassObject* sub, const ClassObject* clazz)
  */
 int dvmImplements(const ClassObject* clazz, const ClassObject* interface)
 {
-    int i;
-
     assert(dvmIsInterfaceClass(interface));
 
     /*
      * All interfaces implemented directly and by our superclass, and
      * recursively all super-interfaces of those interfaces, are listed
-     * in "iftable", so we can just do a linear scan through that.
+     * in "iftable", and hashed into "ifHash" when the class is linked.
      */
-    for (i = 0; i < clazz->iftableCount; i++) {
+    const ClassObject* const* ifHash = clazz->ifHash;
+    if (ifHash != NULL) {
+        u4 mask = clazz->ifHashMask;
+        u4 slot = dvmIfHashIndex(interface, mask);
+        while (ifHash[slot] != NULL) {
+            if (ifHash[slot] == interface)
+                return 1;
+            slot = (slot + 1) & mask;
+        }
+        return 0;
+    }
+
+    /* not linked yet; do a linear scan through iftable */
+    for (int i = 0; i < clazz->iftableCount; i++) {
         if (clazz->iftable[i].clazz == interface)
             return 1;
     }
@@ -237,12 +248,48 @@ static inline int isInstanceof(const ClassObject* instance,
 /*
  * Do the instanceof calculation, pulling the result from the cache if
  * possible.
+ *
+ * Casts to a shallow class are answered from the instance's display.
+ * Otherwise, casts usually see the same one or two instance classes, so
+ * the first ones found are remembered in the class itself and checked
+ * first.  A slot is written once, when it's empty; after that the class
+ * is only read, so threads casting to it don't keep pulling its line
+ * away from each other.  Racing threads may both fill the same slot,
+ * but every entry they can leave behind is an instance class of "clazz".
  */
 int dvmInstanceofNonTrivial(const ClassObject* instance,
     const ClassObject* clazz)
 {
+    /*
+     * Below the display depth, a class (other than an array class) is a
+     * superclass of "instance" exactly when it's in the display.  This
+     * covers array instances too, whose only superclass is Object.
+     */
+    if (clazz->classDepth < CLASS_DISPLAY_SIZE &&
+        !dvmIsInterfaceClass(clazz) && !dvmIsArrayClass(clazz))
+    {
+        return instance->display[clazz->classDepth] == clazz;
+    }
+
+    for (int i = 0; i < INSTANCEOF_HITS; i++) {
+        if (clazz->instanceofHits[i] == instance)
+            return 1;
+    }
+
+    int result;
 #define ATOMIC_CACHE_CALC isInstanceof(instance, clazz)
-    return ATOMIC_CACHE_LOOKUP(gDvm.instanceofCache,
+    result = ATOMIC_CACHE_LOOKUP(gDvm.instanceofCache,
                 INSTANCEOF_CACHE_SIZE, instance, clazz);
 #undef ATOMIC_CACHE_CALC
+
+    if (result) {
+        ClassObject* hitClass = (ClassObject*) clazz;
+        for (int i = 0; i < INSTANCEOF_HITS; i++) {
+            if (hitClass->instanceofHits[i] == NULL) {
+                hitClass->instanceofHits[i] = instance;
+                break;
+            }
+        }
+    }
+    return result;
 }
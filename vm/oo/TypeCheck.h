@@ -50,20 +50,35 @@ INLINE int dvmInstanceof(const ClassObject* instance, const ClassObject* clazz)
  */
 int dvmImplements(const ClassObject* clazz, const ClassObject* interface);
 
+/*
+ * Get the ancestor of "clazz" at depth "depth", which must be no deeper
+ * than "clazz" itself.
+ */
+INLINE ClassObject* dvmGetClassAtDepth(const ClassObject* clazz, int depth) {
+    assert(depth >= 0 && depth <= clazz->classDepth);
+    if (depth < CLASS_DISPLAY_SIZE)
+        return clazz->display[depth];
+
+    for (int d = clazz->classDepth; d > depth; d--)
+        clazz = clazz->super;
+    return (ClassObject*) clazz;
+}
+
 /*
  * Determine whether "sub" is a sub-class of "clazz".
  *
  * Returns 0 (false) if not, 1 (true) if so.
  */
 INLINE int dvmIsSubClass(const ClassObject* sub, const ClassObject* clazz) {
-    do {
-        /*printf("###### sub='%s' clazz='%s'\n", sub->name, clazz->name);*/
-        if (sub == clazz)
-            return 1;
-        sub = sub->super;
-    } while (sub != NULL);
+    int depth = clazz->classDepth;
+
+    /* display slots past sub's own depth are NULL */
+    if (depth < CLASS_DISPLAY_SIZE)
+        return sub->display[depth] == clazz;
 
-    return 0;
+    if (sub->classDepth < depth)
+        return 0;
+    return dvmGetClassAtDepth(sub, depth) == clazz;
 }
 
 /*